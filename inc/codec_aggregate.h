@@ -0,0 +1,53 @@
+#ifndef _MAVTUNNEL_CODEC_AGGREGATE_H_
+#define _MAVTUNNEL_CODEC_AGGREGATE_H_
+
+#include "os.h"
+#include "tunnel.h"
+
+/**
+ * Frame aggregation. The encoder keeps the frames it receives and packs them
+ * into one super-frame, which is sent when the oldest frame is deadline_us
+ * old or when the next frame would not fit in budget payload bytes. The
+ * super-frame is a V2_EXTENSION frame marked with MAVTUNNEL_CFLAG_AGGREGATE,
+ * so it is encrypted once and pays one header, CRC and datagram. The decoder
+ * splits it back into the original frames.
+ *
+ * Super-frame payload: one packed frame after another, see
+ * MAVTUNNEL_FRAME_HEADER_LEN.
+ */
+#define CODEC_AGGREGATE_MSGID               MAVLINK_MSG_ID_V2_EXTENSION
+#define CODEC_AGGREGATE_SUBHEADER_LEN       MAVTUNNEL_FRAME_HEADER_LEN
+#define CODEC_AGGREGATE_DEADLINE_DEFAULT_US 2000
+
+struct codec_aggregate_t
+{
+    struct mavtunnel_codec_t stage;
+    uint64_t                 deadline_us;
+    size_t                   budget;
+    mavlink_message_t        carrier, msg;
+    size_t                   count;
+    uint64_t                 first_us;
+    uint8_t                  seq;
+    uint64_t                 frames, superframes;
+};
+
+#if __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @param deadline_us  longest time a frame waits for company; 0 packs only
+ *                     the frames that arrive in the same read
+ * @param budget       super-frame payload size, 0 for MAVLINK_MAX_PAYLOAD_LEN
+ */
+void codec_aggregate_attach(struct mavtunnel_t* ctx,
+    struct codec_aggregate_t* agg, enum mavtunnel_codec_dir_t dir,
+    uint64_t deadline_us, size_t budget);
+
+enum mavtunnel_error_t codec_aggregate_flush(struct codec_aggregate_t* agg);
+
+#if __cplusplus
+};
+#endif
+
+#endif /* !_MAVTUNNEL_CODEC_AGGREGATE_H_ */
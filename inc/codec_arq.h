@@ -0,0 +1,104 @@
+#ifndef _MAVTUNNEL_CODEC_ARQ_H_
+#define _MAVTUNNEL_CODEC_ARQ_H_
+
+#include "os.h"
+#include "tunnel.h"
+
+/**
+ * Selective ARQ for a set of critical messages, e.g. commands, mission
+ * items and parameter writes, hop by hop between two tunnel ends. The rest
+ * of the traffic stays best effort.
+ *
+ * One codec_arq_t serves both tunnels of an end: an encode stage on the
+ * tunnel towards the peer (out) and a decode stage on the tunnel from it
+ * (in). Attach it first on both, so that retransmissions go through the
+ * other stages again.
+ *
+ * A reliable frame carries MAVTUNNEL_CFLAG_ARQ and a [session: 2 bytes]
+ * [base][seq] trailer, where base is the oldest seq the sender still holds.
+ * The receiver drops duplicates and acknowledges with a [session]
+ * [next expected seq][bitmap of the 32 seqs after it] trailer and
+ * MAVTUNNEL_CFLAG_ACK on the next frame out, or on an empty V2_EXTENSION
+ * frame after ack_delay_us.
+ *
+ * The session is drawn from the clock at attach, so a sender that restarts
+ * at seq 0 is not taken for a replay of the frames before: the receiver
+ * starts over at base when the session changes, and the sender ignores the
+ * ACKs of another session. A receiver that restarts starts at base too.
+ *
+ * The sender keeps up to CODEC_ARQ_WINDOW frames and resends one after its
+ * RTO (RFC 6298 from the measured RTT, doubled per retry), or after one
+ * smoothed RTT when a later frame is acknowledged. It gives up after
+ * CODEC_ARQ_MAX_RETRIES.
+ *
+ * The out tunnel only notices an ACK to send when it wakes up, so while the
+ * peer sends reliable frames its read timeout is held to ack_delay_us.
+ */
+#define CODEC_ARQ_MSGID          MAVLINK_MSG_ID_V2_EXTENSION
+#define CODEC_ARQ_WINDOW         32
+#define CODEC_ARQ_MAX_MSGIDS     16
+#define CODEC_ARQ_MAX_RETRIES    5
+#define CODEC_ARQ_SEQ_LEN        4
+#define CODEC_ARQ_ACK_LEN        7
+#define CODEC_ARQ_ACK_DELAY_US   5000
+#define CODEC_ARQ_RTO_INIT_US    200000
+#define CODEC_ARQ_RTO_MIN_US     10000
+#define CODEC_ARQ_RTO_MAX_US     2000000
+#define CODEC_ARQ_LINGER_US      1000000
+
+#define CODEC_ARQ_DEFAULT_MSGIDS                                               \
+    MAVLINK_MSG_ID_COMMAND_LONG, MAVLINK_MSG_ID_COMMAND_INT,                   \
+        MAVLINK_MSG_ID_MISSION_ITEM_INT, MAVLINK_MSG_ID_PARAM_SET
+
+struct codec_arq_slot_t
+{
+    bool              in_use;
+    uint8_t           seq;
+    uint8_t           retries;
+    uint64_t          sent_us, due_us;
+    mavlink_message_t msg;
+};
+
+struct codec_arq_t
+{
+    struct mavtunnel_codec_t tx, rx;
+    /* the two stages run in the threads of their tunnels */
+    os_lock_t                lock;
+    uint32_t                 msgids[CODEC_ARQ_MAX_MSGIDS];
+    size_t                   n_msgids;
+
+    /* sender, in flight to the peer */
+    struct codec_arq_slot_t  window[CODEC_ARQ_WINDOW];
+    uint16_t                 session;
+    uint8_t                  next_seq, ack_seq;
+    uint64_t                 srtt_us, rttvar_us, rto_us;
+
+    /* receiver, what the peer sent us */
+    bool                     rx_synced;
+    uint16_t                 rx_session;
+    uint8_t                  rx_next;
+    uint32_t                 rx_bitmap;
+    bool                     ack_pending;
+    uint64_t                 ack_due_us, last_rx_us, ack_delay_us;
+
+    mavlink_message_t        msg;
+    uint64_t                 frames, retransmits, acked, expired, overflow;
+    uint64_t                 delivered, duplicates, acks;
+};
+
+#if __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @param msgids    messages to deliver reliably, NULL for
+ *                  CODEC_ARQ_DEFAULT_MSGIDS
+ */
+void codec_arq_attach(struct mavtunnel_t* out, struct mavtunnel_t* in,
+    struct codec_arq_t* arq, const uint32_t* msgids, size_t n_msgids);
+
+#if __cplusplus
+};
+#endif
+
+#endif /* !_MAVTUNNEL_CODEC_ARQ_H_ */
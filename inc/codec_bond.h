@@ -0,0 +1,102 @@
+#ifndef _MAVTUNNEL_CODEC_BOND_H_
+#define _MAVTUNNEL_CODEC_BOND_H_
+
+#include "os.h"
+#include "tunnel.h"
+
+/**
+ * Multi-path bonding, e.g. a telemetry radio and an LTE link. The out
+ * tunnel writes critical frames on every path and the rest on the first
+ * live path that takes them. A path is live while it has received from the
+ * peer in the last CODEC_BOND_LIVE_US, or until any path has, as a write
+ * that succeeds says little on a datagram link. When no live path takes a
+ * frame, it goes out on all the others. A bonded frame carries
+ * MAVTUNNEL_CFLAG_BOND and a [session: 2 bytes LE][seq: 2 bytes LE]
+ * trailer. The session is drawn from the clock at attach: a receiver that
+ * sees a new one starts its window over rather than take a restarted
+ * sender's frames for old ones, and drops what still comes of the session
+ * before.
+ *
+ * On the other end every path has its own tunnel, which parses and decrypts
+ * what its link receives. The first copy of a bonded frame wins and goes on
+ * through the decode stages of the merged tunnel, with mavtunnel_inject(),
+ * so that these see a single stream; later copies only count towards the
+ * statistics of their path.
+ *
+ * Attach the bond last on the out tunnel, so that it sees the frames the
+ * other stages emit; msgids selects the critical ones, all frames if none.
+ */
+#define CODEC_BOND_MAX_PATHS   4
+#define CODEC_BOND_MAX_MSGIDS  16
+#define CODEC_BOND_WINDOW      256
+#define CODEC_BOND_TRAILER_LEN 4
+#define CODEC_BOND_LIVE_US     3000000
+
+struct codec_bond_t;
+
+struct codec_bond_path_t
+{
+    struct mavtunnel_codec_t  stage;
+    struct codec_bond_t*      bond;
+    struct mavtunnel_writer_t writer;
+
+    uint64_t tx_frames, tx_bytes, tx_errors;
+    /* copies that came first, copies that came later and how much later */
+    uint64_t rx_frames, wins, duplicates;
+    uint64_t lag_us_total, lag_us_max;
+    atomic_uint_least64_t last_rx_us;
+};
+
+struct codec_bond_slot_t
+{
+    bool     valid;
+    uint16_t seq;
+    uint64_t first_us;
+};
+
+struct codec_bond_t
+{
+    struct mavtunnel_codec_t tx;
+    struct mavtunnel_t*      merged;
+    os_lock_t                lock;
+    uint32_t                 msgids[CODEC_BOND_MAX_MSGIDS];
+    size_t                   n_msgids;
+    struct codec_bond_path_t paths[CODEC_BOND_MAX_PATHS];
+    size_t                   n_paths;
+    uint16_t                 session, next_seq;
+
+    /* the peer's session, and the one it restarted from */
+    bool                     rx_synced, rx_restarted;
+    uint16_t                 rx_session, rx_old_session;
+    struct codec_bond_slot_t window[CODEC_BOND_WINDOW];
+
+    uint64_t bonded, late, restarts;
+};
+
+#if __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @param out     tunnel towards the peer; its writer is replaced by the paths
+ * @param merged  tunnel whose decode stages and writer the paths feed; it is
+ *                not spun itself
+ * @param msgids  frames to send on every path, NULL for all
+ */
+void codec_bond_attach(struct mavtunnel_t* out, struct mavtunnel_t* merged,
+    struct codec_bond_t* bond, const uint32_t* msgids, size_t n_msgids);
+
+/**
+ * @param in  the path's receiving tunnel, with the link endpoint attached as
+ *            its reader and writer; the writer becomes the path's way out
+ * @return the path index
+ */
+size_t codec_bond_add_path(struct codec_bond_t* bond, struct mavtunnel_t* in);
+
+void codec_bond_print_stats(const struct codec_bond_t* bond);
+
+#if __cplusplus
+};
+#endif
+
+#endif /* !_MAVTUNNEL_CODEC_BOND_H_ */
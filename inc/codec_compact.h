@@ -0,0 +1,65 @@
+#ifndef _MAVTUNNEL_CODEC_COMPACT_H_
+#define _MAVTUNNEL_CODEC_COMPACT_H_
+
+#include "os.h"
+#include "tunnel.h"
+
+/**
+ * Compact sub-frame headers for aggregated super-frames. Attached after
+ * codec_aggregate on both ends, it rewrites the 8-byte sub-headers of every
+ * super-frame into
+ *   [ctx: DEFINE | SEQ | CFLAGS | context id][sysid][compid][msgid: 3 bytes]
+ *   [seq][compat flags][len][payload]
+ * where the fields in brackets after ctx are only present when the
+ * matching bit is set:
+ *   DEFINE  binds the context id to (sysid, compid, msgid); it is repeated
+ *           every CODEC_COMPACT_REFRESH uses
+ *   SEQ     the seq is not the previous sub-frame's seq + 1
+ *   CFLAGS  the frame carries tunnel compat flags
+ * A repeated frame from an in-order stream costs 2 bytes of header.
+ * Once bound, a context id keeps its stream for as long as the encoder is
+ * attached: a stream whose id is taken by another is defined in every
+ * frame under CODEC_COMPACT_INLINE, which binds nothing. A lost
+ * super-frame therefore only delays the streams it would have bound, whose
+ * frames the decoder drops until their next definition, and never changes
+ * a context the decoder holds. Super-frames that do not get shorter are
+ * left alone.
+ */
+#define CODEC_COMPACT_CONTEXTS 32
+#define CODEC_COMPACT_REFRESH  32
+#define CODEC_COMPACT_INLINE   (CODEC_COMPACT_CONTEXTS - 1)
+
+#define CODEC_COMPACT_DEFINE   0x80
+#define CODEC_COMPACT_SEQ      0x40
+#define CODEC_COMPACT_CFLAGS   0x20
+#define CODEC_COMPACT_ID_MASK  (CODEC_COMPACT_CONTEXTS - 1)
+
+struct codec_compact_context_t
+{
+    bool     valid;
+    uint8_t  sysid, compid;
+    uint32_t msgid;
+    uint16_t uses;
+};
+
+struct codec_compact_t
+{
+    struct mavtunnel_codec_t       stage;
+    struct codec_compact_context_t contexts[CODEC_COMPACT_CONTEXTS];
+    uint8_t                        buffer[MAVLINK_MAX_PAYLOAD_LEN];
+    uint64_t                       frames, defines, dropped;
+    uint64_t                       bytes_in, bytes_out;
+};
+
+#if __cplusplus
+extern "C" {
+#endif
+
+void codec_compact_attach(struct mavtunnel_t* ctx, struct codec_compact_t* compact,
+    enum mavtunnel_codec_dir_t dir);
+
+#if __cplusplus
+};
+#endif
+
+#endif /* !_MAVTUNNEL_CODEC_COMPACT_H_ */
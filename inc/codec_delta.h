@@ -0,0 +1,70 @@
+#ifndef _MAVTUNNEL_CODEC_DELTA_H_
+#define _MAVTUNNEL_CODEC_DELTA_H_
+
+#include "os.h"
+#include "tunnel.h"
+
+/**
+ * Delta encoding of periodic telemetry. Both tunnels cache the last payload
+ * of every (sysid, compid, msgid) stream; a frame is sent as an XOR delta
+ * against it, marked with MAVTUNNEL_CFLAG_DELTA. Every keyframe_interval
+ * frames, or when the delta does not pay off, the raw payload is sent as a
+ * keyframe. A delta whose base frame was lost, or that does not rebuild the
+ * payload it was taken from, is dropped by the decoder, and the stream
+ * resynchronizes on its next keyframe.
+ */
+#define CODEC_DELTA_STREAMS          32
+#define CODEC_DELTA_STATS            64
+#define CODEC_DELTA_KEYFRAME_DEFAULT 50
+/* with profiling, one frame in this many per msgid is timed */
+#define CODEC_DELTA_TIME_SAMPLE      16
+
+struct codec_delta_stream_t
+{
+    bool     valid;
+    uint8_t  sysid, compid;
+    uint32_t msgid;
+    uint8_t  seq;
+    uint8_t  len;
+    uint16_t since_keyframe;
+    uint8_t  payload[MAVLINK_MAX_PAYLOAD_LEN];
+};
+
+/* bytes_in counts raw payload bytes, bytes_out the bytes sent on the wire */
+struct codec_delta_stat_t
+{
+    bool     used;
+    uint32_t msgid;
+    uint64_t frames, keyframes, dropped;
+    uint64_t bytes_in, bytes_out;
+#ifdef MAVTUNNEL_PROFILING
+    uint64_t timed, exec_time_ns;
+#endif
+};
+
+struct codec_delta_t
+{
+    struct mavtunnel_codec_t    stage;
+    uint16_t                    keyframe_interval;
+    struct codec_delta_stream_t streams[CODEC_DELTA_STREAMS];
+    struct codec_delta_stat_t   stats[CODEC_DELTA_STATS];
+    uint8_t                     buffer[MAVLINK_MAX_PAYLOAD_LEN];
+};
+
+#if __cplusplus
+extern "C" {
+#endif
+
+void codec_delta_attach(struct mavtunnel_t* ctx, struct codec_delta_t* delta,
+    enum mavtunnel_codec_dir_t dir, uint16_t keyframe_interval);
+
+struct codec_delta_stat_t* codec_delta_stat(
+    struct codec_delta_t* delta, uint32_t msgid);
+
+void codec_delta_report(struct codec_delta_t* delta);
+
+#if __cplusplus
+};
+#endif
+
+#endif /* !_MAVTUNNEL_CODEC_DELTA_H_ */
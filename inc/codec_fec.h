@@ -0,0 +1,65 @@
+#ifndef _MAVTUNNEL_CODEC_FEC_H_
+#define _MAVTUNNEL_CODEC_FEC_H_
+
+#include "os.h"
+#include "tunnel.h"
+
+/**
+ * Forward error correction. The encoder groups k frames and sends n - k
+ * Reed-Solomon parity frames after them, so that the decoder can rebuild up
+ * to n - k lost frames of a group without a round trip. A group that is not
+ * full after deadline_us is closed early and protects fewer frames.
+ *
+ * The code is systematic over GF(2^8): data frames are sent as they are,
+ * with a [group][index] trailer and MAVTUNNEL_CFLAG_FEC. A symbol is a frame
+ * packed as in MAVTUNNEL_FRAME_HEADER_LEN, zero padded to the longest one in
+ * its group. Parity frames are V2_EXTENSION frames with MAVTUNNEL_CFLAG_FEC:
+ *   [parity symbol][data frames in the group][group][k + parity index]
+ * The parity rows are a Cauchy matrix scaled so that the first one is all
+ * ones, so that n = k + 1 is a plain XOR.
+ *
+ * Frames whose symbol would not fit in a parity frame pass unprotected.
+ */
+#define CODEC_FEC_MSGID       MAVLINK_MSG_ID_V2_EXTENSION
+#define CODEC_FEC_MAX_K       16
+#define CODEC_FEC_MAX_M       8
+#define CODEC_FEC_TRAILER_LEN 2
+#define CODEC_FEC_MAX_SYMBOL  (MAVLINK_MAX_PAYLOAD_LEN - CODEC_FEC_TRAILER_LEN - 1)
+#define CODEC_FEC_DEADLINE_DEFAULT_US 20000
+
+struct codec_fec_t
+{
+    struct mavtunnel_codec_t stage;
+    size_t                   k, m;
+    uint64_t                 deadline_us;
+    uint8_t                  coef[CODEC_FEC_MAX_M][CODEC_FEC_MAX_K];
+    uint8_t                  data[CODEC_FEC_MAX_K][CODEC_FEC_MAX_SYMBOL];
+    uint8_t                  parity[CODEC_FEC_MAX_M][CODEC_FEC_MAX_SYMBOL];
+    bool                     have[CODEC_FEC_MAX_K], have_parity[CODEC_FEC_MAX_M];
+    size_t                   count, symbol_len;
+    uint8_t                  group, seq;
+    bool                     active, done;
+    uint64_t                 first_us;
+    mavlink_message_t        msg;
+    uint64_t                 frames, parities, recovered, lost;
+};
+
+#if __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @param k            data frames per group, at most CODEC_FEC_MAX_K
+ * @param n            frames per group on the wire, k + at most CODEC_FEC_MAX_M
+ * @param deadline_us  longest time the encoder holds a partial group open
+ */
+void codec_fec_attach(struct mavtunnel_t* ctx, struct codec_fec_t* fec,
+    enum mavtunnel_codec_dir_t dir, size_t k, size_t n, uint64_t deadline_us);
+
+enum mavtunnel_error_t codec_fec_flush(struct codec_fec_t* fec);
+
+#if __cplusplus
+};
+#endif
+
+#endif /* !_MAVTUNNEL_CODEC_FEC_H_ */
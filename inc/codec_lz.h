@@ -0,0 +1,46 @@
+#ifndef _MAVTUNNEL_CODEC_LZ_H_
+#define _MAVTUNNEL_CODEC_LZ_H_
+
+#include "os.h"
+#include "tunnel.h"
+
+/**
+ * LZ payload compression. The static dictionary is prepended to the window of
+ * every payload so that short STATUSTEXT and PARAM_VALUE payloads still find
+ * matches. Compressed frames carry MAVTUNNEL_CFLAG_COMPRESSED; a payload that
+ * does not shrink is sent raw.
+ */
+#define CODEC_LZ_HASH_BITS  10
+#define CODEC_LZ_HASH_SIZE  (1 << CODEC_LZ_HASH_BITS)
+#define CODEC_LZ_DICT_SIZE  768
+#define CODEC_LZ_MIN_INPUT  8
+
+struct codec_lz_t
+{
+    struct mavtunnel_codec_t stage;
+    uint16_t                 dict_table[CODEC_LZ_HASH_SIZE];
+    uint16_t                 table[CODEC_LZ_HASH_SIZE];
+    uint8_t                  window[CODEC_LZ_DICT_SIZE + MAVLINK_MAX_PAYLOAD_LEN];
+    uint8_t                  buffer[MAVLINK_MAX_PAYLOAD_LEN];
+    size_t                   dict_len;
+    uint64_t                 frames, compressed, bytes_in, bytes_out;
+};
+
+#if __cplusplus
+extern "C" {
+#endif
+
+void codec_lz_attach(struct mavtunnel_t* ctx, struct codec_lz_t* lz,
+    enum mavtunnel_codec_dir_t dir);
+
+size_t codec_lz_compress(struct codec_lz_t* lz, const uint8_t* src, size_t len,
+    uint8_t* dst, size_t cap);
+
+ssize_t codec_lz_decompress(struct codec_lz_t* lz, const uint8_t* src,
+    size_t len, uint8_t* dst, size_t cap);
+
+#if __cplusplus
+};
+#endif
+
+#endif /* !_MAVTUNNEL_CODEC_LZ_H_ */
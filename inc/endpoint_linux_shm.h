@@ -0,0 +1,131 @@
+#ifndef _MAVTUNNEL_ENDPOINT_LINUX_SHM_H_
+#define _MAVTUNNEL_ENDPOINT_LINUX_SHM_H_
+
+#include "os.h"
+#include "tunnel.h"
+
+/**
+ * Shared-memory endpoint for co-located processes that take every frame,
+ * such as an onboard logger. The tunnel and its clients map the same
+ * memfd, which holds two rings of frame slots:
+ *
+ * - down: frames the tunnel writes, read by one client in place, without
+ *   a copy or a syscall while it keeps up;
+ * - up: frames any number of clients send, read by the tunnel.
+ *
+ * The rings are bounded MPSC queues with a sequence number per slot. A
+ * full ring drops the frame rather than blocking its producer. A consumer
+ * that finds its ring empty announces that it sleeps and waits on a futex
+ * in the shared memory, so a producer makes a FUTEX_WAKE only for a ring
+ * that went from empty to non-empty under a sleeping consumer.
+ *
+ * Clients get the memfd through fork, SCM_RIGHTS or /proc/<pid>/fd/<fd>
+ * and open it with mavtunnel_shm_client_open().
+ *
+ * Clients can write all of the memory, so the tunnel keeps the ring size
+ * to itself and clamps the length of every frame it reads; a misbehaving
+ * client can garble frames, not make the tunnel reach outside the mapping.
+ * It can stall the up ring, though: a client that dies after it claimed a
+ * slot and before it published the frame leaves the tunnel waiting on
+ * that slot, and once the ring comes round to it every client's frames
+ * are dropped as if it were full, until the endpoint is opened anew.
+ */
+#define EP_SHM_MAGIC      0x4d54534d /* "MSTM" */
+#define EP_SHM_FRAME_SIZE 296
+#define EP_SHM_SLOTS      256
+
+struct ep_shm_slot_t
+{
+    atomic_uint_least64_t seq;
+    uint32_t              len;
+    uint8_t               data[EP_SHM_FRAME_SIZE];
+};
+
+struct ep_shm_ring_t
+{
+    /* producers and the consumer each on their own cache line */
+    atomic_uint_least64_t enqueue_pos __attribute__((aligned(64)));
+    atomic_uint_least64_t dequeue_pos __attribute__((aligned(64)));
+    atomic_uint_least32_t sleeping;
+    atomic_uint_least64_t dropped __attribute__((aligned(64)));
+};
+
+struct ep_shm_area_t
+{
+    uint32_t             magic;
+    uint32_t             n_slots;
+    struct ep_shm_ring_t down, up;
+    /* n_slots down, then n_slots up */
+    struct ep_shm_slot_t slots[];
+};
+
+struct endpoint_linux_shm_t
+{
+    int                   fd;
+    size_t                size, n_slots;
+    struct ep_shm_area_t* area;
+    atomic_bool           terminated;
+
+    uint64_t rx_frames, tx_frames, tx_dropped, wakeups;
+};
+
+struct mavtunnel_shm_client_t
+{
+    size_t                size, n_slots;
+    struct ep_shm_area_t* area;
+    /* the slot handed out by mavtunnel_shm_client_peek() */
+    struct ep_shm_slot_t* peeked;
+
+    uint64_t tx_dropped, wakeups;
+};
+
+#if __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * @param name     shows up in /proc/<pid>/fd
+ * @param n_slots  per ring, a power of two
+ */
+enum mavtunnel_error_t ep_linux_shm_init(
+    struct endpoint_linux_shm_t* ep, const char* name, size_t n_slots);
+
+void ep_linux_shm_destroy(struct endpoint_linux_shm_t* ep);
+
+void ep_linux_shm_interrupt(struct endpoint_linux_shm_t* ep);
+
+void ep_linux_shm_attach_reader(
+    struct mavtunnel_t* tunnel, struct endpoint_linux_shm_t* ep);
+
+void ep_linux_shm_attach_writer(
+    struct mavtunnel_t* tunnel, struct endpoint_linux_shm_t* ep);
+
+enum mavtunnel_error_t mavtunnel_shm_client_open(
+    struct mavtunnel_shm_client_t* client, int fd);
+
+void mavtunnel_shm_client_close(struct mavtunnel_shm_client_t* client);
+
+/**
+ * Wait up to timeout_ms (-1: forever) for the next frame from the tunnel.
+ *
+ * @return the frame, in shared memory until mavtunnel_shm_client_release(),
+ *         or NULL on timeout
+ */
+const uint8_t* mavtunnel_shm_client_peek(
+    struct mavtunnel_shm_client_t* client, size_t* len, int timeout_ms);
+
+void mavtunnel_shm_client_release(struct mavtunnel_shm_client_t* client);
+
+/**
+ * @return MERR_OK, or MERR_PENDING if the tunnel's ring is full and the
+ *         frame was dropped
+ */
+enum mavtunnel_error_t mavtunnel_shm_client_send(
+    struct mavtunnel_shm_client_t* client, const uint8_t* bytes, size_t len);
+
+#if __cplusplus
+};
+#endif
+
+#endif /* !_MAVTUNNEL_ENDPOINT_LINUX_SHM_H_ */
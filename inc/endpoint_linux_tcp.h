@@ -0,0 +1,100 @@
+#ifndef _MAVTUNNEL_ENDPOINT_LINUX_TCP_H_
+#define _MAVTUNNEL_ENDPOINT_LINUX_TCP_H_
+
+#include "os.h"
+#include "tunnel.h"
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+
+/**
+ * MAVLink over TCP, as spoken by MAVProxy, QGroundControl and most relays.
+ * The endpoint either listens for one client at a time, the newest
+ * replacing the old so that a ground station reconnects at once, or
+ * connects out, retrying with a backoff doubling from backoff_min_ms up to
+ * backoff_max_ms. All of it happens inside read(), so the tunnel thread
+ * carries on over a lost connection.
+ *
+ * The socket is non-blocking and has TCP_NODELAY. Writes that do not fit
+ * into the socket are queued and flushed by the reader on EPOLLOUT; writes
+ * while there is no connection are dropped, as the UDP endpoints do before
+ * they know a peer, and so is the queue when the connection goes.
+ */
+#define EP_TCP_QUEUE_SIZE 16384
+
+enum ep_tcp_mode_t
+{
+    EP_TCP_LISTEN,
+    EP_TCP_CONNECT,
+};
+
+enum ep_tcp_state_t
+{
+    EP_TCP_DOWN,
+    EP_TCP_CONNECTING,
+    EP_TCP_UP,
+};
+
+struct ep_tcp_options_t
+{
+    /* re-armed after every read, the kernel clears it on its own */
+    bool     quickack;
+    /* TCP_USER_TIMEOUT, 0 for the system default */
+    unsigned user_timeout_ms;
+    unsigned backoff_min_ms, backoff_max_ms;
+};
+
+#define EP_TCP_OPTIONS_DEFAULT {false, 0, 100, 5000}
+
+struct endpoint_linux_tcp_t
+{
+    enum ep_tcp_mode_t      mode;
+    struct sockaddr_in      addr;
+    struct ep_tcp_options_t options;
+    int                     listen_fd;
+    int                     epoll, terminate_fd;
+    struct epoll_event      event[3];
+    atomic_bool             terminated;
+
+    /* the reader (re)connects while the writer sends */
+    os_lock_t           lock;
+    int                 fd;
+    enum ep_tcp_state_t state;
+    bool                polling_out;
+    unsigned            backoff_ms;
+    uint64_t            retry_us;
+
+    uint8_t queue[EP_TCP_QUEUE_SIZE];
+    size_t  queue_head, queue_len;
+
+    uint64_t connects, disconnects;
+    uint64_t rx_bytes, tx_bytes, tx_queued, tx_dropped;
+};
+
+#if __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * @param ip       address to listen on or to connect to
+ * @param options  NULL for EP_TCP_OPTIONS_DEFAULT
+ */
+enum mavtunnel_error_t ep_linux_tcp_init(struct endpoint_linux_tcp_t* ep,
+    enum ep_tcp_mode_t mode, const char* ip, uint16_t port,
+    const struct ep_tcp_options_t* options);
+
+void ep_linux_tcp_destroy(struct endpoint_linux_tcp_t* ep);
+
+void ep_linux_tcp_interrupt(struct endpoint_linux_tcp_t* ep);
+
+void ep_linux_tcp_attach_reader(
+    struct mavtunnel_t* tunnel, struct endpoint_linux_tcp_t* ep);
+
+void ep_linux_tcp_attach_writer(
+    struct mavtunnel_t* tunnel, struct endpoint_linux_tcp_t* ep);
+
+#if __cplusplus
+};
+#endif
+
+#endif /* !_MAVTUNNEL_ENDPOINT_LINUX_TCP_H_ */
@@ -0,0 +1,115 @@
+#ifndef _MAVTUNNEL_ENDPOINT_LINUX_TLOG_H_
+#define _MAVTUNNEL_ENDPOINT_LINUX_TLOG_H_
+
+#include "os.h"
+#include "tunnel.h"
+
+#include <pthread.h>
+
+/**
+ * Capture and replay of MAVLink traffic, in the tlog format that Mission
+ * Planner and pymavlink read: every frame is preceded by the time it was
+ * written, in microseconds since the epoch, big-endian.
+ *
+ * The capture endpoint is a writer. It appends to memory-mapped segments
+ * of segment_size bytes, <prefix>-0000.tlog, <prefix>-0001.tlog, ..., so
+ * a write is a copy into memory. A helper thread creates and maps the next
+ * segment while one fills, and cuts a full one to the bytes it holds,
+ * which makes it a plain tlog; a write that fills a segment only swaps in
+ * the next, and waits only if segments fill faster than they are created.
+ * Should the next segment fail to be created, frames are dropped while the
+ * helper tries again, from EP_TLOG_RETRY_MS on, backing off to
+ * EP_TLOG_RETRY_MAX_MS. To record what a tunnel sends while it sends it,
+ * make the capture and the real endpoint members of a writer set.
+ *
+ * The replay endpoint is a reader. It plays a tlog, or the segments of a
+ * capture, one frame per read, at the recorded pace divided by speed, or
+ * as fast as it is read with speed 0.
+ */
+#define EP_TLOG_SEGMENT_SIZE (16 * 1024 * 1024)
+#define EP_TLOG_RETRY_MS     100
+#define EP_TLOG_RETRY_MAX_MS 5000
+
+struct endpoint_linux_capture_t
+{
+    char*    prefix;
+    size_t   segment_size;
+    unsigned segment;
+    int      fd;
+    uint8_t* map;
+    size_t   used;
+
+    /* the helper, the next segment it mapped and the full one it closes */
+    pthread_t       helper;
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    bool            running, stop;
+    int             spare_fd, full_fd;
+    uint8_t *       spare_map, *full_map;
+    size_t          full_used;
+    unsigned        full_segment;
+    /* the next segment could not be created; tried again at retry_us */
+    bool            spare_failed;
+    unsigned        retry_ms;
+    uint64_t        retry_us;
+
+    uint64_t frames, bytes, segments, dropped;
+};
+
+struct endpoint_linux_replay_t
+{
+    char*          path;
+    /* a capture's segments rather than one file */
+    bool           segmented;
+    unsigned       segment;
+    int            fd;
+    const uint8_t* map;
+    size_t         size, pos;
+
+    double   speed;
+    bool     started;
+    uint64_t first_log_us, start_us;
+    /* the recorded time of the last frame read */
+    uint64_t last_log_us;
+
+    int         terminate_fd;
+    atomic_bool terminated;
+
+    uint64_t frames, bytes;
+};
+
+#if __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * @param segment_size  0 for EP_TLOG_SEGMENT_SIZE
+ */
+enum mavtunnel_error_t ep_linux_capture_init(
+    struct endpoint_linux_capture_t* ep, const char* prefix, size_t segment_size);
+
+void ep_linux_capture_destroy(struct endpoint_linux_capture_t* ep);
+
+void ep_linux_capture_attach_writer(
+    struct mavtunnel_t* tunnel, struct endpoint_linux_capture_t* ep);
+
+/**
+ * @param path   a tlog, or the prefix of a capture
+ * @param speed  1 for the recorded pace, 0 for no pace at all
+ */
+enum mavtunnel_error_t ep_linux_replay_init(
+    struct endpoint_linux_replay_t* ep, const char* path, double speed);
+
+void ep_linux_replay_destroy(struct endpoint_linux_replay_t* ep);
+
+void ep_linux_replay_interrupt(struct endpoint_linux_replay_t* ep);
+
+void ep_linux_replay_attach_reader(
+    struct mavtunnel_t* tunnel, struct endpoint_linux_replay_t* ep);
+
+#if __cplusplus
+};
+#endif
+
+#endif /* !_MAVTUNNEL_ENDPOINT_LINUX_TLOG_H_ */
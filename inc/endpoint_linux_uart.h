@@ -6,6 +6,41 @@
 
 #include <sys/epoll.h>
 
+/**
+ * Line settings, 8N1 in raw mode. Any baud rate the driver can make is
+ * accepted (termios2 with BOTHER); the endpoint keeps the rate the driver
+ * reports back in baud.
+ *
+ * vmin/vtime make a read() of the device wait for vmin bytes, or for
+ * vtime tenths of a second without a new byte, before it returns, so that
+ * one wake-up takes a whole burst. The device is then opened blocking, so
+ * vmin > 0 needs vtime > 0. read_size caps the bytes taken per read(), 0
+ * for as many as the caller has room for.
+ *
+ * coalesce_us, instead of VMIN/VTIME, makes reads frame-aware. The
+ * endpoint follows MAVLink framing through the bytes it reads; a read that
+ * ends inside a frame sleeps on a timerfd for as long as the rest of the
+ * frame takes at the line rate, then takes what came in, for at most
+ * coalesce_us in all. A read that ends on a frame boundary, such as a
+ * short control frame that came in whole, returns at once. A bound below
+ * the time a whole frame takes on the line (3.5 ms for 40 bytes at 115200)
+ * cuts the wait short.
+ */
+struct ep_uart_options_t
+{
+    uint32_t baud;
+    /* RTS/CTS hardware flow control */
+    bool     rtscts;
+    /* ASYNC_LOW_LATENCY, if the driver has it */
+    bool     low_latency;
+    uint8_t  vmin, vtime;
+    size_t   read_size;
+    /* the latency bound of frame-aware reads, 0 for none */
+    uint32_t coalesce_us;
+};
+
+#define EP_UART_OPTIONS_DEFAULT {115200, false, false, 0, 0, 0, 0}
+
 struct endpoint_linux_uart_t
 {
     int            fd;
@@ -14,6 +49,14 @@ struct endpoint_linux_uart_t
     char*          device_path;
     int            terminate_fd;
     atomic_bool    terminated;
+    struct ep_uart_options_t options;
+    uint32_t       baud;
+
+    /* frame-aware reads: the frame in progress at the end of the last read */
+    int            timer_fd;
+    uint8_t        scan_stx;
+    size_t         scan_have, scan_total;
+    uint64_t       reads, coalesced;
 };
 
 #if __cplusplus
@@ -22,6 +65,12 @@ extern "C" {
 
 int ep_linux_uart_init(struct endpoint_linux_uart_t * ep, const char * device_path);
 
+/**
+ * @param options  NULL for EP_UART_OPTIONS_DEFAULT
+ */
+int ep_linux_uart_init_options(struct endpoint_linux_uart_t * ep, const char * device_path,
+    const struct ep_uart_options_t * options);
+
 void ep_linux_uart_destroy(struct endpoint_linux_uart_t * ep);
 
 void ep_linux_uart_attach_reader(struct mavtunnel_t * tunnel, struct endpoint_linux_uart_t * ep);
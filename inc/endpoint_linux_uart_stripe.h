@@ -0,0 +1,95 @@
+#ifndef _MAVTUNNEL_ENDPOINT_LINUX_UART_STRIPE_H_
+#define _MAVTUNNEL_ENDPOINT_LINUX_UART_STRIPE_H_
+
+#include "os.h"
+#include "tunnel.h"
+#include "endpoint_linux_uart.h"
+
+#include <sys/epoll.h>
+
+/**
+ * Striping over several UARTs. Every frame goes whole to the link that
+ * drains it first, judged by the bytes each link still has queued and its
+ * drain rate: measured from TIOCOUTQ where the driver reports it, else the
+ * line speed. On the wire a frame is prefixed with a stripe seq and followed
+ * by a CRC-16 (X.25, little endian) over seq and frame:
+ *   [seq][MAVLink2 frame][crc]
+ * The reader parses every link on its own, drops records that fail the CRC
+ * (rx_corrupt) and hands out the frames in seq order, from seq 0 on. A seq
+ * already held is counted in duplicates and dropped. A frame that does not come within reorder_timeout_us
+ * of a later one is taken for lost; should it come after all, it is handed
+ * out at once, or counted in late_dropped if the output buffer is full.
+ * A read still returns after the reader's timeout_ms while a gap is open.
+ */
+#define EP_STRIPE_MAX_LINKS          4
+#define EP_STRIPE_WINDOW             64
+#define EP_STRIPE_REORDER_TIMEOUT_US 50000
+#define EP_STRIPE_RX_BUFFER          1024
+#define EP_STRIPE_OUT_BUFFER         2048
+
+struct ep_stripe_link_t
+{
+    struct endpoint_linux_uart_t* uart;
+    uint64_t                      line_rate, rate;
+    bool                          outq_reported;
+    uint64_t                      backlog, last_us;
+    uint8_t                       rx[EP_STRIPE_RX_BUFFER];
+    size_t                        rx_len;
+    uint64_t                      tx_frames, tx_bytes, rx_frames, rx_dropped, rx_corrupt;
+};
+
+struct ep_stripe_slot_t
+{
+    bool     valid;
+    uint8_t  seq;
+    uint16_t len;
+    uint8_t  frame[MAVLINK_MAX_PACKET_LEN];
+};
+
+struct endpoint_linux_uart_stripe_t
+{
+    struct ep_stripe_link_t links[EP_STRIPE_MAX_LINKS];
+    size_t                  n_links;
+    int                     epoll, terminate_fd;
+    struct epoll_event      event[EP_STRIPE_MAX_LINKS + 1];
+    atomic_bool             terminated;
+
+    uint8_t                 tx_seq;
+    uint8_t                 tx_buf[1 + MAVLINK_MAX_PACKET_LEN + 2];
+
+    struct ep_stripe_slot_t window[EP_STRIPE_WINDOW];
+    uint8_t                 rx_next;
+    size_t                  buffered;
+    uint64_t                gap_us, reorder_timeout_us;
+    uint8_t                 out[EP_STRIPE_OUT_BUFFER];
+    size_t                  out_len, out_pos;
+    uint64_t                skipped, late, late_dropped, duplicates;
+};
+
+#if __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @param uarts  initialized UART endpoints, each at its line speed; the
+ *               stripe reads and writes their devices from then on
+ */
+enum mavtunnel_error_t ep_linux_uart_stripe_init(
+    struct endpoint_linux_uart_stripe_t* ep, struct endpoint_linux_uart_t* uarts,
+    size_t n_uarts);
+
+void ep_linux_uart_stripe_destroy(struct endpoint_linux_uart_stripe_t* ep);
+
+void ep_linux_uart_stripe_interrupt(struct endpoint_linux_uart_stripe_t* ep);
+
+void ep_linux_uart_stripe_attach_reader(
+    struct mavtunnel_t* tunnel, struct endpoint_linux_uart_stripe_t* ep);
+
+void ep_linux_uart_stripe_attach_writer(
+    struct mavtunnel_t* tunnel, struct endpoint_linux_uart_stripe_t* ep);
+
+#if __cplusplus
+};
+#endif
+
+#endif /* !_MAVTUNNEL_ENDPOINT_LINUX_UART_STRIPE_H_ */
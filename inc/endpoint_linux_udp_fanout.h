@@ -0,0 +1,58 @@
+#ifndef _MAVTUNNEL_ENDPOINT_LINUX_UDP_FANOUT_H_
+#define _MAVTUNNEL_ENDPOINT_LINUX_UDP_FANOUT_H_
+
+#include "os.h"
+#include "tunnel.h"
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+/**
+ * UDP to a list of peers: every frame is sent to all of them with one
+ * sendmmsg(), whose messages share the same buffer. A write fails only when
+ * none of the peers took the frame.
+ */
+#define EP_UDP_FANOUT_MAX_PEERS 64
+
+struct endpoint_linux_udp_fanout_t
+{
+    int                fd;
+    struct sockaddr_in peers[EP_UDP_FANOUT_MAX_PEERS];
+    size_t             n_peers;
+    struct iovec       iov;
+    struct mmsghdr     msgs[EP_UDP_FANOUT_MAX_PEERS];
+
+    uint64_t frames, datagrams, errors, syscalls;
+};
+
+#if __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * @param port  local port to send from, 0 for any
+ */
+enum mavtunnel_error_t ep_linux_udp_fanout_init(
+    struct endpoint_linux_udp_fanout_t* ep, uint16_t port);
+
+void ep_linux_udp_fanout_destroy(struct endpoint_linux_udp_fanout_t* ep);
+
+enum mavtunnel_error_t ep_linux_udp_fanout_add_peer(
+    struct endpoint_linux_udp_fanout_t* ep, const char* ip, uint16_t port);
+
+void ep_linux_udp_fanout_attach_writer(
+    struct mavtunnel_t* tunnel, struct endpoint_linux_udp_fanout_t* ep);
+
+/**
+ * Send n messages with as few sendmmsg() calls as it takes; a message the
+ * kernel refuses (an unreachable peer, a full buffer) is counted in errors
+ * and skipped. Shared with the UDP server.
+ */
+void ep_linux_udp_sendmmsg(int fd, struct mmsghdr* msgs, size_t n,
+    uint64_t* datagrams, uint64_t* errors, uint64_t* syscalls);
+
+#if __cplusplus
+};
+#endif
+
+#endif /* !_MAVTUNNEL_ENDPOINT_LINUX_UDP_FANOUT_H_ */
@@ -0,0 +1,100 @@
+#ifndef _MAVTUNNEL_ENDPOINT_LINUX_UDP_SERVER_H_
+#define _MAVTUNNEL_ENDPOINT_LINUX_UDP_SERVER_H_
+
+#include "os.h"
+#include "tunnel.h"
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+/**
+ * UDP server for several clients, e.g. ground stations. Every address that
+ * sends to the server becomes a peer, until it has been silent for
+ * idle_timeout_us. A write goes to all peers with one sendmmsg(); a subset
+ * can be sent to with ep_linux_udp_server_send_to().
+ *
+ * Peers are kept in a dense array, which the sendmmsg() messages point
+ * into, and found by address through an open-addressing hash table.
+ */
+#define EP_UDP_SERVER_MAX_PEERS        64
+#define EP_UDP_SERVER_TABLE            128
+#define EP_UDP_SERVER_IDLE_TIMEOUT_US  10000000
+#define EP_UDP_SERVER_EXPIRY_PERIOD_US 100000
+
+enum ep_udp_server_flags_t
+{
+    /* join a SO_REUSEPORT group on the port, see endpoint_linux_udp_sharded.h */
+    EP_UDP_SERVER_REUSEPORT = 0x1,
+};
+
+struct ep_udp_server_peer_t
+{
+    struct sockaddr_in addr;
+    uint64_t           last_rx_us;
+    uint64_t           rx_datagrams, rx_bytes;
+};
+
+struct endpoint_linux_udp_server_t
+{
+    int                fd;
+    int                epoll, terminate_fd;
+    struct epoll_event event[2];
+    atomic_bool        terminated;
+
+    /* the reader adds peers while the writer sends to them */
+    os_lock_t                   lock;
+    struct ep_udp_server_peer_t peers[EP_UDP_SERVER_MAX_PEERS];
+    size_t                      n_peers;
+    /* index into peers + 1, 0 for an empty slot */
+    uint8_t                     table[EP_UDP_SERVER_TABLE];
+    uint64_t                    idle_timeout_us, expired_us;
+    /* where the last datagram read came from */
+    struct sockaddr_in          last_peer;
+
+    struct iovec   iov;
+    struct mmsghdr msgs[EP_UDP_SERVER_MAX_PEERS];
+    struct mmsghdr subset[EP_UDP_SERVER_MAX_PEERS];
+
+    uint64_t joined, expired, rejected;
+    uint64_t rx_datagrams, rx_bytes;
+    uint64_t tx_frames, tx_datagrams, tx_errors, syscalls;
+};
+
+#if __cplusplus
+extern "C"
+{
+#endif
+
+enum mavtunnel_error_t ep_linux_udp_server_init(
+    struct endpoint_linux_udp_server_t* ep, uint16_t port);
+
+/**
+ * @param flags  EP_UDP_SERVER_REUSEPORT to share the port
+ */
+enum mavtunnel_error_t ep_linux_udp_server_init_flags(
+    struct endpoint_linux_udp_server_t* ep, uint16_t port, unsigned flags);
+
+void ep_linux_udp_server_destroy(struct endpoint_linux_udp_server_t* ep);
+
+void ep_linux_udp_server_interrupt(struct endpoint_linux_udp_server_t* ep);
+
+/**
+ * Send to those of peers that are known; the others are skipped.
+ */
+enum mavtunnel_error_t ep_linux_udp_server_send_to(
+    struct endpoint_linux_udp_server_t* ep, const struct sockaddr_in* peers,
+    size_t n_peers, const uint8_t* bytes, size_t len);
+
+void ep_linux_udp_server_attach_reader(
+    struct mavtunnel_t* tunnel, struct endpoint_linux_udp_server_t* ep);
+
+void ep_linux_udp_server_attach_writer(
+    struct mavtunnel_t* tunnel, struct endpoint_linux_udp_server_t* ep);
+
+void ep_linux_udp_server_print_stats(const struct endpoint_linux_udp_server_t* ep);
+
+#if __cplusplus
+};
+#endif
+
+#endif /* !_MAVTUNNEL_ENDPOINT_LINUX_UDP_SERVER_H_ */
@@ -0,0 +1,61 @@
+#ifndef _MAVTUNNEL_ENDPOINT_LINUX_UDP_SHARDED_H_
+#define _MAVTUNNEL_ENDPOINT_LINUX_UDP_SHARDED_H_
+
+#include "os.h"
+#include "tunnel.h"
+#include "endpoint_linux_udp_server.h"
+
+/**
+ * UDP ingest on one port, spread over several workers: every shard is a
+ * SO_REUSEPORT socket of its own, read by its own tunnel in its own thread.
+ * The kernel keeps each sender on one shard, by hashing its address and
+ * port or, with EP_UDP_SHARDED_STEER, by a cBPF program that picks
+ * (source address + source port) % n_shards, which stays the same as long
+ * as the number of shards does.
+ *
+ * A shard is a UDP server (see endpoint_linux_udp_server.h) of its own: it
+ * keeps the senders it hears from as peers, up to EP_UDP_SERVER_MAX_PEERS,
+ * and writes to all of them.
+ */
+#define EP_UDP_SHARDED_MAX_SHARDS 64
+
+enum ep_udp_sharded_flags_t
+{
+    EP_UDP_SHARDED_STEER = 0x1,
+};
+
+struct endpoint_linux_udp_sharded_t
+{
+    struct endpoint_linux_udp_server_t shards[EP_UDP_SHARDED_MAX_SHARDS];
+    size_t                             n_shards;
+    uint16_t                           port;
+};
+
+#if __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * @param n_shards  number of workers, e.g. one per core
+ * @param flags     EP_UDP_SHARDED_STEER for steering by source address
+ */
+enum mavtunnel_error_t ep_linux_udp_sharded_init(
+    struct endpoint_linux_udp_sharded_t* ep, uint16_t port, size_t n_shards,
+    unsigned flags);
+
+void ep_linux_udp_sharded_destroy(struct endpoint_linux_udp_sharded_t* ep);
+
+void ep_linux_udp_sharded_interrupt(struct endpoint_linux_udp_sharded_t* ep);
+
+void ep_linux_udp_sharded_attach_reader(struct mavtunnel_t* tunnel,
+    struct endpoint_linux_udp_sharded_t* ep, size_t shard);
+
+void ep_linux_udp_sharded_attach_writer(struct mavtunnel_t* tunnel,
+    struct endpoint_linux_udp_sharded_t* ep, size_t shard);
+
+#if __cplusplus
+};
+#endif
+
+#endif /* !_MAVTUNNEL_ENDPOINT_LINUX_UDP_SHARDED_H_ */
@@ -0,0 +1,96 @@
+#ifndef _MAVTUNNEL_ENDPOINT_LINUX_UNIX_H_
+#define _MAVTUNNEL_ENDPOINT_LINUX_UNIX_H_
+
+#include "os.h"
+#include "tunnel.h"
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/**
+ * AF_UNIX endpoint for clients on the same host, such as a mission app or
+ * a logger, which would otherwise go through the loopback UDP/IP stack.
+ * Both SOCK_SEQPACKET and SOCK_DGRAM keep message boundaries, so a read
+ * returns what one write sent.
+ *
+ * The server takes up to EP_UNIX_MAX_PEERS clients: connections for
+ * SOCK_SEQPACKET, bound sender addresses for SOCK_DGRAM, learned as for
+ * the UDP server. A write goes to all of them and never blocks; a client
+ * that does not keep up loses messages, with SOCK_DGRAM as soon as
+ * net.unix.max_dgram_qlen of them wait. A client of the server is an
+ * endpoint too, with the same attach API.
+ *
+ * A path that starts with '@' names an abstract socket, which needs no
+ * file and vanishes with its last user. A server replaces a socket file
+ * only when no one answers on it any more; while another server listens
+ * there, init fails.
+ */
+#define EP_UNIX_MAX_PEERS 16
+
+enum ep_unix_type_t
+{
+    EP_UNIX_SEQPACKET,
+    EP_UNIX_DGRAM,
+};
+
+enum ep_unix_role_t
+{
+    EP_UNIX_SERVER,
+    EP_UNIX_CLIENT,
+};
+
+struct ep_unix_peer_t
+{
+    /* a SOCK_SEQPACKET connection, or -1 */
+    int                fd;
+    /* a SOCK_DGRAM sender */
+    struct sockaddr_un addr;
+    socklen_t          addr_len;
+};
+
+struct endpoint_linux_unix_t
+{
+    enum ep_unix_type_t type;
+    enum ep_unix_role_t role;
+    int                 fd;
+    struct sockaddr_un  addr;
+    socklen_t           addr_len;
+    int                 epoll, terminate_fd;
+    struct epoll_event  event[4];
+    atomic_bool         terminated;
+
+    /* the reader adds and removes peers while the writer sends to them */
+    os_lock_t             lock;
+    struct ep_unix_peer_t peers[EP_UNIX_MAX_PEERS];
+    size_t                n_peers;
+
+    uint64_t joined, left, rejected;
+    uint64_t rx_messages, tx_messages, tx_dropped;
+};
+
+#if __cplusplus
+extern "C"
+{
+#endif
+
+enum mavtunnel_error_t ep_linux_unix_init(struct endpoint_linux_unix_t* ep,
+    enum ep_unix_type_t type, enum ep_unix_role_t role, const char* path);
+
+/**
+ * A server also removes its socket file.
+ */
+void ep_linux_unix_destroy(struct endpoint_linux_unix_t* ep);
+
+void ep_linux_unix_interrupt(struct endpoint_linux_unix_t* ep);
+
+void ep_linux_unix_attach_reader(
+    struct mavtunnel_t* tunnel, struct endpoint_linux_unix_t* ep);
+
+void ep_linux_unix_attach_writer(
+    struct mavtunnel_t* tunnel, struct endpoint_linux_unix_t* ep);
+
+#if __cplusplus
+};
+#endif
+
+#endif /* !_MAVTUNNEL_ENDPOINT_LINUX_UNIX_H_ */
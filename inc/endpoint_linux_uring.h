@@ -0,0 +1,115 @@
+#ifndef _MAVTUNNEL_ENDPOINT_LINUX_URING_H_
+#define _MAVTUNNEL_ENDPOINT_LINUX_URING_H_
+
+#include "os.h"
+#include "tunnel.h"
+#include <arpa/inet.h>
+#include <linux/io_uring.h>
+#include <sys/socket.h>
+
+/**
+ * io_uring backend for the UART and UDP endpoints: open the device with
+ * ep_linux_uart_init() or ep_linux_udp_init() as usual, then either attach
+ * that endpoint (epoll) or hand its fd to ep_linux_uring_init().
+ *
+ * Receives complete into a ring of buffers provided to the kernel, so that
+ * a read costs at most one io_uring_enter(), none if completions are
+ * already waiting. Sockets keep a multishot recvmsg armed; a tty read is
+ * re-armed with the wait for its completion. Writes are copied into slots of
+ * a buffer registered for the tty writes. With EP_URING_SQPOLL a kernel
+ * thread picks them up, so bursts of writes are submitted in batches
+ * without syscalls.
+ *
+ * The reader and the writer each own a ring, so that they may run in
+ * different tunnels. A stream keeps one write in flight, which keeps its
+ * bytes in order; a datagram socket up to EP_URING_TX_SLOTS.
+ */
+#define EP_URING_ENTRIES        64
+#define EP_URING_RX_BUFFERS     32
+#define EP_URING_RX_BUFFER_SIZE 2048
+#define EP_URING_TX_SLOTS       32
+#define EP_URING_TX_SLOT_SIZE   512
+#define EP_URING_SQ_IDLE_MS     50
+
+enum ep_uring_kind_t
+{
+    EP_URING_STREAM,
+    EP_URING_DATAGRAM,
+};
+
+enum ep_uring_flags_t
+{
+    EP_URING_SQPOLL = 0x1,
+};
+
+struct ep_uring_ring_t
+{
+    int                  fd;
+    bool                 sqpoll;
+    unsigned             entries, pending;
+    unsigned *           sq_head, *sq_tail, *sq_mask, *sq_flags, *sq_array;
+    struct io_uring_sqe* sqes;
+    unsigned *           cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe* cqes;
+    void *               sq_map, *cq_map;
+    size_t               sq_map_len, cq_map_len, sqes_len;
+    uint64_t             enters;
+};
+
+struct endpoint_linux_uring_t
+{
+    int                  fd;
+    enum ep_uring_kind_t kind;
+    int                  terminate_fd;
+    atomic_bool          terminated;
+
+    struct ep_uring_ring_t   rx;
+    struct io_uring_buf_ring* rx_ring;
+    uint8_t*                 rx_pool;
+    bool                     rx_armed;
+    struct msghdr            rx_msg;
+    /* a completion read() could not hand out at once */
+    int                      rx_bid;
+    uint8_t*                 rx_data;
+    size_t                   rx_left;
+    /* where the last datagram came from, the one writes go to */
+    struct sockaddr_in       peer;
+    atomic_bool              has_peer;
+
+    struct ep_uring_ring_t tx;
+    uint8_t*               tx_pool;
+    struct sockaddr_in     tx_peer[EP_URING_TX_SLOTS];
+    uint16_t               tx_len[EP_URING_TX_SLOTS];
+    uint32_t               tx_free;
+    unsigned               tx_inflight;
+
+    uint64_t rx_completions, rx_bytes, tx_frames, tx_errors;
+};
+
+#if __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * @param fd     an open tty or a bound UDP socket, left open by destroy
+ * @param flags  EP_URING_SQPOLL for a submission thread for the writes
+ */
+enum mavtunnel_error_t ep_linux_uring_init(struct endpoint_linux_uring_t* ep,
+    int fd, enum ep_uring_kind_t kind, unsigned flags);
+
+void ep_linux_uring_destroy(struct endpoint_linux_uring_t* ep);
+
+void ep_linux_uring_interrupt(struct endpoint_linux_uring_t* ep);
+
+void ep_linux_uring_attach_reader(
+    struct mavtunnel_t* tunnel, struct endpoint_linux_uring_t* ep);
+
+void ep_linux_uring_attach_writer(
+    struct mavtunnel_t* tunnel, struct endpoint_linux_uring_t* ep);
+
+#if __cplusplus
+};
+#endif
+
+#endif /* !_MAVTUNNEL_ENDPOINT_LINUX_URING_H_ */
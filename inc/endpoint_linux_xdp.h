@@ -0,0 +1,99 @@
+#ifndef _MAVTUNNEL_ENDPOINT_LINUX_XDP_H_
+#define _MAVTUNNEL_ENDPOINT_LINUX_XDP_H_
+
+#include "os.h"
+#include "tunnel.h"
+#include <arpa/inet.h>
+#include <linux/if_xdp.h>
+#include <sys/epoll.h>
+
+/**
+ * AF_XDP replacement for endpoint_linux_udp_t: the tunnel's UDP flow is
+ * taken off the interface before the IP stack by a small XDP program that
+ * redirects IPv4/UDP to the bound port into an XSK socket; everything else
+ * passes on to the kernel. Datagrams are read from and written to a UMEM
+ * area shared with the kernel, replies go to the sender of the last one,
+ * headers mirrored.
+ *
+ * By default the program runs in generic (skb) mode with copying, which
+ * works on any interface, a veth pair included. EP_XDP_ZEROCOPY needs a
+ * driver with native XDP and AF_XDP zero-copy support.
+ *
+ * The first half of the UMEM frames backs the fill/rx rings, the second
+ * half the tx/completion rings, so that the reader and the writer never
+ * touch the same ring.
+ */
+#define EP_XDP_FRAME_SIZE 2048
+#define EP_XDP_FRAMES     256
+#define EP_XDP_RING_SIZE  128
+#define EP_XDP_HEADERS    42 /* Ethernet + IPv4 + UDP */
+
+enum ep_xdp_flags_t
+{
+    EP_XDP_ZEROCOPY = 0x1,
+};
+
+struct ep_xdp_ring_t
+{
+    uint32_t *producer, *consumer, *flags;
+    void*     ring;
+    uint32_t  mask;
+    void*     map;
+    size_t    map_len;
+};
+
+struct endpoint_linux_xdp_t
+{
+    int      fd;
+    int      ifindex;
+    uint32_t queue;
+    uint16_t port;
+    int      map_fd, prog_fd, link_fd;
+
+    uint8_t*             umem;
+    struct ep_xdp_ring_t rx, fill, tx, comp;
+    uint64_t             tx_free[EP_XDP_FRAMES / 2];
+    size_t               n_tx_free;
+
+    int                epoll, terminate_fd;
+    struct epoll_event event[2];
+
+    /* where the last datagram came from, the one writes go to */
+    uint8_t            local_mac[6], peer_mac[6];
+    uint32_t           local_ip;
+    struct sockaddr_in client;
+    uint16_t           ip_id;
+    atomic_bool        has_client;
+    atomic_bool        terminated;
+
+    uint64_t rx_packets, rx_dropped, tx_packets, tx_dropped;
+};
+
+#if __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * @param ifname  interface to attach to, replacing its XDP program
+ * @param queue   receive queue to serve; one endpoint per queue
+ * @param port    UDP port of the tunnel, in host order
+ */
+enum mavtunnel_error_t ep_linux_xdp_init(struct endpoint_linux_xdp_t* ep,
+    const char* ifname, uint32_t queue, uint16_t port, unsigned flags);
+
+void ep_linux_xdp_destroy(struct endpoint_linux_xdp_t* ep);
+
+void ep_linux_xdp_interrupt(struct endpoint_linux_xdp_t* ep);
+
+void ep_linux_xdp_attach_reader(
+    struct mavtunnel_t* tunnel, struct endpoint_linux_xdp_t* ep);
+
+void ep_linux_xdp_attach_writer(
+    struct mavtunnel_t* tunnel, struct endpoint_linux_xdp_t* ep);
+
+#if __cplusplus
+};
+#endif
+
+#endif /* !_MAVTUNNEL_ENDPOINT_LINUX_XDP_H_ */
@@ -0,0 +1,90 @@
+#ifndef _MAVTUNNEL_ENDPOINT_LOOPBACK_H_
+#define _MAVTUNNEL_ENDPOINT_LOOPBACK_H_
+
+#include "os.h"
+#include "tunnel.h"
+
+#include <pthread.h>
+
+/**
+ * In-process endpoint pair: what one end writes, the other end reads, out
+ * of a ring in memory. There is no fd and no syscall on the way, so a
+ * benchmark of mavtunnel_spin_once() over it measures the parser, the codec
+ * pipeline and the finalizer rather than the kernel.
+ *
+ * Each direction is a lock-free single-producer single-consumer ring: one
+ * thread writes to an end, one thread reads from the other. In byte mode it
+ * behaves like a UART, a read returns whatever bytes are there. In datagram
+ * mode it behaves like a UDP socket, a read returns one write, cut to len.
+ * A write that does not fit in its ring is dropped whole.
+ *
+ * A read on an empty ring polls it for EP_LOOPBACK_SPIN_POLLS, then sleeps
+ * until a write wakes it, timeout_ms passes (never with -1) or the end is
+ * interrupted. A writer only takes the ring's lock when its reader sleeps.
+ * Needs the heap and threads of a hosted build.
+ */
+#define EP_LOOPBACK_RING_SIZE  65536
+#define EP_LOOPBACK_SPIN_POLLS 4096
+
+enum ep_loopback_kind_t
+{
+    EP_LOOPBACK_BYTES,
+    EP_LOOPBACK_DATAGRAM,
+};
+
+struct ep_loopback_ring_t
+{
+    /* the producer and the consumer each on their own cache line */
+    atomic_size_t head __attribute__((aligned(64)));
+    atomic_size_t tail __attribute__((aligned(64)));
+    size_t        size;
+    uint8_t*      data;
+
+    /* where the reader sleeps once polling gave up */
+    atomic_bool     waiting;
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+};
+
+struct endpoint_loopback_t
+{
+    enum ep_loopback_kind_t    kind;
+    struct ep_loopback_ring_t *rx, *tx;
+    atomic_bool                terminated;
+
+    uint64_t rx_bytes, tx_bytes, tx_dropped;
+};
+
+struct endpoint_loopback_pair_t
+{
+    struct ep_loopback_ring_t  ring[2];
+    struct endpoint_loopback_t end[2];
+};
+
+#if __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * end[0] writes to what end[1] reads and the other way around.
+ *
+ * @param ring_size  bytes in each direction, a power of two; 0 for
+ *                   EP_LOOPBACK_RING_SIZE
+ */
+enum mavtunnel_error_t ep_loopback_pair_init(
+    struct endpoint_loopback_pair_t* pair, enum ep_loopback_kind_t kind, size_t ring_size);
+
+void ep_loopback_pair_destroy(struct endpoint_loopback_pair_t* pair);
+
+void ep_loopback_interrupt(struct endpoint_loopback_t* ep);
+
+void ep_loopback_attach_reader(struct mavtunnel_t* tunnel, struct endpoint_loopback_t* ep);
+
+void ep_loopback_attach_writer(struct mavtunnel_t* tunnel, struct endpoint_loopback_t* ep);
+
+#if __cplusplus
+};
+#endif
+
+#endif /* !_MAVTUNNEL_ENDPOINT_LOOPBACK_H_ */
@@ -64,6 +64,13 @@ static inline unsigned long long time_us(void)
     return (unsigned long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
 }
 
+static inline unsigned long long clock_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
 #ifndef INFO
 #define INFO(fmt, ...) printf("[I] " fmt, ##__VA_ARGS__)
 #endif /* INFO */
@@ -112,6 +119,13 @@ static inline unsigned long long time_us(void)
     return tsc / tsc_khz() * 1000;
 }
 
+static inline unsigned long long clock_ns(void)
+{
+    uint64_t tsc = tsc();
+    uint64_t khz = tsc_khz();
+    return tsc / khz * 1000000 + tsc % khz * 1000000 / khz;
+}
+
 #ifndef INFO
 #define INFO(fmt, ...)                                                         \
     do                                                                         \
@@ -136,10 +150,47 @@ static inline unsigned long long time_us(void)
 
 #endif
 
+#ifdef MAVTUNNEL_LINUX
+#include <pthread.h>
+#endif
+
 #if __cplusplus
 extern "C" {
 #endif
 
+/*
+ * A lock for what the threads of two tunnels share. On Linux it is a
+ * mutex, as a thread may block while it holds it; on a single core with
+ * no scheduler to yield to, a spinlock.
+ */
+#ifdef MAVTUNNEL_LINUX
+typedef pthread_mutex_t os_lock_t;
+
+static inline void os_lock_init(os_lock_t* lock) { pthread_mutex_init(lock, NULL); }
+static inline void os_lock_destroy(os_lock_t* lock) { pthread_mutex_destroy(lock); }
+static inline void os_lock(os_lock_t* lock) { pthread_mutex_lock(lock); }
+static inline void os_unlock(os_lock_t* lock) { pthread_mutex_unlock(lock); }
+#else
+typedef atomic_flag os_lock_t;
+
+static inline void os_lock_init(os_lock_t* lock) { atomic_flag_clear(lock); }
+static inline void os_lock_destroy(os_lock_t* lock) { (void)lock; }
+
+static inline void
+os_lock(os_lock_t* lock)
+{
+    while (atomic_flag_test_and_set_explicit(lock, memory_order_acquire))
+    {
+    }
+}
+
+static inline void
+os_unlock(os_lock_t* lock)
+{
+    atomic_flag_clear_explicit(lock, memory_order_release);
+}
+#endif
+
 static inline void puthex(uint8_t * buf, size_t len)
 {
     INFO("%lu: ", len);
@@ -0,0 +1,73 @@
+#ifndef _MAVTUNNEL_RELAY_LINUX_H_
+#define _MAVTUNNEL_RELAY_LINUX_H_
+
+#include "os.h"
+#include "tunnel.h"
+
+#include <sys/epoll.h>
+
+/**
+ * Raw relay for passthrough links, which forward every byte unchanged:
+ * instead of parsing frames into a mavtunnel_t and serializing them again,
+ * it moves bytes from in_fd to out_fd with splice() through a pipe, so they
+ * never reach user space. Where either fd does not support splice(), it
+ * falls back to one large read() and write() per wake-up.
+ *
+ * Framing is not checked by default. With check_every = 1 every byte is
+ * run through a MAVLink parser on the side, and with check_every = N only
+ * every Nth chunk is, teed off the pipe. A sampled chunk starts mid-stream,
+ * so its bad frames count only once the parser found a good one in it.
+ * Either way the bytes are forwarded as they came.
+ */
+#define RELAY_LINUX_CHUNK_SIZE 65536
+
+struct relay_linux_t
+{
+    int                in_fd, out_fd;
+    int                pipe[2], sample_pipe[2];
+    bool               use_splice;
+    int                epoll, terminate_fd;
+    struct epoll_event event[2];
+    atomic_bool        terminated;
+
+    size_t             check_every;
+    bool               check_synced;
+    mavlink_message_t  check_msg, check_frame;
+    mavlink_status_t   check_status, check_frame_status;
+
+    uint8_t            buffer[RELAY_LINUX_CHUNK_SIZE];
+
+    uint64_t bytes, chunks, frames, bad_frames;
+};
+
+#if __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * @param in_fd, out_fd  left open by relay_linux_destroy()
+ * @param check_every    0: no framing checks, 1: all bytes, N: every Nth chunk
+ */
+enum mavtunnel_error_t relay_linux_init(
+    struct relay_linux_t* relay, int in_fd, int out_fd, size_t check_every);
+
+void relay_linux_destroy(struct relay_linux_t* relay);
+
+void relay_linux_interrupt(struct relay_linux_t* relay);
+
+/**
+ * Wait up to timeout_ms (-1: forever) for in_fd and forward what it has.
+ *
+ * @return MERR_OK, or MERR_END once in_fd or out_fd is gone or the relay
+ *         was interrupted
+ */
+enum mavtunnel_error_t relay_linux_spin_once(struct relay_linux_t* relay, int timeout_ms);
+
+void relay_linux_spin(struct relay_linux_t* relay);
+
+#if __cplusplus
+};
+#endif
+
+#endif /* !_MAVTUNNEL_RELAY_LINUX_H_ */
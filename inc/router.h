@@ -0,0 +1,84 @@
+#ifndef _MAVTUNNEL_ROUTER_H_
+#define _MAVTUNNEL_ROUTER_H_
+
+#include "os.h"
+#include "tunnel.h"
+
+/**
+ * MAVLink routing between several endpoints, e.g. a GCS, a companion
+ * computer and a logger. Every endpoint is a port with its own tunnel, which
+ * parses what the endpoint sends; the router learns from it on which port
+ * each (sysid, compid) lives and writes the frame to the ports it is meant
+ * for, serialized once:
+ *   - no target, or target system 0: every port
+ *   - a known (target system, target component): that component's port
+ *   - a known target system otherwise: every port the system was heard on
+ *   - an unknown target system: none
+ * A frame never goes back out on the port it came in on.
+ *
+ * Routes and targets are looked up in flat tables, so routing a frame does
+ * not depend on the number of systems or message types. The tables are
+ * locked only for the lookup; the writes to the ports happen after it, each
+ * port's writer serialized on its own lock, so a slow port does not hold up
+ * routing on the others.
+ */
+#define MAVTUNNEL_ROUTER_MAX_PORTS 8
+#define MAVTUNNEL_ROUTER_TARGETS   256
+
+struct mavtunnel_router_t;
+
+struct mavtunnel_router_port_t
+{
+    struct mavtunnel_codec_t   stage;
+    struct mavtunnel_router_t* router;
+    struct mavtunnel_writer_t  writer;
+    os_lock_t                  lock;
+
+    uint64_t rx_frames, tx_frames, tx_bytes, tx_errors;
+};
+
+/* where the targets of a message are, cached by the low byte of its id */
+struct mavtunnel_router_target_t
+{
+    bool     valid;
+    uint32_t msgid;
+    uint8_t  flags, system_ofs, component_ofs;
+};
+
+struct mavtunnel_router_t
+{
+    os_lock_t                        lock;
+    struct mavtunnel_router_port_t   ports[MAVTUNNEL_ROUTER_MAX_PORTS];
+    size_t                           n_ports;
+    /* port + 1 each (sysid, compid) was last heard on, 0 for none */
+    uint8_t                          routes[256 * 256];
+    /* ports each sysid was heard on, one bit per port */
+    uint8_t                          systems[256];
+    struct mavtunnel_router_target_t targets[MAVTUNNEL_ROUTER_TARGETS];
+
+    uint64_t broadcast, targeted, unroutable;
+};
+
+#if __cplusplus
+extern "C" {
+#endif
+
+void mavtunnel_router_init(struct mavtunnel_router_t* router);
+
+/**
+ * @param in  the port's tunnel, with the endpoint attached as its reader and
+ *            writer; the writer becomes the port's way out. Add the port
+ *            before attaching other decode stages to in, so that the router
+ *            sees what they decode.
+ * @return the port index
+ */
+size_t mavtunnel_router_add_port(
+    struct mavtunnel_router_t* router, struct mavtunnel_t* in);
+
+void mavtunnel_router_print_stats(const struct mavtunnel_router_t* router);
+
+#if __cplusplus
+};
+#endif
+
+#endif /* !_MAVTUNNEL_ROUTER_H_ */
@@ -16,6 +16,7 @@ enum mavtunnel_error_t
     MERR_BAD_STATE,
     MERR_BAD_PROTOCOL,
     MERR_BAD_ID,
+    MERR_PENDING,
 };
 
 #define MAVTUNNEL_OUTPUT_BUFFER_SIZE 1024
@@ -24,10 +25,16 @@ struct mavtunnel_reader_t;
 
 typedef ssize_t (*read_t)(struct mavtunnel_reader_t* ctx, uint8_t* bytes, size_t len);
 
+/**
+ * timeout_ms bounds how long read() may block (-1: forever). The tunnel sets
+ * it from the deadlines of its stages, so that they get ticked while the link
+ * is idle. A read that times out returns 0.
+ */
 struct mavtunnel_reader_t
 {
     void * object;
     read_t read;
+    int    timeout_ms;
 };
 
 struct mavtunnel_writer_t;
@@ -45,12 +52,63 @@ struct mavtunnel_codec_t;
 typedef enum mavtunnel_error_t (*encode_t)(
     struct mavtunnel_codec_t* ctx, mavlink_message_t* msg);
 
+/**
+ * @return time_us() at which the stage wants its next tick, 0 for none
+ */
+typedef uint64_t (*tick_t)(struct mavtunnel_codec_t* ctx, uint64_t now_us);
+
+enum mavtunnel_codec_dir_t
+{
+    MT_CODEC_ENCODE,
+    MT_CODEC_DECODE,
+};
+
 struct mavtunnel_codec_t
 {
     void * object;
     encode_t encode;
+    enum mavtunnel_codec_dir_t dir;
+    tick_t tick;
+    struct mavtunnel_t * tunnel;
 };
 
+/**
+ * Extra codec stages run around the tunnel codec: encode stages before it in
+ * attach order, decode stages after it in reverse attach order. Both ends
+ * attach the same stages in the same order, with opposite directions.
+ *
+ * A stage that returns MERR_PENDING keeps the message; it may later pass
+ * messages of its own down the rest of the pipeline with
+ * mavtunnel_stage_emit(), from encode() or from its optional tick(), which
+ * runs after every read.
+ */
+#define MAVTUNNEL_MAX_STAGES 8
+
+/**
+ * compat_flags bits owned by the tunnel. A stage sets them on a frame whose
+ * payload the peer tunnel has to restore; they are cleared before the frame
+ * leaves the tunnel. MAVLink2 ignores compat flags it does not understand.
+ */
+#define MAVTUNNEL_CFLAG_COMPRESSED 0x80
+#define MAVTUNNEL_CFLAG_DELTA      0x40
+#define MAVTUNNEL_CFLAG_AGGREGATE  0x20
+#define MAVTUNNEL_CFLAG_COMPACT    0x10
+#define MAVTUNNEL_CFLAG_FEC        0x08
+#define MAVTUNNEL_CFLAG_ARQ        0x04
+#define MAVTUNNEL_CFLAG_ACK        0x02
+#define MAVTUNNEL_CFLAG_BOND       0x01
+#define MAVTUNNEL_CFLAGS                                                       \
+    (MAVTUNNEL_CFLAG_COMPRESSED | MAVTUNNEL_CFLAG_DELTA                        \
+        | MAVTUNNEL_CFLAG_AGGREGATE | MAVTUNNEL_CFLAG_COMPACT                  \
+        | MAVTUNNEL_CFLAG_FEC | MAVTUNNEL_CFLAG_ARQ | MAVTUNNEL_CFLAG_ACK      \
+        | MAVTUNNEL_CFLAG_BOND)
+
+/**
+ * A frame packed into the payload of another one, e.g. a super-frame:
+ *   [len][seq][sysid][compid][msgid: 3 bytes LE][compat flags][payload]
+ */
+#define MAVTUNNEL_FRAME_HEADER_LEN 8
+
 enum mavtunnel_status_t
 {
     MT_STATUS_UNINITIALIZED,
@@ -82,6 +140,8 @@ struct mavtunnel_t
     struct mavtunnel_reader_t  reader;
     struct mavtunnel_writer_t  writer;
     struct mavtunnel_codec_t   codec;
+    struct mavtunnel_codec_t*  stages[MAVTUNNEL_MAX_STAGES];
+    size_t                     n_stages;
     uint8_t                    read_buffer[MAVTUNNEL_READ_BUFFER_SIZE];
     mavlink_message_t          rx_msg;
     mavlink_status_t           rx_status;
@@ -109,6 +169,25 @@ void mavtunnel_spin(struct mavtunnel_t* ctx);
 
 void mavtunnel_exit(struct mavtunnel_t * ctx);
 
+void mavtunnel_attach_stage(struct mavtunnel_t* ctx, struct mavtunnel_codec_t* stage);
+
+enum mavtunnel_error_t mavtunnel_stage_emit(
+    struct mavtunnel_codec_t* stage, mavlink_message_t* msg);
+
+enum mavtunnel_error_t mavtunnel_inject(
+    struct mavtunnel_t* ctx, mavlink_message_t* msg);
+
+size_t mavtunnel_serialize(uint8_t* buf, mavlink_message_t* msg);
+
+size_t mavtunnel_frame_pack(uint8_t* dst, const mavlink_message_t* msg);
+
+ssize_t mavtunnel_frame_unpack(
+    const uint8_t* src, size_t len, mavlink_message_t* msg);
+
+bool mavtunnel_trailer_push(mavlink_message_t* msg, const uint8_t* bytes, size_t n);
+
+bool mavtunnel_trailer_pop(mavlink_message_t* msg, uint8_t* bytes, size_t n);
+
 /**
  * Aux
  */
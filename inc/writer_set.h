@@ -0,0 +1,52 @@
+#ifndef _MAVTUNNEL_WRITER_SET_H_
+#define _MAVTUNNEL_WRITER_SET_H_
+
+#include "os.h"
+#include "tunnel.h"
+
+/**
+ * Fan-out of one tunnel to several subscribers, e.g. ground stations that
+ * watch the same vehicle. The set is the tunnel's writer: a frame is encoded
+ * and encrypted once and the same bytes are written to every member. A
+ * member that fails does not keep the others from getting the frame.
+ *
+ * Many UDP subscribers are best one member, an endpoint_linux_udp_fanout_t,
+ * which reaches all of them with a single sendmmsg().
+ *
+ * Members are added before the tunnel spins.
+ */
+#define MAVTUNNEL_WRITER_SET_MAX 16
+
+struct mavtunnel_writer_set_member_t
+{
+    struct mavtunnel_writer_t writer;
+    uint64_t                  frames, errors;
+};
+
+struct mavtunnel_writer_set_t
+{
+    struct mavtunnel_writer_set_member_t members[MAVTUNNEL_WRITER_SET_MAX];
+    size_t                               n_members;
+    uint64_t                             frames, bytes;
+};
+
+#if __cplusplus
+extern "C" {
+#endif
+
+void mavtunnel_writer_set_init(struct mavtunnel_writer_set_t* set);
+
+/**
+ * @return the member index
+ */
+size_t mavtunnel_writer_set_add(
+    struct mavtunnel_writer_set_t* set, const struct mavtunnel_writer_t* writer);
+
+void mavtunnel_writer_set_attach(
+    struct mavtunnel_t* tunnel, struct mavtunnel_writer_set_t* set);
+
+#if __cplusplus
+};
+#endif
+
+#endif /* !_MAVTUNNEL_WRITER_SET_H_ */
@@ -0,0 +1,141 @@
+#include "codec_aggregate.h"
+
+enum mavtunnel_error_t
+codec_aggregate_flush(struct codec_aggregate_t* agg)
+{
+    ASSERT(agg != NULL);
+
+    enum mavtunnel_error_t err = MERR_OK;
+    if (agg->count == 1)
+    {
+        /* a lone frame is cheaper as it is */
+        mavtunnel_frame_unpack((const uint8_t*)_MAV_PAYLOAD(&agg->carrier),
+            agg->carrier.len, &agg->msg);
+        err = mavtunnel_stage_emit(&agg->stage, &agg->msg);
+    }
+    else if (agg->count > 1)
+    {
+        agg->carrier.magic          = MAVLINK_STX;
+        agg->carrier.msgid          = CODEC_AGGREGATE_MSGID;
+        agg->carrier.incompat_flags = 0;
+        agg->carrier.compat_flags   = MAVTUNNEL_CFLAG_AGGREGATE;
+        agg->carrier.seq            = agg->seq++;
+        agg->superframes++;
+        err = mavtunnel_stage_emit(&agg->stage, &agg->carrier);
+    }
+
+    agg->count       = 0;
+    agg->carrier.len = 0;
+    return err;
+}
+
+static enum mavtunnel_error_t
+codec_aggregate_encode(struct mavtunnel_codec_t* codec, mavlink_message_t* msg)
+{
+    struct codec_aggregate_t* agg  = (struct codec_aggregate_t*)codec->object;
+    size_t                    need = CODEC_AGGREGATE_SUBHEADER_LEN + msg->len;
+
+    if (need > agg->budget)
+    {
+        /* never fits: send it on its own, after the frames before it */
+        codec_aggregate_flush(agg);
+        return MERR_OK;
+    }
+    if (agg->carrier.len + need > agg->budget)
+    {
+        codec_aggregate_flush(agg);
+    }
+
+    if (agg->count == 0)
+    {
+        agg->first_us       = time_us();
+        agg->carrier.sysid  = msg->sysid;
+        agg->carrier.compid = msg->compid;
+    }
+    agg->carrier.len += mavtunnel_frame_pack(
+        (uint8_t*)_MAV_PAYLOAD_NON_CONST(&agg->carrier) + agg->carrier.len, msg);
+    agg->count++;
+    agg->frames++;
+    return MERR_PENDING;
+}
+
+static uint64_t
+codec_aggregate_tick(struct mavtunnel_codec_t* codec, uint64_t now_us)
+{
+    struct codec_aggregate_t* agg = (struct codec_aggregate_t*)codec->object;
+    if (agg->count == 0)
+    {
+        return 0;
+    }
+
+    if (now_us >= agg->first_us + agg->deadline_us)
+    {
+        codec_aggregate_flush(agg);
+        return 0;
+    }
+    return agg->first_us + agg->deadline_us;
+}
+
+static enum mavtunnel_error_t
+codec_aggregate_decode(struct mavtunnel_codec_t* codec, mavlink_message_t* msg)
+{
+    struct codec_aggregate_t* agg = (struct codec_aggregate_t*)codec->object;
+
+    if (!(msg->compat_flags & MAVTUNNEL_CFLAG_AGGREGATE))
+    {
+        return MERR_OK;
+    }
+    if (msg->msgid != CODEC_AGGREGATE_MSGID)
+    {
+        return MERR_BAD_PROTOCOL;
+    }
+
+    const uint8_t* payload = (const uint8_t*)_MAV_PAYLOAD(msg);
+    size_t         ip      = 0;
+    agg->superframes++;
+    while (ip < msg->len)
+    {
+        ssize_t n = mavtunnel_frame_unpack(payload + ip, msg->len - ip, &agg->msg);
+        if (n < 0)
+        {
+            return (enum mavtunnel_error_t)-n;
+        }
+        ip += n;
+        agg->frames++;
+        mavtunnel_stage_emit(&agg->stage, &agg->msg);
+    }
+    return MERR_PENDING;
+}
+
+void
+codec_aggregate_attach(struct mavtunnel_t* ctx, struct codec_aggregate_t* agg,
+    enum mavtunnel_codec_dir_t dir, uint64_t deadline_us, size_t budget)
+{
+    ASSERT(ctx != NULL && agg != NULL);
+
+    budget = budget == 0 ? MAVLINK_MAX_PAYLOAD_LEN : budget;
+    ASSERT(budget > CODEC_AGGREGATE_SUBHEADER_LEN
+        && budget <= MAVLINK_MAX_PAYLOAD_LEN);
+
+    agg->deadline_us = deadline_us;
+    agg->budget      = budget;
+    agg->count       = 0;
+    agg->seq         = 0;
+    agg->frames      = 0;
+    agg->superframes = 0;
+    memset(&agg->carrier, 0, sizeof(agg->carrier));
+
+    agg->stage.object = agg;
+    agg->stage.dir    = dir;
+    if (dir == MT_CODEC_ENCODE)
+    {
+        agg->stage.encode = codec_aggregate_encode;
+        agg->stage.tick   = codec_aggregate_tick;
+    }
+    else
+    {
+        agg->stage.encode = codec_aggregate_decode;
+        agg->stage.tick   = NULL;
+    }
+    mavtunnel_attach_stage(ctx, &agg->stage);
+}
@@ -0,0 +1,421 @@
+#include "codec_arq.h"
+
+static bool
+arq_reliable(const struct codec_arq_t* arq, uint32_t msgid)
+{
+    for (size_t i = 0; i < arq->n_msgids; i++)
+    {
+        if (arq->msgids[i] == msgid)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint64_t
+arq_backoff(const struct codec_arq_t* arq, uint8_t retries)
+{
+    uint64_t rto = arq->rto_us << retries;
+    return rto < CODEC_ARQ_RTO_MAX_US ? rto : CODEC_ARQ_RTO_MAX_US;
+}
+
+/* RFC 6298, with samples from frames acknowledged on the first send */
+static void
+arq_rtt_sample(struct codec_arq_t* arq, uint64_t rtt_us)
+{
+    if (arq->srtt_us == 0)
+    {
+        arq->srtt_us   = rtt_us;
+        arq->rttvar_us = rtt_us / 2;
+    }
+    else
+    {
+        uint64_t err   = arq->srtt_us > rtt_us ? arq->srtt_us - rtt_us
+                                               : rtt_us - arq->srtt_us;
+        arq->rttvar_us = (3 * arq->rttvar_us + err) / 4;
+        arq->srtt_us   = (7 * arq->srtt_us + rtt_us) / 8;
+    }
+
+    arq->rto_us = arq->srtt_us + 4 * arq->rttvar_us;
+    arq->rto_us = arq->rto_us < CODEC_ARQ_RTO_MIN_US ? CODEC_ARQ_RTO_MIN_US
+                                                     : arq->rto_us;
+}
+
+/**
+ * Acknowledge the frames in flight that the peer has, and schedule those it
+ * skipped for a resend one RTT after they went out.
+ */
+static void
+arq_on_ack(struct codec_arq_t* arq, uint8_t next, uint32_t bitmap, uint64_t now)
+{
+    int8_t last = -1;
+    for (int b = 31; b >= 0; b--)
+    {
+        if (bitmap & (1u << b))
+        {
+            last = (int8_t)(b + 1);
+            break;
+        }
+    }
+
+    for (size_t i = 0; i < CODEC_ARQ_WINDOW; i++)
+    {
+        struct codec_arq_slot_t* slot = &arq->window[i];
+        if (!slot->in_use)
+        {
+            continue;
+        }
+
+        int8_t d = (int8_t)(slot->seq - next);
+        if (d < 0 || (d >= 1 && d <= 32 && (bitmap & (1u << (d - 1)))))
+        {
+            if (slot->retries == 0)
+            {
+                arq_rtt_sample(arq, now - slot->sent_us);
+            }
+            slot->in_use = false;
+            arq->acked++;
+        }
+        else if (d < last && arq->srtt_us != 0
+            && slot->sent_us + arq->srtt_us < slot->due_us)
+        {
+            slot->due_us = slot->sent_us + arq->srtt_us;
+        }
+    }
+}
+
+/* move past rx_next, and past the frames after it that are already here */
+static void
+arq_advance(struct codec_arq_t* arq)
+{
+    arq->rx_next++;
+    while (arq->rx_bitmap & 1)
+    {
+        arq->rx_bitmap >>= 1;
+        arq->rx_next++;
+    }
+    arq->rx_bitmap >>= 1;
+}
+
+/**
+ * @return false if seq was delivered before
+ */
+static bool
+arq_on_frame(struct codec_arq_t* arq, uint16_t session, uint8_t base,
+    uint8_t seq, uint64_t now)
+{
+    bool fresh = true;
+
+    /* the peer restarted, or we did */
+    if (!arq->rx_synced || session != arq->rx_session)
+    {
+        arq->rx_synced  = true;
+        arq->rx_session = session;
+        arq->rx_next    = base;
+        arq->rx_bitmap  = 0;
+    }
+
+    /* the sender has no more of the frames that hold rx_next back */
+    while ((int8_t)(base - arq->rx_next) > 0)
+    {
+        arq_advance(arq);
+    }
+
+    int8_t d = (int8_t)(seq - arq->rx_next);
+    if (d < 0)
+    {
+        fresh = false;
+    }
+    else if (d == 0)
+    {
+        arq_advance(arq);
+    }
+    else if (arq->rx_bitmap & (1u << (d - 1)))
+    {
+        fresh = false;
+    }
+    else
+    {
+        arq->rx_bitmap |= 1u << (d - 1);
+    }
+
+    if (!arq->ack_pending)
+    {
+        arq->ack_pending = true;
+        arq->ack_due_us  = now + arq->ack_delay_us;
+    }
+    arq->last_rx_us = now;
+    return fresh;
+}
+
+/* the oldest seq in flight, before the one about to be sent */
+static uint8_t
+arq_base(const struct codec_arq_t* arq)
+{
+    uint8_t base = arq->next_seq;
+    for (size_t i = 0; i < CODEC_ARQ_WINDOW; i++)
+    {
+        const struct codec_arq_slot_t* slot = &arq->window[i];
+        if (slot->in_use && (int8_t)(slot->seq - base) < 0)
+        {
+            base = slot->seq;
+        }
+    }
+    return base;
+}
+
+static void
+arq_piggyback(struct codec_arq_t* arq, mavlink_message_t* msg)
+{
+    os_lock(&arq->lock);
+    if (arq->ack_pending && msg->len + CODEC_ARQ_ACK_LEN <= MAVLINK_MAX_PAYLOAD_LEN)
+    {
+        uint8_t ack[CODEC_ARQ_ACK_LEN] = {arq->rx_session & 0xFF,
+            arq->rx_session >> 8, arq->rx_next, arq->rx_bitmap & 0xFF,
+            (arq->rx_bitmap >> 8) & 0xFF, (arq->rx_bitmap >> 16) & 0xFF,
+            (arq->rx_bitmap >> 24) & 0xFF};
+        mavtunnel_trailer_push(msg, ack, sizeof(ack));
+        msg->compat_flags |= MAVTUNNEL_CFLAG_ACK;
+        arq->ack_pending = false;
+        arq->acks++;
+    }
+    os_unlock(&arq->lock);
+}
+
+static enum mavtunnel_error_t
+codec_arq_encode(struct mavtunnel_codec_t* codec, mavlink_message_t* msg)
+{
+    struct codec_arq_t* arq = (struct codec_arq_t*)codec->object;
+
+    if (arq_reliable(arq, msg->msgid)
+        && msg->len + CODEC_ARQ_SEQ_LEN <= MAVLINK_MAX_PAYLOAD_LEN)
+    {
+        os_lock(&arq->lock);
+        struct codec_arq_slot_t* slot
+            = &arq->window[arq->next_seq % CODEC_ARQ_WINDOW];
+        if (slot->in_use)
+        {
+            /* the window is full: best effort */
+            arq->overflow++;
+        }
+        else
+        {
+            uint8_t base = arq_base(arq);
+            uint8_t seq  = arq->next_seq++;
+            uint8_t trailer[CODEC_ARQ_SEQ_LEN]
+                = {arq->session & 0xFF, arq->session >> 8, base, seq};
+            mavtunnel_trailer_push(msg, trailer, sizeof(trailer));
+            msg->compat_flags |= MAVTUNNEL_CFLAG_ARQ;
+
+            slot->in_use  = true;
+            slot->seq     = seq;
+            slot->retries = 0;
+            slot->sent_us = time_us();
+            slot->due_us  = slot->sent_us + arq->rto_us;
+            slot->msg     = *msg;
+            arq->frames++;
+        }
+        os_unlock(&arq->lock);
+    }
+
+    arq_piggyback(arq, msg);
+    return MERR_OK;
+}
+
+/**
+ * Resend what is due, send a pending ACK nobody took along, and tell when
+ * to come back.
+ */
+static uint64_t
+codec_arq_tick(struct mavtunnel_codec_t* codec, uint64_t now_us)
+{
+    struct codec_arq_t* arq = (struct codec_arq_t*)codec->object;
+    uint64_t            due = 0;
+
+    for (size_t i = 0; i < CODEC_ARQ_WINDOW; i++)
+    {
+        struct codec_arq_slot_t* slot = &arq->window[i];
+        bool                     resend = false;
+
+        os_lock(&arq->lock);
+        if (slot->in_use && slot->due_us <= now_us)
+        {
+            if (slot->retries == CODEC_ARQ_MAX_RETRIES)
+            {
+                slot->in_use = false;
+                arq->expired++;
+            }
+            else
+            {
+                slot->retries++;
+                slot->sent_us = now_us;
+                slot->due_us  = now_us + arq_backoff(arq, slot->retries);
+                arq->msg      = slot->msg;
+                arq->retransmits++;
+                resend = true;
+            }
+        }
+        if (slot->in_use && (due == 0 || slot->due_us < due))
+        {
+            due = slot->due_us;
+        }
+        os_unlock(&arq->lock);
+
+        if (resend)
+        {
+            arq_piggyback(arq, &arq->msg);
+            mavtunnel_stage_emit(codec, &arq->msg);
+        }
+    }
+
+    os_lock(&arq->lock);
+    bool standalone = arq->ack_pending && arq->ack_due_us <= now_us;
+    bool linger     = now_us < arq->last_rx_us + CODEC_ARQ_LINGER_US;
+    uint64_t next   = arq->ack_pending ? arq->ack_due_us : now_us + arq->ack_delay_us;
+    os_unlock(&arq->lock);
+
+    if (standalone)
+    {
+        mavlink_message_t* msg = &arq->msg;
+        memset(msg, 0, sizeof(*msg));
+        msg->magic = MAVLINK_STX;
+        msg->msgid = CODEC_ARQ_MSGID;
+        msg->seq   = arq->ack_seq++;
+        arq_piggyback(arq, msg);
+        if (msg->compat_flags & MAVTUNNEL_CFLAG_ACK)
+        {
+            mavtunnel_stage_emit(codec, msg);
+        }
+        next = now_us + arq->ack_delay_us;
+    }
+
+    if (linger && (due == 0 || next < due))
+    {
+        due = next > now_us ? next : now_us + 1;
+    }
+    return due;
+}
+
+static enum mavtunnel_error_t
+codec_arq_decode(struct mavtunnel_codec_t* codec, mavlink_message_t* msg)
+{
+    struct codec_arq_t* arq = (struct codec_arq_t*)codec->object;
+    uint64_t            now = 0;
+
+    if (msg->compat_flags & MAVTUNNEL_CFLAG_ACK)
+    {
+        uint8_t ack[CODEC_ARQ_ACK_LEN];
+        if (!mavtunnel_trailer_pop(msg, ack, sizeof(ack)))
+        {
+            return MERR_BAD_LENGTH;
+        }
+        msg->compat_flags &= ~MAVTUNNEL_CFLAG_ACK;
+
+        now = time_us();
+        os_lock(&arq->lock);
+        /* an ACK of our previous life says nothing of this one */
+        if ((ack[0] | (ack[1] << 8)) == arq->session)
+        {
+            arq_on_ack(arq, ack[2],
+                ack[3] | (ack[4] << 8) | (ack[5] << 16) | ((uint32_t)ack[6] << 24),
+                now);
+        }
+        os_unlock(&arq->lock);
+
+        if (msg->len == 0 && msg->msgid == CODEC_ARQ_MSGID)
+        {
+            return MERR_PENDING;
+        }
+    }
+
+    if (msg->compat_flags & MAVTUNNEL_CFLAG_ARQ)
+    {
+        uint8_t trailer[CODEC_ARQ_SEQ_LEN];
+        if (!mavtunnel_trailer_pop(msg, trailer, sizeof(trailer)))
+        {
+            return MERR_BAD_LENGTH;
+        }
+        msg->compat_flags &= ~MAVTUNNEL_CFLAG_ARQ;
+
+        now = now ? now : time_us();
+        os_lock(&arq->lock);
+        bool fresh = arq_on_frame(
+            arq, trailer[0] | (trailer[1] << 8), trailer[2], trailer[3], now);
+        if (fresh)
+        {
+            arq->delivered++;
+        }
+        else
+        {
+            arq->duplicates++;
+        }
+        os_unlock(&arq->lock);
+
+        if (!fresh)
+        {
+            return MERR_PENDING;
+        }
+    }
+    return MERR_OK;
+}
+
+void
+codec_arq_attach(struct mavtunnel_t* out, struct mavtunnel_t* in,
+    struct codec_arq_t* arq, const uint32_t* msgids, size_t n_msgids)
+{
+    static const uint32_t defaults[] = {CODEC_ARQ_DEFAULT_MSGIDS};
+
+    ASSERT(out != NULL && in != NULL && arq != NULL);
+    if (msgids == NULL)
+    {
+        msgids   = defaults;
+        n_msgids = sizeof(defaults) / sizeof(defaults[0]);
+    }
+    ASSERT(n_msgids <= CODEC_ARQ_MAX_MSGIDS);
+
+    os_lock_init(&arq->lock);
+    memcpy(arq->msgids, msgids, n_msgids * sizeof(uint32_t));
+    arq->n_msgids = n_msgids;
+
+    /* tells this attach from the ones before it, to the peer */
+    uint64_t seed = clock_ns() ^ (uintptr_t)arq;
+    seed          = (seed ^ (seed >> 33)) * 0xff51afd7ed558ccdull;
+    seed ^= seed >> 33;
+
+    memset(arq->window, 0, sizeof(arq->window));
+    arq->session      = (uint16_t)seed;
+    arq->next_seq     = 0;
+    arq->ack_seq      = 0;
+    arq->srtt_us      = 0;
+    arq->rttvar_us    = 0;
+    arq->rto_us       = CODEC_ARQ_RTO_INIT_US;
+    arq->rx_synced    = false;
+    arq->rx_session   = 0;
+    arq->rx_next      = 0;
+    arq->rx_bitmap    = 0;
+    arq->ack_pending  = false;
+    arq->ack_due_us   = 0;
+    arq->last_rx_us   = 0;
+    arq->ack_delay_us = CODEC_ARQ_ACK_DELAY_US;
+    arq->frames       = 0;
+    arq->retransmits  = 0;
+    arq->acked        = 0;
+    arq->expired      = 0;
+    arq->overflow     = 0;
+    arq->delivered    = 0;
+    arq->duplicates   = 0;
+    arq->acks         = 0;
+
+    arq->tx.object = arq;
+    arq->tx.dir    = MT_CODEC_ENCODE;
+    arq->tx.encode = codec_arq_encode;
+    arq->tx.tick   = codec_arq_tick;
+    mavtunnel_attach_stage(out, &arq->tx);
+
+    arq->rx.object = arq;
+    arq->rx.dir    = MT_CODEC_DECODE;
+    arq->rx.encode = codec_arq_decode;
+    arq->rx.tick   = NULL;
+    mavtunnel_attach_stage(in, &arq->rx);
+}
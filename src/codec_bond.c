@@ -0,0 +1,267 @@
+#include "codec_bond.h"
+
+static bool
+bond_critical(const struct codec_bond_t* bond, uint32_t msgid)
+{
+    if (bond->n_msgids == 0)
+    {
+        return true;
+    }
+    for (size_t i = 0; i < bond->n_msgids; i++)
+    {
+        if (bond->msgids[i] == msgid)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static enum mavtunnel_error_t
+codec_bond_encode(struct mavtunnel_codec_t* codec, mavlink_message_t* msg)
+{
+    struct codec_bond_t* bond = (struct codec_bond_t*)codec->object;
+
+    if (bond_critical(bond, msg->msgid)
+        && msg->len + CODEC_BOND_TRAILER_LEN <= MAVLINK_MAX_PAYLOAD_LEN)
+    {
+        uint8_t trailer[] = {bond->session & 0xFF, bond->session >> 8,
+            bond->next_seq & 0xFF, bond->next_seq >> 8};
+        mavtunnel_trailer_push(msg, trailer, sizeof(trailer));
+        msg->compat_flags |= MAVTUNNEL_CFLAG_BOND;
+        bond->next_seq++;
+        bond->bonded++;
+    }
+    return MERR_OK;
+}
+
+static enum mavtunnel_error_t
+bond_path_write(struct codec_bond_path_t* path, const uint8_t* bytes, size_t len)
+{
+    enum mavtunnel_error_t err = path->writer.write(&path->writer, bytes, len);
+    if (err == MERR_OK)
+    {
+        path->tx_frames++;
+        path->tx_bytes += len;
+    }
+    else
+    {
+        path->tx_errors++;
+    }
+    return err;
+}
+
+/**
+ * Bonded frames go out on every path, the others on the first live path that
+ * takes them, or else on all the paths that are not live. Either way the
+ * write fails only if no path took it.
+ */
+static enum mavtunnel_error_t
+codec_bond_write(struct mavtunnel_writer_t* wr, const uint8_t* bytes, size_t len)
+{
+    struct codec_bond_t*   bond   = (struct codec_bond_t*)wr->object;
+    bool                   bonded = len > 3 && bytes[0] == MAVLINK_STX
+        && (bytes[3] & MAVTUNNEL_CFLAG_BOND);
+    enum mavtunnel_error_t err    = MERR_DEVICE_ERROR;
+    bool                   sent   = false;
+    bool                   live[CODEC_BOND_MAX_PATHS];
+    bool                   heard  = false;
+    uint64_t               now    = time_us();
+
+    for (size_t i = 0; i < bond->n_paths; i++)
+    {
+        uint64_t last = atomic_load_explicit(
+            &bond->paths[i].last_rx_us, memory_order_relaxed);
+        live[i] = last != 0 && now < last + CODEC_BOND_LIVE_US;
+        heard   = heard || last != 0;
+    }
+
+    for (size_t i = 0; i < bond->n_paths && (bonded || !sent); i++)
+    {
+        if (bonded || live[i] || !heard)
+        {
+            err  = bond_path_write(&bond->paths[i], bytes, len);
+            sent = sent || err == MERR_OK;
+        }
+    }
+    /* no live path took it: the peer may still hear us on the others */
+    bool others = !bonded && !sent && heard;
+    for (size_t i = 0; i < bond->n_paths && others; i++)
+    {
+        if (!live[i])
+        {
+            err  = bond_path_write(&bond->paths[i], bytes, len);
+            sent = sent || err == MERR_OK;
+        }
+    }
+    return sent ? MERR_OK : err;
+}
+
+/**
+ * @return false if a copy of the frame came first on another path, or it is
+ *         too old to tell
+ */
+static bool
+bond_first(struct codec_bond_path_t* path, uint16_t session, uint16_t seq, uint64_t now)
+{
+    struct codec_bond_t* bond  = path->bond;
+    bool                 first = true;
+
+    os_lock(&bond->lock);
+    if (bond->rx_synced && session != bond->rx_session && bond->rx_restarted
+        && session == bond->rx_old_session)
+    {
+        /* a slower path still has frames of the sender's previous life */
+        bond->late++;
+        os_unlock(&bond->lock);
+        return false;
+    }
+    if (!bond->rx_synced || session != bond->rx_session)
+    {
+        if (bond->rx_synced)
+        {
+            bond->rx_restarted   = true;
+            bond->rx_old_session = bond->rx_session;
+            bond->restarts++;
+        }
+        bond->rx_synced  = true;
+        bond->rx_session = session;
+        memset(bond->window, 0, sizeof(bond->window));
+    }
+
+    struct codec_bond_slot_t* slot = &bond->window[seq % CODEC_BOND_WINDOW];
+    if (slot->valid && slot->seq == seq)
+    {
+        uint64_t lag = now - slot->first_us;
+        path->duplicates++;
+        path->lag_us_total += lag;
+        path->lag_us_max = lag > path->lag_us_max ? lag : path->lag_us_max;
+        first = false;
+    }
+    else if (slot->valid && (int16_t)(seq - slot->seq) < 0)
+    {
+        bond->late++;
+        first = false;
+    }
+    else
+    {
+        slot->valid    = true;
+        slot->seq      = seq;
+        slot->first_us = now;
+        path->wins++;
+    }
+    os_unlock(&bond->lock);
+    return first;
+}
+
+static enum mavtunnel_error_t
+codec_bond_decode(struct mavtunnel_codec_t* codec, mavlink_message_t* msg)
+{
+    struct codec_bond_path_t* path = (struct codec_bond_path_t*)codec->object;
+    struct codec_bond_t*      bond = path->bond;
+
+    path->rx_frames++;
+    atomic_store_explicit(&path->last_rx_us, time_us(), memory_order_relaxed);
+    if (msg->compat_flags & MAVTUNNEL_CFLAG_BOND)
+    {
+        uint8_t trailer[CODEC_BOND_TRAILER_LEN];
+        if (!mavtunnel_trailer_pop(msg, trailer, sizeof(trailer)))
+        {
+            return MERR_BAD_LENGTH;
+        }
+        msg->compat_flags &= ~MAVTUNNEL_CFLAG_BOND;
+
+        if (!bond_first(path, trailer[0] | (trailer[1] << 8),
+                trailer[2] | (trailer[3] << 8), time_us()))
+        {
+            return MERR_PENDING;
+        }
+    }
+
+    /* the paths run in their own threads, the merged tunnel in none */
+    os_lock(&bond->lock);
+    mavtunnel_inject(bond->merged, msg);
+    os_unlock(&bond->lock);
+    return MERR_PENDING;
+}
+
+size_t
+codec_bond_add_path(struct codec_bond_t* bond, struct mavtunnel_t* in)
+{
+    ASSERT(bond != NULL && in != NULL);
+    ASSERT(bond->n_paths < CODEC_BOND_MAX_PATHS);
+    ASSERT(in->writer.write != NULL);
+
+    size_t                    index = bond->n_paths++;
+    struct codec_bond_path_t* path  = &bond->paths[index];
+    memset(path, 0, sizeof(*path));
+    path->bond   = bond;
+    path->writer = in->writer;
+
+    path->stage.object = path;
+    path->stage.dir    = MT_CODEC_DECODE;
+    path->stage.encode = codec_bond_decode;
+    path->stage.tick   = NULL;
+    mavtunnel_attach_stage(in, &path->stage);
+    return index;
+}
+
+void
+codec_bond_attach(struct mavtunnel_t* out, struct mavtunnel_t* merged,
+    struct codec_bond_t* bond, const uint32_t* msgids, size_t n_msgids)
+{
+    ASSERT(out != NULL && merged != NULL && bond != NULL);
+    ASSERT(n_msgids <= CODEC_BOND_MAX_MSGIDS);
+
+    os_lock_init(&bond->lock);
+    bond->merged   = merged;
+    bond->n_msgids = msgids == NULL ? 0 : n_msgids;
+    if (msgids != NULL)
+    {
+        memcpy(bond->msgids, msgids, n_msgids * sizeof(uint32_t));
+    }
+    /* tells this attach from the ones before it, to the peer */
+    uint64_t seed = clock_ns() ^ (uintptr_t)bond;
+    seed          = (seed ^ (seed >> 33)) * 0xff51afd7ed558ccdull;
+    seed ^= seed >> 33;
+
+    bond->n_paths      = 0;
+    bond->session      = (uint16_t)seed;
+    bond->next_seq     = 0;
+    bond->rx_synced    = false;
+    bond->rx_restarted = false;
+    bond->bonded       = 0;
+    bond->late         = 0;
+    bond->restarts     = 0;
+    memset(bond->window, 0, sizeof(bond->window));
+
+    bond->tx.object = bond;
+    bond->tx.dir    = MT_CODEC_ENCODE;
+    bond->tx.encode = codec_bond_encode;
+    bond->tx.tick   = NULL;
+    mavtunnel_attach_stage(out, &bond->tx);
+
+    out->writer.object = bond;
+    out->writer.write  = codec_bond_write;
+}
+
+void
+codec_bond_print_stats(const struct codec_bond_t* bond)
+{
+    ASSERT(bond != NULL);
+
+    INFO("bond: %lu bonded, %lu late, %lu restarts\n", bond->bonded, bond->late,
+        bond->restarts);
+    for (size_t i = 0; i < bond->n_paths; i++)
+    {
+        const struct codec_bond_path_t* path = &bond->paths[i];
+        uint64_t copies = path->wins + path->duplicates;
+        printf("\tpath %zu: tx %lu (%lu B, %lu errors), rx %lu, "
+               "won %lu/%lu (%3lu%%), lag avg %lu us max %lu us\n",
+            i, path->tx_frames, path->tx_bytes, path->tx_errors,
+            path->rx_frames, path->wins, copies,
+            copies ? path->wins * 100 / copies : 0,
+            path->duplicates ? path->lag_us_total / path->duplicates : 0,
+            path->lag_us_max);
+    }
+}
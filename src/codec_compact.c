@@ -0,0 +1,223 @@
+#include "codec_compact.h"
+#include "codec_aggregate.h"
+
+static uint8_t
+compact_id(uint8_t sysid, uint8_t compid, uint32_t msgid)
+{
+    uint32_t h = (msgid * 2654435761u) ^ (sysid << 8) ^ compid;
+    return h % CODEC_COMPACT_INLINE;
+}
+
+static enum mavtunnel_error_t
+codec_compact_encode(struct mavtunnel_codec_t* codec, mavlink_message_t* msg)
+{
+    struct codec_compact_t* compact = (struct codec_compact_t*)codec->object;
+    const uint8_t*          src     = (const uint8_t*)_MAV_PAYLOAD(msg);
+    uint8_t*                dst     = compact->buffer;
+    size_t                  len     = msg->len;
+    size_t                  ip = 0, op = 0, frames = 0;
+    uint8_t                 prev_seq = 0;
+    struct codec_compact_context_t saved[CODEC_COMPACT_CONTEXTS];
+
+    if (!(msg->compat_flags & MAVTUNNEL_CFLAG_AGGREGATE))
+    {
+        return MERR_OK;
+    }
+
+    memcpy(saved, compact->contexts, sizeof(saved));
+    while (ip < len)
+    {
+        const uint8_t* sub = src + ip;
+        if (len - ip < CODEC_AGGREGATE_SUBHEADER_LEN
+            || len - ip - CODEC_AGGREGATE_SUBHEADER_LEN < sub[0])
+        {
+            return MERR_BAD_LENGTH;
+        }
+
+        uint8_t  plen   = sub[0];
+        uint8_t  seq    = sub[1];
+        uint32_t msgid  = sub[4] | (sub[5] << 8) | ((uint32_t)sub[6] << 16);
+        uint8_t  cflags = sub[7];
+        uint8_t  id     = compact_id(sub[2], sub[3], msgid);
+        struct codec_compact_context_t* context = &compact->contexts[id];
+
+        /* taken by another stream, which keeps it */
+        bool taken = context->valid
+            && (context->sysid != sub[2] || context->compid != sub[3] || context->msgid != msgid);
+        if (taken)
+        {
+            id = CODEC_COMPACT_INLINE;
+        }
+        bool define = taken || !context->valid || context->uses + 1 >= CODEC_COMPACT_REFRESH;
+        bool explicit_seq = frames == 0 || seq != (uint8_t)(prev_seq + 1);
+
+        size_t need = 1 + (define ? 5 : 0) + (explicit_seq ? 1 : 0)
+            + (cflags ? 1 : 0) + 1 + plen;
+        if (op + need >= len)
+        {
+            /* no gain; the definitions made so far were never sent */
+            memcpy(compact->contexts, saved, sizeof(saved));
+            compact->bytes_in += len;
+            compact->bytes_out += len;
+            return MERR_OK;
+        }
+
+        dst[op++] = id | (define ? CODEC_COMPACT_DEFINE : 0)
+            | (explicit_seq ? CODEC_COMPACT_SEQ : 0)
+            | (cflags ? CODEC_COMPACT_CFLAGS : 0);
+        if (define)
+        {
+            memcpy(dst + op, sub + 2, 5);
+            op += 5;
+            compact->defines++;
+        }
+        if (define && !taken)
+        {
+            context->valid  = true;
+            context->sysid  = sub[2];
+            context->compid = sub[3];
+            context->msgid  = msgid;
+            context->uses   = 0;
+        }
+        else if (!define)
+        {
+            context->uses++;
+        }
+        if (explicit_seq)
+        {
+            dst[op++] = seq;
+        }
+        if (cflags)
+        {
+            dst[op++] = cflags;
+        }
+        dst[op++] = plen;
+        memcpy(dst + op, sub + CODEC_AGGREGATE_SUBHEADER_LEN, plen);
+        op += plen;
+
+        prev_seq = seq;
+        ip += CODEC_AGGREGATE_SUBHEADER_LEN + plen;
+        frames++;
+    }
+
+    memcpy(_MAV_PAYLOAD_NON_CONST(msg), dst, op);
+    msg->len = (uint8_t)op;
+    msg->compat_flags |= MAVTUNNEL_CFLAG_COMPACT;
+
+    compact->frames += frames;
+    compact->bytes_in += len;
+    compact->bytes_out += op;
+    return MERR_OK;
+}
+
+static enum mavtunnel_error_t
+codec_compact_decode(struct mavtunnel_codec_t* codec, mavlink_message_t* msg)
+{
+    struct codec_compact_t* compact = (struct codec_compact_t*)codec->object;
+    const uint8_t*          src     = (const uint8_t*)_MAV_PAYLOAD(msg);
+    uint8_t*                dst     = compact->buffer;
+    size_t                  len     = msg->len;
+    size_t                  ip = 0, op = 0, frames = 0;
+    uint8_t                 seq = 0;
+
+    if (!(msg->compat_flags & MAVTUNNEL_CFLAG_AGGREGATE)
+        || !(msg->compat_flags & MAVTUNNEL_CFLAG_COMPACT))
+    {
+        return MERR_OK;
+    }
+
+    while (ip < len)
+    {
+        uint8_t hdr = src[ip++];
+        size_t  need = ((hdr & CODEC_COMPACT_DEFINE) ? 5 : 0)
+            + ((hdr & CODEC_COMPACT_SEQ) ? 1 : 0)
+            + ((hdr & CODEC_COMPACT_CFLAGS) ? 1 : 0) + 1;
+        if (len - ip < need || (frames == 0 && !(hdr & CODEC_COMPACT_SEQ)))
+        {
+            return MERR_BAD_MESSAGE;
+        }
+
+        /* an inline definition is good for its own frame only */
+        struct codec_compact_context_t  inline_context = {.valid = false};
+        struct codec_compact_context_t* context
+            = (hdr & CODEC_COMPACT_ID_MASK) == CODEC_COMPACT_INLINE
+            ? &inline_context
+            : &compact->contexts[hdr & CODEC_COMPACT_ID_MASK];
+        if (hdr & CODEC_COMPACT_DEFINE)
+        {
+            context->valid  = true;
+            context->sysid  = src[ip];
+            context->compid = src[ip + 1];
+            context->msgid  = src[ip + 2] | (src[ip + 3] << 8)
+                | ((uint32_t)src[ip + 4] << 16);
+            ip += 5;
+            compact->defines++;
+        }
+        seq             = (hdr & CODEC_COMPACT_SEQ) ? src[ip++] : seq + 1;
+        uint8_t cflags  = (hdr & CODEC_COMPACT_CFLAGS) ? src[ip++] : 0;
+        uint8_t plen    = src[ip++];
+        if (len - ip < plen)
+        {
+            return MERR_BAD_LENGTH;
+        }
+        frames++;
+
+        /* its definition was lost */
+        if (!context->valid)
+        {
+            compact->dropped++;
+            ip += plen;
+            continue;
+        }
+
+        if (op + CODEC_AGGREGATE_SUBHEADER_LEN + plen > MAVLINK_MAX_PAYLOAD_LEN)
+        {
+            return MERR_BAD_LENGTH;
+        }
+        dst[op++] = plen;
+        dst[op++] = seq;
+        dst[op++] = context->sysid;
+        dst[op++] = context->compid;
+        dst[op++] = context->msgid & 0xFF;
+        dst[op++] = (context->msgid >> 8) & 0xFF;
+        dst[op++] = (context->msgid >> 16) & 0xFF;
+        dst[op++] = cflags;
+        memcpy(dst + op, src + ip, plen);
+        op += plen;
+        ip += plen;
+    }
+
+    compact->frames += frames;
+    compact->bytes_in += op;
+    compact->bytes_out += len;
+    if (op == 0)
+    {
+        return MERR_BAD_STATE;
+    }
+
+    memcpy(_MAV_PAYLOAD_NON_CONST(msg), dst, op);
+    msg->len = (uint8_t)op;
+    msg->compat_flags &= ~MAVTUNNEL_CFLAG_COMPACT;
+    return MERR_OK;
+}
+
+void
+codec_compact_attach(struct mavtunnel_t* ctx, struct codec_compact_t* compact,
+    enum mavtunnel_codec_dir_t dir)
+{
+    ASSERT(ctx != NULL && compact != NULL);
+
+    memset(compact->contexts, 0, sizeof(compact->contexts));
+    compact->frames    = 0;
+    compact->defines   = 0;
+    compact->dropped   = 0;
+    compact->bytes_in  = 0;
+    compact->bytes_out = 0;
+
+    compact->stage.object = compact;
+    compact->stage.dir    = dir;
+    compact->stage.encode
+        = dir == MT_CODEC_ENCODE ? codec_compact_encode : codec_compact_decode;
+    compact->stage.tick = NULL;
+    mavtunnel_attach_stage(ctx, &compact->stage);
+}
@@ -0,0 +1,355 @@
+#include "codec_delta.h"
+
+/**
+ * Delta payload:
+ *   [base seq][length][check] then runs of
+ *   [unchanged bytes: varint][changed bytes: varint][changed bytes XOR base]
+ * until length is covered. Trailing unchanged bytes are omitted. The base
+ * seq is the source's 8-bit MAVLink seq, which a low-rate stream among
+ * busier ones of the same source can meet again on a stale base; the check,
+ * the CRC-16 of the payload folded to a byte, is what tells the decoder it
+ * rebuilt the payload the encoder had.
+ */
+#define DELTA_HEADER_LEN 3
+
+static inline uint8_t
+delta_check(const uint8_t* payload, size_t len)
+{
+    uint16_t crc = crc_calculate(payload, (uint16_t)len);
+    return (uint8_t)(crc ^ (crc >> 8));
+}
+
+static struct codec_delta_stream_t*
+delta_stream(struct codec_delta_t* delta, const mavlink_message_t* msg)
+{
+    uint32_t h = (msg->msgid * 2654435761u) ^ (msg->sysid << 8) ^ msg->compid;
+    return &delta->streams[h % CODEC_DELTA_STREAMS];
+}
+
+static bool
+delta_stream_match(
+    const struct codec_delta_stream_t* stream, const mavlink_message_t* msg)
+{
+    return stream->valid && stream->msgid == msg->msgid
+        && stream->sysid == msg->sysid && stream->compid == msg->compid;
+}
+
+static void
+delta_stream_store(struct codec_delta_stream_t* stream,
+    const mavlink_message_t* msg, const uint8_t* payload, bool keyframe)
+{
+    stream->valid  = true;
+    stream->sysid  = msg->sysid;
+    stream->compid = msg->compid;
+    stream->msgid  = msg->msgid;
+    stream->seq    = msg->seq;
+    stream->len    = msg->len;
+    memcpy(stream->payload, payload, msg->len);
+    memset(stream->payload + msg->len, 0, MAVLINK_MAX_PAYLOAD_LEN - msg->len);
+    stream->since_keyframe = keyframe ? 0 : stream->since_keyframe + 1;
+}
+
+struct codec_delta_stat_t*
+codec_delta_stat(struct codec_delta_t* delta, uint32_t msgid)
+{
+    for (size_t i = 0; i < CODEC_DELTA_STATS; i++)
+    {
+        struct codec_delta_stat_t* stat
+            = &delta->stats[(msgid + i) % CODEC_DELTA_STATS];
+        if (!stat->used)
+        {
+            stat->used  = true;
+            stat->msgid = msgid;
+            return stat;
+        }
+        if (stat->msgid == msgid)
+        {
+            return stat;
+        }
+    }
+    return NULL;
+}
+
+static bool
+delta_put_varint(uint8_t* dst, size_t cap, size_t* op, size_t n)
+{
+    do
+    {
+        if (*op >= cap)
+        {
+            return false;
+        }
+        dst[(*op)++] = (uint8_t)((n & 0x7F) | (n >= 0x80 ? 0x80 : 0));
+        n >>= 7;
+    } while (n != 0);
+    return true;
+}
+
+static bool
+delta_get_varint(const uint8_t* src, size_t len, size_t* ip, size_t* n)
+{
+    *n = 0;
+    for (size_t shift = 0; shift < 14; shift += 7)
+    {
+        if (*ip >= len)
+        {
+            return false;
+        }
+        uint8_t b = src[(*ip)++];
+        *n |= (size_t)(b & 0x7F) << shift;
+        if (!(b & 0x80))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @return delta size, or 0 when it would not fit in cap
+ */
+static size_t
+delta_diff(const struct codec_delta_stream_t* stream, const uint8_t* cur,
+    size_t len, uint8_t* dst, size_t cap)
+{
+    const uint8_t* base = stream->payload;
+    size_t         op   = 0;
+    size_t         i    = 0;
+
+    if (cap < DELTA_HEADER_LEN)
+    {
+        return 0;
+    }
+    dst[op++] = stream->seq;
+    dst[op++] = (uint8_t)len;
+    dst[op++] = delta_check(cur, len);
+
+    while (i < len)
+    {
+        size_t skip = i;
+        while (i < len && cur[i] == base[i])
+        {
+            i++;
+        }
+        if (i == len)
+        {
+            break;
+        }
+
+        /* a single unchanged byte is cheaper inside the run than a new run */
+        size_t start = i;
+        while (i < len
+            && (cur[i] != base[i] || (i + 1 < len && cur[i + 1] != base[i + 1])))
+        {
+            i++;
+        }
+
+        if (!delta_put_varint(dst, cap, &op, start - skip)
+            || !delta_put_varint(dst, cap, &op, i - start) || op + i - start > cap)
+        {
+            return 0;
+        }
+        for (size_t k = start; k < i; k++)
+        {
+            dst[op++] = cur[k] ^ base[k];
+        }
+    }
+    return op;
+}
+
+static ssize_t
+delta_apply(const struct codec_delta_stream_t* stream, const uint8_t* src,
+    size_t len, uint8_t* dst)
+{
+    if (len < DELTA_HEADER_LEN)
+    {
+        return -MERR_BAD_LENGTH;
+    }
+
+    size_t out_len = src[1];
+    size_t ip      = DELTA_HEADER_LEN;
+    size_t pos     = 0;
+    memcpy(dst, stream->payload, MAVLINK_MAX_PAYLOAD_LEN);
+
+    while (ip < len)
+    {
+        size_t skip, n;
+        if (!delta_get_varint(src, len, &ip, &skip)
+            || !delta_get_varint(src, len, &ip, &n))
+        {
+            return -MERR_BAD_MESSAGE;
+        }
+        pos += skip;
+        if (pos + n > out_len || ip + n > len)
+        {
+            return -MERR_BAD_MESSAGE;
+        }
+        for (size_t k = 0; k < n; k++)
+        {
+            dst[pos++] ^= src[ip++];
+        }
+    }
+    memset(dst + out_len, 0, MAVLINK_MAX_PAYLOAD_LEN - out_len);
+    if (delta_check(dst, out_len) != src[2])
+    {
+        return -MERR_BAD_STATE;
+    }
+    return (ssize_t)out_len;
+}
+
+static enum mavtunnel_error_t
+codec_delta_encode(struct mavtunnel_codec_t* codec, mavlink_message_t* msg)
+{
+    struct codec_delta_t*        delta   = (struct codec_delta_t*)codec->object;
+    struct codec_delta_stream_t* stream  = delta_stream(delta, msg);
+    struct codec_delta_stat_t*   stat    = codec_delta_stat(delta, msg->msgid);
+    uint8_t*                     payload = (uint8_t*)_MAV_PAYLOAD_NON_CONST(msg);
+#ifdef MAVTUNNEL_PROFILING
+    bool     timed = stat != NULL && stat->frames % CODEC_DELTA_TIME_SAMPLE == 0;
+    uint64_t start = timed ? clock_ns() : 0;
+#endif
+
+    /* a delta of a payload this short would not beat it */
+    size_t n        = 0;
+    bool   keyframe = !delta_stream_match(stream, msg) || msg->len <= DELTA_HEADER_LEN
+        || stream->since_keyframe + 1 >= delta->keyframe_interval;
+    if (!keyframe)
+    {
+        /* must beat the raw payload, otherwise send a keyframe */
+        n        = delta_diff(stream, payload, msg->len, delta->buffer, msg->len - 1);
+        keyframe = n == 0;
+    }
+
+    if (stat != NULL)
+    {
+        stat->frames++;
+        stat->keyframes += keyframe;
+        stat->bytes_in += msg->len;
+    }
+
+    delta_stream_store(stream, msg, payload, keyframe);
+    msg->compat_flags &= ~MAVTUNNEL_CFLAG_DELTA;
+    if (!keyframe)
+    {
+        memcpy(payload, delta->buffer, n);
+        msg->len = (uint8_t)n;
+        msg->compat_flags |= MAVTUNNEL_CFLAG_DELTA;
+    }
+
+    if (stat != NULL)
+    {
+        stat->bytes_out += msg->len;
+#ifdef MAVTUNNEL_PROFILING
+        if (timed)
+        {
+            stat->timed++;
+            stat->exec_time_ns += clock_ns() - start;
+        }
+#endif
+    }
+    return MERR_OK;
+}
+
+static enum mavtunnel_error_t
+codec_delta_decode(struct mavtunnel_codec_t* codec, mavlink_message_t* msg)
+{
+    struct codec_delta_t*        delta   = (struct codec_delta_t*)codec->object;
+    struct codec_delta_stream_t* stream  = delta_stream(delta, msg);
+    struct codec_delta_stat_t*   stat    = codec_delta_stat(delta, msg->msgid);
+    uint8_t*                     payload = (uint8_t*)_MAV_PAYLOAD_NON_CONST(msg);
+#ifdef MAVTUNNEL_PROFILING
+    bool     timed = stat != NULL && stat->frames % CODEC_DELTA_TIME_SAMPLE == 0;
+    uint64_t start = timed ? clock_ns() : 0;
+#endif
+
+    bool keyframe = !(msg->compat_flags & MAVTUNNEL_CFLAG_DELTA);
+    if (stat != NULL)
+    {
+        stat->frames++;
+        stat->keyframes += keyframe;
+        stat->bytes_out += msg->len;
+    }
+
+    if (!keyframe)
+    {
+        /* the base frame was lost, wait for the next keyframe */
+        if (!delta_stream_match(stream, msg) || stream->seq != payload[0])
+        {
+            if (stat != NULL)
+            {
+                stat->dropped++;
+            }
+            return MERR_BAD_STATE;
+        }
+
+        /* a stale base with the same seq rebuilds the wrong payload */
+        ssize_t n = delta_apply(stream, payload, msg->len, delta->buffer);
+        if (n < 0)
+        {
+            if (stat != NULL && n == -MERR_BAD_STATE)
+            {
+                stat->dropped++;
+            }
+            return (enum mavtunnel_error_t)-n;
+        }
+        memcpy(payload, delta->buffer, MAVLINK_MAX_PAYLOAD_LEN);
+        msg->len = (uint8_t)n;
+        msg->compat_flags &= ~MAVTUNNEL_CFLAG_DELTA;
+    }
+    delta_stream_store(stream, msg, payload, keyframe);
+
+    if (stat != NULL)
+    {
+        stat->bytes_in += msg->len;
+#ifdef MAVTUNNEL_PROFILING
+        if (timed)
+        {
+            stat->timed++;
+            stat->exec_time_ns += clock_ns() - start;
+        }
+#endif
+    }
+    return MERR_OK;
+}
+
+void
+codec_delta_report(struct codec_delta_t* delta)
+{
+    INFO("delta %s:\n", delta->stage.dir == MT_CODEC_ENCODE ? "encode" : "decode");
+    for (size_t i = 0; i < CODEC_DELTA_STATS; i++)
+    {
+        struct codec_delta_stat_t* stat = &delta->stats[i];
+        if (!stat->used || stat->frames == 0)
+        {
+            continue;
+        }
+        uint64_t ratio = stat->bytes_in ? stat->bytes_out * 1000 / stat->bytes_in : 0;
+        printf("\tmsgid %6u: frames %8lu, keyframes %6lu, dropped %6lu, "
+               "ratio %lu.%03lu",
+            stat->msgid, stat->frames, stat->keyframes, stat->dropped,
+            ratio / 1000, ratio % 1000);
+#ifdef MAVTUNNEL_PROFILING
+        printf(", %6lu ns/frame", stat->timed ? stat->exec_time_ns / stat->timed : 0);
+#endif
+        printf("\n");
+    }
+}
+
+void
+codec_delta_attach(struct mavtunnel_t* ctx, struct codec_delta_t* delta,
+    enum mavtunnel_codec_dir_t dir, uint16_t keyframe_interval)
+{
+    ASSERT(ctx != NULL && delta != NULL);
+    ASSERT(keyframe_interval > 0);
+
+    delta->keyframe_interval = keyframe_interval;
+    memset(delta->streams, 0, sizeof(delta->streams));
+    memset(delta->stats, 0, sizeof(delta->stats));
+
+    delta->stage.object = delta;
+    delta->stage.dir    = dir;
+    delta->stage.encode
+        = dir == MT_CODEC_ENCODE ? codec_delta_encode : codec_delta_decode;
+    delta->stage.tick = NULL;
+    mavtunnel_attach_stage(ctx, &delta->stage);
+}
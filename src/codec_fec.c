@@ -0,0 +1,456 @@
+#include "codec_fec.h"
+
+/**
+ * GF(2^8) over x^8 + x^4 + x^3 + x^2 + 1, with a full multiplication table
+ * so that a symbol row is one lookup per byte.
+ */
+#define GF_POLY 0x11D
+
+static uint8_t gf_exp[512];
+static uint8_t gf_log[256];
+static uint8_t gf_mul[256][256];
+static bool    gf_ready = false;
+
+static void
+gf_init(void)
+{
+    if (gf_ready)
+    {
+        return;
+    }
+
+    unsigned x = 1;
+    for (int i = 0; i < 255; i++)
+    {
+        gf_exp[i] = (uint8_t)x;
+        gf_log[x] = (uint8_t)i;
+        x <<= 1;
+        if (x & 0x100)
+        {
+            x ^= GF_POLY;
+        }
+    }
+    for (int i = 255; i < 512; i++)
+    {
+        gf_exp[i] = gf_exp[i - 255];
+    }
+    for (int a = 1; a < 256; a++)
+    {
+        for (int b = 1; b < 256; b++)
+        {
+            gf_mul[a][b] = gf_exp[gf_log[a] + gf_log[b]];
+        }
+    }
+    gf_ready = true;
+}
+
+static uint8_t
+gf_inv(uint8_t a)
+{
+    return gf_exp[255 - gf_log[a]];
+}
+
+/* dst ^= c * src */
+static void
+gf_madd(uint8_t* dst, const uint8_t* src, uint8_t c, size_t len)
+{
+    if (c == 0)
+    {
+        return;
+    }
+    if (c == 1)
+    {
+        for (size_t i = 0; i < len; i++)
+        {
+            dst[i] ^= src[i];
+        }
+        return;
+    }
+
+    const uint8_t* row = gf_mul[c];
+    for (size_t i = 0; i < len; i++)
+    {
+        dst[i] ^= row[src[i]];
+    }
+}
+
+/**
+ * Invert the e x e matrix a in place, by Gauss-Jordan elimination. Every
+ * square submatrix of a Cauchy matrix is invertible.
+ */
+static bool
+gf_invert(uint8_t a[CODEC_FEC_MAX_M][CODEC_FEC_MAX_M], size_t e)
+{
+    uint8_t inv[CODEC_FEC_MAX_M][CODEC_FEC_MAX_M] = {0};
+    for (size_t i = 0; i < e; i++)
+    {
+        inv[i][i] = 1;
+    }
+
+    for (size_t c = 0; c < e; c++)
+    {
+        size_t p = c;
+        while (p < e && a[p][c] == 0)
+        {
+            p++;
+        }
+        if (p == e)
+        {
+            return false;
+        }
+        for (size_t j = 0; j < e; j++)
+        {
+            uint8_t t = a[c][j];
+            a[c][j]   = a[p][j];
+            a[p][j]   = t;
+            t         = inv[c][j];
+            inv[c][j] = inv[p][j];
+            inv[p][j] = t;
+        }
+
+        uint8_t s = gf_inv(a[c][c]);
+        for (size_t j = 0; j < e; j++)
+        {
+            a[c][j]   = gf_mul[s][a[c][j]];
+            inv[c][j] = gf_mul[s][inv[c][j]];
+        }
+        for (size_t r = 0; r < e; r++)
+        {
+            uint8_t f = a[r][c];
+            if (r == c || f == 0)
+            {
+                continue;
+            }
+            for (size_t j = 0; j < e; j++)
+            {
+                a[r][j] ^= gf_mul[f][a[c][j]];
+                inv[r][j] ^= gf_mul[f][inv[c][j]];
+            }
+        }
+    }
+
+    memcpy(a, inv, sizeof(inv));
+    return true;
+}
+
+static size_t
+fec_symbol(uint8_t* dst, const mavlink_message_t* msg)
+{
+    size_t len = mavtunnel_frame_pack(dst, msg);
+    memset(dst + len, 0, CODEC_FEC_MAX_SYMBOL - len);
+    return len;
+}
+
+static void
+fec_reset(struct codec_fec_t* fec)
+{
+    memset(fec->parity, 0, sizeof(fec->parity));
+    memset(fec->have, 0, sizeof(fec->have));
+    memset(fec->have_parity, 0, sizeof(fec->have_parity));
+    fec->count      = 0;
+    fec->symbol_len = 0;
+    fec->done       = false;
+}
+
+enum mavtunnel_error_t
+codec_fec_flush(struct codec_fec_t* fec)
+{
+    ASSERT(fec != NULL);
+
+    if (fec->count == 0)
+    {
+        return MERR_OK;
+    }
+
+    enum mavtunnel_error_t err = MERR_OK;
+    mavlink_message_t*     msg = &fec->msg;
+    for (size_t j = 0; j < fec->m && err == MERR_OK; j++)
+    {
+        uint8_t trailer[] = {(uint8_t)fec->count, fec->group, (uint8_t)(fec->k + j)};
+
+        msg->magic          = MAVLINK_STX;
+        msg->msgid          = CODEC_FEC_MSGID;
+        msg->incompat_flags = 0;
+        msg->compat_flags   = MAVTUNNEL_CFLAG_FEC;
+        msg->seq            = fec->seq++;
+        msg->len            = (uint8_t)fec->symbol_len;
+        memcpy(_MAV_PAYLOAD_NON_CONST(msg), fec->parity[j], fec->symbol_len);
+        mavtunnel_trailer_push(msg, trailer, sizeof(trailer));
+        fec->parities++;
+        err = mavtunnel_stage_emit(&fec->stage, msg);
+    }
+
+    fec->group++;
+    fec_reset(fec);
+    return err;
+}
+
+static enum mavtunnel_error_t
+codec_fec_encode(struct mavtunnel_codec_t* codec, mavlink_message_t* msg)
+{
+    struct codec_fec_t* fec = (struct codec_fec_t*)codec->object;
+
+    if (MAVTUNNEL_FRAME_HEADER_LEN + msg->len > CODEC_FEC_MAX_SYMBOL)
+    {
+        return MERR_OK;
+    }
+
+    uint8_t symbol[CODEC_FEC_MAX_SYMBOL];
+    size_t  len = mavtunnel_frame_pack(symbol, msg);
+    size_t  i   = fec->count;
+    for (size_t j = 0; j < fec->m; j++)
+    {
+        gf_madd(fec->parity[j], symbol, fec->coef[j][i], len);
+    }
+    fec->symbol_len = len > fec->symbol_len ? len : fec->symbol_len;
+
+    uint8_t trailer[] = {fec->group, (uint8_t)i};
+    mavtunnel_trailer_push(msg, trailer, sizeof(trailer));
+    msg->compat_flags |= MAVTUNNEL_CFLAG_FEC;
+    fec->frames++;
+
+    if (++fec->count < fec->k)
+    {
+        if (i == 0)
+        {
+            fec->first_us = time_us();
+        }
+        return MERR_OK;
+    }
+
+    /* the last frame of the group goes before its parity */
+    enum mavtunnel_error_t err = mavtunnel_stage_emit(&fec->stage, msg);
+    codec_fec_flush(fec);
+    return err == MERR_OK ? MERR_PENDING : err;
+}
+
+static uint64_t
+codec_fec_tick(struct mavtunnel_codec_t* codec, uint64_t now_us)
+{
+    struct codec_fec_t* fec = (struct codec_fec_t*)codec->object;
+    if (fec->count == 0)
+    {
+        return 0;
+    }
+
+    if (now_us >= fec->first_us + fec->deadline_us)
+    {
+        codec_fec_flush(fec);
+        return 0;
+    }
+    return fec->first_us + fec->deadline_us;
+}
+
+/**
+ * Rebuild the missing data frames of the group once there are as many
+ * parity frames as missing ones, and pass them on.
+ */
+static void
+fec_recover(struct codec_fec_t* fec)
+{
+    size_t missing[CODEC_FEC_MAX_M], rows[CODEC_FEC_MAX_M];
+    size_t e = 0, r = 0;
+
+    if (fec->done || fec->count == 0)
+    {
+        return;
+    }
+    for (size_t i = 0; i < fec->count; i++)
+    {
+        if (!fec->have[i])
+        {
+            if (e == fec->m)
+            {
+                return;
+            }
+            missing[e++] = i;
+        }
+    }
+    for (size_t j = 0; j < fec->m && r < e; j++)
+    {
+        if (fec->have_parity[j])
+        {
+            rows[r++] = j;
+        }
+    }
+    if (e == 0 || r < e)
+    {
+        fec->done = e == 0;
+        return;
+    }
+
+    /* parity minus the frames we have leaves the missing ones' share */
+    uint8_t a[CODEC_FEC_MAX_M][CODEC_FEC_MAX_M];
+    for (r = 0; r < e; r++)
+    {
+        uint8_t* p = fec->parity[rows[r]];
+        for (size_t i = 0; i < fec->count; i++)
+        {
+            if (fec->have[i])
+            {
+                gf_madd(p, fec->data[i], fec->coef[rows[r]][i], fec->symbol_len);
+            }
+        }
+        for (size_t c = 0; c < e; c++)
+        {
+            a[r][c] = fec->coef[rows[r]][missing[c]];
+        }
+    }
+    if (!gf_invert(a, e))
+    {
+        return;
+    }
+
+    for (size_t c = 0; c < e; c++)
+    {
+        uint8_t* d = fec->data[missing[c]];
+        memset(d, 0, CODEC_FEC_MAX_SYMBOL);
+        for (r = 0; r < e; r++)
+        {
+            gf_madd(d, fec->parity[rows[r]], a[c][r], fec->symbol_len);
+        }
+        fec->have[missing[c]] = true;
+
+        if (mavtunnel_frame_unpack(d, fec->symbol_len, &fec->msg) < 0)
+        {
+            continue;
+        }
+        fec->recovered++;
+        mavtunnel_stage_emit(&fec->stage, &fec->msg);
+    }
+    fec->done = true;
+}
+
+/* a new group ends the current one; what it did not get back is lost */
+static void
+fec_begin(struct codec_fec_t* fec, uint8_t group)
+{
+    if (fec->active && !fec->done)
+    {
+        size_t n = fec->count;
+        for (size_t i = 0; i < fec->k; i++)
+        {
+            n = fec->have[i] && i + 1 > n ? i + 1 : n;
+        }
+        for (size_t i = 0; i < n; i++)
+        {
+            fec->lost += fec->have[i] ? 0 : 1;
+        }
+    }
+
+    fec_reset(fec);
+    fec->group  = group;
+    fec->active = true;
+}
+
+static enum mavtunnel_error_t
+codec_fec_decode(struct mavtunnel_codec_t* codec, mavlink_message_t* msg)
+{
+    struct codec_fec_t* fec = (struct codec_fec_t*)codec->object;
+    uint8_t             trailer[CODEC_FEC_TRAILER_LEN];
+
+    if (!(msg->compat_flags & MAVTUNNEL_CFLAG_FEC))
+    {
+        return MERR_OK;
+    }
+    if (!mavtunnel_trailer_pop(msg, trailer, sizeof(trailer)))
+    {
+        return MERR_BAD_LENGTH;
+    }
+    msg->compat_flags &= ~MAVTUNNEL_CFLAG_FEC;
+
+    uint8_t group = trailer[0];
+    size_t  index = trailer[1];
+    if (!fec->active || group != fec->group)
+    {
+        if (fec->active && (int8_t)(group - fec->group) < 0)
+        {
+            /* late frame of a group already given up on */
+            return index < fec->k ? MERR_OK : MERR_PENDING;
+        }
+        fec_begin(fec, group);
+    }
+
+    if (index < fec->k)
+    {
+        if (fec->have[index])
+        {
+            return MERR_PENDING;
+        }
+        fec->have[index] = true;
+        fec->frames++;
+        fec_symbol(fec->data[index], msg);
+        if (fec->count == 0 || fec->done)
+        {
+            return MERR_OK;
+        }
+
+        /* late data may be what recovery waited for; pass it on first */
+        mavtunnel_stage_emit(&fec->stage, msg);
+        fec_recover(fec);
+        return MERR_PENDING;
+    }
+
+    size_t j = index - fec->k;
+    if (j >= fec->m || msg->msgid != CODEC_FEC_MSGID || msg->len < 2)
+    {
+        return MERR_BAD_MESSAGE;
+    }
+    if (!fec->have_parity[j])
+    {
+        fec->have_parity[j] = true;
+        fec->count          = _MAV_PAYLOAD(msg)[msg->len - 1];
+        fec->symbol_len     = msg->len - 1;
+        memcpy(fec->parity[j], _MAV_PAYLOAD(msg), fec->symbol_len);
+        fec->parities++;
+        fec_recover(fec);
+    }
+    return MERR_PENDING;
+}
+
+void
+codec_fec_attach(struct mavtunnel_t* ctx, struct codec_fec_t* fec,
+    enum mavtunnel_codec_dir_t dir, size_t k, size_t n, uint64_t deadline_us)
+{
+    ASSERT(ctx != NULL && fec != NULL);
+    ASSERT(k > 0 && k <= CODEC_FEC_MAX_K);
+    ASSERT(n > k && n - k <= CODEC_FEC_MAX_M);
+
+    gf_init();
+
+    fec->k           = k;
+    fec->m           = n - k;
+    fec->deadline_us = deadline_us;
+    fec->group       = 0;
+    fec->seq         = 0;
+    fec->active      = false;
+    fec->frames      = 0;
+    fec->parities    = 0;
+    fec->recovered   = 0;
+    fec->lost        = 0;
+    fec_reset(fec);
+
+    /* x_j = k + j, y_i = i; column i scaled by (x_0 ^ y_i) */
+    for (size_t j = 0; j < fec->m; j++)
+    {
+        for (size_t i = 0; i < k; i++)
+        {
+            fec->coef[j][i]
+                = gf_mul[k ^ i][gf_inv((uint8_t)((k + j) ^ i))];
+        }
+    }
+
+    fec->stage.object = fec;
+    fec->stage.dir    = dir;
+    if (dir == MT_CODEC_ENCODE)
+    {
+        fec->stage.encode = codec_fec_encode;
+        fec->stage.tick   = codec_fec_tick;
+    }
+    else
+    {
+        fec->stage.encode = codec_fec_decode;
+        fec->stage.tick   = NULL;
+    }
+    mavtunnel_attach_stage(ctx, &fec->stage);
+}
@@ -0,0 +1,339 @@
+#include "codec_lz.h"
+
+/**
+ * Sequence format (LZ4 style):
+ *   token   [literal length:4][match length - LZ_MIN_MATCH:4]
+ *   a nibble of 15 continues in extra bytes of 255 until a byte < 255
+ *   literals
+ *   offset  2 bytes little endian, distance back into dictionary + output
+ * The last sequence has no offset and no match.
+ */
+#define LZ_MIN_MATCH 4
+#define LZ_RUN_MASK  15
+#define LZ_EMPTY     0xFFFF
+
+/* STATUSTEXT, PARAM_VALUE and parameter names seen on ardupilotmega links */
+static const char lz_dictionary[] =
+    "PreArm: Compass not calibratedPreArm: Check mag field"
+    "PreArm: Gyros inconsistentPreArm: Need 3D Fix"
+    "PreArm: Hardware safety switchPreArm: Throttle below failsafe"
+    "EKF3 IMU0 is using GPSEKF3 IMU1 is using GPS"
+    "EKF3 IMU0 origin set EKF3 IMU1 initialised"
+    "Arming motorsDisarming motorsGPS 1: detected as u-blox"
+    "ArduCopter V4.ArduPlane V4.ChibiOS: Frame: QUAD/X"
+    "Field Elevation Set: Mission: Reached command #"
+    "ARMING_CHECKBATT_MONITORBATT_CAPACITYCOMPASS_OFS_"
+    "INS_ACC_OFFSINS_GYR_OFFSSERVO1_FUNCTIONRC1_MINRC1_MAX"
+    "SR0_EXTRA1SR0_POSITIONSR0_RAW_SENSFLTMODE"
+    "WPNAV_SPEEDRTL_ALTPILOT_SPEED_UPATC_RAT_RLL_P"
+    "\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0";
+
+static inline uint32_t
+lz_read32(const uint8_t* p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16
+        | (uint32_t)p[3] << 24;
+}
+
+static inline uint32_t
+lz_hash(const uint8_t* p)
+{
+    return (lz_read32(p) * 2654435761u) >> (32 - CODEC_LZ_HASH_BITS);
+}
+
+static void
+lz_dictionary_init(struct codec_lz_t* lz)
+{
+    lz->dict_len = sizeof(lz_dictionary) - 1;
+    ASSERT(lz->dict_len <= CODEC_LZ_DICT_SIZE);
+
+    /* dictionary is right-aligned so payloads start at CODEC_LZ_DICT_SIZE */
+    size_t base = CODEC_LZ_DICT_SIZE - lz->dict_len;
+    memset(lz->window, 0, base);
+    memcpy(lz->window + base, lz_dictionary, lz->dict_len);
+
+    for (size_t i = 0; i < CODEC_LZ_HASH_SIZE; i++)
+    {
+        lz->dict_table[i] = LZ_EMPTY;
+    }
+    for (size_t i = base; i + LZ_MIN_MATCH <= CODEC_LZ_DICT_SIZE; i++)
+    {
+        lz->dict_table[lz_hash(lz->window + i)] = (uint16_t)i;
+    }
+}
+
+static bool
+lz_put_length(uint8_t* dst, size_t cap, size_t* op, size_t n)
+{
+    while (n >= 255)
+    {
+        if (*op >= cap)
+        {
+            return false;
+        }
+        dst[(*op)++] = 255;
+        n -= 255;
+    }
+    if (*op >= cap)
+    {
+        return false;
+    }
+    dst[(*op)++] = (uint8_t)n;
+    return true;
+}
+
+static bool
+lz_put_sequence(uint8_t* dst, size_t cap, size_t* op, const uint8_t* literals,
+    size_t n_literals, size_t offset, size_t match)
+{
+    if (*op >= cap)
+    {
+        return false;
+    }
+
+    uint8_t lit   = n_literals < LZ_RUN_MASK ? n_literals : LZ_RUN_MASK;
+    size_t  ml    = match ? match - LZ_MIN_MATCH : 0;
+    uint8_t mat   = ml < LZ_RUN_MASK ? ml : LZ_RUN_MASK;
+    dst[(*op)++]  = (uint8_t)(lit << 4 | mat);
+
+    if (lit == LZ_RUN_MASK
+        && !lz_put_length(dst, cap, op, n_literals - LZ_RUN_MASK))
+    {
+        return false;
+    }
+    if (*op + n_literals > cap)
+    {
+        return false;
+    }
+    memcpy(dst + *op, literals, n_literals);
+    *op += n_literals;
+
+    if (match == 0)
+    {
+        return true;
+    }
+
+    if (*op + 2 > cap)
+    {
+        return false;
+    }
+    dst[(*op)++] = offset & 0xFF;
+    dst[(*op)++] = (offset >> 8) & 0xFF;
+
+    if (mat == LZ_RUN_MASK && !lz_put_length(dst, cap, op, ml - LZ_RUN_MASK))
+    {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @return compressed size, or 0 when the output would not fit in cap
+ */
+size_t
+codec_lz_compress(struct codec_lz_t* lz, const uint8_t* src, size_t len,
+    uint8_t* dst, size_t cap)
+{
+    ASSERT(len <= MAVLINK_MAX_PAYLOAD_LEN);
+
+    uint8_t* window = lz->window;
+    size_t   ip     = CODEC_LZ_DICT_SIZE;
+    size_t   anchor = ip;
+    size_t   end    = ip + len;
+    size_t   op     = 0;
+
+    memcpy(window + ip, src, len);
+    memcpy(lz->table, lz->dict_table, sizeof(lz->table));
+
+    while (ip + LZ_MIN_MATCH <= end)
+    {
+        uint32_t h   = lz_hash(window + ip);
+        uint16_t ref = lz->table[h];
+        lz->table[h] = (uint16_t)ip;
+
+        if (ref == LZ_EMPTY || lz_read32(window + ref) != lz_read32(window + ip))
+        {
+            ip++;
+            continue;
+        }
+
+        size_t match = LZ_MIN_MATCH;
+        while (ip + match < end && window[ref + match] == window[ip + match])
+        {
+            match++;
+        }
+
+        if (!lz_put_sequence(dst, cap, &op, window + anchor, ip - anchor,
+                ip - ref, match))
+        {
+            return 0;
+        }
+        ip += match;
+        anchor = ip;
+    }
+
+    if (!lz_put_sequence(dst, cap, &op, window + anchor, end - anchor, 0, 0))
+    {
+        return 0;
+    }
+    return op;
+}
+
+static bool
+lz_get_length(const uint8_t* src, size_t len, size_t* ip, size_t* n)
+{
+    uint8_t b;
+    do
+    {
+        if (*ip >= len)
+        {
+            return false;
+        }
+        b = src[(*ip)++];
+        *n += b;
+    } while (b == 255);
+    return true;
+}
+
+/**
+ * @return decompressed size, or -MERR_BAD_MESSAGE on a malformed stream
+ */
+ssize_t
+codec_lz_decompress(struct codec_lz_t* lz, const uint8_t* src, size_t len,
+    uint8_t* dst, size_t cap)
+{
+    ASSERT(cap <= MAVLINK_MAX_PAYLOAD_LEN);
+
+    uint8_t* window = lz->window;
+    size_t   ip     = 0;
+    size_t   op     = CODEC_LZ_DICT_SIZE;
+    size_t   end    = op + cap;
+
+    while (ip < len)
+    {
+        uint8_t token      = src[ip++];
+        size_t  n_literals = token >> 4;
+        if (n_literals == LZ_RUN_MASK && !lz_get_length(src, len, &ip, &n_literals))
+        {
+            return -MERR_BAD_MESSAGE;
+        }
+        if (ip + n_literals > len || op + n_literals > end)
+        {
+            return -MERR_BAD_MESSAGE;
+        }
+        memcpy(window + op, src + ip, n_literals);
+        ip += n_literals;
+        op += n_literals;
+
+        if (ip == len)
+        {
+            break;
+        }
+
+        if (ip + 2 > len)
+        {
+            return -MERR_BAD_MESSAGE;
+        }
+        size_t offset = src[ip] | (size_t)src[ip + 1] << 8;
+        ip += 2;
+
+        size_t match = token & LZ_RUN_MASK;
+        if (match == LZ_RUN_MASK && !lz_get_length(src, len, &ip, &match))
+        {
+            return -MERR_BAD_MESSAGE;
+        }
+        match += LZ_MIN_MATCH;
+
+        if (offset == 0 || offset > op || op + match > end)
+        {
+            return -MERR_BAD_MESSAGE;
+        }
+        /* byte by byte: matches may overlap their own output */
+        for (size_t i = 0; i < match; i++, op++)
+        {
+            window[op] = window[op - offset];
+        }
+    }
+
+    size_t n = op - CODEC_LZ_DICT_SIZE;
+    memcpy(dst, window + CODEC_LZ_DICT_SIZE, n);
+    return (ssize_t)n;
+}
+
+static enum mavtunnel_error_t
+codec_lz_encode(struct mavtunnel_codec_t* codec, mavlink_message_t* msg)
+{
+    struct codec_lz_t* lz      = (struct codec_lz_t*)codec->object;
+    uint8_t*           payload = (uint8_t*)_MAV_PAYLOAD_NON_CONST(msg);
+
+    lz->frames++;
+    lz->bytes_in += msg->len;
+    msg->compat_flags &= ~MAVTUNNEL_CFLAG_COMPRESSED;
+
+    if (msg->len < CODEC_LZ_MIN_INPUT)
+    {
+        lz->bytes_out += msg->len;
+        return MERR_OK;
+    }
+
+    /* must save at least one byte, otherwise fall back to raw */
+    size_t n = codec_lz_compress(lz, payload, msg->len, lz->buffer, msg->len - 1);
+    if (n != 0)
+    {
+        memcpy(payload, lz->buffer, n);
+        msg->len = (uint8_t)n;
+        msg->compat_flags |= MAVTUNNEL_CFLAG_COMPRESSED;
+        lz->compressed++;
+    }
+    lz->bytes_out += msg->len;
+    return MERR_OK;
+}
+
+static enum mavtunnel_error_t
+codec_lz_decode(struct mavtunnel_codec_t* codec, mavlink_message_t* msg)
+{
+    struct codec_lz_t* lz      = (struct codec_lz_t*)codec->object;
+    uint8_t*           payload = (uint8_t*)_MAV_PAYLOAD_NON_CONST(msg);
+
+    lz->frames++;
+    lz->bytes_in += msg->len;
+    if (!(msg->compat_flags & MAVTUNNEL_CFLAG_COMPRESSED))
+    {
+        lz->bytes_out += msg->len;
+        return MERR_OK;
+    }
+
+    ssize_t n = codec_lz_decompress(
+        lz, payload, msg->len, lz->buffer, MAVLINK_MAX_PAYLOAD_LEN);
+    if (n < 0)
+    {
+        return MERR_BAD_MESSAGE;
+    }
+
+    memcpy(payload, lz->buffer, n);
+    memset(payload + n, 0, MAVLINK_MAX_PAYLOAD_LEN - n);
+    msg->len = (uint8_t)n;
+    msg->compat_flags &= ~MAVTUNNEL_CFLAG_COMPRESSED;
+    lz->compressed++;
+    lz->bytes_out += msg->len;
+    return MERR_OK;
+}
+
+void
+codec_lz_attach(struct mavtunnel_t* ctx, struct codec_lz_t* lz,
+    enum mavtunnel_codec_dir_t dir)
+{
+    ASSERT(ctx != NULL && lz != NULL);
+
+    lz_dictionary_init(lz);
+    lz->frames     = 0;
+    lz->compressed = 0;
+    lz->bytes_in   = 0;
+    lz->bytes_out  = 0;
+
+    lz->stage.object = lz;
+    lz->stage.dir    = dir;
+    lz->stage.encode = dir == MT_CODEC_ENCODE ? codec_lz_encode : codec_lz_decode;
+    lz->stage.tick   = NULL;
+    mavtunnel_attach_stage(ctx, &lz->stage);
+}
@@ -0,0 +1,375 @@
+#ifndef MAVTUNNEL_LINUX
+#error "This file is only for Linux"
+#endif
+
+#include "endpoint_linux_shm.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+static size_t
+shm_size(size_t n_slots)
+{
+    return sizeof(struct ep_shm_area_t) + 2 * n_slots * sizeof(struct ep_shm_slot_t);
+}
+
+/*
+ * n_slots is the caller's own copy: the one in the area is only trusted
+ * when a client opens it, as clients can write anywhere in it
+ */
+static struct ep_shm_slot_t*
+shm_slots(struct ep_shm_area_t* area, size_t n_slots, struct ep_shm_ring_t* ring)
+{
+    return ring == &area->down ? area->slots : area->slots + n_slots;
+}
+
+/* not FUTEX_PRIVATE_FLAG: the word is shared between processes */
+static void
+shm_futex_wait(atomic_uint_least32_t* word, uint32_t value, int timeout_ms)
+{
+    struct timespec ts = {timeout_ms / 1000, (timeout_ms % 1000) * 1000000l};
+    syscall(SYS_futex, (uint32_t*)word, FUTEX_WAIT, value, timeout_ms < 0 ? NULL : &ts,
+        NULL, 0);
+}
+
+static void
+shm_futex_wake(atomic_uint_least32_t* word)
+{
+    syscall(SYS_futex, (uint32_t*)word, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+/**
+ * @return false if the ring was full and the frame dropped
+ */
+static bool
+shm_push(struct ep_shm_area_t* area, size_t n_slots, struct ep_shm_ring_t* ring,
+    const uint8_t* bytes, size_t len, uint64_t* wakeups)
+{
+    struct ep_shm_slot_t* slots = shm_slots(area, n_slots, ring);
+    struct ep_shm_slot_t* slot;
+    uint64_t pos = atomic_load_explicit(&ring->enqueue_pos, memory_order_relaxed);
+    for (;;)
+    {
+        slot         = &slots[pos & (n_slots - 1)];
+        uint64_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        int64_t  dif = (int64_t)(seq - pos);
+        if (dif == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&ring->enqueue_pos, &pos, pos + 1,
+                    memory_order_relaxed, memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (dif < 0)
+        {
+            atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+            return false;
+        }
+        else
+        {
+            pos = atomic_load_explicit(&ring->enqueue_pos, memory_order_relaxed);
+        }
+    }
+
+    memcpy(slot->data, bytes, len);
+    slot->len = len;
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+
+    /* pairs with the fence in shm_wait(): either the consumer sees this
+       frame before it sleeps, or we see it sleeping */
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&ring->sleeping, memory_order_relaxed)
+        && atomic_exchange(&ring->sleeping, 0))
+    {
+        shm_futex_wake(&ring->sleeping);
+        (*wakeups)++;
+    }
+    return true;
+}
+
+static struct ep_shm_slot_t*
+shm_front(struct ep_shm_area_t* area, size_t n_slots, struct ep_shm_ring_t* ring)
+{
+    uint64_t              pos  = atomic_load_explicit(&ring->dequeue_pos, memory_order_relaxed);
+    struct ep_shm_slot_t* slot = &shm_slots(area, n_slots, ring)[pos & (n_slots - 1)];
+    return atomic_load_explicit(&slot->seq, memory_order_acquire) == pos + 1 ? slot : NULL;
+}
+
+static void
+shm_pop(struct ep_shm_area_t* area, size_t n_slots, struct ep_shm_ring_t* ring)
+{
+    uint64_t              pos  = atomic_load_explicit(&ring->dequeue_pos, memory_order_relaxed);
+    struct ep_shm_slot_t* slot = &shm_slots(area, n_slots, ring)[pos & (n_slots - 1)];
+    atomic_store_explicit(&slot->seq, pos + n_slots, memory_order_release);
+    atomic_store_explicit(&ring->dequeue_pos, pos + 1, memory_order_relaxed);
+}
+
+/**
+ * Sleep until a frame arrives, timeout_ms passes or *terminated is set.
+ */
+static void
+shm_wait(struct ep_shm_area_t* area, size_t n_slots, struct ep_shm_ring_t* ring,
+    int timeout_ms, atomic_bool* terminated)
+{
+    atomic_store(&ring->sleeping, 1);
+    atomic_thread_fence(memory_order_seq_cst);
+    if (shm_front(area, n_slots, ring) == NULL
+        && (terminated == NULL || !atomic_load(terminated)))
+    {
+        shm_futex_wait(&ring->sleeping, 1, timeout_ms);
+    }
+    atomic_store(&ring->sleeping, 0);
+}
+
+static struct ep_shm_slot_t*
+shm_next(struct ep_shm_area_t* area, size_t n_slots, struct ep_shm_ring_t* ring,
+    int timeout_ms, atomic_bool* terminated)
+{
+    struct ep_shm_slot_t* slot = shm_front(area, n_slots, ring);
+    if (slot == NULL && timeout_ms != 0)
+    {
+        shm_wait(area, n_slots, ring, timeout_ms, terminated);
+        slot = shm_front(area, n_slots, ring);
+    }
+    return slot;
+}
+
+/* the length a slot claims, which a client may have scribbled over */
+static size_t
+shm_len(const struct ep_shm_slot_t* slot)
+{
+    size_t len = *(const volatile uint32_t*)&slot->len;
+    return len < EP_SHM_FRAME_SIZE ? len : EP_SHM_FRAME_SIZE;
+}
+
+enum mavtunnel_error_t
+ep_linux_shm_init(struct endpoint_linux_shm_t* ep, const char* name, size_t n_slots)
+{
+    ASSERT(ep != NULL);
+    ASSERT(name != NULL);
+    ASSERT(n_slots >= 2 && (n_slots & (n_slots - 1)) == 0);
+
+    memset(ep, 0, sizeof(*ep));
+    ep->n_slots = n_slots;
+    ep->size    = shm_size(n_slots);
+    ep->area = MAP_FAILED;
+    ep->fd   = memfd_create(name, MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (ep->fd < 0)
+    {
+        WARN("Failed to create memfd: %s\n", strerror(errno));
+        return MERR_DEVICE_ERROR;
+    }
+
+    /* sealed, so that a client cannot take the memory away under us */
+    if (ftruncate(ep->fd, ep->size) < 0
+        || fcntl(ep->fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW) < 0)
+    {
+        WARN("Failed to size memfd: %s\n", strerror(errno));
+        return MERR_DEVICE_ERROR;
+    }
+
+    ep->area = mmap(NULL, ep->size, PROT_READ | PROT_WRITE, MAP_SHARED, ep->fd, 0);
+    if (ep->area == MAP_FAILED)
+    {
+        WARN("Failed to map memfd: %s\n", strerror(errno));
+        return MERR_DEVICE_ERROR;
+    }
+
+    ep->area->n_slots = n_slots;
+    for (size_t i = 0; i < 2 * n_slots; i++)
+    {
+        atomic_init(&ep->area->slots[i].seq, i % n_slots);
+    }
+    ep->area->magic = EP_SHM_MAGIC;
+    atomic_store(&ep->terminated, false);
+    return MERR_OK;
+}
+
+void
+ep_linux_shm_destroy(struct endpoint_linux_shm_t* ep)
+{
+    ASSERT(ep != NULL);
+
+    if (ep->area != MAP_FAILED)
+    {
+        munmap(ep->area, ep->size);
+    }
+    if (ep->fd >= 0)
+    {
+        close(ep->fd);
+    }
+}
+
+void
+ep_linux_shm_interrupt(struct endpoint_linux_shm_t* ep)
+{
+    atomic_store(&ep->terminated, true);
+    atomic_store(&ep->area->up.sleeping, 0);
+    shm_futex_wake(&ep->area->up.sleeping);
+}
+
+static ssize_t
+ep_linux_shm_read(struct mavtunnel_reader_t* rd, uint8_t* bytes, size_t len)
+{
+    ASSERT(rd != NULL && rd->object != NULL);
+    ASSERT(bytes != NULL);
+
+    struct endpoint_linux_shm_t* ep   = (struct endpoint_linux_shm_t*)rd->object;
+    struct ep_shm_slot_t*        slot = shm_next(ep->area, ep->n_slots, &ep->area->up,
+        rd->timeout_ms, &ep->terminated);
+    if (atomic_load(&ep->terminated))
+    {
+        return -MERR_END;
+    }
+    if (slot == NULL)
+    {
+        return 0;
+    }
+
+    size_t n = shm_len(slot);
+    n        = n < len ? n : len;
+    memcpy(bytes, slot->data, n);
+    shm_pop(ep->area, ep->n_slots, &ep->area->up);
+    ep->rx_frames++;
+    return n;
+}
+
+static enum mavtunnel_error_t
+ep_linux_shm_write(struct mavtunnel_writer_t* wr, const uint8_t* bytes, size_t len)
+{
+    ASSERT(wr != NULL && wr->object != NULL);
+    ASSERT(bytes != NULL);
+
+    struct endpoint_linux_shm_t* ep = (struct endpoint_linux_shm_t*)wr->object;
+    if (len > EP_SHM_FRAME_SIZE)
+    {
+        return MERR_BAD_LENGTH;
+    }
+
+    /* a consumer that falls behind loses frames, the tunnel goes on */
+    if (shm_push(ep->area, ep->n_slots, &ep->area->down, bytes, len, &ep->wakeups))
+    {
+        ep->tx_frames++;
+    }
+    else
+    {
+        ep->tx_dropped++;
+    }
+    return MERR_OK;
+}
+
+void
+ep_linux_shm_attach_reader(struct mavtunnel_t* tunnel, struct endpoint_linux_shm_t* ep)
+{
+    ASSERT(tunnel != NULL);
+    ASSERT(ep != NULL);
+
+    tunnel->reader.read   = ep_linux_shm_read;
+    tunnel->reader.object = ep;
+}
+
+void
+ep_linux_shm_attach_writer(struct mavtunnel_t* tunnel, struct endpoint_linux_shm_t* ep)
+{
+    ASSERT(tunnel != NULL);
+    ASSERT(ep != NULL);
+
+    tunnel->writer.write  = ep_linux_shm_write;
+    tunnel->writer.object = ep;
+}
+
+enum mavtunnel_error_t
+mavtunnel_shm_client_open(struct mavtunnel_shm_client_t* client, int fd)
+{
+    ASSERT(client != NULL);
+
+    memset(client, 0, sizeof(*client));
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(struct ep_shm_area_t))
+    {
+        WARN("Not a tunnel memfd\n");
+        return MERR_DEVICE_ERROR;
+    }
+
+    client->size = st.st_size;
+    client->area = mmap(NULL, client->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (client->area == MAP_FAILED)
+    {
+        WARN("Failed to map memfd: %s\n", strerror(errno));
+        client->area = NULL;
+        return MERR_DEVICE_ERROR;
+    }
+
+    if (client->area->magic != EP_SHM_MAGIC || shm_size(client->area->n_slots) != client->size)
+    {
+        WARN("Not a tunnel memfd\n");
+        mavtunnel_shm_client_close(client);
+        return MERR_BAD_MAGIC;
+    }
+    client->n_slots = client->area->n_slots;
+    return MERR_OK;
+}
+
+void
+mavtunnel_shm_client_close(struct mavtunnel_shm_client_t* client)
+{
+    ASSERT(client != NULL);
+
+    if (client->area != NULL)
+    {
+        munmap(client->area, client->size);
+        client->area = NULL;
+    }
+}
+
+const uint8_t*
+mavtunnel_shm_client_peek(struct mavtunnel_shm_client_t* client, size_t* len, int timeout_ms)
+{
+    ASSERT(client != NULL && client->area != NULL);
+    ASSERT(len != NULL);
+
+    client->peeked
+        = shm_next(client->area, client->n_slots, &client->area->down, timeout_ms, NULL);
+    if (client->peeked == NULL)
+    {
+        return NULL;
+    }
+    *len = shm_len(client->peeked);
+    return client->peeked->data;
+}
+
+void
+mavtunnel_shm_client_release(struct mavtunnel_shm_client_t* client)
+{
+    ASSERT(client != NULL && client->peeked != NULL);
+
+    shm_pop(client->area, client->n_slots, &client->area->down);
+    client->peeked = NULL;
+}
+
+enum mavtunnel_error_t
+mavtunnel_shm_client_send(
+    struct mavtunnel_shm_client_t* client, const uint8_t* bytes, size_t len)
+{
+    ASSERT(client != NULL && client->area != NULL);
+    ASSERT(bytes != NULL);
+
+    if (len > EP_SHM_FRAME_SIZE)
+    {
+        return MERR_BAD_LENGTH;
+    }
+    if (!shm_push(client->area, client->n_slots, &client->area->up, bytes, len,
+            &client->wakeups))
+    {
+        client->tx_dropped++;
+        return MERR_PENDING;
+    }
+    return MERR_OK;
+}
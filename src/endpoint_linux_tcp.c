@@ -0,0 +1,478 @@
+#ifndef MAVTUNNEL_LINUX
+#error "This file is only for Linux"
+#endif
+
+#include "endpoint_linux_tcp.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+
+static void
+tcp_configure(struct endpoint_linux_tcp_t* ep, int fd)
+{
+    int one = 1;
+    if (setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)) < 0)
+    {
+        WARN("Failed to set TCP_NODELAY: %s\n", strerror(errno));
+    }
+    if (ep->options.quickack
+        && setsockopt(fd, IPPROTO_TCP, TCP_QUICKACK, &one, sizeof(one)) < 0)
+    {
+        WARN("Failed to set TCP_QUICKACK: %s\n", strerror(errno));
+    }
+    unsigned timeout = ep->options.user_timeout_ms;
+    if (timeout != 0
+        && setsockopt(fd, IPPROTO_TCP, TCP_USER_TIMEOUT, &timeout, sizeof(timeout)) < 0)
+    {
+        WARN("Failed to set TCP_USER_TIMEOUT: %s\n", strerror(errno));
+    }
+}
+
+/* watch for EPOLLOUT only while connecting or with a queue to flush */
+static void
+tcp_poll(struct endpoint_linux_tcp_t* ep, int op)
+{
+    bool out = ep->state == EP_TCP_CONNECTING || ep->queue_len > 0;
+    if (op == EPOLL_CTL_MOD && out == ep->polling_out)
+    {
+        return;
+    }
+
+    struct epoll_event ev;
+    ev.events  = EPOLLIN | EPOLLRDHUP | (out ? EPOLLOUT : 0);
+    ev.data.fd = ep->fd;
+    if (epoll_ctl(ep->epoll, op, ep->fd, &ev) < 0)
+    {
+        WARN("Failed to poll connection: %s\n", strerror(errno));
+    }
+    ep->polling_out = out;
+}
+
+/* only the reader opens and closes connections, under the lock */
+static void
+tcp_up(struct endpoint_linux_tcp_t* ep, int fd, enum ep_tcp_state_t state)
+{
+    os_lock(&ep->lock);
+    ep->fd    = fd;
+    ep->state = state;
+    if (state == EP_TCP_UP)
+    {
+        ep->backoff_ms = ep->options.backoff_min_ms;
+        ep->connects++;
+    }
+    tcp_poll(ep, EPOLL_CTL_ADD);
+    os_unlock(&ep->lock);
+}
+
+static void
+tcp_down(struct endpoint_linux_tcp_t* ep)
+{
+    os_lock(&ep->lock);
+    if (ep->fd >= 0)
+    {
+        epoll_ctl(ep->epoll, EPOLL_CTL_DEL, ep->fd, NULL);
+        close(ep->fd);
+    }
+    if (ep->state == EP_TCP_UP)
+    {
+        ep->disconnects++;
+    }
+    ep->fd         = -1;
+    ep->state      = EP_TCP_DOWN;
+    ep->queue_head = ep->queue_len = 0;
+
+    ep->retry_us   = time_us() + ep->backoff_ms * 1000ull;
+    ep->backoff_ms = ep->backoff_ms * 2 < ep->options.backoff_max_ms
+        ? ep->backoff_ms * 2
+        : ep->options.backoff_max_ms;
+    os_unlock(&ep->lock);
+}
+
+static void
+tcp_connect(struct endpoint_linux_tcp_t* ep)
+{
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        WARN("Failed to create socket: %s\n", strerror(errno));
+        tcp_down(ep);
+        return;
+    }
+    tcp_configure(ep, fd);
+
+    if (connect(fd, (struct sockaddr*)&ep->addr, sizeof(ep->addr)) == 0)
+    {
+        tcp_up(ep, fd, EP_TCP_UP);
+    }
+    else if (errno == EINPROGRESS)
+    {
+        tcp_up(ep, fd, EP_TCP_CONNECTING);
+    }
+    else
+    {
+        close(fd);
+        tcp_down(ep);
+    }
+}
+
+static void
+tcp_accept(struct endpoint_linux_tcp_t* ep)
+{
+    int fd = accept4(ep->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0)
+    {
+        return;
+    }
+    tcp_configure(ep, fd);
+
+    /* a client that reconnects must not wait for its old connection to
+       time out */
+    if (ep->fd >= 0)
+    {
+        tcp_down(ep);
+    }
+    tcp_up(ep, fd, EP_TCP_UP);
+}
+
+/* with the lock held */
+static void
+tcp_flush(struct endpoint_linux_tcp_t* ep)
+{
+    while (ep->queue_len > 0)
+    {
+        size_t  chunk = EP_TCP_QUEUE_SIZE - ep->queue_head;
+        chunk         = chunk < ep->queue_len ? chunk : ep->queue_len;
+        ssize_t n     = send(ep->fd, ep->queue + ep->queue_head, chunk,
+            MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                /* the reader sees the hangup and closes */
+                shutdown(ep->fd, SHUT_RDWR);
+            }
+            break;
+        }
+        ep->queue_head = (ep->queue_head + n) % EP_TCP_QUEUE_SIZE;
+        ep->queue_len -= n;
+        ep->tx_bytes += n;
+    }
+    tcp_poll(ep, EPOLL_CTL_MOD);
+}
+
+static void
+tcp_enqueue(struct endpoint_linux_tcp_t* ep, const uint8_t* bytes, size_t len)
+{
+    size_t tail = (ep->queue_head + ep->queue_len) % EP_TCP_QUEUE_SIZE;
+    size_t n    = EP_TCP_QUEUE_SIZE - tail < len ? EP_TCP_QUEUE_SIZE - tail : len;
+    memcpy(ep->queue + tail, bytes, n);
+    memcpy(ep->queue, bytes + n, len - n);
+    ep->queue_len += len;
+    ep->tx_queued += len;
+}
+
+enum mavtunnel_error_t
+ep_linux_tcp_init(struct endpoint_linux_tcp_t* ep, enum ep_tcp_mode_t mode,
+    const char* ip, uint16_t port, const struct ep_tcp_options_t* options)
+{
+    ASSERT(ep != NULL);
+    ASSERT(ip != NULL);
+
+    static const struct ep_tcp_options_t defaults = EP_TCP_OPTIONS_DEFAULT;
+    memset(ep, 0, sizeof(*ep));
+    ep->mode       = mode;
+    ep->options    = options != NULL ? *options : defaults;
+    ep->backoff_ms = ep->options.backoff_min_ms;
+    ep->fd = ep->listen_fd = -1;
+    ep->epoll = ep->terminate_fd = -1;
+    os_lock_init(&ep->lock);
+
+    ep->addr.sin_family = AF_INET;
+    ep->addr.sin_port   = htons(port);
+    if (inet_pton(AF_INET, ip, &ep->addr.sin_addr) != 1)
+    {
+        WARN("Invalid address %s\n", ip);
+        return MERR_DEVICE_ERROR;
+    }
+
+    ep->epoll = epoll_create1(0);
+    if (ep->epoll < 0)
+    {
+        WARN("Failed to create epoll instance: %s\n", strerror(errno));
+        return MERR_DEVICE_ERROR;
+    }
+
+    struct epoll_event ev;
+    ep->terminate_fd = eventfd(0, EFD_NONBLOCK);
+    ev.events        = EPOLLIN;
+    ev.data.fd       = ep->terminate_fd;
+    if (ep->terminate_fd < 0
+        || epoll_ctl(ep->epoll, EPOLL_CTL_ADD, ep->terminate_fd, &ev) < 0)
+    {
+        WARN("Failed to add eventfd to epoll: %s\n", strerror(errno));
+        return MERR_DEVICE_ERROR;
+    }
+
+    if (mode == EP_TCP_LISTEN)
+    {
+        int one       = 1;
+        ep->listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (ep->listen_fd < 0
+            || setsockopt(ep->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) < 0
+            || bind(ep->listen_fd, (struct sockaddr*)&ep->addr, sizeof(ep->addr)) < 0
+            || listen(ep->listen_fd, 4) < 0)
+        {
+            WARN("Failed to listen on %s:%u: %s\n", ip, port, strerror(errno));
+            return MERR_DEVICE_ERROR;
+        }
+        ev.events  = EPOLLIN;
+        ev.data.fd = ep->listen_fd;
+        if (epoll_ctl(ep->epoll, EPOLL_CTL_ADD, ep->listen_fd, &ev) < 0)
+        {
+            WARN("Failed to add socket to epoll: %s\n", strerror(errno));
+            return MERR_DEVICE_ERROR;
+        }
+    }
+    else
+    {
+        tcp_connect(ep);
+    }
+
+    atomic_store(&ep->terminated, false);
+    return MERR_OK;
+}
+
+void
+ep_linux_tcp_destroy(struct endpoint_linux_tcp_t* ep)
+{
+    ASSERT(ep != NULL);
+
+    if (ep->fd >= 0)
+    {
+        close(ep->fd);
+    }
+    if (ep->listen_fd >= 0)
+    {
+        close(ep->listen_fd);
+    }
+    if (ep->epoll >= 0)
+    {
+        close(ep->epoll);
+    }
+    if (ep->terminate_fd >= 0)
+    {
+        close(ep->terminate_fd);
+    }
+}
+
+void
+ep_linux_tcp_interrupt(struct endpoint_linux_tcp_t* ep)
+{
+    eventfd_write(ep->terminate_fd, 1);
+}
+
+/**
+ * @return bytes read, 0 if the connection changed or had nothing to read
+ */
+static ssize_t
+tcp_event(struct endpoint_linux_tcp_t* ep, uint32_t events, uint8_t* bytes, size_t len)
+{
+    if (ep->state == EP_TCP_CONNECTING)
+    {
+        int       err     = 0;
+        socklen_t err_len = sizeof(err);
+        getsockopt(ep->fd, SOL_SOCKET, SO_ERROR, &err, &err_len);
+        if (err != 0)
+        {
+            tcp_down(ep);
+            return 0;
+        }
+        os_lock(&ep->lock);
+        ep->state      = EP_TCP_UP;
+        ep->backoff_ms = ep->options.backoff_min_ms;
+        ep->connects++;
+        tcp_poll(ep, EPOLL_CTL_MOD);
+        os_unlock(&ep->lock);
+        INFO("Connected to %s:%u\n", inet_ntoa(ep->addr.sin_addr),
+            ntohs(ep->addr.sin_port));
+        return 0;
+    }
+
+    if (events & EPOLLOUT)
+    {
+        os_lock(&ep->lock);
+        tcp_flush(ep);
+        os_unlock(&ep->lock);
+    }
+    if (!(events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)))
+    {
+        return 0;
+    }
+
+    ssize_t n = recv(ep->fd, bytes, len, MSG_DONTWAIT);
+    if (n > 0)
+    {
+        if (ep->options.quickack)
+        {
+            int one = 1;
+            setsockopt(ep->fd, IPPROTO_TCP, TCP_QUICKACK, &one, sizeof(one));
+        }
+        ep->rx_bytes += n;
+        return n;
+    }
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+    {
+        return 0;
+    }
+    tcp_down(ep);
+    return 0;
+}
+
+static ssize_t
+ep_linux_tcp_read(struct mavtunnel_reader_t* rd, uint8_t* bytes, size_t len)
+{
+    ASSERT(rd != NULL && rd->object != NULL);
+    ASSERT(bytes != NULL);
+
+    struct endpoint_linux_tcp_t* ep = (struct endpoint_linux_tcp_t*)rd->object;
+    uint64_t deadline = rd->timeout_ms < 0 ? UINT64_MAX : time_us() + rd->timeout_ms * 1000ull;
+
+    for (;;)
+    {
+        uint64_t now = time_us();
+        if (ep->mode == EP_TCP_CONNECT && ep->state == EP_TCP_DOWN && now >= ep->retry_us)
+        {
+            tcp_connect(ep);
+        }
+
+        uint64_t until = deadline;
+        if (ep->mode == EP_TCP_CONNECT && ep->state == EP_TCP_DOWN && ep->retry_us < until)
+        {
+            until = ep->retry_us;
+        }
+        int timeout = until == UINT64_MAX ? -1
+            : until <= now                ? 0
+                                          : (int)((until - now + 999) / 1000);
+
+        int n_events = epoll_wait(ep->epoll, ep->event, 3, timeout);
+        if (n_events < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            WARN("Failed to wait for epoll events: %s\n", strerror(errno));
+            atomic_store(&ep->terminated, true);
+            return -MERR_END;
+        }
+
+        for (int i = 0; i < n_events; i++)
+        {
+            if (ep->event[i].data.fd == ep->terminate_fd)
+            {
+                atomic_store(&ep->terminated, true);
+                return -MERR_END;
+            }
+        }
+
+        ssize_t n = 0;
+        for (int i = 0; i < n_events && n == 0; i++)
+        {
+            if (ep->event[i].data.fd == ep->listen_fd)
+            {
+                tcp_accept(ep);
+            }
+            else if (ep->event[i].data.fd == ep->fd)
+            {
+                n = tcp_event(ep, ep->event[i].events, bytes, len);
+            }
+        }
+        if (n > 0)
+        {
+            return n;
+        }
+        if (time_us() >= deadline)
+        {
+            return 0;
+        }
+    }
+}
+
+static enum mavtunnel_error_t
+ep_linux_tcp_write(struct mavtunnel_writer_t* wr, const uint8_t* bytes, size_t len)
+{
+    ASSERT(wr != NULL && wr->object != NULL);
+    ASSERT(bytes != NULL);
+
+    struct endpoint_linux_tcp_t* ep  = (struct endpoint_linux_tcp_t*)wr->object;
+    enum mavtunnel_error_t       err = MERR_OK;
+
+    os_lock(&ep->lock);
+    if (ep->state != EP_TCP_UP)
+    {
+        ep->tx_dropped += len;
+    }
+    else if (ep->queue_len > 0)
+    {
+        /* keep frames whole: all of it is queued or none */
+        if (ep->queue_len + len <= EP_TCP_QUEUE_SIZE)
+        {
+            tcp_enqueue(ep, bytes, len);
+            tcp_flush(ep);
+        }
+        else
+        {
+            ep->tx_dropped += len;
+        }
+    }
+    else
+    {
+        ssize_t n = send(ep->fd, bytes, len, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+        {
+            WARN("Failed to write to socket: %s\n", strerror(errno));
+            shutdown(ep->fd, SHUT_RDWR);
+            ep->tx_dropped += len;
+            err = MERR_DEVICE_ERROR;
+        }
+        else
+        {
+            n = n < 0 ? 0 : n;
+            ep->tx_bytes += n;
+            if ((size_t)n < len)
+            {
+                /* an empty queue always has room for the rest of a frame */
+                tcp_enqueue(ep, bytes + n, len - n);
+                tcp_poll(ep, EPOLL_CTL_MOD);
+            }
+        }
+    }
+    os_unlock(&ep->lock);
+    return err;
+}
+
+void
+ep_linux_tcp_attach_reader(struct mavtunnel_t* tunnel, struct endpoint_linux_tcp_t* ep)
+{
+    ASSERT(tunnel != NULL);
+    ASSERT(ep != NULL);
+
+    tunnel->reader.read   = ep_linux_tcp_read;
+    tunnel->reader.object = ep;
+}
+
+void
+ep_linux_tcp_attach_writer(struct mavtunnel_t* tunnel, struct endpoint_linux_tcp_t* ep)
+{
+    ASSERT(tunnel != NULL);
+    ASSERT(ep != NULL);
+
+    tunnel->writer.write  = ep_linux_tcp_write;
+    tunnel->writer.object = ep;
+}
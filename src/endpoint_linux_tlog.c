@@ -0,0 +1,568 @@
+#ifndef MAVTUNNEL_LINUX
+#error "This file is only for Linux"
+#endif
+
+#include "endpoint_linux_tlog.h"
+
+#include <endian.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define TLOG_STAMP_LEN 8
+
+static uint64_t
+tlog_wall_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void
+tlog_segment_path(char* path, const char* prefix, unsigned segment)
+{
+    snprintf(path, PATH_MAX, "%s-%04u.tlog", prefix, segment);
+}
+
+/* cut a full segment to the bytes it holds, which makes it a plain tlog */
+static void
+capture_trim(const struct endpoint_linux_capture_t* ep, int fd, uint8_t* map, size_t used,
+    unsigned segment)
+{
+    if (map != NULL)
+    {
+        munmap(map, ep->segment_size);
+    }
+    if (fd >= 0)
+    {
+        if (ftruncate(fd, used) < 0)
+        {
+            WARN("Failed to trim capture segment %u: %s\n", segment, strerror(errno));
+        }
+        close(fd);
+    }
+}
+
+static enum mavtunnel_error_t
+capture_create(
+    const struct endpoint_linux_capture_t* ep, unsigned segment, int* fd, uint8_t** map)
+{
+    char path[PATH_MAX];
+    tlog_segment_path(path, ep->prefix, segment);
+    *map = NULL;
+    *fd  = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (*fd < 0 || ftruncate(*fd, ep->segment_size) < 0)
+    {
+        WARN("Failed to create capture segment %s: %s\n", path, strerror(errno));
+        goto fail;
+    }
+
+    void* p = mmap(NULL, ep->segment_size, PROT_READ | PROT_WRITE, MAP_SHARED, *fd, 0);
+    if (p == MAP_FAILED)
+    {
+        WARN("Failed to map capture segment %s: %s\n", path, strerror(errno));
+        goto fail;
+    }
+    *map = p;
+    return MERR_OK;
+
+fail:
+    if (*fd >= 0)
+    {
+        close(*fd);
+        unlink(path);
+        *fd = -1;
+    }
+    return MERR_DEVICE_ERROR;
+}
+
+/* with the lock held */
+static void
+capture_wait_until(struct endpoint_linux_capture_t* ep, uint64_t due_us)
+{
+    struct timespec ts = {due_us / 1000000, (due_us % 1000000) * 1000};
+    pthread_cond_timedwait(&ep->cond, &ep->lock, &ts);
+}
+
+/**
+ * Creates the next segment ahead of the writer, and closes the full one.
+ * A segment that could not be created is tried again, backing off from
+ * EP_TLOG_RETRY_MS to EP_TLOG_RETRY_MAX_MS.
+ */
+static void*
+capture_helper(void* arg)
+{
+    struct endpoint_linux_capture_t* ep = (struct endpoint_linux_capture_t*)arg;
+
+    pthread_mutex_lock(&ep->lock);
+    while (!ep->stop)
+    {
+        if (ep->full_fd >= 0)
+        {
+            int      fd      = ep->full_fd;
+            uint8_t* map     = ep->full_map;
+            size_t   used    = ep->full_used;
+            unsigned segment = ep->full_segment;
+            pthread_mutex_unlock(&ep->lock);
+            capture_trim(ep, fd, map, used, segment);
+            pthread_mutex_lock(&ep->lock);
+            ep->full_fd  = -1;
+            ep->full_map = NULL;
+            pthread_cond_broadcast(&ep->cond);
+        }
+        else if (ep->spare_map == NULL && (!ep->spare_failed || time_us() >= ep->retry_us))
+        {
+            unsigned segment = ep->segment + 1;
+            int      fd;
+            uint8_t* map;
+            pthread_mutex_unlock(&ep->lock);
+            bool ok = capture_create(ep, segment, &fd, &map) == MERR_OK;
+            pthread_mutex_lock(&ep->lock);
+            ep->spare_fd     = fd;
+            ep->spare_map    = map;
+            ep->spare_failed = !ok;
+            if (ok)
+            {
+                ep->retry_ms = 0;
+            }
+            else
+            {
+                ep->retry_ms = ep->retry_ms == 0 ? EP_TLOG_RETRY_MS
+                    : ep->retry_ms * 2 < EP_TLOG_RETRY_MAX_MS ? ep->retry_ms * 2
+                                                              : EP_TLOG_RETRY_MAX_MS;
+                ep->retry_us = time_us() + ep->retry_ms * 1000ull;
+            }
+            pthread_cond_broadcast(&ep->cond);
+        }
+        else if (ep->spare_map == NULL)
+        {
+            capture_wait_until(ep, ep->retry_us);
+        }
+        else
+        {
+            pthread_cond_wait(&ep->cond, &ep->lock);
+        }
+    }
+    pthread_mutex_unlock(&ep->lock);
+    return NULL;
+}
+
+/* with the lock held: moves on to the segment the helper created, if any */
+static bool
+capture_take_spare(struct endpoint_linux_capture_t* ep)
+{
+    if (ep->spare_map == NULL)
+    {
+        ep->fd  = -1;
+        ep->map = NULL;
+        return false;
+    }
+    ep->fd   = ep->spare_fd;
+    ep->map  = ep->spare_map;
+    ep->used = 0;
+    ep->segment++;
+    ep->segments++;
+    ep->spare_fd  = -1;
+    ep->spare_map = NULL;
+    pthread_cond_broadcast(&ep->cond);
+    return true;
+}
+
+/**
+ * Hands the full segment to the helper and takes the one it created. If
+ * there is none, capture pauses until the helper's retry makes one.
+ */
+static enum mavtunnel_error_t
+capture_rotate(struct endpoint_linux_capture_t* ep)
+{
+    pthread_mutex_lock(&ep->lock);
+    while ((ep->spare_map == NULL && !ep->spare_failed) || ep->full_fd >= 0)
+    {
+        pthread_cond_wait(&ep->cond, &ep->lock);
+    }
+    ep->full_fd      = ep->fd;
+    ep->full_map     = ep->map;
+    ep->full_used    = ep->used;
+    ep->full_segment = ep->segment;
+    pthread_cond_broadcast(&ep->cond);
+    bool ok = capture_take_spare(ep);
+    pthread_mutex_unlock(&ep->lock);
+
+    return ok ? MERR_OK : MERR_DEVICE_ERROR;
+}
+
+/* after a failed rotation, picks up the segment a retry created */
+static void
+capture_resume(struct endpoint_linux_capture_t* ep)
+{
+    pthread_mutex_lock(&ep->lock);
+    capture_take_spare(ep);
+    pthread_mutex_unlock(&ep->lock);
+}
+
+enum mavtunnel_error_t
+ep_linux_capture_init(
+    struct endpoint_linux_capture_t* ep, const char* prefix, size_t segment_size)
+{
+    ASSERT(ep != NULL);
+    ASSERT(prefix != NULL);
+
+    memset(ep, 0, sizeof(*ep));
+    ep->fd = ep->spare_fd = ep->full_fd = -1;
+    ep->prefix                          = strdup(prefix);
+    ep->segment_size = segment_size != 0 ? segment_size : EP_TLOG_SEGMENT_SIZE;
+    if (capture_create(ep, 0, &ep->fd, &ep->map) != MERR_OK)
+    {
+        return MERR_DEVICE_ERROR;
+    }
+    ep->segments = 1;
+
+    /* the helper's retry waits run on the clock of time_us() */
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_mutex_init(&ep->lock, NULL);
+    pthread_cond_init(&ep->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    if (pthread_create(&ep->helper, NULL, capture_helper, ep) != 0)
+    {
+        WARN("Failed to start capture helper: %s\n", strerror(errno));
+        pthread_cond_destroy(&ep->cond);
+        pthread_mutex_destroy(&ep->lock);
+        return MERR_DEVICE_ERROR;
+    }
+    ep->running = true;
+    return MERR_OK;
+}
+
+void
+ep_linux_capture_destroy(struct endpoint_linux_capture_t* ep)
+{
+    ASSERT(ep != NULL);
+
+    if (ep->running)
+    {
+        pthread_mutex_lock(&ep->lock);
+        ep->stop = true;
+        pthread_cond_broadcast(&ep->cond);
+        pthread_mutex_unlock(&ep->lock);
+        pthread_join(ep->helper, NULL);
+        pthread_cond_destroy(&ep->cond);
+        pthread_mutex_destroy(&ep->lock);
+        ep->running = false;
+
+        capture_trim(ep, ep->full_fd, ep->full_map, ep->full_used, ep->full_segment);
+        ep->full_fd  = -1;
+        ep->full_map = NULL;
+        /* the next segment was never written to */
+        if (ep->spare_fd >= 0)
+        {
+            char path[PATH_MAX];
+            tlog_segment_path(path, ep->prefix, ep->segment + 1);
+            munmap(ep->spare_map, ep->segment_size);
+            close(ep->spare_fd);
+            unlink(path);
+            ep->spare_fd  = -1;
+            ep->spare_map = NULL;
+        }
+    }
+
+    capture_trim(ep, ep->fd, ep->map, ep->used, ep->segment);
+    ep->fd  = -1;
+    ep->map = NULL;
+    free(ep->prefix);
+    ep->prefix = NULL;
+}
+
+static enum mavtunnel_error_t
+ep_linux_capture_write(struct mavtunnel_writer_t* wr, const uint8_t* bytes, size_t len)
+{
+    ASSERT(wr != NULL && wr->object != NULL);
+    ASSERT(bytes != NULL);
+
+    struct endpoint_linux_capture_t* ep     = (struct endpoint_linux_capture_t*)wr->object;
+    size_t                           record = TLOG_STAMP_LEN + len;
+    if (record > ep->segment_size)
+    {
+        ep->dropped++;
+        return MERR_OK;
+    }
+    if (ep->map != NULL && ep->used + record > ep->segment_size
+        && capture_rotate(ep) != MERR_OK)
+    {
+        return MERR_DEVICE_ERROR;
+    }
+    if (ep->map == NULL && ep->running)
+    {
+        capture_resume(ep);
+    }
+    if (ep->map == NULL)
+    {
+        ep->dropped++;
+        return MERR_OK;
+    }
+
+    uint64_t stamp = htobe64(tlog_wall_us());
+    memcpy(ep->map + ep->used, &stamp, TLOG_STAMP_LEN);
+    memcpy(ep->map + ep->used + TLOG_STAMP_LEN, bytes, len);
+    ep->used += record;
+    ep->frames++;
+    ep->bytes += len;
+    return MERR_OK;
+}
+
+void
+ep_linux_capture_attach_writer(
+    struct mavtunnel_t* tunnel, struct endpoint_linux_capture_t* ep)
+{
+    ASSERT(tunnel != NULL);
+    ASSERT(ep != NULL);
+
+    tunnel->writer.write  = ep_linux_capture_write;
+    tunnel->writer.object = ep;
+}
+
+static void
+replay_close(struct endpoint_linux_replay_t* ep)
+{
+    if (ep->map != NULL)
+    {
+        munmap((void*)ep->map, ep->size);
+        ep->map = NULL;
+    }
+    if (ep->fd >= 0)
+    {
+        close(ep->fd);
+        ep->fd = -1;
+    }
+    ep->size = ep->pos = 0;
+}
+
+static enum mavtunnel_error_t
+replay_open(struct endpoint_linux_replay_t* ep, const char* path)
+{
+    struct stat st;
+    ep->fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (ep->fd < 0 || fstat(ep->fd, &st) < 0)
+    {
+        return MERR_END;
+    }
+
+    ep->size = st.st_size;
+    ep->pos  = 0;
+    if (ep->size == 0)
+    {
+        return MERR_OK;
+    }
+    ep->map = mmap(NULL, ep->size, PROT_READ, MAP_PRIVATE, ep->fd, 0);
+    if (ep->map == MAP_FAILED)
+    {
+        WARN("Failed to map %s: %s\n", path, strerror(errno));
+        ep->map = NULL;
+        return MERR_DEVICE_ERROR;
+    }
+    madvise((void*)ep->map, ep->size, MADV_SEQUENTIAL);
+    return MERR_OK;
+}
+
+/* on to the next segment of a capture, if there is one */
+static bool
+replay_next_segment(struct endpoint_linux_replay_t* ep)
+{
+    replay_close(ep);
+    if (!ep->segmented)
+    {
+        return false;
+    }
+
+    char path[PATH_MAX];
+    tlog_segment_path(path, ep->path, ++ep->segment);
+    return replay_open(ep, path) == MERR_OK;
+}
+
+/* the length of the frame at p, or 0 if it does not start with a frame */
+static size_t
+replay_frame_len(const uint8_t* p, size_t avail)
+{
+    if (avail < 3)
+    {
+        return 0;
+    }
+    if (p[0] == MAVLINK_STX)
+    {
+        return MAVLINK_NUM_NON_PAYLOAD_BYTES + p[1]
+            + (p[2] & MAVLINK_IFLAG_SIGNED ? MAVLINK_SIGNATURE_BLOCK_LEN : 0);
+    }
+    if (p[0] == MAVLINK_STX_MAVLINK1)
+    {
+        return MAVLINK_CORE_HEADER_MAVLINK1_LEN + 3 + p[1];
+    }
+    return 0;
+}
+
+/**
+ * Sleep until time_us() reaches due, or at most timeout_ms.
+ *
+ * @return false if it did not get there
+ */
+static bool
+replay_wait(struct endpoint_linux_replay_t* ep, uint64_t due, int timeout_ms)
+{
+    uint64_t now = time_us();
+    if (now >= due)
+    {
+        return true;
+    }
+
+    uint64_t wait    = due - now;
+    bool     reached = true;
+    if (timeout_ms >= 0 && wait > (uint64_t)timeout_ms * 1000)
+    {
+        wait    = (uint64_t)timeout_ms * 1000;
+        reached = false;
+    }
+
+    struct timespec ts  = {wait / 1000000, (wait % 1000000) * 1000};
+    struct pollfd   pfd = {.fd = ep->terminate_fd, .events = POLLIN};
+    if (ppoll(&pfd, 1, &ts, NULL) > 0)
+    {
+        atomic_store(&ep->terminated, true);
+        return false;
+    }
+    return reached;
+}
+
+enum mavtunnel_error_t
+ep_linux_replay_init(struct endpoint_linux_replay_t* ep, const char* path, double speed)
+{
+    ASSERT(ep != NULL);
+    ASSERT(path != NULL);
+    ASSERT(speed >= 0);
+
+    memset(ep, 0, sizeof(*ep));
+    ep->fd    = -1;
+    ep->path  = strdup(path);
+    ep->speed = speed;
+    atomic_store(&ep->terminated, false);
+    if ((ep->terminate_fd = eventfd(0, EFD_NONBLOCK)) < 0)
+    {
+        WARN("Failed to create eventfd: %s\n", strerror(errno));
+        return MERR_DEVICE_ERROR;
+    }
+
+    struct stat st;
+    if (stat(path, &st) == 0 && S_ISREG(st.st_mode))
+    {
+        return replay_open(ep, path) == MERR_OK ? MERR_OK : MERR_DEVICE_ERROR;
+    }
+
+    char segment[PATH_MAX];
+    tlog_segment_path(segment, path, 0);
+    ep->segmented = true;
+    if (replay_open(ep, segment) != MERR_OK)
+    {
+        WARN("No tlog or capture at %s\n", path);
+        return MERR_DEVICE_ERROR;
+    }
+    return MERR_OK;
+}
+
+void
+ep_linux_replay_destroy(struct endpoint_linux_replay_t* ep)
+{
+    ASSERT(ep != NULL);
+
+    replay_close(ep);
+    if (ep->terminate_fd >= 0)
+    {
+        close(ep->terminate_fd);
+        ep->terminate_fd = -1;
+    }
+    free(ep->path);
+    ep->path = NULL;
+}
+
+void
+ep_linux_replay_interrupt(struct endpoint_linux_replay_t* ep)
+{
+    ASSERT(ep != NULL);
+    eventfd_write(ep->terminate_fd, 1);
+}
+
+static ssize_t
+ep_linux_replay_read(struct mavtunnel_reader_t* rd, uint8_t* bytes, size_t len)
+{
+    ASSERT(rd != NULL && rd->object != NULL);
+    ASSERT(bytes != NULL);
+
+    struct endpoint_linux_replay_t* ep = (struct endpoint_linux_replay_t*)rd->object;
+    size_t                          frame_len;
+    for (;;)
+    {
+        if (atomic_load(&ep->terminated))
+        {
+            return -MERR_END;
+        }
+
+        size_t avail = ep->size - ep->pos;
+        frame_len    = avail > TLOG_STAMP_LEN
+               ? replay_frame_len(ep->map + ep->pos + TLOG_STAMP_LEN, avail - TLOG_STAMP_LEN)
+               : 0;
+        if (frame_len != 0 && TLOG_STAMP_LEN + frame_len <= avail)
+        {
+            break;
+        }
+        if (avail > TLOG_STAMP_LEN && frame_len == 0)
+        {
+            WARN("Corrupt tlog record at %zu of %s\n", ep->pos, ep->path);
+        }
+        /* the end of the file, or a record cut short */
+        if (!replay_next_segment(ep))
+        {
+            return -MERR_END;
+        }
+    }
+
+    uint64_t stamp;
+    memcpy(&stamp, ep->map + ep->pos, TLOG_STAMP_LEN);
+    stamp = be64toh(stamp);
+    if (!ep->started)
+    {
+        ep->started      = true;
+        ep->first_log_us = stamp;
+        ep->start_us     = time_us();
+    }
+    if (ep->speed > 0 && stamp > ep->first_log_us)
+    {
+        uint64_t due = ep->start_us + (uint64_t)((double)(stamp - ep->first_log_us) / ep->speed);
+        if (!replay_wait(ep, due, rd->timeout_ms))
+        {
+            return atomic_load(&ep->terminated) ? -MERR_END : 0;
+        }
+    }
+
+    size_t n = frame_len < len ? frame_len : len;
+    memcpy(bytes, ep->map + ep->pos + TLOG_STAMP_LEN, n);
+    ep->pos += TLOG_STAMP_LEN + frame_len;
+    ep->last_log_us = stamp;
+    ep->frames++;
+    ep->bytes += n;
+    return n;
+}
+
+void
+ep_linux_replay_attach_reader(struct mavtunnel_t* tunnel, struct endpoint_linux_replay_t* ep)
+{
+    ASSERT(tunnel != NULL);
+    ASSERT(ep != NULL);
+
+    tunnel->reader.read   = ep_linux_replay_read;
+    tunnel->reader.object = ep;
+}
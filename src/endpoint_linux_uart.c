@@ -6,42 +6,72 @@
 
 #include <errno.h>
 #include <fcntl.h>
-#include <termios.h>
 #include <unistd.h>
 #include <errno.h>
+#include <poll.h>
 #include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/timerfd.h>
+
+/* termios2 and BOTHER; <termios.h> has neither */
+#include <asm/termbits.h>
+#include <linux/serial.h>
 
 #include <v2.0/ardupilotmega/mavlink.h>
 
 static int
 ep_linux_uart_config(struct endpoint_linux_uart_t* ep)
 {
-    enum mavtunnel_error_t err = MERR_OK;
-    struct termios * options = malloc(sizeof(struct termios));
-
-    if (tcgetattr(ep->fd, options) == -1)
+    struct termios2 options;
+    if (ioctl(ep->fd, TCGETS2, &options) < 0)
     {
         WARN("Failed to get UART device attributes %s\n", ep->device_path);
-        err = MERR_DEVICE_ERROR;
-        goto cleanup;
+        return MERR_DEVICE_ERROR;
     }
 
-    cfmakeraw(options);
-    options->c_cflag |= CS8 | CLOCAL | CREAD;
-    options->c_cflag &= ~(PARENB | CSTOPB | CRTSCTS);
-    cfsetispeed(options, B115200);
-    cfsetospeed(options, B115200);
+    /* what cfmakeraw() does, at a rate of our own */
+    options.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR | ICRNL | IXON);
+    options.c_oflag &= ~OPOST;
+    options.c_lflag &= ~(ECHO | ECHONL | ICANON | ISIG | IEXTEN);
+    options.c_cflag &= ~(CSIZE | PARENB | CSTOPB | CRTSCTS | CBAUD | (CBAUD << IBSHIFT));
+    options.c_cflag |= CS8 | CLOCAL | CREAD | BOTHER | (BOTHER << IBSHIFT);
+    if (ep->options.rtscts)
+    {
+        options.c_cflag |= CRTSCTS;
+    }
+    options.c_ispeed    = ep->options.baud;
+    options.c_ospeed    = ep->options.baud;
+    options.c_cc[VMIN]  = ep->options.vmin || ep->options.vtime ? ep->options.vmin : 1;
+    options.c_cc[VTIME] = ep->options.vtime;
 
-    if (tcsetattr(ep->fd, TCSANOW, options) != 0)
+    if (ioctl(ep->fd, TCSETS2, &options) < 0 || ioctl(ep->fd, TCGETS2, &options) < 0)
     {
         WARN("Failed to set UART device options! %s\n", strerror(errno));
-        err = MERR_DEVICE_ERROR;
-        goto cleanup;
+        return MERR_DEVICE_ERROR;
+    }
+    ep->baud = options.c_ospeed;
+    if (ep->baud != ep->options.baud)
+    {
+        INFO("UART device %s runs at %u baud, not %u\n", ep->device_path, ep->baud,
+            ep->options.baud);
     }
 
-cleanup:
-    free(options);
-    return err;
+    if (ep->options.low_latency)
+    {
+        struct serial_struct serial;
+        if (ioctl(ep->fd, TIOCGSERIAL, &serial) < 0
+            || (serial.flags |= ASYNC_LOW_LATENCY, ioctl(ep->fd, TIOCSSERIAL, &serial) < 0))
+        {
+            INFO("UART device %s has no low latency mode\n", ep->device_path);
+        }
+    }
+
+    /* VMIN/VTIME only hold back a blocking read() */
+    if (ep->options.vmin || ep->options.vtime)
+    {
+        fcntl(ep->fd, F_SETFL, fcntl(ep->fd, F_GETFL) & ~O_NONBLOCK);
+    }
+    return MERR_OK;
 }
 
 static int
@@ -74,24 +104,200 @@ ep_linux_uart_epoll(struct endpoint_linux_uart_t * ep)
     return MERR_OK;
 }
 
+/**
+ * Follow MAVLink v1/v2 framing, so that a read knows whether it ends in a frame.
+ *
+ * @return whether a frame ended in bytes
+ */
+static bool
+ep_linux_uart_scan(struct endpoint_linux_uart_t * ep, const uint8_t * bytes, size_t len)
+{
+    bool ended = false;
+    for (size_t i = 0; i < len; i++)
+    {
+        if (ep->scan_have == 0)
+        {
+            if (bytes[i] == MAVLINK_STX || bytes[i] == MAVLINK_STX_MAVLINK1)
+            {
+                ep->scan_stx   = bytes[i];
+                ep->scan_have  = 1;
+                ep->scan_total = 0;
+            }
+            continue;
+        }
+
+        ep->scan_have++;
+        if (ep->scan_have == 2)
+        {
+            ep->scan_total = bytes[i] + (ep->scan_stx == MAVLINK_STX
+                ? MAVLINK_NUM_NON_PAYLOAD_BYTES : MAVLINK_CORE_HEADER_MAVLINK1_LEN + 3);
+        }
+        else if (ep->scan_have == 3 && ep->scan_stx == MAVLINK_STX
+            && (bytes[i] & MAVLINK_IFLAG_SIGNED))
+        {
+            ep->scan_total += MAVLINK_SIGNATURE_BLOCK_LEN;
+        }
+        if (ep->scan_have == ep->scan_total)
+        {
+            ep->scan_have = 0;
+            ended         = true;
+        }
+    }
+    return ended;
+}
+
+/* bytes still to come of the frame in progress */
+static size_t
+ep_linux_uart_frame_left(struct endpoint_linux_uart_t * ep)
+{
+    if (ep->scan_have == 0)
+    {
+        return 0;
+    }
+    if (ep->scan_have < 2)
+    {
+        /* the shortest frame there is */
+        return MAVLINK_CORE_HEADER_MAVLINK1_LEN + 3 - ep->scan_have;
+    }
+    return ep->scan_total - ep->scan_have;
+}
+
+/**
+ * Sleep while the rest of the frame in progress comes in, then take it.
+ * Bytes of the next frame that come with it do not hold the read back.
+ *
+ * @return the bytes now in the buffer
+ */
+static size_t
+ep_linux_uart_coalesce(struct endpoint_linux_uart_t * ep, uint8_t * bytes, size_t n, size_t len)
+{
+    uint64_t deadline = time_us() + ep->options.coalesce_us;
+    size_t want = ep_linux_uart_frame_left(ep);
+    while (want > 0 && n < len)
+    {
+        /* ten bits a byte on the wire, 8N1, and the four character times a
+           UART FIFO may hold the last bytes back */
+        uint64_t now  = time_us();
+        uint64_t wait = (uint64_t)(want + 4) * 10 * 1000000 / ep->baud;
+        if (now >= deadline)
+        {
+            break;
+        }
+        if (now + wait > deadline)
+        {
+            wait = deadline - now;
+        }
+
+        struct itimerspec timer = {{0, 0}, {wait / 1000000, (wait % 1000000) * 1000}};
+        timerfd_settime(ep->timer_fd, 0, &timer, NULL);
+        struct pollfd fds[2] = {
+            {.fd = ep->timer_fd, .events = POLLIN},
+            {.fd = ep->terminate_fd, .events = POLLIN},
+        };
+        if (poll(fds, 2, -1) < 0 || (fds[1].revents & POLLIN))
+        {
+            /* the next read sees the interrupt */
+            break;
+        }
+        uint64_t expirations;
+        if (!(fds[0].revents & POLLIN)
+            || read(ep->timer_fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+        {
+            WARN("Failed to wait for UART device %s\n", ep->device_path);
+            break;
+        }
+
+        ssize_t m = read(ep->fd, bytes + n, len - n);
+        if (m <= 0)
+        {
+            /* the sender paused mid-frame: no use waiting */
+            break;
+        }
+        /* the header may only now tell how long the frame is */
+        bool ended = ep_linux_uart_scan(ep, bytes + n, m);
+        want       = ended ? 0 : ep_linux_uart_frame_left(ep);
+        n += m;
+        ep->coalesced++;
+    }
+    return n;
+}
+
 int
 ep_linux_uart_init(struct endpoint_linux_uart_t * ep, const char * device_path)
+{
+    return ep_linux_uart_init_options(ep, device_path, NULL);
+}
+
+int
+ep_linux_uart_init_options(struct endpoint_linux_uart_t * ep, const char * device_path,
+    const struct ep_uart_options_t * options)
 {
     ASSERT(ep != NULL);
     ASSERT(device_path != NULL);
 
+    static const struct ep_uart_options_t defaults = EP_UART_OPTIONS_DEFAULT;
+    ep->options     = options != NULL ? *options : defaults;
+    ep->device_path  = NULL;
+    ep->fd           = -1;
+    ep->epoll        = -1;
+    ep->terminate_fd = -1;
+    ep->timer_fd     = -1;
+    ep->scan_have   = 0;
+    ep->reads       = 0;
+    ep->coalesced   = 0;
+    if (ep->options.vmin > 0 && ep->options.vtime == 0)
+    {
+        WARN("UART device %s: VMIN without VTIME may block forever\n", device_path);
+        return MERR_BAD_STATE;
+    }
+    if (ep->options.coalesce_us > 0 && (ep->options.vmin || ep->options.vtime))
+    {
+        WARN("UART device %s: frame-aware reads replace VMIN/VTIME\n", device_path);
+        return MERR_BAD_STATE;
+    }
+
+    int err         = MERR_DEVICE_ERROR;
     ep->device_path = strdup(device_path);
     if ((ep->fd = open(device_path, O_RDWR | O_NOCTTY | O_NDELAY)) < 0)
     {
         WARN("Failed to open UART device %s: %s\n", device_path, strerror(errno));
-        return MERR_END;
+        err = MERR_END;
+        goto fail;
     }
 
-    ep_linux_uart_config(ep);
-    ep_linux_uart_epoll(ep);
+    if (ep_linux_uart_config(ep) != MERR_OK || ep_linux_uart_epoll(ep) != MERR_OK)
+    {
+        goto fail;
+    }
+    if (ep->options.coalesce_us > 0
+        && (ep->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC)) < 0)
+    {
+        WARN("Failed to create timerfd: %s\n", strerror(errno));
+        goto fail;
+    }
     atomic_store(&ep->terminated, false);
 
     return MERR_OK;
+
+fail:
+    if (ep->terminate_fd >= 0)
+    {
+        close(ep->terminate_fd);
+        ep->terminate_fd = -1;
+    }
+    if (ep->epoll >= 0)
+    {
+        close(ep->epoll);
+        ep->epoll = -1;
+    }
+    if (ep->fd >= 0)
+    {
+        close(ep->fd);
+        ep->fd = -1;
+    }
+    free(ep->device_path);
+    ep->device_path = NULL;
+    return err;
 }
 
 ssize_t
@@ -103,7 +309,7 @@ ep_linux_uart_read(struct mavtunnel_reader_t * rd,
     struct endpoint_linux_uart_t * ep = rd->object;
 
     int n_events;
-    if ((n_events = epoll_wait(ep->epoll, ep->event, 1, -1)) < 0)
+    if ((n_events = epoll_wait(ep->epoll, ep->event, 1, rd->timeout_ms)) < 0)
     {
         WARN("Failed to wait for UART device %s: %s\n", ep->device_path, strerror(errno));
         atomic_store(&ep->terminated, true);
@@ -127,6 +333,10 @@ ep_linux_uart_read(struct mavtunnel_reader_t * rd,
         return -MERR_END;
     }
 
+    if (ep->options.read_size != 0 && len > ep->options.read_size)
+    {
+        len = ep->options.read_size;
+    }
     ssize_t n = read(ep->fd, bytes, len);
     if (n < 0)
     {
@@ -142,6 +352,13 @@ ep_linux_uart_read(struct mavtunnel_reader_t * rd,
             return -MERR_END;
         }
     }
+
+    ep->reads++;
+    if (ep->options.coalesce_us > 0)
+    {
+        ep_linux_uart_scan(ep, bytes, n);
+        n = ep_linux_uart_coalesce(ep, bytes, n, len);
+    }
     return n;
 }
 
@@ -171,7 +388,14 @@ void
 ep_linux_uart_destroy(struct endpoint_linux_uart_t * ep)
 {
     ASSERT(ep != NULL);
-    close(ep->fd);
+    if (ep->fd >= 0)
+    {
+        close(ep->fd);
+    }
+    if (ep->timer_fd >= 0)
+    {
+        close(ep->timer_fd);
+    }
     free(ep->device_path);
 }
 
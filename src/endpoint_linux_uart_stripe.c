@@ -0,0 +1,445 @@
+#ifndef MAVTUNNEL_LINUX
+#error "This file is only for Linux"
+#endif
+
+#include "endpoint_linux_uart_stripe.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+
+#define STRIPE_WRITE_TIMEOUT_MS 100
+
+/* a record is [seq][frame][crc], the crc over seq and frame */
+#define STRIPE_RECORD_OVERHEAD (1 + 2)
+
+/* 10 bits on the line per byte: start, 8 data, stop */
+static uint64_t
+stripe_line_rate(const struct endpoint_linux_uart_t* uart)
+{
+    return (uart->baud ? uart->baud : uart->options.baud) / 10;
+}
+
+enum mavtunnel_error_t
+ep_linux_uart_stripe_init(struct endpoint_linux_uart_stripe_t* ep,
+    struct endpoint_linux_uart_t* uarts, size_t n_uarts)
+{
+    ASSERT(ep != NULL && uarts != NULL);
+    ASSERT(n_uarts > 0 && n_uarts <= EP_STRIPE_MAX_LINKS);
+
+    memset(ep, 0, sizeof(*ep));
+    ep->n_links            = n_uarts;
+    ep->reorder_timeout_us = EP_STRIPE_REORDER_TIMEOUT_US;
+
+    if ((ep->epoll = epoll_create1(0)) < 0)
+    {
+        WARN("Failed to create epoll instance: %s\n", strerror(errno));
+        return MERR_DEVICE_ERROR;
+    }
+
+    struct epoll_event ev;
+    for (size_t i = 0; i < n_uarts; i++)
+    {
+        struct ep_stripe_link_t* link = &ep->links[i];
+        link->uart      = &uarts[i];
+        link->line_rate = stripe_line_rate(&uarts[i]);
+        link->rate      = link->line_rate;
+        link->last_us   = time_us();
+
+        ev.events   = EPOLLIN;
+        ev.data.u64 = i;
+        if (epoll_ctl(ep->epoll, EPOLL_CTL_ADD, uarts[i].fd, &ev) < 0)
+        {
+            WARN("Failed to add UART device %s to epoll: %s\n",
+                uarts[i].device_path, strerror(errno));
+            return MERR_DEVICE_ERROR;
+        }
+    }
+
+    ep->terminate_fd = eventfd(0, EFD_NONBLOCK);
+    ev.events        = EPOLLIN;
+    ev.data.u64      = EP_STRIPE_MAX_LINKS;
+    if (ep->terminate_fd < 0
+        || epoll_ctl(ep->epoll, EPOLL_CTL_ADD, ep->terminate_fd, &ev) < 0)
+    {
+        WARN("Failed to add terminate eventfd to epoll: %s\n", strerror(errno));
+        return MERR_DEVICE_ERROR;
+    }
+
+    atomic_store(&ep->terminated, false);
+    return MERR_OK;
+}
+
+void
+ep_linux_uart_stripe_destroy(struct endpoint_linux_uart_stripe_t* ep)
+{
+    ASSERT(ep != NULL);
+    close(ep->epoll);
+    close(ep->terminate_fd);
+}
+
+void
+ep_linux_uart_stripe_interrupt(struct endpoint_linux_uart_stripe_t* ep)
+{
+    ASSERT(ep != NULL);
+    eventfd_write(ep->terminate_fd, 1);
+}
+
+/**
+ * Bytes still queued on the link. Where the driver reports its output queue
+ * the drain rate is measured from it, otherwise the queue is estimated from
+ * the line rate.
+ */
+static uint64_t
+stripe_backlog(struct ep_stripe_link_t* link, uint64_t now)
+{
+    uint64_t elapsed = now - link->last_us;
+    int      outq    = 0;
+
+    if (ioctl(link->uart->fd, TIOCOUTQ, &outq) == 0 && outq > 0)
+    {
+        link->outq_reported = true;
+    }
+
+    if (link->outq_reported)
+    {
+        uint64_t drained
+            = link->backlog > (uint64_t)outq ? link->backlog - outq : 0;
+        if (outq > 0 && drained > 0 && elapsed > 0)
+        {
+            link->rate = (7 * link->rate + drained * 1000000 / elapsed) / 8;
+        }
+        link->backlog = (uint64_t)outq;
+    }
+    else
+    {
+        uint64_t drained = link->rate * elapsed / 1000000;
+        link->backlog    = link->backlog > drained ? link->backlog - drained : 0;
+    }
+    link->last_us = now;
+    return link->backlog;
+}
+
+static enum mavtunnel_error_t
+stripe_write_all(struct ep_stripe_link_t* link, const uint8_t* bytes, size_t len)
+{
+    struct pollfd pfd = {.fd = link->uart->fd, .events = POLLOUT};
+    size_t        done = 0;
+
+    while (done < len)
+    {
+        ssize_t n = write(link->uart->fd, bytes + done, len - done);
+        if (n > 0)
+        {
+            done += n;
+        }
+        else if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+        {
+            return MERR_DEVICE_ERROR;
+        }
+        else if (poll(&pfd, 1, STRIPE_WRITE_TIMEOUT_MS) <= 0)
+        {
+            return MERR_DEVICE_ERROR;
+        }
+    }
+    return MERR_OK;
+}
+
+static enum mavtunnel_error_t
+ep_linux_uart_stripe_write(
+    struct mavtunnel_writer_t* wr, const uint8_t* bytes, size_t len)
+{
+    ASSERT(wr != NULL && wr->object != NULL);
+    struct endpoint_linux_uart_stripe_t* ep = wr->object;
+
+    if (atomic_load(&ep->terminated))
+    {
+        return MERR_END;
+    }
+    if (len > MAVLINK_MAX_PACKET_LEN)
+    {
+        return MERR_BAD_LENGTH;
+    }
+
+    /* the link that would have the frame out first */
+    uint64_t                 now  = time_us();
+    struct ep_stripe_link_t* best = NULL;
+    uint64_t                 best_us = 0;
+    for (size_t i = 0; i < ep->n_links; i++)
+    {
+        struct ep_stripe_link_t* link = &ep->links[i];
+        uint64_t done_us = (stripe_backlog(link, now) + STRIPE_RECORD_OVERHEAD + len)
+            * 1000000 / link->rate;
+        if (best == NULL || done_us < best_us)
+        {
+            best    = link;
+            best_us = done_us;
+        }
+    }
+
+    ep->tx_buf[0] = ep->tx_seq;
+    memcpy(ep->tx_buf + 1, bytes, len);
+    uint16_t crc        = crc_calculate(ep->tx_buf, (uint16_t)(1 + len));
+    ep->tx_buf[1 + len] = crc & 0xFF;
+    ep->tx_buf[2 + len] = crc >> 8;
+    if (stripe_write_all(best, ep->tx_buf, len + STRIPE_RECORD_OVERHEAD) != MERR_OK)
+    {
+        WARN("Failed to write to UART device %s: %s\n",
+            best->uart->device_path, strerror(errno));
+        return MERR_DEVICE_ERROR;
+    }
+
+    ep->tx_seq++;
+    best->backlog += len + STRIPE_RECORD_OVERHEAD;
+    best->tx_frames++;
+    best->tx_bytes += len + STRIPE_RECORD_OVERHEAD;
+    return MERR_OK;
+}
+
+static bool
+stripe_output(struct endpoint_linux_uart_stripe_t* ep, const uint8_t* frame, size_t len)
+{
+    if (ep->out_pos == ep->out_len)
+    {
+        ep->out_pos = ep->out_len = 0;
+    }
+    if (ep->out_len + len > EP_STRIPE_OUT_BUFFER)
+    {
+        return false;
+    }
+    memcpy(ep->out + ep->out_len, frame, len);
+    ep->out_len += len;
+    return true;
+}
+
+/* hand out the frames that are next in order, as far as there is room */
+static void
+stripe_release(struct endpoint_linux_uart_stripe_t* ep, uint64_t now)
+{
+    struct ep_stripe_slot_t* slot = &ep->window[ep->rx_next % EP_STRIPE_WINDOW];
+    while (slot->valid && slot->seq == ep->rx_next
+        && stripe_output(ep, slot->frame, slot->len))
+    {
+        slot->valid = false;
+        ep->buffered--;
+        ep->rx_next++;
+        slot = &ep->window[ep->rx_next % EP_STRIPE_WINDOW];
+        ep->gap_us = 0;
+    }
+
+    if (ep->buffered > 0 && ep->gap_us == 0)
+    {
+        ep->gap_us = now;
+    }
+}
+
+/* give up on the frame everything waits for; held frames are all within
+ * the window ahead of it */
+static void
+stripe_skip(struct endpoint_linux_uart_stripe_t* ep, uint64_t now)
+{
+    if (ep->buffered == 0)
+    {
+        return;
+    }
+    for (size_t i = 0;
+         i < EP_STRIPE_WINDOW && !ep->window[ep->rx_next % EP_STRIPE_WINDOW].valid;
+         i++)
+    {
+        ep->rx_next++;
+        ep->skipped++;
+    }
+    ep->gap_us = 0;
+    stripe_release(ep, now);
+}
+
+static void
+stripe_insert(struct endpoint_linux_uart_stripe_t* ep, uint8_t seq,
+    const uint8_t* frame, size_t len, uint64_t now)
+{
+    int8_t d = (int8_t)(seq - ep->rx_next);
+    if (d < 0)
+    {
+        /* its place was given up on already; better late than never */
+        ep->late++;
+        if (!stripe_output(ep, frame, len))
+        {
+            ep->late_dropped++;
+        }
+        return;
+    }
+    while (d >= EP_STRIPE_WINDOW)
+    {
+        stripe_skip(ep, now);
+        if (ep->buffered == 0)
+        {
+            ep->skipped += (uint8_t)(seq - ep->rx_next);
+            ep->rx_next = seq;
+        }
+        d = (int8_t)(seq - ep->rx_next);
+    }
+
+    struct ep_stripe_slot_t* slot = &ep->window[seq % EP_STRIPE_WINDOW];
+    if (slot->valid)
+    {
+        /* held already: sent twice, or from before a sender restart */
+        ep->duplicates++;
+        return;
+    }
+    slot->valid = true;
+    slot->seq   = seq;
+    slot->len   = (uint16_t)len;
+    memcpy(slot->frame, frame, len);
+    ep->buffered++;
+    stripe_release(ep, now);
+}
+
+/* split what a link received into [seq][frame][crc] records */
+static void
+stripe_parse(struct endpoint_linux_uart_stripe_t* ep,
+    struct ep_stripe_link_t* link, uint64_t now)
+{
+    size_t ip = 0;
+    while (link->rx_len - ip >= STRIPE_RECORD_OVERHEAD + MAVLINK_CORE_HEADER_LEN + 1)
+    {
+        const uint8_t* rec = link->rx + ip;
+        if (rec[1] != MAVLINK_STX)
+        {
+            ip++;
+            link->rx_dropped++;
+            continue;
+        }
+
+        size_t len = MAVLINK_NUM_NON_PAYLOAD_BYTES + rec[2]
+            + ((rec[3] & MAVLINK_IFLAG_SIGNED) ? MAVLINK_SIGNATURE_BLOCK_LEN : 0);
+        if (link->rx_len - ip < STRIPE_RECORD_OVERHEAD + len)
+        {
+            break;
+        }
+
+        /* a record that does not check out is line noise; hunt on */
+        uint16_t crc = crc_calculate(rec, (uint16_t)(1 + len));
+        if (rec[1 + len] != (crc & 0xFF) || rec[2 + len] != (crc >> 8))
+        {
+            ip++;
+            link->rx_dropped++;
+            link->rx_corrupt++;
+            continue;
+        }
+        stripe_insert(ep, rec[0], rec + 1, len, now);
+        link->rx_frames++;
+        ip += STRIPE_RECORD_OVERHEAD + len;
+    }
+
+    memmove(link->rx, link->rx + ip, link->rx_len - ip);
+    link->rx_len -= ip;
+}
+
+static ssize_t
+stripe_take(struct endpoint_linux_uart_stripe_t* ep, uint8_t* bytes, size_t len)
+{
+    size_t n = ep->out_len - ep->out_pos;
+    n        = n < len ? n : len;
+    memcpy(bytes, ep->out + ep->out_pos, n);
+    ep->out_pos += n;
+    return (ssize_t)n;
+}
+
+static ssize_t
+ep_linux_uart_stripe_read(struct mavtunnel_reader_t* rd, uint8_t* bytes, size_t len)
+{
+    ASSERT(rd != NULL && rd->object != NULL);
+    struct endpoint_linux_uart_stripe_t* ep = rd->object;
+    uint64_t                             start = time_us();
+
+    for (;;)
+    {
+        uint64_t now = time_us();
+        if (ep->out_pos < ep->out_len)
+        {
+            return stripe_take(ep, bytes, len);
+        }
+
+        /* what is left of the reader's timeout */
+        int timeout_ms = rd->timeout_ms;
+        if (timeout_ms > 0)
+        {
+            uint64_t waited_ms = (now - start) / 1000;
+            timeout_ms = waited_ms < (uint64_t)timeout_ms ? timeout_ms - (int)waited_ms : 0;
+        }
+        if (ep->gap_us != 0)
+        {
+            uint64_t due = ep->gap_us + ep->reorder_timeout_us;
+            if (due <= now)
+            {
+                stripe_skip(ep, now);
+                continue;
+            }
+            int gap_ms = (int)((due - now + 999) / 1000);
+            timeout_ms = timeout_ms < 0 || gap_ms < timeout_ms ? gap_ms : timeout_ms;
+        }
+
+        int n_events = epoll_wait(
+            ep->epoll, ep->event, EP_STRIPE_MAX_LINKS + 1, timeout_ms);
+        if (n_events < 0)
+        {
+            WARN("Failed to wait for UART devices: %s\n", strerror(errno));
+            atomic_store(&ep->terminated, true);
+            return -MERR_END;
+        }
+        /* out of time, unless the wait ended for the gap to be given up on */
+        if (n_events == 0
+            && (ep->gap_us == 0 || ep->gap_us + ep->reorder_timeout_us > time_us()))
+        {
+            return 0;
+        }
+
+        now = time_us();
+        for (int e = 0; e < n_events; e++)
+        {
+            if (ep->event[e].data.u64 == EP_STRIPE_MAX_LINKS)
+            {
+                atomic_store(&ep->terminated, true);
+                return -MERR_END;
+            }
+
+            struct ep_stripe_link_t* link = &ep->links[ep->event[e].data.u64];
+            ssize_t n = read(link->uart->fd, link->rx + link->rx_len,
+                EP_STRIPE_RX_BUFFER - link->rx_len);
+            if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                WARN("Failed to read from UART device %s\n",
+                    link->uart->device_path);
+                atomic_store(&ep->terminated, true);
+                return -MERR_END;
+            }
+            link->rx_len += n > 0 ? n : 0;
+            stripe_parse(ep, link, now);
+        }
+        stripe_release(ep, now);
+    }
+}
+
+void
+ep_linux_uart_stripe_attach_reader(
+    struct mavtunnel_t* tunnel, struct endpoint_linux_uart_stripe_t* ep)
+{
+    ASSERT(tunnel != NULL);
+    ASSERT(ep != NULL);
+
+    tunnel->reader.read   = ep_linux_uart_stripe_read;
+    tunnel->reader.object = ep;
+}
+
+void
+ep_linux_uart_stripe_attach_writer(
+    struct mavtunnel_t* tunnel, struct endpoint_linux_uart_stripe_t* ep)
+{
+    ASSERT(tunnel != NULL);
+    ASSERT(ep != NULL);
+
+    tunnel->writer.write  = ep_linux_uart_stripe_write;
+    tunnel->writer.object = ep;
+}
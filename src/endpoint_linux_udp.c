@@ -129,7 +129,7 @@ ep_linux_udp_read(struct mavtunnel_reader_t* rd, uint8_t* bytes, size_t len)
     struct endpoint_linux_udp_t* ep;
     ep = (struct endpoint_linux_udp_t*)rd->object;
     int n_events;
-    n_events = epoll_wait(ep->epoll, ep->event, 2, -1);
+    n_events = epoll_wait(ep->epoll, ep->event, 2, rd->timeout_ms);
     if (n_events < 0)
     {
         WARN("Failed to wait for epoll events: %s\n", strerror(errno));
@@ -128,7 +128,7 @@ ep_linux_client_read(struct mavtunnel_reader_t* rd, uint8_t* bytes, size_t len)
     struct endpoint_linux_udp_client_t* ep;
     ep = rd->object;
     int n_events;
-    n_events = epoll_wait(ep->epoll, ep->event, 2, -1);
+    n_events = epoll_wait(ep->epoll, ep->event, 2, rd->timeout_ms);
     if (n_events < 0)
     {
         WARN("Failed to wait for events: %s\n", strerror(errno));
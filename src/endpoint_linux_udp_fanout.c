@@ -0,0 +1,145 @@
+#ifndef MAVTUNNEL_LINUX
+#error "This file is only for Linux"
+#endif
+
+#include "endpoint_linux_udp_fanout.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <netinet/in.h>
+
+enum mavtunnel_error_t
+ep_linux_udp_fanout_init(struct endpoint_linux_udp_fanout_t* ep, uint16_t port)
+{
+    ASSERT(ep != NULL);
+
+    memset(ep, 0, sizeof(*ep));
+    ep->fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (ep->fd < 0)
+    {
+        WARN("Failed to create socket: %s\n", strerror(errno));
+        return MERR_DEVICE_ERROR;
+    }
+
+    if (fcntl(ep->fd, F_SETFL, O_NONBLOCK) < 0)
+    {
+        WARN("Failed to set socket to non-blocking: %s\n", strerror(errno));
+        goto fail;
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(ep->fd, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+    {
+        WARN("Failed to bind socket port %u: %s\n", port, strerror(errno));
+        goto fail;
+    }
+    return MERR_OK;
+
+fail:
+    close(ep->fd);
+    ep->fd = -1;
+    return MERR_DEVICE_ERROR;
+}
+
+void
+ep_linux_udp_fanout_destroy(struct endpoint_linux_udp_fanout_t* ep)
+{
+    ASSERT(ep != NULL);
+
+    if (ep->fd >= 0)
+    {
+        close(ep->fd);
+    }
+}
+
+enum mavtunnel_error_t
+ep_linux_udp_fanout_add_peer(
+    struct endpoint_linux_udp_fanout_t* ep, const char* ip, uint16_t port)
+{
+    ASSERT(ep != NULL && ip != NULL);
+
+    if (ep->n_peers == EP_UDP_FANOUT_MAX_PEERS)
+    {
+        WARN("Too many peers, %s:%u not added\n", ip, port);
+        return MERR_BAD_STATE;
+    }
+
+    struct sockaddr_in* peer = &ep->peers[ep->n_peers];
+    memset(peer, 0, sizeof(*peer));
+    peer->sin_family = AF_INET;
+    peer->sin_port   = htons(port);
+    if (inet_pton(AF_INET, ip, &peer->sin_addr) != 1)
+    {
+        WARN("Invalid peer address %s\n", ip);
+        return MERR_BAD_STATE;
+    }
+
+    /* every message carries the same iovec, only its buffer changes */
+    struct msghdr* hdr = &ep->msgs[ep->n_peers].msg_hdr;
+    memset(hdr, 0, sizeof(*hdr));
+    hdr->msg_name    = peer;
+    hdr->msg_namelen = sizeof(*peer);
+    hdr->msg_iov     = &ep->iov;
+    hdr->msg_iovlen  = 1;
+    ep->n_peers++;
+    return MERR_OK;
+}
+
+void
+ep_linux_udp_sendmmsg(int fd, struct mmsghdr* msgs, size_t n,
+    uint64_t* datagrams, uint64_t* errors, uint64_t* syscalls)
+{
+    size_t sent = 0;
+    while (sent < n)
+    {
+        int rv = sendmmsg(fd, msgs + sent, n - sent, 0);
+        (*syscalls)++;
+        if (rv < 0)
+        {
+            /* the first remaining peer is unreachable, or its buffer full */
+            (*errors)++;
+            rv = 1;
+        }
+        else
+        {
+            *datagrams += rv;
+        }
+        sent += rv;
+    }
+}
+
+static enum mavtunnel_error_t
+ep_linux_udp_fanout_write(
+    struct mavtunnel_writer_t* wr, const uint8_t* bytes, size_t len)
+{
+    ASSERT(wr != NULL && wr->object != NULL);
+    ASSERT(bytes != NULL);
+
+    struct endpoint_linux_udp_fanout_t* ep
+        = (struct endpoint_linux_udp_fanout_t*)wr->object;
+
+    uint64_t datagrams = ep->datagrams;
+    ep->iov.iov_base   = (void*)bytes;
+    ep->iov.iov_len    = len;
+    ep->frames++;
+    ep_linux_udp_sendmmsg(ep->fd, ep->msgs, ep->n_peers, &ep->datagrams,
+        &ep->errors, &ep->syscalls);
+    return ep->n_peers > 0 && ep->datagrams == datagrams ? MERR_DEVICE_ERROR : MERR_OK;
+}
+
+void
+ep_linux_udp_fanout_attach_writer(
+    struct mavtunnel_t* tunnel, struct endpoint_linux_udp_fanout_t* ep)
+{
+    ASSERT(tunnel != NULL);
+    ASSERT(ep != NULL);
+
+    tunnel->writer.write  = ep_linux_udp_fanout_write;
+    tunnel->writer.object = ep;
+}
@@ -0,0 +1,404 @@
+#ifndef MAVTUNNEL_LINUX
+#error "This file is only for Linux"
+#endif
+
+#include "endpoint_linux_udp_server.h"
+#include "endpoint_linux_udp_fanout.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <netinet/in.h>
+#include <sys/eventfd.h>
+
+static size_t
+udp_server_hash(const struct sockaddr_in* addr)
+{
+    uint32_t key = addr->sin_addr.s_addr ^ ((uint32_t)addr->sin_port << 16);
+    return (key * 2654435761u) >> 25 & (EP_UDP_SERVER_TABLE - 1);
+}
+
+static bool
+udp_server_same(const struct sockaddr_in* a, const struct sockaddr_in* b)
+{
+    return a->sin_addr.s_addr == b->sin_addr.s_addr && a->sin_port == b->sin_port;
+}
+
+/**
+ * @return the table slot of addr, or the empty slot where it would go
+ */
+static size_t
+udp_server_slot(
+    const struct endpoint_linux_udp_server_t* ep, const struct sockaddr_in* addr)
+{
+    size_t slot = udp_server_hash(addr);
+    while (ep->table[slot] != 0
+        && !udp_server_same(&ep->peers[ep->table[slot] - 1].addr, addr))
+    {
+        slot = (slot + 1) & (EP_UDP_SERVER_TABLE - 1);
+    }
+    return slot;
+}
+
+static struct ep_udp_server_peer_t*
+udp_server_find(
+    const struct endpoint_linux_udp_server_t* ep, const struct sockaddr_in* addr)
+{
+    size_t slot = udp_server_slot(ep, addr);
+    return ep->table[slot] ? (struct ep_udp_server_peer_t*)&ep->peers[ep->table[slot] - 1]
+                           : NULL;
+}
+
+/**
+ * Drop the peers that have been silent too long. The survivors move up in
+ * the array, so the table is rebuilt; both are small.
+ */
+static void
+udp_server_expire(struct endpoint_linux_udp_server_t* ep, uint64_t now)
+{
+    if (now - ep->expired_us < EP_UDP_SERVER_EXPIRY_PERIOD_US)
+    {
+        return;
+    }
+    ep->expired_us = now;
+
+    size_t n = 0;
+    for (size_t i = 0; i < ep->n_peers; i++)
+    {
+        struct ep_udp_server_peer_t* peer = &ep->peers[i];
+        if (now - peer->last_rx_us > ep->idle_timeout_us)
+        {
+            INFO("Client expired <--> %s:%u\n", inet_ntoa(peer->addr.sin_addr),
+                ntohs(peer->addr.sin_port));
+            ep->expired++;
+            continue;
+        }
+        ep->peers[n++] = *peer;
+    }
+    if (n == ep->n_peers)
+    {
+        return;
+    }
+
+    ep->n_peers = n;
+    memset(ep->table, 0, sizeof(ep->table));
+    for (size_t i = 0; i < n; i++)
+    {
+        ep->table[udp_server_slot(ep, &ep->peers[i].addr)] = (uint8_t)(i + 1);
+    }
+}
+
+static struct ep_udp_server_peer_t*
+udp_server_join(struct endpoint_linux_udp_server_t* ep,
+    const struct sockaddr_in* addr, uint64_t now)
+{
+    size_t slot = udp_server_slot(ep, addr);
+    if (ep->table[slot] != 0)
+    {
+        return &ep->peers[ep->table[slot] - 1];
+    }
+    if (ep->n_peers == EP_UDP_SERVER_MAX_PEERS)
+    {
+        ep->rejected++;
+        return NULL;
+    }
+
+    struct ep_udp_server_peer_t* peer = &ep->peers[ep->n_peers];
+    memset(peer, 0, sizeof(*peer));
+    peer->addr       = *addr;
+    peer->last_rx_us = now;
+    ep->table[slot]  = (uint8_t)++ep->n_peers;
+    ep->joined++;
+    INFO("Client connected <--> %s:%u\n", inet_ntoa(addr->sin_addr),
+        ntohs(addr->sin_port));
+    return peer;
+}
+
+static enum mavtunnel_error_t
+ep_linux_udp_server_epoll(struct endpoint_linux_udp_server_t* ep)
+{
+    ep->epoll = epoll_create1(0);
+    if (ep->epoll < 0)
+    {
+        WARN("Failed to create epoll instance: %s\n", strerror(errno));
+        return MERR_DEVICE_ERROR;
+    }
+
+    struct epoll_event ev;
+    ev.events  = EPOLLIN;
+    ev.data.fd = ep->fd;
+    if (epoll_ctl(ep->epoll, EPOLL_CTL_ADD, ep->fd, &ev) < 0)
+    {
+        WARN("Failed to add socket to epoll: %s\n", strerror(errno));
+        return MERR_DEVICE_ERROR;
+    }
+
+    ep->terminate_fd = eventfd(0, EFD_NONBLOCK);
+    if (ep->terminate_fd < 0)
+    {
+        WARN("Failed to create eventfd: %s\n", strerror(errno));
+        return MERR_DEVICE_ERROR;
+    }
+    ev.events  = EPOLLIN;
+    ev.data.fd = ep->terminate_fd;
+    if (epoll_ctl(ep->epoll, EPOLL_CTL_ADD, ep->terminate_fd, &ev) < 0)
+    {
+        WARN("Failed to add eventfd to epoll: %s\n", strerror(errno));
+        return MERR_DEVICE_ERROR;
+    }
+    return MERR_OK;
+}
+
+enum mavtunnel_error_t
+ep_linux_udp_server_init(struct endpoint_linux_udp_server_t* ep, uint16_t port)
+{
+    return ep_linux_udp_server_init_flags(ep, port, 0);
+}
+
+enum mavtunnel_error_t
+ep_linux_udp_server_init_flags(
+    struct endpoint_linux_udp_server_t* ep, uint16_t port, unsigned flags)
+{
+    ASSERT(ep != NULL);
+
+    memset(ep, 0, sizeof(*ep));
+    ep->fd              = -1;
+    ep->epoll           = -1;
+    ep->terminate_fd    = -1;
+    os_lock_init(&ep->lock);
+    ep->idle_timeout_us = EP_UDP_SERVER_IDLE_TIMEOUT_US;
+    ep->expired_us      = time_us();
+
+    /* message i always goes to peer i */
+    for (size_t i = 0; i < EP_UDP_SERVER_MAX_PEERS; i++)
+    {
+        ep->msgs[i].msg_hdr.msg_name    = &ep->peers[i].addr;
+        ep->msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+        ep->msgs[i].msg_hdr.msg_iov     = &ep->iov;
+        ep->msgs[i].msg_hdr.msg_iovlen  = 1;
+        ep->subset[i] = ep->msgs[i];
+    }
+
+    ep->fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (ep->fd < 0)
+    {
+        WARN("Failed to create socket: %s\n", strerror(errno));
+        return MERR_DEVICE_ERROR;
+    }
+
+    if (fcntl(ep->fd, F_SETFL, O_NONBLOCK) < 0)
+    {
+        WARN("Failed to set socket to non-blocking: %s\n", strerror(errno));
+        return MERR_DEVICE_ERROR;
+    }
+
+    int one = 1;
+    if ((flags & EP_UDP_SERVER_REUSEPORT)
+        && setsockopt(ep->fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) < 0)
+    {
+        WARN("Failed to set SO_REUSEPORT: %s\n", strerror(errno));
+        return MERR_DEVICE_ERROR;
+    }
+
+    if (ep_linux_udp_server_epoll(ep) != MERR_OK)
+    {
+        return MERR_DEVICE_ERROR;
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(ep->fd, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+    {
+        WARN("Failed to bind socket port %u: %s\n", port, strerror(errno));
+        return MERR_DEVICE_ERROR;
+    }
+
+    atomic_store(&ep->terminated, false);
+    return MERR_OK;
+}
+
+void
+ep_linux_udp_server_destroy(struct endpoint_linux_udp_server_t* ep)
+{
+    ASSERT(ep != NULL);
+
+    if (ep->terminate_fd >= 0)
+    {
+        close(ep->terminate_fd);
+    }
+    if (ep->epoll >= 0)
+    {
+        close(ep->epoll);
+    }
+    if (ep->fd >= 0)
+    {
+        close(ep->fd);
+    }
+}
+
+void
+ep_linux_udp_server_interrupt(struct endpoint_linux_udp_server_t* ep)
+{
+    eventfd_write(ep->terminate_fd, 1);
+}
+
+static ssize_t
+ep_linux_udp_server_read(struct mavtunnel_reader_t* rd, uint8_t* bytes, size_t len)
+{
+    ASSERT(rd != NULL && rd->object != NULL);
+    ASSERT(bytes != NULL);
+
+    struct endpoint_linux_udp_server_t* ep
+        = (struct endpoint_linux_udp_server_t*)rd->object;
+    int n_events = epoll_wait(ep->epoll, ep->event, 2, rd->timeout_ms);
+    if (n_events < 0)
+    {
+        WARN("Failed to wait for epoll events: %s\n", strerror(errno));
+        atomic_store(&ep->terminated, true);
+        return -MERR_END;
+    }
+    else if (n_events == 0)
+    {
+        return 0;
+    }
+
+    for (int i = 0; i < n_events; i++)
+    {
+        if (ep->event[i].data.fd == ep->terminate_fd)
+        {
+            atomic_store(&ep->terminated, true);
+            return -MERR_END;
+        }
+    }
+
+    struct sockaddr_in addr;
+    socklen_t          addr_len = sizeof(addr);
+    ssize_t n = recvfrom(ep->fd, bytes, len, 0, (struct sockaddr*)&addr, &addr_len);
+    if (n < 0)
+    {
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            return 0;
+        }
+        WARN("Failed to read from socket: %s\n", strerror(errno));
+        atomic_store(&ep->terminated, true);
+        return -MERR_END;
+    }
+    ep->rx_datagrams++;
+    ep->rx_bytes += n;
+
+    uint64_t now = time_us();
+    os_lock(&ep->lock);
+    udp_server_expire(ep, now);
+    struct ep_udp_server_peer_t* peer = udp_server_join(ep, &addr, now);
+    if (peer != NULL)
+    {
+        peer->last_rx_us = now;
+        peer->rx_datagrams++;
+        peer->rx_bytes += n;
+        ep->last_peer = addr;
+    }
+    os_unlock(&ep->lock);
+
+    /* no room for another peer, nor for what it sends */
+    return peer != NULL ? n : 0;
+}
+
+static void
+udp_server_sendmmsg(
+    struct endpoint_linux_udp_server_t* ep, struct mmsghdr* msgs, size_t n)
+{
+    ep_linux_udp_sendmmsg(
+        ep->fd, msgs, n, &ep->tx_datagrams, &ep->tx_errors, &ep->syscalls);
+}
+
+static enum mavtunnel_error_t
+ep_linux_udp_server_write(
+    struct mavtunnel_writer_t* wr, const uint8_t* bytes, size_t len)
+{
+    ASSERT(wr != NULL && wr->object != NULL);
+    ASSERT(bytes != NULL);
+
+    struct endpoint_linux_udp_server_t* ep
+        = (struct endpoint_linux_udp_server_t*)wr->object;
+
+    os_lock(&ep->lock);
+    udp_server_expire(ep, time_us());
+    ep->iov.iov_base = (void*)bytes;
+    ep->iov.iov_len  = len;
+    ep->tx_frames++;
+    udp_server_sendmmsg(ep, ep->msgs, ep->n_peers);
+    os_unlock(&ep->lock);
+    return MERR_OK;
+}
+
+enum mavtunnel_error_t
+ep_linux_udp_server_send_to(struct endpoint_linux_udp_server_t* ep,
+    const struct sockaddr_in* peers, size_t n_peers, const uint8_t* bytes,
+    size_t len)
+{
+    ASSERT(ep != NULL && bytes != NULL);
+    ASSERT(peers != NULL || n_peers == 0);
+
+    os_lock(&ep->lock);
+    size_t n = 0;
+    for (size_t i = 0; i < n_peers && n < EP_UDP_SERVER_MAX_PEERS; i++)
+    {
+        struct ep_udp_server_peer_t* peer = udp_server_find(ep, &peers[i]);
+        if (peer != NULL)
+        {
+            ep->subset[n++].msg_hdr.msg_name = &peer->addr;
+        }
+    }
+    ep->iov.iov_base = (void*)bytes;
+    ep->iov.iov_len  = len;
+    ep->tx_frames++;
+    udp_server_sendmmsg(ep, ep->subset, n);
+    os_unlock(&ep->lock);
+    return MERR_OK;
+}
+
+void
+ep_linux_udp_server_attach_reader(
+    struct mavtunnel_t* tunnel, struct endpoint_linux_udp_server_t* ep)
+{
+    ASSERT(tunnel != NULL);
+    ASSERT(ep != NULL);
+
+    tunnel->reader.read   = ep_linux_udp_server_read;
+    tunnel->reader.object = ep;
+}
+
+void
+ep_linux_udp_server_attach_writer(
+    struct mavtunnel_t* tunnel, struct endpoint_linux_udp_server_t* ep)
+{
+    ASSERT(tunnel != NULL);
+    ASSERT(ep != NULL);
+
+    tunnel->writer.write  = ep_linux_udp_server_write;
+    tunnel->writer.object = ep;
+}
+
+void
+ep_linux_udp_server_print_stats(const struct endpoint_linux_udp_server_t* ep)
+{
+    ASSERT(ep != NULL);
+
+    INFO("udp server: %zu peers (%lu joined, %lu expired, %lu rejected), "
+         "rx %lu datagrams, %lu B, "
+         "tx %lu frames, %lu datagrams, %lu errors in %lu syscalls\n",
+        ep->n_peers, ep->joined, ep->expired, ep->rejected, ep->rx_datagrams,
+        ep->rx_bytes, ep->tx_frames, ep->tx_datagrams, ep->tx_errors, ep->syscalls);
+    for (size_t i = 0; i < ep->n_peers; i++)
+    {
+        const struct ep_udp_server_peer_t* peer = &ep->peers[i];
+        printf("\t%s:%u: rx %lu datagrams, %lu B\n",
+            inet_ntoa(peer->addr.sin_addr), ntohs(peer->addr.sin_port),
+            peer->rx_datagrams, peer->rx_bytes);
+    }
+}
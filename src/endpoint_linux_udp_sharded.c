@@ -0,0 +1,114 @@
+#ifndef MAVTUNNEL_LINUX
+#error "This file is only for Linux"
+#endif
+
+#include "endpoint_linux_udp_sharded.h"
+
+#include <errno.h>
+
+#include <linux/filter.h>
+#include <sys/socket.h>
+
+/**
+ * Steer by (source address + source port) % n. The program runs with the
+ * packet at the UDP payload; SKF_NET_OFF reaches back to the IPv4 header,
+ * and its IHL to the UDP header after any options.
+ */
+static enum mavtunnel_error_t
+udp_sharded_steer(int fd, size_t n_shards)
+{
+    struct sock_filter code[] = {
+        /* X = IPv4 header length, M[0] = source port */
+        {BPF_LDX | BPF_B | BPF_MSH, 0, 0, (uint32_t)SKF_NET_OFF},
+        {BPF_LD | BPF_H | BPF_IND, 0, 0, (uint32_t)SKF_NET_OFF},
+        {BPF_ST, 0, 0, 0},
+        /* A = source address + M[0], A %= n */
+        {BPF_LD | BPF_W | BPF_ABS, 0, 0, (uint32_t)SKF_NET_OFF + 12},
+        {BPF_LDX | BPF_W | BPF_MEM, 0, 0, 0},
+        {BPF_ALU | BPF_ADD | BPF_X, 0, 0, 0},
+        {BPF_ALU | BPF_MOD | BPF_K, 0, 0, (uint32_t)n_shards},
+        {BPF_RET | BPF_A, 0, 0, 0},
+    };
+    struct sock_fprog prog = {
+        .len    = sizeof(code) / sizeof(code[0]),
+        .filter = code,
+    };
+
+    if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)) < 0)
+    {
+        WARN("Failed to attach steering program: %s\n", strerror(errno));
+        return MERR_DEVICE_ERROR;
+    }
+    return MERR_OK;
+}
+
+enum mavtunnel_error_t
+ep_linux_udp_sharded_init(struct endpoint_linux_udp_sharded_t* ep,
+    uint16_t port, size_t n_shards, unsigned flags)
+{
+    ASSERT(ep != NULL);
+    ASSERT(n_shards > 0 && n_shards <= EP_UDP_SHARDED_MAX_SHARDS);
+
+    /* a shard that fails leaves its fds at -1 for destroy */
+    ep->port     = port;
+    ep->n_shards = 0;
+    for (size_t i = 0; i < n_shards; i++)
+    {
+        ep->n_shards++;
+        if (ep_linux_udp_server_init_flags(&ep->shards[i], port, EP_UDP_SERVER_REUSEPORT)
+            != MERR_OK)
+        {
+            return MERR_DEVICE_ERROR;
+        }
+    }
+
+    /* the program belongs to the group, any member can attach it */
+    if ((flags & EP_UDP_SHARDED_STEER)
+        && udp_sharded_steer(ep->shards[0].fd, n_shards) != MERR_OK)
+    {
+        return MERR_DEVICE_ERROR;
+    }
+    return MERR_OK;
+}
+
+void
+ep_linux_udp_sharded_destroy(struct endpoint_linux_udp_sharded_t* ep)
+{
+    ASSERT(ep != NULL);
+
+    for (size_t i = 0; i < ep->n_shards; i++)
+    {
+        ep_linux_udp_server_destroy(&ep->shards[i]);
+    }
+}
+
+void
+ep_linux_udp_sharded_interrupt(struct endpoint_linux_udp_sharded_t* ep)
+{
+    ASSERT(ep != NULL);
+
+    for (size_t i = 0; i < ep->n_shards; i++)
+    {
+        ep_linux_udp_server_interrupt(&ep->shards[i]);
+    }
+}
+
+void
+ep_linux_udp_sharded_attach_reader(struct mavtunnel_t* tunnel,
+    struct endpoint_linux_udp_sharded_t* ep, size_t shard)
+{
+    ASSERT(tunnel != NULL);
+    ASSERT(ep != NULL && shard < ep->n_shards);
+
+    ep_linux_udp_server_attach_reader(tunnel, &ep->shards[shard]);
+}
+
+void
+ep_linux_udp_sharded_attach_writer(struct mavtunnel_t* tunnel,
+    struct endpoint_linux_udp_sharded_t* ep, size_t shard)
+{
+    ASSERT(tunnel != NULL);
+    ASSERT(ep != NULL && shard < ep->n_shards);
+
+    ep_linux_udp_server_attach_writer(tunnel, &ep->shards[shard]);
+}
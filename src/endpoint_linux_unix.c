@@ -0,0 +1,410 @@
+#ifndef MAVTUNNEL_LINUX
+#error "This file is only for Linux"
+#endif
+
+#include "endpoint_linux_unix.h"
+
+#include <errno.h>
+#include <stddef.h>
+#include <unistd.h>
+
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+
+static enum mavtunnel_error_t
+unix_address(const char* path, struct sockaddr_un* addr, socklen_t* addr_len)
+{
+    bool   abstract = path[0] == '@';
+    size_t len      = strlen(path);
+    if (len == 0 || len >= sizeof(addr->sun_path))
+    {
+        WARN("Invalid socket path %s\n", path);
+        return MERR_DEVICE_ERROR;
+    }
+
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    memcpy(addr->sun_path, path, len);
+    if (abstract)
+    {
+        addr->sun_path[0] = '\0';
+        *addr_len         = offsetof(struct sockaddr_un, sun_path) + len;
+    }
+    else
+    {
+        *addr_len = offsetof(struct sockaddr_un, sun_path) + len + 1;
+    }
+    return MERR_OK;
+}
+
+/**
+ * Whether a server still listens on the socket file at the endpoint's path.
+ * A file no one answers on is left behind by a previous run, and removed.
+ */
+static bool
+unix_in_use(const struct endpoint_linux_unix_t* ep, int sock_type)
+{
+    int probe = socket(AF_UNIX, sock_type, 0);
+    if (probe < 0)
+    {
+        return false;
+    }
+
+    bool in_use = connect(probe, (const struct sockaddr*)&ep->addr, ep->addr_len) == 0;
+    if (!in_use && errno == ECONNREFUSED)
+    {
+        unlink(ep->addr.sun_path);
+    }
+    close(probe);
+    return in_use;
+}
+
+static bool
+unix_watch(struct endpoint_linux_unix_t* ep, int fd)
+{
+    struct epoll_event ev;
+    ev.events  = EPOLLIN;
+    ev.data.fd = fd;
+    if (epoll_ctl(ep->epoll, EPOLL_CTL_ADD, fd, &ev) < 0)
+    {
+        WARN("Failed to add socket to epoll: %s\n", strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+/* with the lock held */
+static void
+unix_remove(struct endpoint_linux_unix_t* ep, size_t i)
+{
+    if (ep->peers[i].fd >= 0)
+    {
+        epoll_ctl(ep->epoll, EPOLL_CTL_DEL, ep->peers[i].fd, NULL);
+        close(ep->peers[i].fd);
+    }
+    ep->peers[i] = ep->peers[--ep->n_peers];
+    ep->left++;
+}
+
+static void
+unix_accept(struct endpoint_linux_unix_t* ep)
+{
+    int fd = accept4(ep->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0)
+    {
+        return;
+    }
+
+    os_lock(&ep->lock);
+    if (ep->n_peers == EP_UNIX_MAX_PEERS || !unix_watch(ep, fd))
+    {
+        os_unlock(&ep->lock);
+        close(fd);
+        ep->rejected++;
+        return;
+    }
+    ep->peers[ep->n_peers].fd       = fd;
+    ep->peers[ep->n_peers].addr_len = 0;
+    ep->n_peers++;
+    ep->joined++;
+    os_unlock(&ep->lock);
+}
+
+/* a datagram sender becomes a peer if it has an address to reply to */
+static void
+unix_learn(struct endpoint_linux_unix_t* ep, const struct sockaddr_un* addr, socklen_t addr_len)
+{
+    if (addr_len <= offsetof(struct sockaddr_un, sun_path))
+    {
+        return;
+    }
+
+    os_lock(&ep->lock);
+    for (size_t i = 0; i < ep->n_peers; i++)
+    {
+        if (ep->peers[i].addr_len == addr_len && memcmp(&ep->peers[i].addr, addr, addr_len) == 0)
+        {
+            os_unlock(&ep->lock);
+            return;
+        }
+    }
+    if (ep->n_peers == EP_UNIX_MAX_PEERS)
+    {
+        ep->rejected++;
+    }
+    else
+    {
+        ep->peers[ep->n_peers].fd       = -1;
+        ep->peers[ep->n_peers].addr     = *addr;
+        ep->peers[ep->n_peers].addr_len = addr_len;
+        ep->n_peers++;
+        ep->joined++;
+    }
+    os_unlock(&ep->lock);
+}
+
+enum mavtunnel_error_t
+ep_linux_unix_init(struct endpoint_linux_unix_t* ep, enum ep_unix_type_t type,
+    enum ep_unix_role_t role, const char* path)
+{
+    ASSERT(ep != NULL);
+    ASSERT(path != NULL);
+
+    memset(ep, 0, sizeof(*ep));
+    ep->type = type;
+    ep->role = role;
+    ep->fd = ep->epoll = ep->terminate_fd = -1;
+    os_lock_init(&ep->lock);
+    if (unix_address(path, &ep->addr, &ep->addr_len) != MERR_OK)
+    {
+        return MERR_DEVICE_ERROR;
+    }
+
+    int sock_type = (type == EP_UNIX_SEQPACKET ? SOCK_SEQPACKET : SOCK_DGRAM)
+        | SOCK_NONBLOCK | SOCK_CLOEXEC;
+    ep->fd = socket(AF_UNIX, sock_type, 0);
+    if (ep->fd < 0)
+    {
+        WARN("Failed to create socket: %s\n", strerror(errno));
+        return MERR_DEVICE_ERROR;
+    }
+
+    if (role == EP_UNIX_SERVER)
+    {
+        if (path[0] != '@' && unix_in_use(ep, sock_type))
+        {
+            WARN("Socket %s is in use by another server\n", path);
+            ep->addr.sun_path[0] = '\0';
+            return MERR_DEVICE_ERROR;
+        }
+        if (bind(ep->fd, (struct sockaddr*)&ep->addr, ep->addr_len) < 0)
+        {
+            WARN("Failed to bind socket %s: %s\n", path, strerror(errno));
+            /* whatever is at the path is not ours to remove on destroy */
+            ep->addr.sun_path[0] = '\0';
+            return MERR_DEVICE_ERROR;
+        }
+        if (type == EP_UNIX_SEQPACKET && listen(ep->fd, EP_UNIX_MAX_PEERS) < 0)
+        {
+            WARN("Failed to listen on socket %s: %s\n", path, strerror(errno));
+            return MERR_DEVICE_ERROR;
+        }
+    }
+    else
+    {
+        /* autobind, so that the server has an address to reply to */
+        sa_family_t family = AF_UNIX;
+        if ((type == EP_UNIX_DGRAM && bind(ep->fd, (struct sockaddr*)&family, sizeof(family)) < 0)
+            || connect(ep->fd, (struct sockaddr*)&ep->addr, ep->addr_len) < 0)
+        {
+            WARN("Failed to connect to %s: %s\n", path, strerror(errno));
+            return MERR_DEVICE_ERROR;
+        }
+    }
+
+    ep->epoll = epoll_create1(0);
+    if (ep->epoll < 0)
+    {
+        WARN("Failed to create epoll instance: %s\n", strerror(errno));
+        return MERR_DEVICE_ERROR;
+    }
+    ep->terminate_fd = eventfd(0, EFD_NONBLOCK);
+    if (ep->terminate_fd < 0 || !unix_watch(ep, ep->fd) || !unix_watch(ep, ep->terminate_fd))
+    {
+        WARN("Failed to set up epoll: %s\n", strerror(errno));
+        return MERR_DEVICE_ERROR;
+    }
+
+    atomic_store(&ep->terminated, false);
+    return MERR_OK;
+}
+
+void
+ep_linux_unix_destroy(struct endpoint_linux_unix_t* ep)
+{
+    ASSERT(ep != NULL);
+
+    for (size_t i = 0; i < ep->n_peers; i++)
+    {
+        if (ep->peers[i].fd >= 0)
+        {
+            close(ep->peers[i].fd);
+        }
+    }
+    ep->n_peers = 0;
+    if (ep->role == EP_UNIX_SERVER && ep->addr.sun_path[0] != '\0')
+    {
+        unlink(ep->addr.sun_path);
+    }
+    if (ep->fd >= 0)
+    {
+        close(ep->fd);
+    }
+    if (ep->epoll >= 0)
+    {
+        close(ep->epoll);
+    }
+    if (ep->terminate_fd >= 0)
+    {
+        close(ep->terminate_fd);
+    }
+}
+
+void
+ep_linux_unix_interrupt(struct endpoint_linux_unix_t* ep)
+{
+    eventfd_write(ep->terminate_fd, 1);
+}
+
+static ssize_t
+ep_linux_unix_read(struct mavtunnel_reader_t* rd, uint8_t* bytes, size_t len)
+{
+    ASSERT(rd != NULL && rd->object != NULL);
+    ASSERT(bytes != NULL);
+
+    struct endpoint_linux_unix_t* ep = (struct endpoint_linux_unix_t*)rd->object;
+    int n_events = epoll_wait(ep->epoll, ep->event, 4, rd->timeout_ms);
+    if (n_events < 0)
+    {
+        WARN("Failed to wait for epoll events: %s\n", strerror(errno));
+        atomic_store(&ep->terminated, true);
+        return -MERR_END;
+    }
+
+    for (int i = 0; i < n_events; i++)
+    {
+        if (ep->event[i].data.fd == ep->terminate_fd)
+        {
+            atomic_store(&ep->terminated, true);
+            return -MERR_END;
+        }
+    }
+
+    for (int i = 0; i < n_events; i++)
+    {
+        int fd = ep->event[i].data.fd;
+        if (fd == ep->fd && ep->role == EP_UNIX_SERVER && ep->type == EP_UNIX_SEQPACKET)
+        {
+            unix_accept(ep);
+            continue;
+        }
+
+        struct sockaddr_un from;
+        socklen_t          from_len = sizeof(from);
+        ssize_t            n = recvfrom(fd, bytes, len, 0, (struct sockaddr*)&from, &from_len);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            continue;
+        }
+
+        if (fd != ep->fd)
+        {
+            /* a connection of the server */
+            if (n > 0)
+            {
+                ep->rx_messages++;
+                return n;
+            }
+            os_lock(&ep->lock);
+            for (size_t j = 0; j < ep->n_peers; j++)
+            {
+                if (ep->peers[j].fd == fd)
+                {
+                    unix_remove(ep, j);
+                    break;
+                }
+            }
+            os_unlock(&ep->lock);
+            continue;
+        }
+
+        if (n < 0 || (n == 0 && ep->type == EP_UNIX_SEQPACKET))
+        {
+            if (n < 0)
+            {
+                WARN("Failed to read from socket: %s\n", strerror(errno));
+            }
+            atomic_store(&ep->terminated, true);
+            return -MERR_END;
+        }
+        if (ep->role == EP_UNIX_SERVER)
+        {
+            unix_learn(ep, &from, from_len);
+        }
+        ep->rx_messages++;
+        return n;
+    }
+    return 0;
+}
+
+static enum mavtunnel_error_t
+ep_linux_unix_write(struct mavtunnel_writer_t* wr, const uint8_t* bytes, size_t len)
+{
+    ASSERT(wr != NULL && wr->object != NULL);
+    ASSERT(bytes != NULL);
+
+    struct endpoint_linux_unix_t* ep = (struct endpoint_linux_unix_t*)wr->object;
+    if (ep->role == EP_UNIX_CLIENT)
+    {
+        if (send(ep->fd, bytes, len, MSG_DONTWAIT | MSG_NOSIGNAL) < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                ep->tx_dropped++;
+                return MERR_OK;
+            }
+            WARN("Failed to write to socket: %s\n", strerror(errno));
+            return MERR_DEVICE_ERROR;
+        }
+        ep->tx_messages++;
+        return MERR_OK;
+    }
+
+    os_lock(&ep->lock);
+    for (size_t i = 0; i < ep->n_peers;)
+    {
+        struct ep_unix_peer_t* peer = &ep->peers[i];
+        ssize_t                n    = peer->fd >= 0
+                           ? send(peer->fd, bytes, len, MSG_DONTWAIT | MSG_NOSIGNAL)
+                           : sendto(ep->fd, bytes, len, MSG_DONTWAIT | MSG_NOSIGNAL,
+                               (struct sockaddr*)&peer->addr, peer->addr_len);
+        if (n >= 0)
+        {
+            ep->tx_messages++;
+        }
+        else if (peer->fd < 0 && (errno == ECONNREFUSED || errno == ENOENT))
+        {
+            /* the datagram client is gone; a connection the reader sees
+               hang up */
+            unix_remove(ep, i);
+            continue;
+        }
+        else
+        {
+            ep->tx_dropped++;
+        }
+        i++;
+    }
+    os_unlock(&ep->lock);
+    return MERR_OK;
+}
+
+void
+ep_linux_unix_attach_reader(struct mavtunnel_t* tunnel, struct endpoint_linux_unix_t* ep)
+{
+    ASSERT(tunnel != NULL);
+    ASSERT(ep != NULL);
+
+    tunnel->reader.read   = ep_linux_unix_read;
+    tunnel->reader.object = ep;
+}
+
+void
+ep_linux_unix_attach_writer(struct mavtunnel_t* tunnel, struct endpoint_linux_unix_t* ep)
+{
+    ASSERT(tunnel != NULL);
+    ASSERT(ep != NULL);
+
+    tunnel->writer.write  = ep_linux_unix_write;
+    tunnel->writer.object = ep;
+}
@@ -0,0 +1,595 @@
+#ifndef MAVTUNNEL_LINUX
+#error "This file is only for Linux"
+#endif
+
+#include "endpoint_linux_uring.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#define URING_RX        (~0ull)
+#define URING_TERMINATE (~0ull - 1)
+
+static int
+uring_setup(unsigned entries, struct io_uring_params* p)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int
+uring_register(int fd, unsigned opcode, const void* arg, unsigned n)
+{
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, n);
+}
+
+static enum mavtunnel_error_t
+uring_ring_init(struct ep_uring_ring_t* ring, bool sqpoll)
+{
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    if (sqpoll)
+    {
+        p.flags          = IORING_SETUP_SQPOLL;
+        p.sq_thread_idle = EP_URING_SQ_IDLE_MS;
+    }
+
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = uring_setup(EP_URING_ENTRIES, &p);
+    if (ring->fd < 0)
+    {
+        WARN("Failed to set up io_uring: %s\n", strerror(errno));
+        return MERR_DEVICE_ERROR;
+    }
+    ring->sqpoll  = sqpoll;
+    ring->entries = p.sq_entries;
+
+    ring->sq_map_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ring->cq_map_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        ring->sq_map_len = ring->sq_map_len > ring->cq_map_len ? ring->sq_map_len
+                                                               : ring->cq_map_len;
+        ring->cq_map_len = 0;
+    }
+
+    ring->sq_map = mmap(NULL, ring->sq_map_len, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    ring->cq_map = ring->cq_map_len == 0
+        ? ring->sq_map
+        : mmap(NULL, ring->cq_map_len, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+    ring->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes     = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sq_map == MAP_FAILED || ring->cq_map == MAP_FAILED
+        || ring->sqes == MAP_FAILED)
+    {
+        WARN("Failed to map io_uring: %s\n", strerror(errno));
+        return MERR_DEVICE_ERROR;
+    }
+
+    uint8_t* sq    = ring->sq_map;
+    uint8_t* cq    = ring->cq_map;
+    ring->sq_head  = (unsigned*)(sq + p.sq_off.head);
+    ring->sq_tail  = (unsigned*)(sq + p.sq_off.tail);
+    ring->sq_mask  = (unsigned*)(sq + p.sq_off.ring_mask);
+    ring->sq_flags = (unsigned*)(sq + p.sq_off.flags);
+    ring->sq_array = (unsigned*)(sq + p.sq_off.array);
+    ring->cq_head  = (unsigned*)(cq + p.cq_off.head);
+    ring->cq_tail  = (unsigned*)(cq + p.cq_off.tail);
+    ring->cq_mask  = (unsigned*)(cq + p.cq_off.ring_mask);
+    ring->cqes     = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+    return MERR_OK;
+}
+
+static void
+uring_ring_destroy(struct ep_uring_ring_t* ring)
+{
+    if (ring->sqes != NULL && ring->sqes != MAP_FAILED)
+    {
+        munmap(ring->sqes, ring->sqes_len);
+    }
+    if (ring->cq_map_len != 0 && ring->cq_map != NULL && ring->cq_map != MAP_FAILED)
+    {
+        munmap(ring->cq_map, ring->cq_map_len);
+    }
+    if (ring->sq_map != NULL && ring->sq_map != MAP_FAILED)
+    {
+        munmap(ring->sq_map, ring->sq_map_len);
+    }
+    if (ring->fd >= 0)
+    {
+        close(ring->fd);
+    }
+}
+
+/**
+ * @return a cleared entry, queued by uring_commit() once filled in
+ */
+static struct io_uring_sqe*
+uring_sqe(struct ep_uring_ring_t* ring)
+{
+    unsigned tail = *ring->sq_tail;
+    unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    if (tail - head >= ring->entries)
+    {
+        return NULL;
+    }
+    struct io_uring_sqe* sqe = &ring->sqes[tail & *ring->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+static void
+uring_commit(struct ep_uring_ring_t* ring)
+{
+    unsigned tail = *ring->sq_tail;
+    ring->sq_array[tail & *ring->sq_mask] = tail & *ring->sq_mask;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ring->pending++;
+}
+
+/**
+ * Submit what is queued and wait for min_complete completions, at most
+ * timeout_ms (-1: forever). A polled ring only needs waking up, if at all.
+ *
+ * @return 0, or a negative errno
+ */
+static int
+uring_enter(struct ep_uring_ring_t* ring, unsigned min_complete, int timeout_ms)
+{
+    unsigned flags     = 0;
+    unsigned to_submit = ring->pending;
+
+    if (ring->sqpoll)
+    {
+        if (__atomic_load_n(ring->sq_flags, __ATOMIC_ACQUIRE) & IORING_SQ_NEED_WAKEUP)
+        {
+            flags |= IORING_ENTER_SQ_WAKEUP;
+        }
+        ring->pending = 0;
+        if (flags == 0 && min_complete == 0)
+        {
+            return 0;
+        }
+    }
+    else if (to_submit == 0 && min_complete == 0)
+    {
+        return 0;
+    }
+
+    struct __kernel_timespec      ts;
+    struct io_uring_getevents_arg arg;
+    void*                         argp = NULL;
+    size_t                        argsz = 0;
+    if (min_complete > 0)
+    {
+        flags |= IORING_ENTER_GETEVENTS;
+        if (timeout_ms >= 0)
+        {
+            ts.tv_sec  = timeout_ms / 1000;
+            ts.tv_nsec = (timeout_ms % 1000) * 1000000ll;
+            memset(&arg, 0, sizeof(arg));
+            arg.ts = (uint64_t)(uintptr_t)&ts;
+            argp   = &arg;
+            argsz  = sizeof(arg);
+            flags |= IORING_ENTER_EXT_ARG;
+        }
+    }
+
+    ring->enters++;
+    int rv = (int)syscall(__NR_io_uring_enter, ring->fd,
+        ring->sqpoll ? 0 : to_submit, min_complete, flags, argp, argsz);
+    if (rv < 0)
+    {
+        return -errno;
+    }
+    if (!ring->sqpoll)
+    {
+        ring->pending -= (unsigned)rv < to_submit ? (unsigned)rv : to_submit;
+    }
+    return 0;
+}
+
+static struct io_uring_cqe*
+uring_cqe(struct ep_uring_ring_t* ring)
+{
+    unsigned head = *ring->cq_head;
+    unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+    return head == tail ? NULL : &ring->cqes[head & *ring->cq_mask];
+}
+
+static void
+uring_cqe_seen(struct ep_uring_ring_t* ring)
+{
+    __atomic_store_n(ring->cq_head, *ring->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+/* give a receive buffer back to the kernel */
+static void
+uring_rx_recycle(struct endpoint_linux_uring_t* ep, int bid)
+{
+    uint16_t              tail = ep->rx_ring->tail;
+    struct io_uring_buf*  buf  = &ep->rx_ring->bufs[tail & (EP_URING_RX_BUFFERS - 1)];
+    buf->addr = (uint64_t)(uintptr_t)(ep->rx_pool + bid * EP_URING_RX_BUFFER_SIZE);
+    buf->len  = EP_URING_RX_BUFFER_SIZE;
+    buf->bid  = (uint16_t)bid;
+    __atomic_store_n(&ep->rx_ring->tail, (uint16_t)(tail + 1), __ATOMIC_RELEASE);
+}
+
+static bool
+uring_rx_arm(struct endpoint_linux_uring_t* ep)
+{
+    struct io_uring_sqe* sqe = uring_sqe(&ep->rx);
+    if (sqe == NULL)
+    {
+        return false;
+    }
+
+    sqe->fd        = ep->fd;
+    sqe->flags     = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = 0;
+    sqe->user_data = URING_RX;
+    if (ep->kind == EP_URING_DATAGRAM)
+    {
+        sqe->opcode = IORING_OP_RECVMSG;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->addr   = (uint64_t)(uintptr_t)&ep->rx_msg;
+    }
+    else
+    {
+        sqe->opcode = IORING_OP_READ;
+        sqe->len    = EP_URING_RX_BUFFER_SIZE;
+        sqe->off    = (uint64_t)-1;
+    }
+    uring_commit(&ep->rx);
+    ep->rx_armed = true;
+    return true;
+}
+
+static enum mavtunnel_error_t
+uring_rx_init(struct endpoint_linux_uring_t* ep)
+{
+    ep->rx_pool = malloc(EP_URING_RX_BUFFERS * EP_URING_RX_BUFFER_SIZE);
+    ep->rx_ring = mmap(NULL, EP_URING_RX_BUFFERS * sizeof(struct io_uring_buf),
+        PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ep->rx_pool == NULL || ep->rx_ring == MAP_FAILED)
+    {
+        WARN("Failed to allocate receive buffers\n");
+        return MERR_DEVICE_ERROR;
+    }
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr    = (uint64_t)(uintptr_t)ep->rx_ring;
+    reg.ring_entries = EP_URING_RX_BUFFERS;
+    reg.bgid         = 0;
+    if (uring_register(ep->rx.fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+    {
+        WARN("Failed to register receive buffers: %s\n", strerror(errno));
+        return MERR_DEVICE_ERROR;
+    }
+    ep->rx_ring->tail = 0;
+    for (int bid = 0; bid < EP_URING_RX_BUFFERS; bid++)
+    {
+        uring_rx_recycle(ep, bid);
+    }
+
+    /* a multishot recvmsg takes the sizes of name and control from here */
+    memset(&ep->rx_msg, 0, sizeof(ep->rx_msg));
+    ep->rx_msg.msg_namelen = sizeof(struct sockaddr_in);
+    ep->rx_bid             = -1;
+
+    struct io_uring_sqe* sqe = uring_sqe(&ep->rx);
+    sqe->opcode        = IORING_OP_POLL_ADD;
+    sqe->fd            = ep->terminate_fd;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data     = URING_TERMINATE;
+    uring_commit(&ep->rx);
+    uring_rx_arm(ep);
+    return uring_enter(&ep->rx, 0, 0) == 0 ? MERR_OK : MERR_DEVICE_ERROR;
+}
+
+static enum mavtunnel_error_t
+uring_tx_init(struct endpoint_linux_uring_t* ep)
+{
+    ep->tx_pool = malloc(EP_URING_TX_SLOTS * EP_URING_TX_SLOT_SIZE);
+    if (ep->tx_pool == NULL)
+    {
+        WARN("Failed to allocate send buffers\n");
+        return MERR_DEVICE_ERROR;
+    }
+
+    struct iovec iov = {ep->tx_pool, EP_URING_TX_SLOTS * EP_URING_TX_SLOT_SIZE};
+    if (uring_register(ep->tx.fd, IORING_REGISTER_BUFFERS, &iov, 1) < 0)
+    {
+        WARN("Failed to register send buffers: %s\n", strerror(errno));
+        return MERR_DEVICE_ERROR;
+    }
+    ep->tx_free = EP_URING_TX_SLOTS == 32 ? ~0u : (1u << EP_URING_TX_SLOTS) - 1;
+    return MERR_OK;
+}
+
+enum mavtunnel_error_t
+ep_linux_uring_init(struct endpoint_linux_uring_t* ep, int fd,
+    enum ep_uring_kind_t kind, unsigned flags)
+{
+    ASSERT(ep != NULL);
+    ASSERT(fd >= 0);
+
+    memset(ep, 0, sizeof(*ep));
+    ep->fd           = fd;
+    ep->kind         = kind;
+    ep->rx.fd        = ep->tx.fd = -1;
+    ep->terminate_fd = eventfd(0, EFD_NONBLOCK);
+    if (ep->terminate_fd < 0)
+    {
+        WARN("Failed to create eventfd: %s\n", strerror(errno));
+        return MERR_DEVICE_ERROR;
+    }
+
+    if (uring_ring_init(&ep->rx, false) != MERR_OK
+        || uring_ring_init(&ep->tx, flags & EP_URING_SQPOLL) != MERR_OK
+        || uring_rx_init(ep) != MERR_OK || uring_tx_init(ep) != MERR_OK)
+    {
+        return MERR_DEVICE_ERROR;
+    }
+
+    atomic_store(&ep->has_peer, false);
+    atomic_store(&ep->terminated, false);
+    return MERR_OK;
+}
+
+void
+ep_linux_uring_destroy(struct endpoint_linux_uring_t* ep)
+{
+    ASSERT(ep != NULL);
+
+    uring_ring_destroy(&ep->rx);
+    uring_ring_destroy(&ep->tx);
+    if (ep->rx_ring != NULL && ep->rx_ring != MAP_FAILED)
+    {
+        munmap(ep->rx_ring, EP_URING_RX_BUFFERS * sizeof(struct io_uring_buf));
+    }
+    free(ep->rx_pool);
+    free(ep->tx_pool);
+    if (ep->terminate_fd >= 0)
+    {
+        close(ep->terminate_fd);
+    }
+}
+
+void
+ep_linux_uring_interrupt(struct endpoint_linux_uring_t* ep)
+{
+    eventfd_write(ep->terminate_fd, 1);
+}
+
+static size_t
+uring_rx_take(struct endpoint_linux_uring_t* ep, uint8_t* bytes, size_t len)
+{
+    size_t n = ep->rx_left < len ? ep->rx_left : len;
+    memcpy(bytes, ep->rx_data, n);
+    ep->rx_data += n;
+    ep->rx_left -= n;
+    if (ep->rx_left == 0)
+    {
+        uring_rx_recycle(ep, ep->rx_bid);
+        ep->rx_bid = -1;
+    }
+    return n;
+}
+
+static ssize_t
+ep_linux_uring_read(struct mavtunnel_reader_t* rd, uint8_t* bytes, size_t len)
+{
+    ASSERT(rd != NULL && rd->object != NULL);
+    ASSERT(bytes != NULL);
+
+    struct endpoint_linux_uring_t* ep = (struct endpoint_linux_uring_t*)rd->object;
+    if (ep->rx_left > 0)
+    {
+        return (ssize_t)uring_rx_take(ep, bytes, len);
+    }
+
+    for (;;)
+    {
+        struct io_uring_cqe* cqe = uring_cqe(&ep->rx);
+        if (cqe == NULL)
+        {
+            if (!ep->rx_armed)
+            {
+                uring_rx_arm(ep);
+            }
+            int rv = uring_enter(&ep->rx, 1, rd->timeout_ms);
+            if (rv < 0 && rv != -ETIME && rv != -EINTR)
+            {
+                WARN("Failed to wait for io_uring: %s\n", strerror(-rv));
+                atomic_store(&ep->terminated, true);
+                return -MERR_END;
+            }
+            if ((cqe = uring_cqe(&ep->rx)) == NULL)
+            {
+                return 0;
+            }
+        }
+
+        uint64_t user_data = cqe->user_data;
+        int      res       = cqe->res;
+        unsigned flags     = cqe->flags;
+        uring_cqe_seen(&ep->rx);
+
+        if (user_data == URING_TERMINATE)
+        {
+            atomic_store(&ep->terminated, true);
+            return -MERR_END;
+        }
+        if (!(flags & IORING_CQE_F_MORE))
+        {
+            ep->rx_armed = false;
+        }
+        if (res == -ENOBUFS || res == -EAGAIN || res == -EINTR)
+        {
+            continue;
+        }
+        if (res < 0)
+        {
+            WARN("Failed to receive: %s\n", strerror(-res));
+            atomic_store(&ep->terminated, true);
+            return -MERR_END;
+        }
+        if (!(flags & IORING_CQE_F_BUFFER))
+        {
+            continue;
+        }
+
+        int      bid  = flags >> IORING_CQE_BUFFER_SHIFT;
+        uint8_t* data = ep->rx_pool + bid * EP_URING_RX_BUFFER_SIZE;
+        size_t   size = res;
+        if (ep->kind == EP_URING_DATAGRAM)
+        {
+            /* [recvmsg_out][name][control][payload] */
+            struct io_uring_recvmsg_out* out = (struct io_uring_recvmsg_out*)data;
+            if (out->namelen >= sizeof(struct sockaddr_in))
+            {
+                memcpy(&ep->peer, data + sizeof(*out), sizeof(ep->peer));
+                atomic_store(&ep->has_peer, true);
+            }
+            size = out->payloadlen;
+            data += sizeof(*out) + ep->rx_msg.msg_namelen + ep->rx_msg.msg_controllen;
+        }
+
+        ep->rx_completions++;
+        ep->rx_bytes += size;
+        ep->rx_bid  = bid;
+        ep->rx_data = data;
+        ep->rx_left = size;
+        if (size == 0)
+        {
+            uring_rx_recycle(ep, bid);
+            ep->rx_bid = -1;
+            if (ep->kind == EP_URING_STREAM)
+            {
+                return 0;
+            }
+            continue;
+        }
+        return (ssize_t)uring_rx_take(ep, bytes, len);
+    }
+}
+
+static void
+uring_tx_reap(struct endpoint_linux_uring_t* ep)
+{
+    struct io_uring_cqe* cqe;
+    while ((cqe = uring_cqe(&ep->tx)) != NULL)
+    {
+        size_t slot = (size_t)cqe->user_data;
+        if (cqe->res < 0 || (size_t)cqe->res < ep->tx_len[slot])
+        {
+            ep->tx_errors++;
+        }
+        ep->tx_free |= 1u << slot;
+        ep->tx_inflight--;
+        uring_cqe_seen(&ep->tx);
+    }
+}
+
+static enum mavtunnel_error_t
+ep_linux_uring_write(struct mavtunnel_writer_t* wr, const uint8_t* bytes, size_t len)
+{
+    ASSERT(wr != NULL && wr->object != NULL);
+    ASSERT(bytes != NULL);
+
+    struct endpoint_linux_uring_t* ep = (struct endpoint_linux_uring_t*)wr->object;
+    if (len > EP_URING_TX_SLOT_SIZE)
+    {
+        return MERR_BAD_LENGTH;
+    }
+    if (ep->kind == EP_URING_DATAGRAM && !atomic_load(&ep->has_peer))
+    {
+        return MERR_OK;
+    }
+
+    unsigned limit = ep->kind == EP_URING_STREAM ? 1 : EP_URING_TX_SLOTS;
+    uring_tx_reap(ep);
+    while (ep->tx_inflight >= limit || ep->tx_free == 0)
+    {
+        int rv = uring_enter(&ep->tx, 1, -1);
+        if (rv < 0 && rv != -EINTR)
+        {
+            WARN("Failed to wait for io_uring: %s\n", strerror(-rv));
+            return MERR_DEVICE_ERROR;
+        }
+        uring_tx_reap(ep);
+    }
+
+    struct io_uring_sqe* sqe = uring_sqe(&ep->tx);
+    if (sqe == NULL)
+    {
+        return MERR_DEVICE_ERROR;
+    }
+    size_t   slot = __builtin_ctz(ep->tx_free);
+    uint8_t* buf  = ep->tx_pool + slot * EP_URING_TX_SLOT_SIZE;
+    memcpy(buf, bytes, len);
+    ep->tx_free &= ~(1u << slot);
+    ep->tx_len[slot] = (uint16_t)len;
+
+    sqe->fd        = ep->fd;
+    sqe->addr      = (uint64_t)(uintptr_t)buf;
+    sqe->len       = (uint32_t)len;
+    sqe->user_data = slot;
+    if (ep->kind == EP_URING_DATAGRAM)
+    {
+        /* a plain send takes no fixed buffer, the slot only keeps the frame
+           alive until the completion */
+        ep->tx_peer[slot] = ep->peer;
+        sqe->opcode       = IORING_OP_SEND;
+        sqe->addr2        = (uint64_t)(uintptr_t)&ep->tx_peer[slot];
+        sqe->addr_len     = sizeof(struct sockaddr_in);
+    }
+    else
+    {
+        sqe->opcode    = IORING_OP_WRITE_FIXED;
+        sqe->off       = (uint64_t)-1;
+        sqe->buf_index = 0;
+    }
+    uring_commit(&ep->tx);
+    ep->tx_inflight++;
+    ep->tx_frames++;
+
+    int rv = uring_enter(&ep->tx, 0, 0);
+    if (rv < 0)
+    {
+        WARN("Failed to submit to io_uring: %s\n", strerror(-rv));
+        return MERR_DEVICE_ERROR;
+    }
+    return MERR_OK;
+}
+
+void
+ep_linux_uring_attach_reader(
+    struct mavtunnel_t* tunnel, struct endpoint_linux_uring_t* ep)
+{
+    ASSERT(tunnel != NULL);
+    ASSERT(ep != NULL);
+
+    tunnel->reader.read   = ep_linux_uring_read;
+    tunnel->reader.object = ep;
+}
+
+void
+ep_linux_uring_attach_writer(
+    struct mavtunnel_t* tunnel, struct endpoint_linux_uring_t* ep)
+{
+    ASSERT(tunnel != NULL);
+    ASSERT(ep != NULL);
+
+    tunnel->writer.write  = ep_linux_uring_write;
+    tunnel->writer.object = ep;
+}
@@ -0,0 +1,573 @@
+#ifndef MAVTUNNEL_LINUX
+#error "This file is only for Linux"
+#endif
+
+#include "endpoint_linux_xdp.h"
+
+#include <errno.h>
+#include <unistd.h>
+
+#include <linux/bpf.h>
+#include <linux/if_ether.h>
+#include <linux/if_link.h>
+#include <net/if.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+
+#ifndef AF_XDP
+#define AF_XDP 44
+#endif
+#ifndef SOL_XDP
+#define SOL_XDP 283
+#endif
+
+#define XDP_TX_FRAME(i) ((uint64_t)(EP_XDP_FRAMES / 2 + (i)) * EP_XDP_FRAME_SIZE)
+
+static int
+xdp_bpf(int cmd, union bpf_attr* attr)
+{
+    return (int)syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+
+/**
+ * if (IPv4 without options && UDP && dport == port)
+ *     return bpf_redirect_map(&xsks, rx_queue_index, XDP_PASS);
+ * return XDP_PASS;
+ */
+static int
+xdp_load_program(int map_fd, uint16_t port)
+{
+#define INSN(code, dst, src, off, imm) {(code), (dst), (src), (off), (imm)}
+    struct bpf_insn prog[] = {
+        INSN(BPF_LDX | BPF_W | BPF_MEM, BPF_REG_2, BPF_REG_1, 0, 0),
+        INSN(BPF_LDX | BPF_W | BPF_MEM, BPF_REG_3, BPF_REG_1, 4, 0),
+        INSN(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_4, BPF_REG_2, 0, 0),
+        INSN(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_4, 0, 0, EP_XDP_HEADERS),
+        INSN(BPF_JMP | BPF_JGT | BPF_X, BPF_REG_4, BPF_REG_3, 14, 0),
+        INSN(BPF_LDX | BPF_H | BPF_MEM, BPF_REG_4, BPF_REG_2, 12, 0),
+        INSN(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_4, 0, 12, htons(ETH_P_IP)),
+        INSN(BPF_LDX | BPF_B | BPF_MEM, BPF_REG_4, BPF_REG_2, 14, 0),
+        INSN(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_4, 0, 10, 0x45),
+        INSN(BPF_LDX | BPF_B | BPF_MEM, BPF_REG_4, BPF_REG_2, 23, 0),
+        INSN(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_4, 0, 8, IPPROTO_UDP),
+        INSN(BPF_LDX | BPF_H | BPF_MEM, BPF_REG_4, BPF_REG_2, 36, 0),
+        INSN(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_4, 0, 6, htons(port)),
+        INSN(BPF_LDX | BPF_W | BPF_MEM, BPF_REG_2, BPF_REG_1, 16, 0),
+        INSN(BPF_LD | BPF_DW | BPF_IMM, BPF_REG_1, BPF_PSEUDO_MAP_FD, 0, map_fd),
+        INSN(0, 0, 0, 0, 0),
+        INSN(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_3, 0, 0, XDP_PASS),
+        INSN(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map),
+        INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0),
+        INSN(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_0, 0, 0, XDP_PASS),
+        INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0),
+    };
+#undef INSN
+
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.prog_type = BPF_PROG_TYPE_XDP;
+    attr.insns     = (uint64_t)(uintptr_t)prog;
+    attr.insn_cnt  = sizeof(prog) / sizeof(prog[0]);
+    attr.license   = (uint64_t)(uintptr_t) "Dual MIT/GPL";
+    return xdp_bpf(BPF_PROG_LOAD, &attr);
+}
+
+static enum mavtunnel_error_t
+xdp_attach(struct endpoint_linux_xdp_t* ep, unsigned flags)
+{
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.map_type    = BPF_MAP_TYPE_XSKMAP;
+    attr.key_size    = sizeof(uint32_t);
+    attr.value_size  = sizeof(uint32_t);
+    attr.max_entries = ep->queue + 1;
+    ep->map_fd       = xdp_bpf(BPF_MAP_CREATE, &attr);
+    if (ep->map_fd < 0)
+    {
+        WARN("Failed to create XSK map: %s\n", strerror(errno));
+        return MERR_DEVICE_ERROR;
+    }
+
+    uint32_t value = ep->fd;
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = ep->map_fd;
+    attr.key    = (uint64_t)(uintptr_t)&ep->queue;
+    attr.value  = (uint64_t)(uintptr_t)&value;
+    if (xdp_bpf(BPF_MAP_UPDATE_ELEM, &attr) < 0)
+    {
+        WARN("Failed to insert XSK socket: %s\n", strerror(errno));
+        return MERR_DEVICE_ERROR;
+    }
+
+    ep->prog_fd = xdp_load_program(ep->map_fd, ep->port);
+    if (ep->prog_fd < 0)
+    {
+        WARN("Failed to load XDP program: %s\n", strerror(errno));
+        return MERR_DEVICE_ERROR;
+    }
+
+    /* the link detaches the program when the endpoint closes it */
+    memset(&attr, 0, sizeof(attr));
+    attr.link_create.prog_fd        = ep->prog_fd;
+    attr.link_create.target_ifindex = ep->ifindex;
+    attr.link_create.attach_type    = BPF_XDP;
+    attr.link_create.flags
+        = (flags & EP_XDP_ZEROCOPY) ? XDP_FLAGS_DRV_MODE : XDP_FLAGS_SKB_MODE;
+    ep->link_fd = xdp_bpf(BPF_LINK_CREATE, &attr);
+    if (ep->link_fd < 0)
+    {
+        WARN("Failed to attach XDP program: %s\n", strerror(errno));
+        return MERR_DEVICE_ERROR;
+    }
+    return MERR_OK;
+}
+
+static enum mavtunnel_error_t
+xdp_ring_map(struct endpoint_linux_xdp_t* ep, struct ep_xdp_ring_t* ring,
+    const struct xdp_ring_offset* off, size_t entry_size, off_t pgoff)
+{
+    ring->map_len = off->desc + EP_XDP_RING_SIZE * entry_size;
+    ring->map     = mmap(NULL, ring->map_len, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ep->fd, pgoff);
+    if (ring->map == MAP_FAILED)
+    {
+        WARN("Failed to map XSK ring: %s\n", strerror(errno));
+        return MERR_DEVICE_ERROR;
+    }
+
+    uint8_t* base  = ring->map;
+    ring->producer = (uint32_t*)(base + off->producer);
+    ring->consumer = (uint32_t*)(base + off->consumer);
+    ring->flags    = (uint32_t*)(base + off->flags);
+    ring->ring     = base + off->desc;
+    ring->mask     = EP_XDP_RING_SIZE - 1;
+    return MERR_OK;
+}
+
+static enum mavtunnel_error_t
+xdp_socket(struct endpoint_linux_xdp_t* ep, unsigned flags)
+{
+    ep->fd = socket(AF_XDP, SOCK_RAW, 0);
+    if (ep->fd < 0)
+    {
+        WARN("Failed to create XDP socket: %s\n", strerror(errno));
+        return MERR_DEVICE_ERROR;
+    }
+
+    ep->umem = mmap(NULL, EP_XDP_FRAMES * EP_XDP_FRAME_SIZE, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ep->umem == MAP_FAILED)
+    {
+        WARN("Failed to allocate UMEM: %s\n", strerror(errno));
+        return MERR_DEVICE_ERROR;
+    }
+
+    struct xdp_umem_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.addr       = (uint64_t)(uintptr_t)ep->umem;
+    reg.len        = EP_XDP_FRAMES * EP_XDP_FRAME_SIZE;
+    reg.chunk_size = EP_XDP_FRAME_SIZE;
+    int size       = EP_XDP_RING_SIZE;
+    if (setsockopt(ep->fd, SOL_XDP, XDP_UMEM_REG, &reg, sizeof(reg)) < 0
+        || setsockopt(ep->fd, SOL_XDP, XDP_UMEM_FILL_RING, &size, sizeof(size)) < 0
+        || setsockopt(ep->fd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &size, sizeof(size)) < 0
+        || setsockopt(ep->fd, SOL_XDP, XDP_RX_RING, &size, sizeof(size)) < 0
+        || setsockopt(ep->fd, SOL_XDP, XDP_TX_RING, &size, sizeof(size)) < 0)
+    {
+        WARN("Failed to configure XDP socket: %s\n", strerror(errno));
+        return MERR_DEVICE_ERROR;
+    }
+
+    struct xdp_mmap_offsets off;
+    socklen_t               off_len = sizeof(off);
+    if (getsockopt(ep->fd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &off_len) < 0)
+    {
+        WARN("Failed to query XSK rings: %s\n", strerror(errno));
+        return MERR_DEVICE_ERROR;
+    }
+    if (xdp_ring_map(ep, &ep->rx, &off.rx, sizeof(struct xdp_desc), XDP_PGOFF_RX_RING)
+            != MERR_OK
+        || xdp_ring_map(ep, &ep->tx, &off.tx, sizeof(struct xdp_desc), XDP_PGOFF_TX_RING)
+            != MERR_OK
+        || xdp_ring_map(ep, &ep->fill, &off.fr, sizeof(uint64_t), XDP_UMEM_PGOFF_FILL_RING)
+            != MERR_OK
+        || xdp_ring_map(ep, &ep->comp, &off.cr, sizeof(uint64_t),
+               XDP_UMEM_PGOFF_COMPLETION_RING)
+            != MERR_OK)
+    {
+        return MERR_DEVICE_ERROR;
+    }
+
+    /* hand the receive half of the UMEM to the kernel */
+    uint64_t* fill = ep->fill.ring;
+    for (uint32_t i = 0; i < EP_XDP_RING_SIZE; i++)
+    {
+        fill[i] = (uint64_t)i * EP_XDP_FRAME_SIZE;
+    }
+    __atomic_store_n(ep->fill.producer, EP_XDP_RING_SIZE, __ATOMIC_RELEASE);
+    for (size_t i = 0; i < EP_XDP_FRAMES / 2; i++)
+    {
+        ep->tx_free[i] = XDP_TX_FRAME(i);
+    }
+    ep->n_tx_free = EP_XDP_FRAMES / 2;
+
+    struct sockaddr_xdp addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sxdp_family   = AF_XDP;
+    addr.sxdp_flags    = ((flags & EP_XDP_ZEROCOPY) ? XDP_ZEROCOPY : XDP_COPY)
+        | XDP_USE_NEED_WAKEUP;
+    addr.sxdp_ifindex  = ep->ifindex;
+    addr.sxdp_queue_id = ep->queue;
+    if (bind(ep->fd, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+    {
+        WARN("Failed to bind XDP socket: %s\n", strerror(errno));
+        return MERR_DEVICE_ERROR;
+    }
+    return MERR_OK;
+}
+
+static enum mavtunnel_error_t
+xdp_epoll(struct endpoint_linux_xdp_t* ep)
+{
+    ep->epoll = epoll_create1(0);
+    if (ep->epoll < 0)
+    {
+        WARN("Failed to create epoll instance: %s\n", strerror(errno));
+        return MERR_DEVICE_ERROR;
+    }
+
+    struct epoll_event ev;
+    ev.events  = EPOLLIN;
+    ev.data.fd = ep->fd;
+    if (epoll_ctl(ep->epoll, EPOLL_CTL_ADD, ep->fd, &ev) < 0)
+    {
+        WARN("Failed to add XDP socket to epoll: %s\n", strerror(errno));
+        return MERR_DEVICE_ERROR;
+    }
+
+    ep->terminate_fd = eventfd(0, EFD_NONBLOCK);
+    ev.events        = EPOLLIN;
+    ev.data.fd       = ep->terminate_fd;
+    if (ep->terminate_fd < 0
+        || epoll_ctl(ep->epoll, EPOLL_CTL_ADD, ep->terminate_fd, &ev) < 0)
+    {
+        WARN("Failed to add eventfd to epoll: %s\n", strerror(errno));
+        return MERR_DEVICE_ERROR;
+    }
+    return MERR_OK;
+}
+
+enum mavtunnel_error_t
+ep_linux_xdp_init(struct endpoint_linux_xdp_t* ep, const char* ifname,
+    uint32_t queue, uint16_t port, unsigned flags)
+{
+    ASSERT(ep != NULL);
+    ASSERT(ifname != NULL);
+
+    memset(ep, 0, sizeof(*ep));
+    ep->fd = ep->map_fd = ep->prog_fd = ep->link_fd = -1;
+    ep->epoll = ep->terminate_fd = -1;
+    ep->umem                     = MAP_FAILED;
+    ep->queue                    = queue;
+    ep->port                     = port;
+    ep->ifindex                  = (int)if_nametoindex(ifname);
+    if (ep->ifindex == 0)
+    {
+        WARN("Unknown interface %s\n", ifname);
+        return MERR_DEVICE_ERROR;
+    }
+
+    /* our replies carry the interface's own address */
+    struct ifreq ifr;
+    int          sock = socket(AF_INET, SOCK_DGRAM, 0);
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, ifname, IFNAMSIZ - 1);
+    if (sock < 0 || ioctl(sock, SIOCGIFHWADDR, &ifr) < 0)
+    {
+        WARN("Failed to get address of %s: %s\n", ifname, strerror(errno));
+        if (sock >= 0)
+        {
+            close(sock);
+        }
+        return MERR_DEVICE_ERROR;
+    }
+    close(sock);
+    memcpy(ep->local_mac, ifr.ifr_hwaddr.sa_data, sizeof(ep->local_mac));
+
+    if (xdp_socket(ep, flags) != MERR_OK || xdp_attach(ep, flags) != MERR_OK
+        || xdp_epoll(ep) != MERR_OK)
+    {
+        return MERR_DEVICE_ERROR;
+    }
+
+    atomic_store(&ep->has_client, false);
+    atomic_store(&ep->terminated, false);
+    return MERR_OK;
+}
+
+void
+ep_linux_xdp_destroy(struct endpoint_linux_xdp_t* ep)
+{
+    ASSERT(ep != NULL);
+
+    int fds[] = {ep->link_fd, ep->prog_fd, ep->map_fd, ep->terminate_fd, ep->epoll};
+    for (size_t i = 0; i < sizeof(fds) / sizeof(fds[0]); i++)
+    {
+        if (fds[i] >= 0)
+        {
+            close(fds[i]);
+        }
+    }
+
+    struct ep_xdp_ring_t* rings[] = {&ep->rx, &ep->tx, &ep->fill, &ep->comp};
+    for (size_t i = 0; i < 4; i++)
+    {
+        if (rings[i]->map != NULL && rings[i]->map != MAP_FAILED)
+        {
+            munmap(rings[i]->map, rings[i]->map_len);
+        }
+    }
+    if (ep->fd >= 0)
+    {
+        close(ep->fd);
+    }
+    if (ep->umem != MAP_FAILED)
+    {
+        munmap(ep->umem, EP_XDP_FRAMES * EP_XDP_FRAME_SIZE);
+    }
+}
+
+void
+ep_linux_xdp_interrupt(struct endpoint_linux_xdp_t* ep)
+{
+    eventfd_write(ep->terminate_fd, 1);
+}
+
+/**
+ * @return the UDP payload of a frame for our port, or NULL
+ */
+static const uint8_t*
+xdp_parse(struct endpoint_linux_xdp_t* ep, const uint8_t* frame, size_t len, size_t* n)
+{
+    if (len < EP_XDP_HEADERS)
+    {
+        return NULL;
+    }
+    const struct ethhdr* eth = (const struct ethhdr*)frame;
+    const struct iphdr*  ip  = (const struct iphdr*)(frame + ETH_HLEN);
+    size_t               ihl = ip->ihl * 4u;
+    if (eth->h_proto != htons(ETH_P_IP) || ip->protocol != IPPROTO_UDP || ihl < 20
+        || len < ETH_HLEN + ihl + sizeof(struct udphdr))
+    {
+        return NULL;
+    }
+    const struct udphdr* udp = (const struct udphdr*)(frame + ETH_HLEN + ihl);
+    size_t               end = ETH_HLEN + ihl + ntohs(udp->len);
+    if (udp->dest != htons(ep->port) || ntohs(udp->len) < sizeof(*udp) || end > len)
+    {
+        return NULL;
+    }
+
+    memcpy(ep->peer_mac, eth->h_source, sizeof(ep->peer_mac));
+    ep->local_ip                    = ip->daddr;
+    ep->client.sin_family           = AF_INET;
+    ep->client.sin_addr.s_addr      = ip->saddr;
+    ep->client.sin_port             = udp->source;
+    atomic_store(&ep->has_client, true);
+
+    *n = ntohs(udp->len) - sizeof(*udp);
+    return (const uint8_t*)(udp + 1);
+}
+
+static ssize_t
+ep_linux_xdp_read(struct mavtunnel_reader_t* rd, uint8_t* bytes, size_t len)
+{
+    ASSERT(rd != NULL && rd->object != NULL);
+    ASSERT(bytes != NULL);
+
+    struct endpoint_linux_xdp_t* ep = (struct endpoint_linux_xdp_t*)rd->object;
+    for (;;)
+    {
+        uint32_t cons = *ep->rx.consumer;
+        if (cons == __atomic_load_n(ep->rx.producer, __ATOMIC_ACQUIRE))
+        {
+            int n_events = epoll_wait(ep->epoll, ep->event, 2, rd->timeout_ms);
+            if (n_events < 0)
+            {
+                WARN("Failed to wait for epoll events: %s\n", strerror(errno));
+                atomic_store(&ep->terminated, true);
+                return -MERR_END;
+            }
+            else if (n_events == 0)
+            {
+                return 0;
+            }
+            for (int i = 0; i < n_events; i++)
+            {
+                if (ep->event[i].data.fd == ep->terminate_fd)
+                {
+                    atomic_store(&ep->terminated, true);
+                    return -MERR_END;
+                }
+            }
+            continue;
+        }
+
+        struct xdp_desc desc = ((struct xdp_desc*)ep->rx.ring)[cons & ep->rx.mask];
+        __atomic_store_n(ep->rx.consumer, cons + 1, __ATOMIC_RELEASE);
+
+        size_t         n       = 0;
+        const uint8_t* payload = xdp_parse(ep, ep->umem + desc.addr, desc.len, &n);
+        if (payload != NULL)
+        {
+            n = n < len ? n : len;
+            memcpy(bytes, payload, n);
+        }
+
+        /* the frame goes straight back to the kernel; the fill ring has a
+           slot for every receive frame, so it cannot be full */
+        uint32_t prod                                      = *ep->fill.producer;
+        ((uint64_t*)ep->fill.ring)[prod & ep->fill.mask]
+            = desc.addr & ~(uint64_t)(EP_XDP_FRAME_SIZE - 1);
+        __atomic_store_n(ep->fill.producer, prod + 1, __ATOMIC_RELEASE);
+        if (*ep->fill.flags & XDP_RING_NEED_WAKEUP)
+        {
+            recvfrom(ep->fd, NULL, 0, MSG_DONTWAIT, NULL, NULL);
+        }
+
+        if (payload == NULL)
+        {
+            ep->rx_dropped++;
+            continue;
+        }
+        ep->rx_packets++;
+        return (ssize_t)n;
+    }
+}
+
+static void
+xdp_reap(struct endpoint_linux_xdp_t* ep)
+{
+    uint32_t cons = *ep->comp.consumer;
+    uint32_t prod = __atomic_load_n(ep->comp.producer, __ATOMIC_ACQUIRE);
+    for (; cons != prod; cons++)
+    {
+        ep->tx_free[ep->n_tx_free++] = ((uint64_t*)ep->comp.ring)[cons & ep->comp.mask];
+    }
+    __atomic_store_n(ep->comp.consumer, cons, __ATOMIC_RELEASE);
+}
+
+static uint16_t
+xdp_ip_checksum(const struct iphdr* ip)
+{
+    const uint16_t* words = (const uint16_t*)ip;
+    uint32_t        sum   = 0;
+    for (size_t i = 0; i < sizeof(*ip) / 2; i++)
+    {
+        sum += words[i];
+    }
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum = (sum & 0xffff) + (sum >> 16);
+    return (uint16_t)~sum;
+}
+
+static enum mavtunnel_error_t
+ep_linux_xdp_write(struct mavtunnel_writer_t* wr, const uint8_t* bytes, size_t len)
+{
+    ASSERT(wr != NULL && wr->object != NULL);
+    ASSERT(bytes != NULL);
+
+    struct endpoint_linux_xdp_t* ep = (struct endpoint_linux_xdp_t*)wr->object;
+    if (!atomic_load(&ep->has_client))
+    {
+        return MERR_OK;
+    }
+    if (len > EP_XDP_FRAME_SIZE - EP_XDP_HEADERS)
+    {
+        return MERR_BAD_LENGTH;
+    }
+
+    xdp_reap(ep);
+    if (ep->n_tx_free == 0)
+    {
+        sendto(ep->fd, NULL, 0, MSG_DONTWAIT, NULL, 0);
+        xdp_reap(ep);
+        if (ep->n_tx_free == 0)
+        {
+            ep->tx_dropped++;
+            return MERR_DEVICE_ERROR;
+        }
+    }
+
+    uint64_t       addr  = ep->tx_free[--ep->n_tx_free];
+    uint8_t*       frame = ep->umem + addr;
+    struct ethhdr* eth   = (struct ethhdr*)frame;
+    struct iphdr*  ip    = (struct iphdr*)(frame + ETH_HLEN);
+    struct udphdr* udp   = (struct udphdr*)(ip + 1);
+
+    memcpy(eth->h_dest, ep->peer_mac, ETH_ALEN);
+    memcpy(eth->h_source, ep->local_mac, ETH_ALEN);
+    eth->h_proto = htons(ETH_P_IP);
+
+    memset(ip, 0, sizeof(*ip));
+    ip->version  = 4;
+    ip->ihl      = 5;
+    ip->tot_len  = htons(sizeof(*ip) + sizeof(*udp) + len);
+    ip->id       = htons(ep->ip_id++);
+    ip->frag_off = htons(IP_DF);
+    ip->ttl      = 64;
+    ip->protocol = IPPROTO_UDP;
+    ip->saddr    = ep->local_ip;
+    ip->daddr    = ep->client.sin_addr.s_addr;
+    ip->check    = xdp_ip_checksum(ip);
+
+    /* a zero checksum is allowed over IPv4 and saves a pass over the frame */
+    udp->source = htons(ep->port);
+    udp->dest   = ep->client.sin_port;
+    udp->len    = htons(sizeof(*udp) + len);
+    udp->check  = 0;
+    memcpy(udp + 1, bytes, len);
+
+    /* the tx ring has a slot for every transmit frame, so it cannot be full */
+    uint32_t         prod = *ep->tx.producer;
+    struct xdp_desc* desc = &((struct xdp_desc*)ep->tx.ring)[prod & ep->tx.mask];
+    desc->addr            = addr;
+    desc->len             = EP_XDP_HEADERS + len;
+    desc->options         = 0;
+    __atomic_store_n(ep->tx.producer, prod + 1, __ATOMIC_RELEASE);
+
+    if ((*ep->tx.flags & XDP_RING_NEED_WAKEUP)
+        && sendto(ep->fd, NULL, 0, MSG_DONTWAIT, NULL, 0) < 0 && errno != EAGAIN
+        && errno != EBUSY && errno != ENOBUFS)
+    {
+        WARN("Failed to kick XDP socket: %s\n", strerror(errno));
+        return MERR_DEVICE_ERROR;
+    }
+    ep->tx_packets++;
+    return MERR_OK;
+}
+
+void
+ep_linux_xdp_attach_reader(struct mavtunnel_t* tunnel, struct endpoint_linux_xdp_t* ep)
+{
+    ASSERT(tunnel != NULL);
+    ASSERT(ep != NULL);
+
+    tunnel->reader.read   = ep_linux_xdp_read;
+    tunnel->reader.object = ep;
+}
+
+void
+ep_linux_xdp_attach_writer(struct mavtunnel_t* tunnel, struct endpoint_linux_xdp_t* ep)
+{
+    ASSERT(tunnel != NULL);
+    ASSERT(ep != NULL);
+
+    tunnel->writer.write  = ep_linux_xdp_write;
+    tunnel->writer.object = ep;
+}
@@ -0,0 +1,242 @@
+#include "endpoint_loopback.h"
+
+#include <errno.h>
+
+/* datagrams are stored as a 16-bit length, then the bytes */
+#define EP_LOOPBACK_DATAGRAM_HEADER 2
+
+static void
+ring_copy_in(struct ep_loopback_ring_t* ring, size_t pos, const uint8_t* bytes, size_t len)
+{
+    size_t offset = pos & (ring->size - 1);
+    size_t first  = ring->size - offset < len ? ring->size - offset : len;
+    memcpy(ring->data + offset, bytes, first);
+    memcpy(ring->data, bytes + first, len - first);
+}
+
+static void
+ring_copy_out(const struct ep_loopback_ring_t* ring, size_t pos, uint8_t* bytes, size_t len)
+{
+    size_t offset = pos & (ring->size - 1);
+    size_t first  = ring->size - offset < len ? ring->size - offset : len;
+    memcpy(bytes, ring->data + offset, first);
+    memcpy(bytes + first, ring->data, len - first);
+}
+
+enum mavtunnel_error_t
+ep_loopback_pair_init(
+    struct endpoint_loopback_pair_t* pair, enum ep_loopback_kind_t kind, size_t ring_size)
+{
+    ASSERT(pair != NULL);
+
+    if (ring_size == 0)
+    {
+        ring_size = EP_LOOPBACK_RING_SIZE;
+    }
+    if ((ring_size & (ring_size - 1)) != 0)
+    {
+        WARN("Loopback ring size %zu is not a power of two\n", ring_size);
+        return MERR_BAD_LENGTH;
+    }
+
+    /* timed sleeps run on the clock of time_us() */
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+
+    memset(pair, 0, sizeof(*pair));
+    for (int i = 0; i < 2; i++)
+    {
+        struct ep_loopback_ring_t* ring = &pair->ring[i];
+        atomic_store(&ring->head, 0);
+        atomic_store(&ring->tail, 0);
+        atomic_store(&ring->waiting, false);
+        pthread_mutex_init(&ring->lock, NULL);
+        pthread_cond_init(&ring->cond, &attr);
+        ring->size = ring_size;
+        ring->data = (uint8_t*)malloc(ring_size);
+        if (ring->data == NULL)
+        {
+            pthread_condattr_destroy(&attr);
+            return MERR_DEVICE_ERROR;
+        }
+
+        struct endpoint_loopback_t* ep = &pair->end[i];
+        ep->kind = kind;
+        ep->tx   = &pair->ring[i];
+        ep->rx   = &pair->ring[1 - i];
+        atomic_store(&ep->terminated, false);
+    }
+    pthread_condattr_destroy(&attr);
+    return MERR_OK;
+}
+
+void
+ep_loopback_pair_destroy(struct endpoint_loopback_pair_t* pair)
+{
+    ASSERT(pair != NULL);
+
+    for (int i = 0; i < 2; i++)
+    {
+        free(pair->ring[i].data);
+        pair->ring[i].data = NULL;
+        pthread_cond_destroy(&pair->ring[i].cond);
+        pthread_mutex_destroy(&pair->ring[i].lock);
+    }
+}
+
+void
+ep_loopback_interrupt(struct endpoint_loopback_t* ep)
+{
+    ASSERT(ep != NULL);
+    atomic_store(&ep->terminated, true);
+
+    pthread_mutex_lock(&ep->rx->lock);
+    pthread_cond_broadcast(&ep->rx->cond);
+    pthread_mutex_unlock(&ep->rx->lock);
+}
+
+/**
+ * @return bytes in the ring, 0 if it stayed empty for timeout_ms
+ */
+static size_t
+ep_loopback_wait(struct endpoint_loopback_t* ep, size_t tail, int timeout_ms)
+{
+    struct ep_loopback_ring_t* ring = ep->rx;
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    for (unsigned polls = 0; head == tail && timeout_ms != 0 && polls < EP_LOOPBACK_SPIN_POLLS;
+         polls++)
+    {
+        head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    }
+    if (head != tail || timeout_ms == 0)
+    {
+        return head - tail;
+    }
+
+    uint64_t        due = time_us() + (uint64_t)timeout_ms * 1000;
+    struct timespec ts  = {due / 1000000, (due % 1000000) * 1000};
+
+    /* waiting is set before head is checked again, and the writer checks
+     * waiting after it moved head, so one of the two sees the other */
+    pthread_mutex_lock(&ring->lock);
+    atomic_store(&ring->waiting, true);
+    while ((head = atomic_load(&ring->head)) == tail && !atomic_load(&ep->terminated))
+    {
+        if (timeout_ms < 0)
+        {
+            pthread_cond_wait(&ring->cond, &ring->lock);
+        }
+        else if (pthread_cond_timedwait(&ring->cond, &ring->lock, &ts) == ETIMEDOUT)
+        {
+            head = atomic_load(&ring->head);
+            break;
+        }
+    }
+    atomic_store(&ring->waiting, false);
+    pthread_mutex_unlock(&ring->lock);
+    return head - tail;
+}
+
+static ssize_t
+ep_loopback_read(struct mavtunnel_reader_t* rd, uint8_t* bytes, size_t len)
+{
+    ASSERT(rd != NULL && rd->object != NULL);
+    ASSERT(bytes != NULL);
+
+    struct endpoint_loopback_t* ep = (struct endpoint_loopback_t*)rd->object;
+    if (atomic_load(&ep->terminated))
+    {
+        return -MERR_END;
+    }
+
+    struct ep_loopback_ring_t* ring  = ep->rx;
+    size_t                     tail  = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t                     avail = ep_loopback_wait(ep, tail, rd->timeout_ms);
+    if (avail == 0)
+    {
+        return atomic_load(&ep->terminated) ? -MERR_END : 0;
+    }
+
+    size_t n, used;
+    if (ep->kind == EP_LOOPBACK_BYTES)
+    {
+        n    = avail < len ? avail : len;
+        used = n;
+        ring_copy_out(ring, tail, bytes, n);
+    }
+    else
+    {
+        uint8_t header[EP_LOOPBACK_DATAGRAM_HEADER];
+        ring_copy_out(ring, tail, header, sizeof(header));
+        size_t datagram = header[0] | (size_t)header[1] << 8;
+        n               = datagram < len ? datagram : len;
+        used            = sizeof(header) + datagram;
+        ring_copy_out(ring, tail + sizeof(header), bytes, n);
+    }
+    atomic_store_explicit(&ring->tail, tail + used, memory_order_release);
+    ep->rx_bytes += n;
+    return n;
+}
+
+static enum mavtunnel_error_t
+ep_loopback_write(struct mavtunnel_writer_t* wr, const uint8_t* bytes, size_t len)
+{
+    ASSERT(wr != NULL && wr->object != NULL);
+    ASSERT(bytes != NULL);
+
+    struct endpoint_loopback_t* ep   = (struct endpoint_loopback_t*)wr->object;
+    struct ep_loopback_ring_t*  ring = ep->tx;
+    if (ep->kind == EP_LOOPBACK_DATAGRAM && len > UINT16_MAX)
+    {
+        return MERR_BAD_LENGTH;
+    }
+
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    size_t need = len + (ep->kind == EP_LOOPBACK_DATAGRAM ? EP_LOOPBACK_DATAGRAM_HEADER : 0);
+    if (ring->size - (head - tail) < need)
+    {
+        ep->tx_dropped++;
+        return MERR_OK;
+    }
+
+    if (ep->kind == EP_LOOPBACK_DATAGRAM)
+    {
+        uint8_t header[EP_LOOPBACK_DATAGRAM_HEADER] = {len & 0xff, len >> 8};
+        ring_copy_in(ring, head, header, sizeof(header));
+        head += sizeof(header);
+    }
+    ring_copy_in(ring, head, bytes, len);
+    atomic_store_explicit(&ring->head, head + len, memory_order_release);
+    ep->tx_bytes += len;
+
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&ring->waiting, memory_order_relaxed))
+    {
+        pthread_mutex_lock(&ring->lock);
+        pthread_cond_signal(&ring->cond);
+        pthread_mutex_unlock(&ring->lock);
+    }
+    return MERR_OK;
+}
+
+void
+ep_loopback_attach_reader(struct mavtunnel_t* tunnel, struct endpoint_loopback_t* ep)
+{
+    ASSERT(tunnel != NULL);
+    ASSERT(ep != NULL);
+
+    tunnel->reader.read   = ep_loopback_read;
+    tunnel->reader.object = ep;
+}
+
+void
+ep_loopback_attach_writer(struct mavtunnel_t* tunnel, struct endpoint_loopback_t* ep)
+{
+    ASSERT(tunnel != NULL);
+    ASSERT(ep != NULL);
+
+    tunnel->writer.write  = ep_loopback_write;
+    tunnel->writer.object = ep;
+}
@@ -0,0 +1,326 @@
+#ifndef MAVTUNNEL_LINUX
+#error "This file is only for Linux"
+#endif
+
+#include "relay_linux.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <sys/eventfd.h>
+
+static void
+relay_check(struct relay_linux_t* relay, const uint8_t* bytes, size_t len, bool sampled)
+{
+    if (sampled)
+    {
+        memset(&relay->check_status, 0, sizeof(relay->check_status));
+        relay->check_synced = false;
+    }
+
+    for (size_t i = 0; i < len; i++)
+    {
+        uint8_t rv = mavlink_frame_char_buffer(&relay->check_msg, &relay->check_status,
+            bytes[i], &relay->check_frame, &relay->check_frame_status);
+        if (rv == MAVLINK_FRAMING_OK)
+        {
+            relay->frames++;
+            relay->check_synced = true;
+        }
+        else if (rv != MAVLINK_FRAMING_INCOMPLETE && relay->check_synced)
+        {
+            relay->bad_frames++;
+        }
+    }
+}
+
+/* the writer is slower than the reader: block until out_fd takes more */
+static bool
+relay_wait_out(struct relay_linux_t* relay)
+{
+    struct pollfd fds[2] = {
+        {.fd = relay->out_fd, .events = POLLOUT},
+        {.fd = relay->terminate_fd, .events = POLLIN},
+    };
+    if (poll(fds, 2, -1) < 0 && errno != EINTR)
+    {
+        WARN("Failed to wait for the relay output: %s\n", strerror(errno));
+        return false;
+    }
+    if (fds[1].revents & POLLIN)
+    {
+        atomic_store(&relay->terminated, true);
+        return false;
+    }
+    return (fds[0].revents & (POLLERR | POLLHUP | POLLNVAL)) == 0;
+}
+
+static enum mavtunnel_error_t
+relay_write(struct relay_linux_t* relay, const uint8_t* bytes, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = write(relay->out_fd, bytes, len);
+        if (n < 0)
+        {
+            if (errno == EINTR || ((errno == EAGAIN || errno == EWOULDBLOCK) && relay_wait_out(relay)))
+            {
+                continue;
+            }
+            if (!atomic_load(&relay->terminated))
+            {
+                WARN("Failed to write to the relay output: %s\n", strerror(errno));
+            }
+            return MERR_END;
+        }
+        bytes += n;
+        len -= n;
+    }
+    return MERR_OK;
+}
+
+static enum mavtunnel_error_t
+relay_copy(struct relay_linux_t* relay)
+{
+    ssize_t n = read(relay->in_fd, relay->buffer, sizeof(relay->buffer));
+    if (n < 0)
+    {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+        {
+            return MERR_OK;
+        }
+        WARN("Failed to read from the relay input: %s\n", strerror(errno));
+        return MERR_END;
+    }
+    if (n == 0)
+    {
+        return MERR_END;
+    }
+
+    relay->chunks++;
+    if (relay->check_every == 1)
+    {
+        relay_check(relay, relay->buffer, n, false);
+    }
+    else if (relay->check_every > 1 && relay->chunks % relay->check_every == 0)
+    {
+        relay_check(relay, relay->buffer, n, true);
+    }
+    relay->bytes += n;
+    return relay_write(relay, relay->buffer, n);
+}
+
+/* move len bytes out of the pipe, with a copy if out_fd cannot splice */
+static enum mavtunnel_error_t
+relay_drain(struct relay_linux_t* relay, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n;
+        if (relay->use_splice)
+        {
+            n = splice(relay->pipe[0], NULL, relay->out_fd, NULL, len,
+                SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (n < 0 && errno == EINVAL)
+            {
+                INFO("Relay output does not splice, copying instead\n");
+                relay->use_splice = false;
+                continue;
+            }
+        }
+        else
+        {
+            n = read(relay->pipe[0], relay->buffer, len);
+            if (n > 0 && relay_write(relay, relay->buffer, n) != MERR_OK)
+            {
+                return MERR_END;
+            }
+        }
+
+        if (n < 0)
+        {
+            if (errno == EINTR || ((errno == EAGAIN || errno == EWOULDBLOCK) && relay_wait_out(relay)))
+            {
+                continue;
+            }
+            if (!atomic_load(&relay->terminated))
+            {
+                WARN("Failed to write to the relay output: %s\n", strerror(errno));
+            }
+            return MERR_END;
+        }
+        len -= n;
+    }
+    return MERR_OK;
+}
+
+static enum mavtunnel_error_t
+relay_splice(struct relay_linux_t* relay)
+{
+    ssize_t n = splice(relay->in_fd, NULL, relay->pipe[1], NULL, RELAY_LINUX_CHUNK_SIZE,
+        SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (n < 0)
+    {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+        {
+            return MERR_OK;
+        }
+        if (errno == EINVAL)
+        {
+            INFO("Relay input does not splice, copying instead\n");
+            relay->use_splice = false;
+            return relay_copy(relay);
+        }
+        WARN("Failed to read from the relay input: %s\n", strerror(errno));
+        return MERR_END;
+    }
+    if (n == 0)
+    {
+        return MERR_END;
+    }
+
+    relay->chunks++;
+    if (relay->check_every > 1 && relay->chunks % relay->check_every == 0)
+    {
+        /* tee() leaves the chunk in the pipe */
+        ssize_t m = tee(relay->pipe[0], relay->sample_pipe[1], n, SPLICE_F_NONBLOCK);
+        if (m > 0 && (m = read(relay->sample_pipe[0], relay->buffer, m)) > 0)
+        {
+            relay_check(relay, relay->buffer, m, true);
+        }
+    }
+    relay->bytes += n;
+    return relay_drain(relay, n);
+}
+
+enum mavtunnel_error_t
+relay_linux_init(struct relay_linux_t* relay, int in_fd, int out_fd, size_t check_every)
+{
+    ASSERT(relay != NULL);
+    ASSERT(in_fd >= 0 && out_fd >= 0);
+
+    memset(relay, 0, sizeof(*relay));
+    relay->in_fd       = in_fd;
+    relay->out_fd      = out_fd;
+    relay->check_every = check_every;
+    relay->pipe[0] = relay->pipe[1] = relay->sample_pipe[0] = relay->sample_pipe[1] = -1;
+    relay->epoll = relay->terminate_fd = -1;
+
+    /* checking every byte needs them in user space anyway */
+    relay->use_splice = check_every != 1;
+    if (pipe2(relay->pipe, O_CLOEXEC | O_NONBLOCK) < 0
+        || (check_every > 1 && pipe2(relay->sample_pipe, O_CLOEXEC | O_NONBLOCK) < 0))
+    {
+        WARN("Failed to create relay pipe: %s\n", strerror(errno));
+        return MERR_DEVICE_ERROR;
+    }
+    fcntl(relay->pipe[1], F_SETPIPE_SZ, RELAY_LINUX_CHUNK_SIZE);
+    if (check_every > 1)
+    {
+        fcntl(relay->sample_pipe[1], F_SETPIPE_SZ, RELAY_LINUX_CHUNK_SIZE);
+    }
+
+    if ((relay->epoll = epoll_create1(0)) < 0)
+    {
+        WARN("Failed to create epoll instance: %s\n", strerror(errno));
+        return MERR_DEVICE_ERROR;
+    }
+
+    struct epoll_event ev;
+    ev.events  = EPOLLIN;
+    ev.data.fd = in_fd;
+    if (epoll_ctl(relay->epoll, EPOLL_CTL_ADD, in_fd, &ev) < 0)
+    {
+        WARN("Failed to add relay input to epoll: %s\n", strerror(errno));
+        return MERR_DEVICE_ERROR;
+    }
+
+    relay->terminate_fd = eventfd(0, EFD_NONBLOCK);
+    ev.data.fd          = relay->terminate_fd;
+    if (relay->terminate_fd < 0
+        || epoll_ctl(relay->epoll, EPOLL_CTL_ADD, relay->terminate_fd, &ev) < 0)
+    {
+        WARN("Failed to add terminate eventfd to epoll: %s\n", strerror(errno));
+        return MERR_DEVICE_ERROR;
+    }
+
+    atomic_store(&relay->terminated, false);
+    return MERR_OK;
+}
+
+void
+relay_linux_destroy(struct relay_linux_t* relay)
+{
+    ASSERT(relay != NULL);
+
+    int fds[] = {relay->pipe[0], relay->pipe[1], relay->sample_pipe[0], relay->sample_pipe[1],
+        relay->epoll, relay->terminate_fd};
+    for (size_t i = 0; i < sizeof(fds) / sizeof(fds[0]); i++)
+    {
+        if (fds[i] >= 0)
+        {
+            close(fds[i]);
+        }
+    }
+}
+
+void
+relay_linux_interrupt(struct relay_linux_t* relay)
+{
+    ASSERT(relay != NULL);
+    eventfd_write(relay->terminate_fd, 1);
+}
+
+enum mavtunnel_error_t
+relay_linux_spin_once(struct relay_linux_t* relay, int timeout_ms)
+{
+    ASSERT(relay != NULL);
+
+    if (atomic_load(&relay->terminated))
+    {
+        return MERR_END;
+    }
+
+    int n_events = epoll_wait(relay->epoll, relay->event, 2, timeout_ms);
+    if (n_events < 0)
+    {
+        if (errno == EINTR)
+        {
+            return MERR_OK;
+        }
+        WARN("Failed to wait for the relay input: %s\n", strerror(errno));
+        atomic_store(&relay->terminated, true);
+        return MERR_END;
+    }
+
+    for (int i = 0; i < n_events; i++)
+    {
+        if (relay->event[i].data.fd == relay->terminate_fd)
+        {
+            atomic_store(&relay->terminated, true);
+            return MERR_END;
+        }
+    }
+
+    for (int i = 0; i < n_events; i++)
+    {
+        enum mavtunnel_error_t err
+            = relay->use_splice ? relay_splice(relay) : relay_copy(relay);
+        if (err != MERR_OK)
+        {
+            atomic_store(&relay->terminated, true);
+            return err;
+        }
+    }
+    return MERR_OK;
+}
+
+void
+relay_linux_spin(struct relay_linux_t* relay)
+{
+    while (relay_linux_spin_once(relay, -1) == MERR_OK)
+    {
+    }
+}
@@ -0,0 +1,159 @@
+#include "router.h"
+
+static const struct mavtunnel_router_target_t*
+router_target(struct mavtunnel_router_t* router, uint32_t msgid)
+{
+    struct mavtunnel_router_target_t* target
+        = &router->targets[msgid % MAVTUNNEL_ROUTER_TARGETS];
+
+    if (!target->valid || target->msgid != msgid)
+    {
+        const mavlink_msg_entry_t* entry = mavlink_get_msg_entry(msgid);
+        target->valid         = true;
+        target->msgid         = msgid;
+        target->flags         = entry ? entry->flags : 0;
+        target->system_ofs    = entry ? entry->target_system_ofs : 0;
+        target->component_ofs = entry ? entry->target_component_ofs : 0;
+    }
+    return target;
+}
+
+/* trailing zeros of the payload may have been trimmed */
+static uint8_t
+router_payload_byte(const mavlink_message_t* msg, uint8_t ofs)
+{
+    return ofs < msg->len ? (uint8_t)_MAV_PAYLOAD(msg)[ofs] : 0;
+}
+
+/**
+ * @return the ports msg goes out on, one bit per port
+ */
+static uint32_t
+router_destinations(struct mavtunnel_router_t* router, const mavlink_message_t* msg)
+{
+    uint32_t all = (1u << router->n_ports) - 1;
+
+    const struct mavtunnel_router_target_t* target
+        = router_target(router, msg->msgid);
+    uint8_t system = (target->flags & MAV_MSG_ENTRY_FLAG_HAVE_TARGET_SYSTEM)
+        ? router_payload_byte(msg, target->system_ofs)
+        : 0;
+    if (system == 0)
+    {
+        router->broadcast++;
+        return all;
+    }
+
+    uint8_t component = (target->flags & MAV_MSG_ENTRY_FLAG_HAVE_TARGET_COMPONENT)
+        ? router_payload_byte(msg, target->component_ofs)
+        : 0;
+    uint8_t route = component ? router->routes[system << 8 | component] : 0;
+    if (route != 0)
+    {
+        router->targeted++;
+        return 1u << (route - 1);
+    }
+    if (router->systems[system] != 0)
+    {
+        router->targeted++;
+        return router->systems[system];
+    }
+
+    router->unroutable++;
+    return 0;
+}
+
+static enum mavtunnel_error_t
+codec_router_decode(struct mavtunnel_codec_t* codec, mavlink_message_t* msg)
+{
+    struct mavtunnel_router_port_t* port   = (struct mavtunnel_router_port_t*)codec->object;
+    struct mavtunnel_router_t*      router = port->router;
+    size_t                          index  = port - router->ports;
+
+    /* the ports run in their own threads; the tables are shared, the writes
+     * are not held up by each other beyond their own port */
+    os_lock(&router->lock);
+    port->rx_frames++;
+    if (msg->sysid != 0)
+    {
+        router->routes[msg->sysid << 8 | msg->compid] = (uint8_t)(index + 1);
+        router->systems[msg->sysid] |= 1u << index;
+    }
+    uint32_t destinations = router_destinations(router, msg) & ~(1u << index);
+    size_t   n_ports      = router->n_ports;
+    os_unlock(&router->lock);
+
+    uint8_t buf[MAVLINK_MAX_PACKET_LEN];
+    size_t  len = 0;
+    for (size_t i = 0; i < n_ports; i++)
+    {
+        if (!(destinations & (1u << i)))
+        {
+            continue;
+        }
+        if (len == 0)
+        {
+            len = mavtunnel_serialize(buf, msg);
+        }
+
+        struct mavtunnel_router_port_t* out = &router->ports[i];
+        os_lock(&out->lock);
+        if (out->writer.write(&out->writer, buf, len) == MERR_OK)
+        {
+            out->tx_frames++;
+            out->tx_bytes += len;
+        }
+        else
+        {
+            out->tx_errors++;
+        }
+        os_unlock(&out->lock);
+    }
+    return MERR_PENDING;
+}
+
+void
+mavtunnel_router_init(struct mavtunnel_router_t* router)
+{
+    ASSERT(router != NULL);
+
+    memset(router, 0, sizeof(*router));
+    os_lock_init(&router->lock);
+}
+
+size_t
+mavtunnel_router_add_port(struct mavtunnel_router_t* router, struct mavtunnel_t* in)
+{
+    ASSERT(router != NULL && in != NULL);
+    ASSERT(router->n_ports < MAVTUNNEL_ROUTER_MAX_PORTS);
+    ASSERT(in->writer.write != NULL);
+
+    size_t                          index = router->n_ports++;
+    struct mavtunnel_router_port_t* port  = &router->ports[index];
+    memset(port, 0, sizeof(*port));
+    os_lock_init(&port->lock);
+    port->router = router;
+    port->writer = in->writer;
+
+    port->stage.object = port;
+    port->stage.dir    = MT_CODEC_DECODE;
+    port->stage.encode = codec_router_decode;
+    port->stage.tick   = NULL;
+    mavtunnel_attach_stage(in, &port->stage);
+    return index;
+}
+
+void
+mavtunnel_router_print_stats(const struct mavtunnel_router_t* router)
+{
+    ASSERT(router != NULL);
+
+    INFO("router: %lu broadcast, %lu targeted, %lu unroutable\n",
+        router->broadcast, router->targeted, router->unroutable);
+    for (size_t i = 0; i < router->n_ports; i++)
+    {
+        const struct mavtunnel_router_port_t* port = &router->ports[i];
+        printf("\tport %zu: rx %lu, tx %lu (%lu B, %lu errors)\n", i,
+            port->rx_frames, port->tx_frames, port->tx_bytes, port->tx_errors);
+    }
+}
@@ -16,6 +16,8 @@ mavtunnel_init(struct mavtunnel_t* ctx, size_t id)
     atomic_store(&ctx->terminate, false);
     memset(&ctx->rx_status, 0, sizeof(ctx->rx_status));
     memset(&ctx->tx_status, 0, sizeof(ctx->tx_status));
+    ctx->n_stages = 0;
+    ctx->reader.timeout_ms = -1;
 
     mavlink_reset_channel_status(id);
 
@@ -74,17 +76,303 @@ static void mavtunnel_perf_update(struct mavtunnel_t * ctx)
 }
 #endif
 
+void
+mavtunnel_attach_stage(struct mavtunnel_t* ctx, struct mavtunnel_codec_t* stage)
+{
+    ASSERT(ctx != NULL && stage != NULL);
+    ASSERT(ctx->n_stages < MAVTUNNEL_MAX_STAGES);
+
+    stage->tunnel = ctx;
+    ctx->stages[ctx->n_stages++] = stage;
+}
+
+/**
+ * The pipeline: encode stages in attach order, the tunnel codec, then decode
+ * stages in reverse attach order.
+ */
+static struct mavtunnel_codec_t *
+mavtunnel_step(struct mavtunnel_t* ctx, size_t pos)
+{
+    size_t n_encode = 0;
+    for (size_t i = 0; i < ctx->n_stages; i++)
+    {
+        if (ctx->stages[i]->dir == MT_CODEC_ENCODE)
+        {
+            if (n_encode == pos)
+            {
+                return ctx->stages[i];
+            }
+            n_encode++;
+        }
+    }
+
+    if (pos == n_encode)
+    {
+        return &ctx->codec;
+    }
+
+    pos -= n_encode + 1;
+    for (size_t i = ctx->n_stages; i > 0; i--)
+    {
+        if (ctx->stages[i - 1]->dir == MT_CODEC_DECODE)
+        {
+            if (pos == 0)
+            {
+                return ctx->stages[i - 1];
+            }
+            pos--;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Frames carrying tunnel compat flags have an opaque payload: keep the flags
+ * and do not trim trailing zeros, which would corrupt it.
+ */
+static void
+mavtunnel_finalize_tunneled(mavlink_status_t * status, mavlink_message_t * msg, uint8_t crc_extra)
+{
+    msg->magic          = MAVLINK_STX;
+    msg->incompat_flags = 0;
+    msg->compat_flags  &= MAVTUNNEL_CFLAGS;
+    msg->seq            = status->current_tx_seq++;
+
+    uint8_t header[MAVLINK_CORE_HEADER_LEN] = {
+        msg->len, msg->incompat_flags, msg->compat_flags, msg->seq,
+        msg->sysid, msg->compid, msg->msgid & 0xFF, (msg->msgid >> 8) & 0xFF,
+        (msg->msgid >> 16) & 0xFF};
+
+    uint16_t checksum = crc_calculate(header, MAVLINK_CORE_HEADER_LEN);
+    crc_accumulate_buffer(&checksum, _MAV_PAYLOAD(msg), msg->len);
+    crc_accumulate(crc_extra, &checksum);
+    mavlink_ck_a(msg) = (uint8_t)(checksum & 0xFF);
+    mavlink_ck_b(msg) = (uint8_t)(checksum >> 8);
+    msg->checksum     = checksum;
+}
+
 static size_t
 mavtunnel_finalize_message(uint8_t * buf, mavlink_status_t * status, mavlink_message_t * msg)
 {
     uint8_t crc_extra = mavlink_get_crc_extra(msg);
     size_t min_length = mavlink_min_message_length(msg);
-    mavlink_finalize_message_buffer(msg, msg->sysid, msg->compid, status, min_length, msg->len, crc_extra);
+    if (msg->compat_flags & MAVTUNNEL_CFLAGS)
+    {
+        mavtunnel_finalize_tunneled(status, msg, crc_extra);
+    }
+    else
+    {
+        mavlink_finalize_message_buffer(msg, msg->sysid, msg->compid, status, min_length, msg->len, crc_extra);
+    }
     size_t len = mavlink_msg_to_send_buffer(buf, msg);
     return len;
 }
 
 
+/**
+ * Finalize msg, keeping its seq, and write the frame to buf, which must hold
+ * MAVLINK_MAX_PACKET_LEN bytes.
+ */
+size_t
+mavtunnel_serialize(uint8_t* buf, mavlink_message_t* msg)
+{
+    mavlink_status_t status = {0};
+    status.current_tx_seq   = msg->seq;
+    return mavtunnel_finalize_message(buf, &status, msg);
+}
+
+static enum mavtunnel_error_t
+mavtunnel_send(struct mavtunnel_t* ctx, mavlink_message_t * msg)
+{
+    enum mavtunnel_error_t err;
+
+    ctx->tx_status.current_tx_seq = msg->seq;
+    size_t len = mavtunnel_finalize_message(ctx->tx_buf, &ctx->tx_status, msg);
+
+    if ((err = ctx->writer.write(&ctx->writer, ctx->tx_buf, len)) != MERR_OK)
+    {
+        WARN("tunnel %ld failed to write message (%d)\n", ctx->id, err);
+        return err;
+    }
+#if (DEBUG_MODE == 1)
+    INFO("tunnel %ld: send message seq[%d] id[%02x] size[%d]\n",
+        ctx->id, msg->seq, msg->msgid, msg->len);
+#endif
+    ctx->count[MT_PERF_SENT_COUNT] ++;
+    ctx->count[MT_PERF_SENT_BYTE] += len;
+
+    static size_t prev_rx_bytes = 0;
+    size_t expected_len = ctx->count[MT_PERF_RECV_BYTE] - prev_rx_bytes;
+    if(expected_len != len)
+    {
+        ctx->count[MT_PERF_DROP_BYTE] += expected_len - len;
+    }
+    prev_rx_bytes = ctx->count[MT_PERF_RECV_BYTE];
+    return MERR_OK;
+}
+
+/**
+ * Run msg through the pipeline from position pos on and send it, unless a
+ * stage keeps it.
+ */
+static enum mavtunnel_error_t
+mavtunnel_forward(struct mavtunnel_t* ctx, size_t pos, mavlink_message_t * msg)
+{
+    enum mavtunnel_error_t err;
+    struct mavtunnel_codec_t * step;
+
+    for (; (step = mavtunnel_step(ctx, pos)) != NULL; pos++)
+    {
+        err = step->encode(step, msg);
+        if (err == MERR_PENDING)
+        {
+            return MERR_OK;
+        }
+        if (err != MERR_OK)
+        {
+            WARN("tunnel %ld failed to encode message (%d)\n", ctx->id, err);
+            return err;
+        }
+    }
+    return mavtunnel_send(ctx, msg);
+}
+
+enum mavtunnel_error_t
+mavtunnel_stage_emit(struct mavtunnel_codec_t* stage, mavlink_message_t* msg)
+{
+    ASSERT(stage != NULL && stage->tunnel != NULL);
+
+    struct mavtunnel_t * ctx = stage->tunnel;
+    struct mavtunnel_codec_t * step;
+    for (size_t pos = 0; (step = mavtunnel_step(ctx, pos)) != NULL; pos++)
+    {
+        if (step == stage)
+        {
+            return mavtunnel_forward(ctx, pos + 1, msg);
+        }
+    }
+    return MERR_BAD_STATE;
+}
+
+/**
+ * Run msg, decoded by another tunnel, through the decode stages of ctx and
+ * send it.
+ */
+enum mavtunnel_error_t
+mavtunnel_inject(struct mavtunnel_t* ctx, mavlink_message_t* msg)
+{
+    ASSERT(ctx != NULL);
+
+    size_t n_encode = 0;
+    for (size_t i = 0; i < ctx->n_stages; i++)
+    {
+        n_encode += ctx->stages[i]->dir == MT_CODEC_ENCODE ? 1 : 0;
+    }
+    return mavtunnel_forward(ctx, n_encode + 1, msg);
+}
+
+/**
+ * Tick the stages and bound the next read by the earliest deadline.
+ */
+static void
+mavtunnel_tick(struct mavtunnel_t* ctx)
+{
+    uint64_t now = 0, due = 0;
+    for (size_t i = 0; i < ctx->n_stages; i++)
+    {
+        struct mavtunnel_codec_t * stage = ctx->stages[i];
+        if (stage->tick != NULL)
+        {
+            now = now ? now : time_us();
+            uint64_t next = stage->tick(stage, now);
+            if (next != 0 && (due == 0 || next < due))
+            {
+                due = next;
+            }
+        }
+    }
+
+    if (due == 0)
+    {
+        ctx->reader.timeout_ms = -1;
+    }
+    else
+    {
+        ctx->reader.timeout_ms = due > now ? (int)((due - now + 999) / 1000) : 0;
+    }
+}
+
+size_t
+mavtunnel_frame_pack(uint8_t* dst, const mavlink_message_t* msg)
+{
+    dst[0] = msg->len;
+    dst[1] = msg->seq;
+    dst[2] = msg->sysid;
+    dst[3] = msg->compid;
+    dst[4] = msg->msgid & 0xFF;
+    dst[5] = (msg->msgid >> 8) & 0xFF;
+    dst[6] = (msg->msgid >> 16) & 0xFF;
+    dst[7] = msg->compat_flags;
+    memcpy(dst + MAVTUNNEL_FRAME_HEADER_LEN, _MAV_PAYLOAD(msg), msg->len);
+    return MAVTUNNEL_FRAME_HEADER_LEN + msg->len;
+}
+
+/**
+ * @return bytes consumed from src, or a negative error
+ */
+ssize_t
+mavtunnel_frame_unpack(const uint8_t* src, size_t len, mavlink_message_t* msg)
+{
+    if (len < MAVTUNNEL_FRAME_HEADER_LEN
+        || len - MAVTUNNEL_FRAME_HEADER_LEN < src[0])
+    {
+        return -MERR_BAD_LENGTH;
+    }
+
+    uint8_t* payload    = (uint8_t*)_MAV_PAYLOAD_NON_CONST(msg);
+    msg->magic          = MAVLINK_STX;
+    msg->len            = src[0];
+    msg->seq            = src[1];
+    msg->sysid          = src[2];
+    msg->compid         = src[3];
+    msg->msgid          = src[4] | (src[5] << 8) | ((uint32_t)src[6] << 16);
+    msg->incompat_flags = 0;
+    msg->compat_flags   = src[7];
+    memcpy(payload, src + MAVTUNNEL_FRAME_HEADER_LEN, msg->len);
+    memset(payload + msg->len, 0, MAVLINK_MAX_PAYLOAD_LEN - msg->len);
+    return MAVTUNNEL_FRAME_HEADER_LEN + msg->len;
+}
+
+/**
+ * Tunnel stages append their own fields to the payload; the stage that
+ * pushed them pops them on the other end, last pushed first.
+ */
+bool
+mavtunnel_trailer_push(mavlink_message_t* msg, const uint8_t* bytes, size_t n)
+{
+    if (msg->len + n > MAVLINK_MAX_PAYLOAD_LEN)
+    {
+        return false;
+    }
+    memcpy((uint8_t*)_MAV_PAYLOAD_NON_CONST(msg) + msg->len, bytes, n);
+    msg->len += n;
+    return true;
+}
+
+bool
+mavtunnel_trailer_pop(mavlink_message_t* msg, uint8_t* bytes, size_t n)
+{
+    if (msg->len < n)
+    {
+        return false;
+    }
+    msg->len -= n;
+    uint8_t* trailer = (uint8_t*)_MAV_PAYLOAD_NON_CONST(msg) + msg->len;
+    memcpy(bytes, trailer, n);
+    memset(trailer, 0, n);
+    return true;
+}
+
 enum mavtunnel_error_t
 mavtunnel_spin_once(struct mavtunnel_t* ctx)
 {
@@ -92,7 +380,6 @@ mavtunnel_spin_once(struct mavtunnel_t* ctx)
 
     int                    rv;
     ssize_t                n;
-    enum mavtunnel_error_t err;
 
     n = ctx->reader.read(
         &ctx->reader, ctx->read_buffer, MAVTUNNEL_READ_BUFFER_SIZE);
@@ -142,12 +429,6 @@ mavtunnel_spin_once(struct mavtunnel_t* ctx)
         else if (rv == MAVLINK_FRAMING_OK)
         {
             ctx->count[MT_PERF_RECV_COUNT] ++;
-            if ((err = ctx->codec.encode(&ctx->codec, &ctx->rx_msg)) != MERR_OK)
-            {
-                WARN(
-                    "tunnel %ld failed to encode message (%d)\n", ctx->id, err);
-                continue;
-            }
 
             static uint32_t prev_seq = 0;
             if(ctx->rx_msg.seq != (prev_seq+1)%256)
@@ -157,33 +438,12 @@ mavtunnel_spin_once(struct mavtunnel_t* ctx)
             }
             prev_seq = ctx->rx_msg.seq;
 
-
-
-            ctx->tx_status.current_tx_seq = ctx->rx_msg.seq;
-            size_t len = mavtunnel_finalize_message(ctx->tx_buf, &ctx->tx_status, &ctx->rx_msg);
-
-            if ((err = ctx->writer.write(&ctx->writer, ctx->tx_buf, len)) != MERR_OK)
-            {
-                WARN("tunnel %ld failed to write message (%d)\n", ctx->id, err);
-                continue;
-            }
-#if (DEBUG_MODE == 1)
-            INFO("tunnel %ld: send message seq[%d] id[%02x] size[%d]\n",
-                ctx->id, ctx->msg.seq, ctx->msg.msgid, ctx->msg.len);
-#endif
-            ctx->count[MT_PERF_SENT_COUNT] ++;
-            ctx->count[MT_PERF_SENT_BYTE] += len;
-
-            static size_t prev_rx_bytes = 0;
-            size_t expected_len = ctx->count[MT_PERF_RECV_BYTE] - prev_rx_bytes;
-            if(expected_len != len)
-            {
-                ctx->count[MT_PERF_DROP_BYTE] += expected_len - len;
-            }
-            prev_rx_bytes = ctx->count[MT_PERF_RECV_BYTE];
+            mavtunnel_forward(ctx, 0, &ctx->rx_msg);
         }
     }
 
+    mavtunnel_tick(ctx);
+
 #ifdef MAVTUNNEL_PROFILING
     ctx->exec_time_us += time_us() - exec_start;
 #endif
@@ -0,0 +1,63 @@
+#include "writer_set.h"
+
+/**
+ * The write fails only if every member failed.
+ */
+static enum mavtunnel_error_t
+mavtunnel_writer_set_write(
+    struct mavtunnel_writer_t* wr, const uint8_t* bytes, size_t len)
+{
+    struct mavtunnel_writer_set_t* set  = (struct mavtunnel_writer_set_t*)wr->object;
+    enum mavtunnel_error_t         err  = MERR_OK;
+    bool                           sent = set->n_members == 0;
+
+    set->frames++;
+    set->bytes += len;
+    for (size_t i = 0; i < set->n_members; i++)
+    {
+        struct mavtunnel_writer_set_member_t* member = &set->members[i];
+        enum mavtunnel_error_t rv = member->writer.write(&member->writer, bytes, len);
+        if (rv == MERR_OK)
+        {
+            member->frames++;
+            sent = true;
+        }
+        else
+        {
+            member->errors++;
+            err = rv;
+        }
+    }
+    return sent ? MERR_OK : err;
+}
+
+void
+mavtunnel_writer_set_init(struct mavtunnel_writer_set_t* set)
+{
+    ASSERT(set != NULL);
+    memset(set, 0, sizeof(*set));
+}
+
+size_t
+mavtunnel_writer_set_add(
+    struct mavtunnel_writer_set_t* set, const struct mavtunnel_writer_t* writer)
+{
+    ASSERT(set != NULL && writer != NULL && writer->write != NULL);
+    ASSERT(set->n_members < MAVTUNNEL_WRITER_SET_MAX);
+
+    size_t index = set->n_members++;
+    memset(&set->members[index], 0, sizeof(set->members[index]));
+    set->members[index].writer = *writer;
+    return index;
+}
+
+void
+mavtunnel_writer_set_attach(
+    struct mavtunnel_t* tunnel, struct mavtunnel_writer_set_t* set)
+{
+    ASSERT(tunnel != NULL);
+    ASSERT(set != NULL);
+
+    tunnel->writer.write  = mavtunnel_writer_set_write;
+    tunnel->writer.object = set;
+}
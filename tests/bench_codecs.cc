@@ -0,0 +1,472 @@
+#include <benchmark/benchmark.h>
+#include <codec_aggregate.h>
+#include <codec_chacha20.h>
+#include <codec_compact.h>
+#include <codec_delta.h>
+#include <codec_fec.h>
+#include <codec_lz.h>
+#include <codec_passthrough.h>
+#include <endpoint_loopback.h>
+
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * Encode and decode cost of every codec, for payloads of 1 to 255 bytes,
+ * one frame at a time (latency) and in batches (throughput). A second
+ * workload, <side>/<codec>/telemetry, interleaves ATTITUDE, GPS_RAW_INT and
+ * HEARTBEAT as an autopilot streams them; one frame at a time, it reports
+ * the ns each message type took.
+ *
+ * The frames go source -> encoder tunnel -> decoder tunnel -> sink over
+ * in-memory loopback pairs, so the numbers include parsing and finalizing,
+ * as a codec never runs without them; passthrough is the baseline. The
+ * encoder and the decoder are timed separately.
+ *
+ * ARQ and bonding are left out: they need a return path and several links,
+ * and their cost is in the protocol rather than in the transform.
+ *
+ * To compare with an earlier commit, save its results with
+ *   --benchmark_out=base.json --benchmark_out_format=json
+ * and run again with
+ *   --baseline=base.json [--threshold=percent]
+ * Every benchmark whose ns/frame grew by more than the threshold (default
+ * 10%) is flagged, and the exit status is 1.
+ */
+
+#define BATCH_MAX 32
+
+/* frames from a batch arrive back to back: close groups at the end of it */
+static const uint64_t deadline_us       = 1000000;
+static const uint16_t keyframe_interval = 50;
+
+static struct stream_cipher_t   ciphers[2];
+static struct codec_lz_t        compressors[2];
+static struct codec_delta_t     deltas[2];
+static struct codec_aggregate_t aggregators[2];
+static struct codec_compact_t   compactors[2];
+static struct codec_fec_t       fecs[2];
+
+struct Codec
+{
+    const char*                                                       name;
+    std::function<void(struct mavtunnel_t*, enum mavtunnel_codec_dir_t)> setup;
+    /* send what the encoder holds at the end of a batch */
+    std::function<void()> flush {};
+};
+
+static const std::vector<Codec> codecs = {
+    {"passthrough",
+     [](struct mavtunnel_t* t, enum mavtunnel_codec_dir_t dir) { codec_passthrough_attach(t); }},
+    { "chacha20",
+     [](struct mavtunnel_t* t, enum mavtunnel_codec_dir_t dir)
+     { codec_chacha20_attach(t, &ciphers[dir]); }},
+    { "lz",
+     [](struct mavtunnel_t* t, enum mavtunnel_codec_dir_t dir)
+     {
+     codec_passthrough_attach(t);
+     codec_lz_attach(t, &compressors[dir], dir);
+     }},
+    { "delta",
+     [](struct mavtunnel_t* t, enum mavtunnel_codec_dir_t dir)
+     {
+     codec_passthrough_attach(t);
+     codec_delta_attach(t, &deltas[dir], dir, keyframe_interval);
+     }},
+    { "aggregate",
+     [](struct mavtunnel_t* t, enum mavtunnel_codec_dir_t dir)
+     {
+     codec_passthrough_attach(t);
+     codec_aggregate_attach(t, &aggregators[dir], dir, deadline_us, 0);
+     }, [] { codec_aggregate_flush(&aggregators[MT_CODEC_ENCODE]); }},
+    { "aggregate+compact",
+     [](struct mavtunnel_t* t, enum mavtunnel_codec_dir_t dir)
+     {
+     codec_passthrough_attach(t);
+     codec_aggregate_attach(t, &aggregators[dir], dir, deadline_us, 0);
+     codec_compact_attach(t, &compactors[dir], dir);
+     }, [] { codec_aggregate_flush(&aggregators[MT_CODEC_ENCODE]); }},
+    { "fec",
+     [](struct mavtunnel_t* t, enum mavtunnel_codec_dir_t dir)
+     {
+     codec_passthrough_attach(t);
+     codec_fec_attach(t, &fecs[dir], dir, 4, 6, deadline_us);
+     }, [] { codec_fec_flush(&fecs[MT_CODEC_ENCODE]); }},
+};
+
+/**
+ * LOGGING_DATA frames trimmed to payload_size bytes: a fixed pseudo-random
+ * block whose first bytes change from frame to frame, as in a log stream.
+ */
+static std::vector<std::vector<uint8_t>>
+frames(size_t payload_size, size_t n)
+{
+    uint8_t  block[sizeof(mavlink_logging_data_t)];
+    uint32_t x = 0x12345678;
+    for (auto& b : block)
+    {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        b = x | 1;
+    }
+
+    std::vector<std::vector<uint8_t>> batch;
+    for (size_t i = 0; i < n; i++)
+    {
+        block[0] = i | 1;
+        mavlink_logging_data_t data;
+        memset(&data, 0, sizeof(data));
+        memcpy(&data, block, payload_size);
+
+        mavlink_message_t msg;
+        uint8_t           buf[MAVLINK_MAX_PACKET_LEN];
+        mavlink_msg_logging_data_encode(1, 1, &msg, &data);
+        size_t len = mavlink_msg_to_send_buffer(buf, &msg);
+        batch.emplace_back(buf, buf + len);
+    }
+    return batch;
+}
+
+/**
+ * A telemetry stream: ATTITUDE every frame, GPS_RAW_INT every other and a
+ * HEARTBEAT every eighth, their fields drifting slowly.
+ */
+static std::vector<std::vector<uint8_t>>
+telemetry()
+{
+    std::vector<std::vector<uint8_t>> stream;
+    auto add = [&stream](const mavlink_message_t& msg)
+    {
+        uint8_t buf[MAVLINK_MAX_PACKET_LEN];
+        size_t  len = mavlink_msg_to_send_buffer(buf, &msg);
+        stream.emplace_back(buf, buf + len);
+    };
+
+    mavlink_message_t msg;
+    for (uint32_t i = 0; stream.size() < 64; i++)
+    {
+        float t = i * 0.02f;
+        mavlink_msg_attitude_pack(1, 1, &msg, i * 20, 0.1f * t, -0.05f * t, 1.5f + t,
+            0.01f, -0.02f, 0.03f);
+        add(msg);
+        if (i % 2 == 0)
+        {
+            mavlink_msg_gps_raw_int_pack(1, 1, &msg, i * 20000ull, 3, 473977420 + i,
+                85455940 - i, 488000 + 10 * i, 121, 150, 512, 9000, 12, 535000, 800, 1200,
+                300, 90, 0);
+            add(msg);
+        }
+        if (i % 8 == 0)
+        {
+            mavlink_msg_heartbeat_pack(1, 1, &msg, MAV_TYPE_QUADROTOR,
+                MAV_AUTOPILOT_ARDUPILOTMEGA, 1, 0, MAV_STATE_ACTIVE);
+            add(msg);
+        }
+    }
+    return stream;
+}
+
+static const std::map<uint32_t, const char*> telemetry_names = {
+    {MAVLINK_MSG_ID_ATTITUDE, "ATTITUDE"},
+    {MAVLINK_MSG_ID_GPS_RAW_INT, "GPS_RAW_INT"},
+    {MAVLINK_MSG_ID_HEARTBEAT, "HEARTBEAT"},
+};
+
+/* the message id of a serialized MAVLink2 frame */
+static uint32_t
+frame_msgid(const std::vector<uint8_t>& f)
+{
+    return f[7] | f[8] << 8 | f[9] << 16;
+}
+
+struct Link
+{
+    /* source -> encoder, encoder -> decoder, decoder -> sink */
+    struct endpoint_loopback_pair_t pairs[3];
+    struct mavtunnel_t              encoder, decoder, source, sink;
+
+    bool open(const Codec& codec)
+    {
+        if (ep_loopback_pair_init(&pairs[0], EP_LOOPBACK_BYTES, 0) != MERR_OK
+            || ep_loopback_pair_init(&pairs[1], EP_LOOPBACK_DATAGRAM, 0) != MERR_OK
+            || ep_loopback_pair_init(&pairs[2], EP_LOOPBACK_DATAGRAM, 0) != MERR_OK)
+        {
+            return false;
+        }
+        mavtunnel_init(&encoder, 0);
+        mavtunnel_init(&decoder, 1);
+        mavtunnel_init(&source, 2);
+        mavtunnel_init(&sink, 3);
+        ep_loopback_attach_writer(&source, &pairs[0].end[0]);
+        ep_loopback_attach_reader(&encoder, &pairs[0].end[1]);
+        ep_loopback_attach_writer(&encoder, &pairs[1].end[0]);
+        ep_loopback_attach_reader(&decoder, &pairs[1].end[1]);
+        ep_loopback_attach_writer(&decoder, &pairs[2].end[0]);
+        ep_loopback_attach_reader(&sink, &pairs[2].end[1]);
+        sink.reader.timeout_ms = 0;
+        codec.setup(&encoder, MT_CODEC_ENCODE);
+        codec.setup(&decoder, MT_CODEC_DECODE);
+        return true;
+    }
+
+    /* spin a tunnel until it has read everything waiting for it */
+    static void drain(struct mavtunnel_t* tunnel, struct ep_loopback_ring_t* ring)
+    {
+        while (atomic_load(&ring->head) != atomic_load(&ring->tail))
+        {
+            mavtunnel_spin_once(tunnel);
+        }
+    }
+
+    ~Link()
+    {
+        for (auto& pair : pairs)
+        {
+            ep_loopback_pair_destroy(&pair);
+        }
+    }
+};
+
+enum side_t
+{
+    SIDE_ENCODE,
+    SIDE_DECODE,
+};
+
+enum workload_t
+{
+    /* range(0): payload size, range(1): frames per batch */
+    WORKLOAD_LOG,
+    /* range(0): frames per batch */
+    WORKLOAD_TELEMETRY,
+};
+
+static void
+run(benchmark::State& state, const Codec* codec, enum side_t side, enum workload_t workload)
+{
+    size_t n = workload == WORKLOAD_LOG ? state.range(1) : state.range(0);
+    Link   link;
+    if (!link.open(*codec))
+    {
+        state.SkipWithError("failed to open the loopback pairs");
+        return;
+    }
+
+    /* every iteration sends the next n frames of the stream */
+    auto stream = workload == WORKLOAD_LOG ? frames(state.range(0), n) : telemetry();
+    size_t                next = 0;
+    std::vector<uint64_t> samples;
+    /* one frame at a time: ns and frames for each message id */
+    std::map<uint32_t, std::pair<uint64_t, uint64_t>> by_msgid;
+    uint64_t              total_ns = 0, payload_bytes = 0;
+    uint8_t               buf[MAVLINK_MAX_PACKET_LEN];
+    for (auto _ : state)
+    {
+        uint32_t msgid = frame_msgid(stream[next]);
+        for (size_t i = 0; i < n; i++, next = (next + 1) % stream.size())
+        {
+            auto& f = stream[next];
+            link.source.writer.write(&link.source.writer, f.data(), f.size());
+            payload_bytes += f[1];
+        }
+
+        uint64_t start = clock_ns();
+        Link::drain(&link.encoder, &link.pairs[0].ring[0]);
+        if (codec->flush)
+        {
+            codec->flush();
+        }
+        uint64_t encoded = clock_ns();
+        Link::drain(&link.decoder, &link.pairs[1].ring[0]);
+        uint64_t decoded = clock_ns();
+
+        size_t received = 0;
+        while (link.sink.reader.read(&link.sink.reader, buf, sizeof(buf)) > 0)
+        {
+            received++;
+        }
+        if (received != n)
+        {
+            state.SkipWithError("lost frames");
+            return;
+        }
+
+        uint64_t ns = side == SIDE_ENCODE ? encoded - start : decoded - encoded;
+        state.SetIterationTime(ns / 1e9);
+        total_ns += ns;
+        if (n == 1 && samples.size() < (1 << 20))
+        {
+            samples.push_back(ns);
+        }
+        if (n == 1 && workload == WORKLOAD_TELEMETRY)
+        {
+            by_msgid[msgid].first += ns;
+            by_msgid[msgid].second++;
+        }
+    }
+
+    size_t n_frames = state.iterations() * n;
+    state.SetItemsProcessed(n_frames);
+    state.SetBytesProcessed(payload_bytes);
+    state.counters["ns/frame"] = (double)total_ns / n_frames;
+    for (auto& msgid : by_msgid)
+    {
+        std::string name = std::string(telemetry_names.at(msgid.first)) + " ns";
+        state.counters[name] = (double)msgid.second.first / msgid.second.second;
+    }
+    if (!samples.empty())
+    {
+        std::sort(samples.begin(), samples.end());
+        state.counters["p50 ns"] = samples[samples.size() / 2];
+        state.counters["p99 ns"] = samples[samples.size() * 99 / 100];
+    }
+}
+
+static void
+register_benchmarks()
+{
+    static const int64_t payload_sizes[] = {1, 8, 32, 64, 128, 192, 255};
+    for (auto& codec : codecs)
+    {
+        for (enum side_t side : {SIDE_ENCODE, SIDE_DECODE})
+        {
+            std::string name = std::string(side == SIDE_ENCODE ? "encode/" : "decode/") + codec.name;
+            auto*       b
+                = benchmark::RegisterBenchmark(name.c_str(), run, &codec, side, WORKLOAD_LOG);
+            for (int64_t size : payload_sizes)
+            {
+                b->Args({size, 1})->Args({size, BATCH_MAX});
+            }
+            b->ArgNames({"payload", "batch"})->UseManualTime();
+
+            name += "/telemetry";
+            b = benchmark::RegisterBenchmark(
+                name.c_str(), run, &codec, side, WORKLOAD_TELEMETRY);
+            b->Arg(1)->Arg(BATCH_MAX)->ArgName("batch")->UseManualTime();
+        }
+    }
+}
+
+/* keeps ns/frame of every run for the comparison with a baseline */
+class Reporter : public benchmark::ConsoleReporter
+{
+public:
+    std::map<std::string, double> ns_per_frame;
+
+    void ReportRuns(const std::vector<Run>& runs) override
+    {
+        for (auto& run : runs)
+        {
+            auto counter = run.counters.find("ns/frame");
+            if (!run.error_occurred && counter != run.counters.end())
+            {
+                ns_per_frame[run.benchmark_name()] = counter->second;
+            }
+        }
+        ConsoleReporter::ReportRuns(runs);
+    }
+};
+
+/**
+ * ns/frame of every benchmark in a --benchmark_out JSON file, which has one
+ * field per line.
+ */
+static std::map<std::string, double>
+load_baseline(const char* path)
+{
+    std::map<std::string, double> baseline;
+    std::ifstream                 in(path);
+    std::string                   line, name;
+    while (std::getline(in, line))
+    {
+        size_t key = line.find_first_not_of(" \t");
+        if (key == std::string::npos)
+        {
+            continue;
+        }
+        if (line.compare(key, 8, "\"name\": ") == 0)
+        {
+            size_t first = line.find('"', key + 8);
+            size_t last  = line.rfind('"');
+            name         = line.substr(first + 1, last - first - 1);
+        }
+        else if (line.compare(key, 12, "\"ns/frame\": ") == 0 && !name.empty())
+        {
+            baseline[name] = strtod(line.c_str() + key + 12, NULL);
+        }
+    }
+    return baseline;
+}
+
+int
+main(int argc, char** argv)
+{
+    const char* baseline_path = NULL;
+    double      threshold     = 10;
+
+    /* take our flags out before the library sees them */
+    int n_args = 1;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--baseline=", 11) == 0)
+        {
+            baseline_path = argv[i] + 11;
+        }
+        else if (strncmp(argv[i], "--threshold=", 12) == 0)
+        {
+            threshold = strtod(argv[i] + 12, NULL);
+        }
+        else
+        {
+            argv[n_args++] = argv[i];
+        }
+    }
+    argc = n_args;
+
+    register_benchmarks();
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+    {
+        return 1;
+    }
+
+    Reporter reporter;
+    benchmark::RunSpecifiedBenchmarks(&reporter);
+    benchmark::Shutdown();
+    if (baseline_path == NULL)
+    {
+        return 0;
+    }
+
+    auto baseline = load_baseline(baseline_path);
+    if (baseline.empty())
+    {
+        fprintf(stderr, "no ns/frame in %s\n", baseline_path);
+        return 1;
+    }
+
+    int regressions = 0;
+    for (auto& result : reporter.ns_per_frame)
+    {
+        auto base = baseline.find(result.first);
+        if (base == baseline.end() || base->second <= 0)
+        {
+            continue;
+        }
+        double change = (result.second / base->second - 1) * 100;
+        if (change > threshold)
+        {
+            printf("REGRESSION %s: %.1f -> %.1f ns/frame (%+.1f%%)\n", result.first.c_str(),
+                base->second, result.second, change);
+            regressions++;
+        }
+    }
+    printf("%d of %zu benchmarks regressed by more than %.1f%% against %s\n", regressions,
+        reporter.ns_per_frame.size(), threshold, baseline_path);
+    return regressions > 0 ? 1 : 0;
+}
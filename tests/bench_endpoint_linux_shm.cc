@@ -0,0 +1,221 @@
+#include <benchmark/benchmark.h>
+#include <endpoint_linux_shm.h>
+#include <endpoint_linux_udp.h>
+#include <endpoint_linux_udp_client.h>
+#include <endpoint_linux_unix.h>
+
+#include <thread>
+
+#define SERVER_PORT 14696
+#define SERVER_PATH "@mavtunnel-bench-shm"
+#define FRAME       64
+/* below net.unix.max_dgram_qlen and the ring size */
+#define BATCH       8
+
+enum link_kind_t
+{
+    LINK_SHM,
+    LINK_SEQPACKET,
+    LINK_UDP,
+};
+
+/* the tunnel and one local consumer */
+struct link_t
+{
+    struct endpoint_linux_shm_t        shm;
+    struct mavtunnel_shm_client_t      shm_client;
+    struct endpoint_linux_unix_t       unix_server, unix_client;
+    struct endpoint_linux_udp_t        udp_server;
+    struct endpoint_linux_udp_client_t udp_client;
+    struct mavtunnel_t                 server, client;
+    enum link_kind_t                   kind;
+
+    bool open(enum link_kind_t link_kind)
+    {
+        kind = link_kind;
+        mavtunnel_init(&server, 0);
+        mavtunnel_init(&client, 1);
+        if (kind == LINK_SHM)
+        {
+            if (ep_linux_shm_init(&shm, "mavtunnel-bench", EP_SHM_SLOTS) != MERR_OK
+                || mavtunnel_shm_client_open(&shm_client, shm.fd) != MERR_OK)
+            {
+                return false;
+            }
+            ep_linux_shm_attach_reader(&server, &shm);
+            ep_linux_shm_attach_writer(&server, &shm);
+            server.reader.timeout_ms = 1000;
+            return true;
+        }
+
+        if (kind == LINK_SEQPACKET)
+        {
+            if (ep_linux_unix_init(&unix_server, EP_UNIX_SEQPACKET, EP_UNIX_SERVER, SERVER_PATH)
+                    != MERR_OK
+                || ep_linux_unix_init(&unix_client, EP_UNIX_SEQPACKET, EP_UNIX_CLIENT, SERVER_PATH)
+                    != MERR_OK)
+            {
+                return false;
+            }
+            ep_linux_unix_attach_reader(&server, &unix_server);
+            ep_linux_unix_attach_writer(&server, &unix_server);
+            ep_linux_unix_attach_reader(&client, &unix_client);
+            ep_linux_unix_attach_writer(&client, &unix_client);
+        }
+        else
+        {
+            if (ep_linux_udp_init(&udp_server, SERVER_PORT) != MERR_OK
+                || ep_linux_udp_client_init(&udp_client, "127.0.0.1", SERVER_PORT) != MERR_OK)
+            {
+                return false;
+            }
+            ep_linux_udp_attach_reader(&server, &udp_server);
+            ep_linux_udp_attach_writer(&server, &udp_server);
+            ep_linux_udp_client_attach_reader(&client, &udp_client);
+            ep_linux_udp_client_attach_writer(&client, &udp_client);
+        }
+
+        /* the server learns its client from a first message */
+        uint8_t buf[MAVTUNNEL_READ_BUFFER_SIZE] = {MAVLINK_STX};
+        server.reader.timeout_ms = client.reader.timeout_ms = 1000;
+        client.writer.write(&client.writer, buf, 1);
+        while (server.reader.read(&server.reader, buf, sizeof(buf)) == 0)
+        {
+        }
+        if (kind == LINK_UDP)
+        {
+            server.reader.read(&server.reader, buf, sizeof(buf));
+        }
+        return true;
+    }
+
+    /* what the consumer does with a frame from the tunnel */
+    bool receive(int timeout_ms)
+    {
+        if (kind == LINK_SHM)
+        {
+            size_t         len;
+            const uint8_t* frame = mavtunnel_shm_client_peek(&shm_client, &len, timeout_ms);
+            if (frame == NULL)
+            {
+                return false;
+            }
+            benchmark::DoNotOptimize(frame[len - 1]);
+            mavtunnel_shm_client_release(&shm_client);
+            return true;
+        }
+        uint8_t buf[MAVTUNNEL_READ_BUFFER_SIZE];
+        client.reader.timeout_ms = timeout_ms;
+        return client.reader.read(&client.reader, buf, sizeof(buf)) > 0;
+    }
+
+    void send(const uint8_t* frame, size_t len)
+    {
+        if (kind == LINK_SHM)
+        {
+            mavtunnel_shm_client_send(&shm_client, frame, len);
+        }
+        else
+        {
+            client.writer.write(&client.writer, frame, len);
+        }
+    }
+
+    ~link_t()
+    {
+        if (kind == LINK_SHM)
+        {
+            mavtunnel_shm_client_close(&shm_client);
+            ep_linux_shm_destroy(&shm);
+        }
+        else if (kind == LINK_SEQPACKET)
+        {
+            ep_linux_unix_destroy(&unix_client);
+            ep_linux_unix_destroy(&unix_server);
+        }
+        else
+        {
+            ep_linux_udp_client_destroy(&udp_client);
+            ep_linux_udp_destroy(&udp_server);
+        }
+    }
+};
+
+static const char* LABELS[] = {"shm", "unix seqpacket", "udp"};
+
+static void
+BM_throughput(benchmark::State& state)
+{
+    link_t link;
+    if (!link.open((enum link_kind_t)state.range(0)))
+    {
+        state.SkipWithError("failed to open the link");
+        return;
+    }
+
+    uint8_t frame[FRAME] = {MAVLINK_STX};
+    for (auto _ : state)
+    {
+        for (int i = 0; i < BATCH; i++)
+        {
+            link.server.writer.write(&link.server.writer, frame, sizeof(frame));
+        }
+        for (int i = 0; i < BATCH; i++)
+        {
+            if (!link.receive(1000))
+            {
+                state.SkipWithError("lost a frame");
+                return;
+            }
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * BATCH);
+    state.SetLabel(LABELS[state.range(0)]);
+}
+BENCHMARK(BM_throughput)->DenseRange(LINK_SHM, LINK_UDP);
+
+/* a consumer thread that sleeps until each frame comes, and answers it */
+static void
+BM_wakeup(benchmark::State& state)
+{
+    link_t link;
+    if (!link.open((enum link_kind_t)state.range(0)))
+    {
+        state.SkipWithError("failed to open the link");
+        return;
+    }
+
+    std::atomic_bool stop(false);
+    std::thread      consumer([&]() {
+        uint8_t frame[FRAME] = {MAVLINK_STX};
+        while (!stop)
+        {
+            if (link.receive(100))
+            {
+                link.send(frame, sizeof(frame));
+            }
+        }
+    });
+
+    uint8_t frame[FRAME] = {MAVLINK_STX}, buf[MAVTUNNEL_READ_BUFFER_SIZE];
+    for (auto _ : state)
+    {
+        link.server.writer.write(&link.server.writer, frame, sizeof(frame));
+        if (link.server.reader.read(&link.server.reader, buf, sizeof(buf)) <= 0)
+        {
+            state.SkipWithError("lost a frame");
+            break;
+        }
+    }
+    stop = true;
+    consumer.join();
+    if (link.kind == LINK_SHM)
+    {
+        state.counters["wakeups_per_msg"] = benchmark::Counter(
+            (double)(link.shm.wakeups + link.shm_client.wakeups) / (2 * state.iterations()));
+    }
+    state.SetLabel(LABELS[state.range(0)]);
+}
+BENCHMARK(BM_wakeup)->DenseRange(LINK_SHM, LINK_UDP)->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,152 @@
+#include <benchmark/benchmark.h>
+#include <endpoint_linux_tcp.h>
+#include <endpoint_linux_udp.h>
+#include <endpoint_linux_udp_client.h>
+
+#define SERVER_PORT 14691
+#define FRAME       64
+#define BATCH       64
+
+/* a pair of endpoints on loopback, either over TCP or over UDP */
+struct link_t
+{
+    struct endpoint_linux_tcp_t        tcp_server, tcp_client;
+    struct endpoint_linux_udp_t        udp_server;
+    struct endpoint_linux_udp_client_t udp_client;
+    struct mavtunnel_t                 server, client;
+    bool                               tcp;
+
+    bool open(bool use_tcp)
+    {
+        tcp = use_tcp;
+        mavtunnel_init(&server, 0);
+        mavtunnel_init(&client, 1);
+        if (tcp)
+        {
+            if (ep_linux_tcp_init(&tcp_server, EP_TCP_LISTEN, "127.0.0.1", SERVER_PORT, NULL)
+                    != MERR_OK
+                || ep_linux_tcp_init(&tcp_client, EP_TCP_CONNECT, "127.0.0.1", SERVER_PORT, NULL)
+                    != MERR_OK)
+            {
+                return false;
+            }
+            ep_linux_tcp_attach_reader(&server, &tcp_server);
+            ep_linux_tcp_attach_writer(&server, &tcp_server);
+            ep_linux_tcp_attach_reader(&client, &tcp_client);
+            ep_linux_tcp_attach_writer(&client, &tcp_client);
+        }
+        else
+        {
+            if (ep_linux_udp_init(&udp_server, SERVER_PORT) != MERR_OK
+                || ep_linux_udp_client_init(&udp_client, "127.0.0.1", SERVER_PORT) != MERR_OK)
+            {
+                return false;
+            }
+            ep_linux_udp_attach_reader(&server, &udp_server);
+            ep_linux_udp_attach_writer(&server, &udp_server);
+            ep_linux_udp_client_attach_reader(&client, &udp_client);
+            ep_linux_udp_client_attach_writer(&client, &udp_client);
+        }
+
+        /* let the connection come up, and the UDP server learn its client */
+        uint8_t buf[MAVTUNNEL_READ_BUFFER_SIZE];
+        server.reader.timeout_ms = client.reader.timeout_ms = 10;
+        for (int i = 0; i < 10; i++)
+        {
+            server.reader.read(&server.reader, buf, sizeof(buf));
+            client.reader.read(&client.reader, buf, sizeof(buf));
+        }
+        server.reader.timeout_ms = client.reader.timeout_ms = 1000;
+        return true;
+    }
+
+    ~link_t()
+    {
+        if (tcp)
+        {
+            ep_linux_tcp_destroy(&tcp_client);
+            ep_linux_tcp_destroy(&tcp_server);
+        }
+        else
+        {
+            ep_linux_udp_client_destroy(&udp_client);
+            ep_linux_udp_destroy(&udp_server);
+        }
+    }
+
+    /* read until len bytes have arrived, a TCP read may merge frames */
+    static bool receive(struct mavtunnel_t* tunnel, size_t len)
+    {
+        uint8_t buf[MAVTUNNEL_READ_BUFFER_SIZE];
+        while (len > 0)
+        {
+            ssize_t n = tunnel->reader.read(&tunnel->reader, buf, sizeof(buf));
+            if (n <= 0)
+            {
+                return false;
+            }
+            len -= n < (ssize_t)len ? n : len;
+        }
+        return true;
+    }
+};
+
+static void
+BM_round_trip(benchmark::State& state)
+{
+    link_t link;
+    if (!link.open(state.range(0)))
+    {
+        state.SkipWithError("failed to open the link");
+        return;
+    }
+
+    uint8_t frame[FRAME] = {MAVLINK_STX};
+    for (auto _ : state)
+    {
+        link.client.writer.write(&link.client.writer, frame, sizeof(frame));
+        if (!link_t::receive(&link.server, sizeof(frame)))
+        {
+            state.SkipWithError("lost a frame");
+            return;
+        }
+        link.server.writer.write(&link.server.writer, frame, sizeof(frame));
+        if (!link_t::receive(&link.client, sizeof(frame)))
+        {
+            state.SkipWithError("lost a frame");
+            return;
+        }
+    }
+    state.SetLabel(state.range(0) ? "tcp" : "udp");
+}
+BENCHMARK(BM_round_trip)->Arg(0)->Arg(1);
+
+static void
+BM_throughput(benchmark::State& state)
+{
+    link_t link;
+    if (!link.open(state.range(0)))
+    {
+        state.SkipWithError("failed to open the link");
+        return;
+    }
+
+    uint8_t frame[FRAME] = {MAVLINK_STX};
+    for (auto _ : state)
+    {
+        for (int i = 0; i < BATCH; i++)
+        {
+            link.client.writer.write(&link.client.writer, frame, sizeof(frame));
+        }
+        if (!link_t::receive(&link.server, BATCH * sizeof(frame)))
+        {
+            state.SkipWithError("lost a frame");
+            return;
+        }
+    }
+    state.SetBytesProcessed(state.iterations() * BATCH * sizeof(frame));
+    state.SetLabel(state.range(0) ? "tcp" : "udp");
+}
+BENCHMARK(BM_throughput)->Arg(0)->Arg(1);
+
+BENCHMARK_MAIN();
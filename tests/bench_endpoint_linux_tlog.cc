@@ -0,0 +1,120 @@
+#include <benchmark/benchmark.h>
+#include <endpoint_linux_tlog.h>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <string>
+
+#define REPLAY_FRAMES 100000
+
+static std::string
+scratch_prefix()
+{
+    char dir[] = "/tmp/mavtunnel-bench-tlog-XXXXXX";
+    if (mkdtemp(dir) == nullptr)
+    {
+        return "";
+    }
+    return std::string(dir) + "/capture";
+}
+
+static void
+remove_scratch(const std::string& prefix)
+{
+    std::string cmd = "rm -rf " + prefix.substr(0, prefix.rfind('/'));
+    if (system(cmd.c_str()) != 0)
+    {
+        fprintf(stderr, "failed to remove %s\n", prefix.c_str());
+    }
+}
+
+static size_t
+attitude(uint8_t* buf)
+{
+    mavlink_message_t msg;
+    mavlink_msg_attitude_pack(1, 1, &msg, 0, 0.1f, 0.2f, 0.3f, 0.4f, 0.5f, 0.6f);
+    return mavlink_msg_to_send_buffer(buf, &msg);
+}
+
+/* range(0): segment size in MB, small ones rotate often */
+static void
+BM_capture(benchmark::State& state)
+{
+    std::string                     prefix = scratch_prefix();
+    struct endpoint_linux_capture_t capture;
+    struct mavtunnel_t              tunnel;
+    if (prefix.empty()
+        || ep_linux_capture_init(&capture, prefix.c_str(), state.range(0) * 1024 * 1024)
+            != MERR_OK)
+    {
+        state.SkipWithError("failed to open the capture");
+        return;
+    }
+    mavtunnel_init(&tunnel, 0);
+    ep_linux_capture_attach_writer(&tunnel, &capture);
+
+    uint8_t buf[MAVLINK_MAX_PACKET_LEN];
+    size_t  len = attitude(buf);
+    for (auto _ : state)
+    {
+        tunnel.writer.write(&tunnel.writer, buf, len);
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(state.iterations() * len);
+    state.counters["segments"] = capture.segments;
+
+    ep_linux_capture_destroy(&capture);
+    remove_scratch(prefix);
+}
+BENCHMARK(BM_capture)->Arg(1)->Arg(16);
+
+static void
+BM_replay(benchmark::State& state)
+{
+    std::string                     prefix = scratch_prefix();
+    struct endpoint_linux_capture_t capture;
+    struct mavtunnel_t              tunnel;
+    if (prefix.empty() || ep_linux_capture_init(&capture, prefix.c_str(), 0) != MERR_OK)
+    {
+        state.SkipWithError("failed to open the capture");
+        return;
+    }
+    mavtunnel_init(&tunnel, 0);
+    ep_linux_capture_attach_writer(&tunnel, &capture);
+    uint8_t buf[MAVLINK_MAX_PACKET_LEN];
+    size_t  len = attitude(buf);
+    for (int i = 0; i < REPLAY_FRAMES; i++)
+    {
+        tunnel.writer.write(&tunnel.writer, buf, len);
+    }
+    ep_linux_capture_destroy(&capture);
+
+    struct endpoint_linux_replay_t replay;
+    if (ep_linux_replay_init(&replay, prefix.c_str(), 0) != MERR_OK)
+    {
+        state.SkipWithError("failed to open the replay");
+        return;
+    }
+    ep_linux_replay_attach_reader(&tunnel, &replay);
+
+    for (auto _ : state)
+    {
+        if (tunnel.reader.read(&tunnel.reader, buf, sizeof(buf)) <= 0)
+        {
+            /* from the top */
+            state.PauseTiming();
+            ep_linux_replay_destroy(&replay);
+            ep_linux_replay_init(&replay, prefix.c_str(), 0);
+            state.ResumeTiming();
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(state.iterations() * len);
+
+    ep_linux_replay_destroy(&replay);
+    remove_scratch(prefix);
+}
+BENCHMARK(BM_replay);
+
+BENCHMARK_MAIN();
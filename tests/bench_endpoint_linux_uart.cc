@@ -0,0 +1,111 @@
+#include <benchmark/benchmark.h>
+#include <endpoint_linux_uart.h>
+
+#include <fcntl.h>
+#include <pty.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#define FRAMES 100
+/* bytes the line delivers per wake-up, as a UART FIFO trigger level would */
+#define CHUNK  8
+#define BAUD   115200
+
+/**
+ * A pty paced like a 115200 baud line: a writer thread feeds it CHUNK
+ * bytes at a time, as fast as the line would carry them. The time is the
+ * reader's CPU time per batch of FRAMES frames.
+ */
+static void
+BM_read(benchmark::State& state)
+{
+    int  master, slave;
+    char name[256];
+    if (openpty(&master, &slave, name, nullptr, nullptr) < 0)
+    {
+        state.SkipWithError("openpty failed");
+        return;
+    }
+    struct termios tio;
+    tcgetattr(master, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(master, TCSANOW, &tio);
+
+    struct ep_uart_options_t options = EP_UART_OPTIONS_DEFAULT;
+    options.baud                     = BAUD;
+    options.coalesce_us              = state.range(0);
+    struct endpoint_linux_uart_t ep;
+    struct mavtunnel_t           tunnel;
+    if (ep_linux_uart_init_options(&ep, name, &options) != MERR_OK)
+    {
+        state.SkipWithError("failed to open the pty");
+        return;
+    }
+    mavtunnel_init(&tunnel, 0);
+    ep_linux_uart_attach_reader(&tunnel, &ep);
+    tunnel.reader.timeout_ms = 1000;
+
+    std::vector<uint8_t> bytes;
+    for (int i = 0; i < FRAMES; i++)
+    {
+        mavlink_message_t msg;
+        uint8_t           buf[MAVLINK_MAX_PACKET_LEN];
+        mavlink_msg_attitude_pack(1, 1, &msg, i, 0.1f, 0.2f, 0.3f, 0.4f, 0.5f, 0.6f);
+        size_t len = mavlink_msg_to_send_buffer(buf, &msg);
+        bytes.insert(bytes.end(), buf, buf + len);
+    }
+
+    uint8_t  buf[MAVTUNNEL_READ_BUFFER_SIZE];
+    uint64_t reads = 0;
+    for (auto _ : state)
+    {
+        std::thread line([&]() {
+            struct timespec next;
+            clock_gettime(CLOCK_MONOTONIC, &next);
+            for (size_t sent = 0; sent < bytes.size(); sent += CHUNK)
+            {
+                next.tv_nsec += (long)CHUNK * 10 * 1000000000 / BAUD;
+                if (next.tv_nsec >= 1000000000)
+                {
+                    next.tv_sec++;
+                    next.tv_nsec -= 1000000000;
+                }
+                clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, nullptr);
+                write(master, bytes.data() + sent, std::min((size_t)CHUNK, bytes.size() - sent));
+            }
+        });
+        size_t received = 0;
+        while (received < bytes.size())
+        {
+            ssize_t n = tunnel.reader.read(&tunnel.reader, buf, sizeof(buf));
+            if (n <= 0)
+            {
+                break;
+            }
+            received += n;
+            reads++;
+        }
+        line.join();
+        if (received != bytes.size())
+        {
+            state.SkipWithError("lost bytes");
+            break;
+        }
+    }
+    state.counters["reads_per_frame"]
+        = benchmark::Counter((double)reads / (state.iterations() * FRAMES));
+    state.counters["timer_sleeps_per_frame"]
+        = benchmark::Counter((double)ep.coalesced / (state.iterations() * FRAMES));
+    state.SetLabel(options.coalesce_us ? "frame-aware" : "immediate");
+
+    ep_linux_uart_destroy(&ep);
+    close(slave);
+    close(master);
+}
+BENCHMARK(BM_read)->Arg(0)->Arg(5000)->Unit(benchmark::kMillisecond)->Iterations(5);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,61 @@
+#include <benchmark/benchmark.h>
+#include <endpoint_linux_udp_server.h>
+
+#include <vector>
+#include <unistd.h>
+
+#define SERVER_PORT 14651
+
+/* throughput of the server's fan-out against the number of peers */
+static void
+BM_udp_server_fanout(benchmark::State& state)
+{
+    struct mavtunnel_t                 tunnel;
+    struct endpoint_linux_udp_server_t server;
+    std::vector<int>                   peers;
+
+    mavtunnel_init(&tunnel, 0);
+    if (ep_linux_udp_server_init(&server, SERVER_PORT) != MERR_OK)
+    {
+        state.SkipWithError("failed to bind the server");
+        return;
+    }
+    ep_linux_udp_server_attach_reader(&tunnel, &server);
+    ep_linux_udp_server_attach_writer(&tunnel, &server);
+    tunnel.reader.timeout_ms = 100;
+
+    struct sockaddr_in addr {};
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(SERVER_PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    for (int64_t i = 0; i < state.range(0); i++)
+    {
+        int     fd    = socket(AF_INET, SOCK_DGRAM, 0);
+        uint8_t hello = MAVLINK_STX, buf[16];
+        connect(fd, (struct sockaddr*)&addr, sizeof(addr));
+        send(fd, &hello, 1, 0);
+        tunnel.reader.read(&tunnel.reader, buf, sizeof(buf));
+        peers.push_back(fd);
+    }
+
+    /* a typical telemetry frame; the peers never read, the kernel drops */
+    uint8_t frame[64] = {MAVLINK_STX};
+    for (auto _ : state)
+    {
+        tunnel.writer.write(&tunnel.writer, frame, sizeof(frame));
+    }
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.SetBytesProcessed(state.iterations() * state.range(0) * sizeof(frame));
+    state.counters["syscalls/frame"]
+        = (double)server.syscalls / (double)server.tx_frames;
+
+    for (int fd : peers)
+    {
+        close(fd);
+    }
+    ep_linux_udp_server_destroy(&server);
+}
+BENCHMARK(BM_udp_server_fanout)->RangeMultiplier(2)->Range(1, EP_UDP_SERVER_MAX_PEERS);
+
+BENCHMARK_MAIN();
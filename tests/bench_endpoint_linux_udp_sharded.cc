@@ -0,0 +1,102 @@
+#include <benchmark/benchmark.h>
+#include <endpoint_linux_udp_sharded.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+#define SERVER_PORT 14661
+#define N_SENDERS   32
+#define BATCH       16
+
+/* ingest throughput of many vehicles against the number of shards */
+static void
+BM_udp_sharded_ingest(benchmark::State& state)
+{
+    struct endpoint_linux_udp_sharded_t server;
+    size_t                              n_shards = state.range(0);
+    if (ep_linux_udp_sharded_init(&server, SERVER_PORT, n_shards, EP_UDP_SHARDED_STEER)
+        != MERR_OK)
+    {
+        state.SkipWithError("failed to bind the shards");
+        return;
+    }
+
+    std::atomic<uint64_t>    received {0};
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < n_shards; i++)
+    {
+        workers.emplace_back([&server, &received, i]() {
+            struct mavtunnel_t tunnel;
+            uint8_t            buf[MAVTUNNEL_READ_BUFFER_SIZE];
+            ep_linux_udp_sharded_attach_reader(&tunnel, &server, i);
+            tunnel.reader.timeout_ms = -1;
+            while (tunnel.reader.read(&tunnel.reader, buf, sizeof(buf)) >= 0)
+            {
+                received.fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+    }
+
+    struct sockaddr_in addr {};
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(SERVER_PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    std::vector<int> senders;
+    for (size_t i = 0; i < N_SENDERS; i++)
+    {
+        int fd = socket(AF_INET, SOCK_DGRAM, 0);
+        connect(fd, (struct sockaddr*)&addr, sizeof(addr));
+        senders.push_back(fd);
+    }
+
+    uint8_t        frame[64] = {MAVLINK_STX};
+    struct iovec   iov       = {frame, sizeof(frame)};
+    struct mmsghdr msgs[BATCH] {};
+    for (auto& msg : msgs)
+    {
+        msg.msg_hdr.msg_iov    = &iov;
+        msg.msg_hdr.msg_iovlen = 1;
+    }
+
+    uint64_t sent = 0;
+    for (auto _ : state)
+    {
+        for (int fd : senders)
+        {
+            sent += sendmmsg(fd, msgs, BATCH, 0);
+        }
+        /* the kernel drops what the shards cannot keep up with: wait for
+           the rest until the shards go quiet */
+        uint64_t last     = received.load();
+        auto     deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(2);
+        while (last < sent && std::chrono::steady_clock::now() < deadline)
+        {
+            std::this_thread::yield();
+            if (received.load() != last)
+            {
+                last     = received.load();
+                deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(2);
+            }
+        }
+    }
+
+    state.SetItemsProcessed(received.load());
+    state.counters["dropped"] = (double)(sent - received.load());
+
+    ep_linux_udp_sharded_interrupt(&server);
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+    for (int fd : senders)
+    {
+        close(fd);
+    }
+    ep_linux_udp_sharded_destroy(&server);
+}
+BENCHMARK(BM_udp_sharded_ingest)->RangeMultiplier(2)->Range(1, 8)->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,152 @@
+#include <benchmark/benchmark.h>
+#include <endpoint_linux_udp.h>
+#include <endpoint_linux_udp_client.h>
+#include <endpoint_linux_unix.h>
+
+#define SERVER_PORT 14695
+#define SERVER_PATH "@mavtunnel-bench-unix"
+#define FRAME       64
+/* below net.unix.max_dgram_qlen, which defaults to 10 */
+#define BATCH       8
+
+enum link_kind_t
+{
+    LINK_UDP,
+    LINK_SEQPACKET,
+    LINK_DGRAM,
+};
+
+/* a server and one client on the same host */
+struct link_t
+{
+    struct endpoint_linux_udp_t        udp_server;
+    struct endpoint_linux_udp_client_t udp_client;
+    struct endpoint_linux_unix_t       unix_server, unix_client;
+    struct mavtunnel_t                 server, client;
+    enum link_kind_t                   kind;
+
+    bool open(enum link_kind_t link_kind)
+    {
+        kind = link_kind;
+        mavtunnel_init(&server, 0);
+        mavtunnel_init(&client, 1);
+        if (kind == LINK_UDP)
+        {
+            if (ep_linux_udp_init(&udp_server, SERVER_PORT) != MERR_OK
+                || ep_linux_udp_client_init(&udp_client, "127.0.0.1", SERVER_PORT) != MERR_OK)
+            {
+                return false;
+            }
+            ep_linux_udp_attach_reader(&server, &udp_server);
+            ep_linux_udp_attach_writer(&server, &udp_server);
+            ep_linux_udp_client_attach_reader(&client, &udp_client);
+            ep_linux_udp_client_attach_writer(&client, &udp_client);
+        }
+        else
+        {
+            enum ep_unix_type_t type = kind == LINK_SEQPACKET ? EP_UNIX_SEQPACKET : EP_UNIX_DGRAM;
+            if (ep_linux_unix_init(&unix_server, type, EP_UNIX_SERVER, SERVER_PATH) != MERR_OK
+                || ep_linux_unix_init(&unix_client, type, EP_UNIX_CLIENT, SERVER_PATH) != MERR_OK)
+            {
+                return false;
+            }
+            ep_linux_unix_attach_reader(&server, &unix_server);
+            ep_linux_unix_attach_writer(&server, &unix_server);
+            ep_linux_unix_attach_reader(&client, &unix_client);
+            ep_linux_unix_attach_writer(&client, &unix_client);
+        }
+
+        /* the server learns its client from a first message */
+        uint8_t buf[MAVTUNNEL_READ_BUFFER_SIZE] = {MAVLINK_STX};
+        server.reader.timeout_ms = client.reader.timeout_ms = 1000;
+        client.writer.write(&client.writer, buf, 1);
+        while (server.reader.read(&server.reader, buf, sizeof(buf)) == 0)
+        {
+        }
+        if (kind == LINK_UDP)
+        {
+            /* and the probe ep_linux_udp_client_init() sent */
+            server.reader.read(&server.reader, buf, sizeof(buf));
+        }
+        return true;
+    }
+
+    ~link_t()
+    {
+        if (kind == LINK_UDP)
+        {
+            ep_linux_udp_client_destroy(&udp_client);
+            ep_linux_udp_destroy(&udp_server);
+        }
+        else
+        {
+            ep_linux_unix_destroy(&unix_client);
+            ep_linux_unix_destroy(&unix_server);
+        }
+    }
+};
+
+static const char* LABELS[] = {"udp", "unix seqpacket", "unix dgram"};
+
+static void
+BM_round_trip(benchmark::State& state)
+{
+    link_t link;
+    if (!link.open((enum link_kind_t)state.range(0)))
+    {
+        state.SkipWithError("failed to open the link");
+        return;
+    }
+
+    uint8_t frame[FRAME] = {MAVLINK_STX}, buf[MAVTUNNEL_READ_BUFFER_SIZE];
+    for (auto _ : state)
+    {
+        link.client.writer.write(&link.client.writer, frame, sizeof(frame));
+        if (link.server.reader.read(&link.server.reader, buf, sizeof(buf)) <= 0)
+        {
+            state.SkipWithError("lost a frame");
+            return;
+        }
+        link.server.writer.write(&link.server.writer, frame, sizeof(frame));
+        if (link.client.reader.read(&link.client.reader, buf, sizeof(buf)) <= 0)
+        {
+            state.SkipWithError("lost a frame");
+            return;
+        }
+    }
+    state.SetLabel(LABELS[state.range(0)]);
+}
+BENCHMARK(BM_round_trip)->DenseRange(LINK_UDP, LINK_DGRAM);
+
+static void
+BM_throughput(benchmark::State& state)
+{
+    link_t link;
+    if (!link.open((enum link_kind_t)state.range(0)))
+    {
+        state.SkipWithError("failed to open the link");
+        return;
+    }
+
+    uint8_t frame[FRAME] = {MAVLINK_STX}, buf[MAVTUNNEL_READ_BUFFER_SIZE];
+    for (auto _ : state)
+    {
+        for (int i = 0; i < BATCH; i++)
+        {
+            link.client.writer.write(&link.client.writer, frame, sizeof(frame));
+        }
+        for (int i = 0; i < BATCH; i++)
+        {
+            if (link.server.reader.read(&link.server.reader, buf, sizeof(buf)) <= 0)
+            {
+                state.SkipWithError("lost a frame");
+                return;
+            }
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * BATCH);
+    state.SetLabel(LABELS[state.range(0)]);
+}
+BENCHMARK(BM_throughput)->DenseRange(LINK_UDP, LINK_DGRAM);
+
+BENCHMARK_MAIN();
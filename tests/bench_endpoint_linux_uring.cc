@@ -0,0 +1,129 @@
+#include <benchmark/benchmark.h>
+#include <endpoint_linux_udp.h>
+#include <endpoint_linux_uring.h>
+
+#include <unistd.h>
+
+#define SERVER_PORT 14671
+#define BATCH       16
+
+struct echo_client_t
+{
+    int            fd;
+    uint8_t        frame[64] = {MAVLINK_STX};
+    uint8_t        replies[BATCH][64];
+    struct iovec   iov[BATCH + 1];
+    struct mmsghdr out[BATCH], in[BATCH];
+
+    echo_client_t()
+    {
+        struct sockaddr_in addr {};
+        addr.sin_family      = AF_INET;
+        addr.sin_port        = htons(SERVER_PORT);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        fd                   = socket(AF_INET, SOCK_DGRAM, 0);
+        connect(fd, (struct sockaddr*)&addr, sizeof(addr));
+
+        iov[BATCH] = {frame, sizeof(frame)};
+        for (size_t i = 0; i < BATCH; i++)
+        {
+            iov[i]                    = {replies[i], sizeof(replies[i])};
+            out[i]                    = {};
+            out[i].msg_hdr.msg_iov    = &iov[BATCH];
+            out[i].msg_hdr.msg_iovlen = 1;
+            in[i]                     = {};
+            in[i].msg_hdr.msg_iov     = &iov[i];
+            in[i].msg_hdr.msg_iovlen  = 1;
+        }
+    }
+    ~echo_client_t() { close(fd); }
+
+    void send() { sendmmsg(fd, out, BATCH, 0); }
+
+    void drain()
+    {
+        for (int n = 0; n < BATCH;)
+        {
+            int rv = recvmmsg(fd, in, BATCH - n, 0, NULL);
+            if (rv <= 0)
+            {
+                break;
+            }
+            n += rv;
+        }
+    }
+};
+
+/* the server echoes a burst: read and write per frame */
+static void
+echo(benchmark::State& state, struct mavtunnel_t* tunnel, echo_client_t& client)
+{
+    uint8_t buf[MAVTUNNEL_READ_BUFFER_SIZE];
+    for (auto _ : state)
+    {
+        client.send();
+        for (int i = 0; i < BATCH; i++)
+        {
+            ssize_t n = tunnel->reader.read(&tunnel->reader, buf, sizeof(buf));
+            if (n <= 0)
+            {
+                state.SkipWithError("lost a frame");
+                return;
+            }
+            tunnel->writer.write(&tunnel->writer, buf, n);
+        }
+        client.drain();
+    }
+    state.SetItemsProcessed(state.iterations() * BATCH);
+}
+
+static void
+BM_udp_epoll_echo(benchmark::State& state)
+{
+    struct endpoint_linux_udp_t ep;
+    struct mavtunnel_t          tunnel;
+    if (ep_linux_udp_init(&ep, SERVER_PORT) != MERR_OK)
+    {
+        state.SkipWithError("failed to bind");
+        return;
+    }
+    ep_linux_udp_attach_reader(&tunnel, &ep);
+    ep_linux_udp_attach_writer(&tunnel, &ep);
+    tunnel.reader.timeout_ms = 1000;
+
+    echo_client_t client;
+    echo(state, &tunnel, client);
+    /* epoll_wait + recvfrom, sendto */
+    state.counters["syscalls_per_msg"] = 3;
+
+    ep_linux_udp_destroy(&ep);
+}
+BENCHMARK(BM_udp_epoll_echo);
+
+static void
+BM_udp_uring_echo(benchmark::State& state)
+{
+    struct endpoint_linux_udp_t   udp;
+    struct endpoint_linux_uring_t ep;
+    struct mavtunnel_t            tunnel;
+    if (ep_linux_udp_init(&udp, SERVER_PORT) != MERR_OK
+        || ep_linux_uring_init(&ep, udp.fd, EP_URING_DATAGRAM, state.range(0)) != MERR_OK)
+    {
+        state.SkipWithError("failed to set up io_uring");
+        return;
+    }
+    ep_linux_uring_attach_reader(&tunnel, &ep);
+    ep_linux_uring_attach_writer(&tunnel, &ep);
+    tunnel.reader.timeout_ms = 1000;
+
+    echo_client_t client;
+    echo(state, &tunnel, client);
+    state.counters["syscalls_per_msg"]
+        = (double)(ep.rx.enters + ep.tx.enters) / (state.iterations() * BATCH);
+
+    ep_linux_uring_destroy(&ep);
+    ep_linux_udp_destroy(&udp);
+}
+BENCHMARK(BM_udp_uring_echo)->Arg(0)->Arg(EP_URING_SQPOLL);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,150 @@
+#include <benchmark/benchmark.h>
+#include <endpoint_linux_udp.h>
+#include <endpoint_linux_xdp.h>
+
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define SERVER_PORT 14681
+#define VETH_HOST   "mtxdp2"
+#define VETH_TUNNEL "mtxdp3"
+#define BATCH       32
+#define PAYLOAD     64
+
+/* blasts tunnel datagrams at the far end of a veth pair */
+struct veth_sender_t
+{
+    int            fd = -1;
+    uint8_t        frame[EP_XDP_HEADERS + PAYLOAD] {};
+    struct iovec   iov {frame, sizeof(frame)};
+    struct mmsghdr msgs[BATCH] {};
+
+    bool open()
+    {
+        if (system("ip link add " VETH_HOST " type veth peer name " VETH_TUNNEL
+                   " 2>/dev/null && ip addr add 10.77.1.2/24 dev " VETH_TUNNEL
+                   " && ip link set " VETH_HOST " up && ip link set " VETH_TUNNEL " up")
+            != 0)
+        {
+            return false;
+        }
+
+        struct ifreq ifr {};
+        strcpy(ifr.ifr_name, VETH_TUNNEL);
+        fd = socket(AF_PACKET, SOCK_RAW, 0);
+        ioctl(fd, SIOCGIFHWADDR, &ifr);
+        struct sockaddr_ll addr {};
+        addr.sll_family  = AF_PACKET;
+        addr.sll_ifindex = if_nametoindex(VETH_HOST);
+        bind(fd, (struct sockaddr*)&addr, sizeof(addr));
+
+        struct ethhdr* eth = (struct ethhdr*)frame;
+        struct iphdr*  ip  = (struct iphdr*)(eth + 1);
+        struct udphdr* udp = (struct udphdr*)(ip + 1);
+        memcpy(eth->h_dest, ifr.ifr_hwaddr.sa_data, ETH_ALEN);
+        eth->h_source[0] = 0x02;
+        eth->h_proto     = htons(ETH_P_IP);
+        ip->version      = 4;
+        ip->ihl          = 5;
+        ip->tot_len      = htons(28 + PAYLOAD);
+        ip->ttl          = 64;
+        ip->protocol     = IPPROTO_UDP;
+        ip->saddr        = inet_addr("10.77.1.1");
+        ip->daddr        = inet_addr("10.77.1.2");
+        uint32_t sum = 0;
+        for (size_t i = 0; i < sizeof(*ip) / 2; i++)
+        {
+            sum += ((uint16_t*)ip)[i];
+        }
+        ip->check   = ~(uint16_t)((sum & 0xffff) + (sum >> 16));
+        udp->source = htons(40000);
+        udp->dest   = htons(SERVER_PORT);
+        udp->len    = htons(8 + PAYLOAD);
+        ((uint8_t*)(udp + 1))[0] = MAVLINK_STX;
+
+        for (auto& msg : msgs)
+        {
+            msg.msg_hdr.msg_iov    = &iov;
+            msg.msg_hdr.msg_iovlen = 1;
+        }
+        return true;
+    }
+
+    ~veth_sender_t()
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+            system("ip link del " VETH_HOST);
+        }
+    }
+
+    void send() { sendmmsg(fd, msgs, BATCH, 0); }
+};
+
+static void
+receive(benchmark::State& state, struct mavtunnel_t* tunnel, veth_sender_t& sender)
+{
+    uint8_t  buf[MAVTUNNEL_READ_BUFFER_SIZE];
+    uint64_t received = 0;
+    for (auto _ : state)
+    {
+        sender.send();
+        for (int i = 0; i < BATCH; i++)
+        {
+            if (tunnel->reader.read(&tunnel->reader, buf, sizeof(buf)) <= 0)
+            {
+                break;
+            }
+            received++;
+        }
+    }
+    state.SetItemsProcessed(received);
+    state.counters["dropped"] = (double)(state.iterations() * BATCH - received);
+}
+
+static void
+BM_udp_socket_rx(benchmark::State& state)
+{
+    veth_sender_t               sender;
+    struct endpoint_linux_udp_t ep;
+    struct mavtunnel_t          tunnel;
+    if (!sender.open() || ep_linux_udp_init(&ep, SERVER_PORT) != MERR_OK)
+    {
+        state.SkipWithError("needs CAP_NET_ADMIN for a veth pair");
+        return;
+    }
+    ep_linux_udp_attach_reader(&tunnel, &ep);
+    tunnel.reader.timeout_ms = 10;
+
+    receive(state, &tunnel, sender);
+    ep_linux_udp_destroy(&ep);
+}
+BENCHMARK(BM_udp_socket_rx)->UseRealTime();
+
+static void
+BM_udp_xdp_rx(benchmark::State& state)
+{
+    veth_sender_t               sender;
+    struct endpoint_linux_xdp_t ep;
+    struct mavtunnel_t          tunnel;
+    if (!sender.open() || ep_linux_xdp_init(&ep, VETH_TUNNEL, 0, SERVER_PORT, 0) != MERR_OK)
+    {
+        state.SkipWithError("needs CAP_NET_ADMIN and AF_XDP");
+        return;
+    }
+    ep_linux_xdp_attach_reader(&tunnel, &ep);
+    tunnel.reader.timeout_ms = 10;
+
+    receive(state, &tunnel, sender);
+    ep_linux_xdp_destroy(&ep);
+}
+BENCHMARK(BM_udp_xdp_rx)->UseRealTime();
+
+BENCHMARK_MAIN();
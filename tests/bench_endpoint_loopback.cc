@@ -0,0 +1,172 @@
+#include <benchmark/benchmark.h>
+#include <codec_chacha20.h>
+#include <codec_passthrough.h>
+#include <endpoint_loopback.h>
+
+#include <vector>
+
+#define BATCH 64
+
+enum codec_t
+{
+    CODEC_PASSTHROUGH,
+    CODEC_CHACHA20,
+};
+
+static const char* KINDS[]  = {"bytes", "datagram"};
+static const char* CODECS[] = {"passthrough", "chacha20"};
+
+static struct stream_cipher_t ciphers[2];
+
+static void
+attach_codec(struct mavtunnel_t* tunnel, enum codec_t codec, int dir)
+{
+    if (codec == CODEC_CHACHA20)
+    {
+        codec_chacha20_attach(tunnel, &ciphers[dir]);
+    }
+    else
+    {
+        codec_passthrough_attach(tunnel);
+    }
+}
+
+static std::vector<std::vector<uint8_t>>
+batch()
+{
+    std::vector<std::vector<uint8_t>> frames;
+    for (int i = 0; i < BATCH; i++)
+    {
+        mavlink_message_t msg;
+        uint8_t           buf[MAVLINK_MAX_PACKET_LEN];
+        mavlink_msg_attitude_pack(1, 1, &msg, i, 0.1f, 0.2f, 0.3f, 0.4f, 0.5f, 0.6f);
+        size_t len = mavlink_msg_to_send_buffer(buf, &msg);
+        frames.emplace_back(buf, buf + len);
+    }
+    return frames;
+}
+
+/**
+ * The source writes a batch of frames into end[0] of the input pair, one
+ * or two tunnels in a chain take them through parse, codec and finalize,
+ * and the sink drains end[1] of the output pair. All on this thread, with
+ * every reader polling once: the kernel is never involved.
+ */
+struct chain_t
+{
+    struct endpoint_loopback_pair_t pairs[3];
+    struct mavtunnel_t              tunnels[2], source, sink;
+    size_t                          n_tunnels;
+
+    bool open(enum ep_loopback_kind_t kind, enum codec_t codec, size_t n)
+    {
+        n_tunnels = n;
+        for (size_t i = 0; i <= n; i++)
+        {
+            if (ep_loopback_pair_init(&pairs[i], kind, 0) != MERR_OK)
+            {
+                return false;
+            }
+        }
+        for (size_t i = 0; i < n; i++)
+        {
+            mavtunnel_init(&tunnels[i], i);
+            ep_loopback_attach_reader(&tunnels[i], &pairs[i].end[1]);
+            ep_loopback_attach_writer(&tunnels[i], &pairs[i + 1].end[0]);
+            /* the first encodes, the second decodes */
+            attach_codec(&tunnels[i], codec, i);
+            tunnels[i].reader.timeout_ms = 0;
+        }
+        mavtunnel_init(&source, n);
+        ep_loopback_attach_writer(&source, &pairs[0].end[0]);
+        mavtunnel_init(&sink, n + 1);
+        ep_loopback_attach_reader(&sink, &pairs[n].end[1]);
+        sink.reader.timeout_ms = 0;
+        return true;
+    }
+
+    size_t forward(const std::vector<std::vector<uint8_t>>& frames)
+    {
+        for (auto& f : frames)
+        {
+            source.writer.write(&source.writer, f.data(), f.size());
+        }
+        for (size_t i = 0; i < n_tunnels; i++)
+        {
+            while (atomic_load(&pairs[i].ring[0].head) != atomic_load(&pairs[i].ring[0].tail))
+            {
+                mavtunnel_spin_once(&tunnels[i]);
+            }
+        }
+        size_t  received = 0;
+        uint8_t buf[MAVTUNNEL_READ_BUFFER_SIZE];
+        ssize_t n;
+        while ((n = sink.reader.read(&sink.reader, buf, sizeof(buf))) > 0)
+        {
+            received += n;
+        }
+        return received;
+    }
+
+    ~chain_t()
+    {
+        for (size_t i = 0; i <= n_tunnels; i++)
+        {
+            ep_loopback_pair_destroy(&pairs[i]);
+        }
+    }
+};
+
+static void
+run(benchmark::State& state, size_t n_tunnels)
+{
+    auto    kind  = (enum ep_loopback_kind_t)state.range(0);
+    auto    codec = (enum codec_t)state.range(1);
+    chain_t chain;
+    if (!chain.open(kind, codec, n_tunnels))
+    {
+        state.SkipWithError("failed to open the loopback pairs");
+        return;
+    }
+
+    auto   frames = batch();
+    size_t bytes  = 0;
+    for (auto& f : frames)
+    {
+        bytes += f.size();
+    }
+
+    for (auto _ : state)
+    {
+        if (chain.forward(frames) != bytes)
+        {
+            state.SkipWithError("lost frames");
+            return;
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * BATCH);
+    state.SetBytesProcessed(state.iterations() * bytes);
+    state.counters["ns/frame"] = benchmark::Counter(state.iterations() * BATCH,
+        benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+    state.SetLabel(std::string(KINDS[kind]) + ", " + CODECS[codec]);
+}
+
+/* one tunnel: parse, encode, finalize */
+static void
+BM_tunnel(benchmark::State& state)
+{
+    run(state, 1);
+}
+BENCHMARK(BM_tunnel)->ArgsProduct({{EP_LOOPBACK_BYTES, EP_LOOPBACK_DATAGRAM},
+    {CODEC_PASSTHROUGH, CODEC_CHACHA20}});
+
+/* both ends of a link: encode in one tunnel, decode in the other */
+static void
+BM_tunnel_pair(benchmark::State& state)
+{
+    run(state, 2);
+}
+BENCHMARK(BM_tunnel_pair)->ArgsProduct({{EP_LOOPBACK_BYTES, EP_LOOPBACK_DATAGRAM},
+    {CODEC_PASSTHROUGH, CODEC_CHACHA20}});
+
+BENCHMARK_MAIN();
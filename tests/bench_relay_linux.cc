@@ -0,0 +1,142 @@
+#include <benchmark/benchmark.h>
+#include <codec_passthrough.h>
+#include <endpoint_linux_uart.h>
+#include <relay_linux.h>
+
+#include <fcntl.h>
+#include <pty.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <vector>
+
+#define BATCH 32
+
+enum path_t
+{
+    PATH_TUNNEL,
+    PATH_RELAY,
+    PATH_RELAY_CHECKED,
+};
+
+/* two ptys, as two UARTs: the bench writes to one and reads the other */
+struct link_t
+{
+    int                          master[2], slave[2];
+    char                         name[2][256];
+    struct endpoint_linux_uart_t uart[2];
+    struct mavtunnel_t           tunnel;
+    struct relay_linux_t         relay;
+    enum path_t                  path;
+
+    bool open(enum path_t link_path)
+    {
+        path = link_path;
+        for (int i = 0; i < 2; i++)
+        {
+            struct termios options;
+            if (openpty(&master[i], &slave[i], name[i], nullptr, nullptr) < 0)
+            {
+                return false;
+            }
+            tcgetattr(master[i], &options);
+            cfmakeraw(&options);
+            tcsetattr(master[i], TCSANOW, &options);
+            fcntl(master[i], F_SETFL, O_NONBLOCK);
+            if (ep_linux_uart_init(&uart[i], name[i]) != MERR_OK)
+            {
+                return false;
+            }
+        }
+
+        if (path == PATH_TUNNEL)
+        {
+            mavtunnel_init(&tunnel, 0);
+            ep_linux_uart_attach_reader(&tunnel, &uart[0]);
+            ep_linux_uart_attach_writer(&tunnel, &uart[1]);
+            codec_passthrough_attach(&tunnel);
+            return true;
+        }
+        return relay_linux_init(&relay, uart[0].fd, uart[1].fd, path == PATH_RELAY ? 0 : 1)
+            == MERR_OK;
+    }
+
+    void spin_once()
+    {
+        if (path == PATH_TUNNEL)
+        {
+            mavtunnel_spin_once(&tunnel);
+        }
+        else
+        {
+            relay_linux_spin_once(&relay, 100);
+        }
+    }
+
+    ~link_t()
+    {
+        if (path != PATH_TUNNEL)
+        {
+            relay_linux_destroy(&relay);
+        }
+        for (int i = 0; i < 2; i++)
+        {
+            ep_linux_uart_destroy(&uart[i]);
+            close(slave[i]);
+            close(master[i]);
+        }
+    }
+};
+
+static const char* LABELS[] = {"tunnel passthrough", "relay", "relay, checked"};
+
+static void
+BM_forward(benchmark::State& state)
+{
+    link_t link;
+    if (!link.open((enum path_t)state.range(0)))
+    {
+        state.SkipWithError("failed to open the link");
+        return;
+    }
+
+    std::vector<uint8_t> bytes;
+    for (int i = 0; i < BATCH; i++)
+    {
+        mavlink_message_t msg;
+        uint8_t           buf[MAVLINK_MAX_PACKET_LEN];
+        mavlink_msg_attitude_pack(1, 1, &msg, i, 0.1f, 0.2f, 0.3f, 0.4f, 0.5f, 0.6f);
+        size_t len = mavlink_msg_to_send_buffer(buf, &msg);
+        bytes.insert(bytes.end(), buf, buf + len);
+    }
+
+    uint8_t buf[4096];
+    for (auto _ : state)
+    {
+        if (write(link.master[0], bytes.data(), bytes.size()) != (ssize_t)bytes.size())
+        {
+            state.SkipWithError("short write");
+            return;
+        }
+        size_t received = 0;
+        for (int i = 0; i < 1000 && received < bytes.size(); i++)
+        {
+            link.spin_once();
+            ssize_t n;
+            while ((n = read(link.master[1], buf, sizeof(buf))) > 0)
+            {
+                received += n;
+            }
+        }
+        if (received != bytes.size())
+        {
+            state.SkipWithError("lost bytes");
+            return;
+        }
+    }
+    state.SetBytesProcessed(state.iterations() * bytes.size());
+    state.SetLabel(LABELS[state.range(0)]);
+}
+BENCHMARK(BM_forward)->DenseRange(PATH_TUNNEL, PATH_RELAY_CHECKED);
+
+BENCHMARK_MAIN();
@@ -2,6 +2,7 @@
 #include "tunnel.h"
 #include "endpoint_linux_uart.h"
 #include "codec_passthrough.h"
+#include "relay_linux.h"
 
 #include <stdio.h>
 #include <unistd.h>
@@ -13,6 +14,8 @@
 
 struct mavtunnel_t up, down;
 struct endpoint_linux_uart_t ep_sitl, ep_gcs;
+struct relay_linux_t relay_up, relay_down;
+static bool parse = false;
 
 static atomic_bool to_exit = ATOMIC_VAR_INIT(false);
 
@@ -39,39 +42,72 @@ static int tunnel_thread(void * tunnel)
     return 0;
 }
 
+static int relay_thread(void * relay)
+{
+    relay_linux_spin((struct relay_linux_t *)relay);
+    atomic_store(&to_exit, true);
+    relay_linux_interrupt(&relay_up);
+    relay_linux_interrupt(&relay_down);
+    return 0;
+}
+
 static void sig_int(int signum)
 {
     (void)signum;
     atomic_store(&to_exit, true);
+    if (!parse)
+    {
+        relay_linux_interrupt(&relay_up);
+        relay_linux_interrupt(&relay_down);
+    }
     ep_linux_uart_interrupt(&ep_sitl);
     ep_linux_uart_interrupt(&ep_gcs);
 }
 
 int main(int argc, char ** argv)
 {
-    mavtunnel_init(&up, 0);
-    mavtunnel_init(&down, 1);
+    /* --parse: run the frames through a tunnel instead of relaying bytes */
+    parse = argc > 1 && strcmp(argv[1], "--parse") == 0;
+
     ep_linux_uart_init(&ep_sitl, "/dev/ttyAMA1");
     ep_linux_uart_init(&ep_gcs, "/dev/ttyAMA2");
 
-    ep_linux_uart_attach_reader(&up, &ep_sitl);
-    ep_linux_uart_attach_writer(&up, &ep_gcs);
-    codec_passthrough_attach(&up);
+    int (*thread)(void *) = relay_thread;
+    void * up_ctx = &relay_up, * down_ctx = &relay_down;
+    if (parse)
+    {
+        mavtunnel_init(&up, 0);
+        mavtunnel_init(&down, 1);
 
-    ep_linux_uart_attach_reader(&down, &ep_gcs);
-    ep_linux_uart_attach_writer(&down, &ep_sitl);
-    codec_passthrough_attach(&down);
+        ep_linux_uart_attach_reader(&up, &ep_sitl);
+        ep_linux_uart_attach_writer(&up, &ep_gcs);
+        codec_passthrough_attach(&up);
+
+        ep_linux_uart_attach_reader(&down, &ep_gcs);
+        ep_linux_uart_attach_writer(&down, &ep_sitl);
+        codec_passthrough_attach(&down);
+
+        thread = tunnel_thread;
+        up_ctx = &up;
+        down_ctx = &down;
+    }
+    else if (relay_linux_init(&relay_up, ep_sitl.fd, ep_gcs.fd, 0) != MERR_OK
+        || relay_linux_init(&relay_down, ep_gcs.fd, ep_sitl.fd, 0) != MERR_OK)
+    {
+        printf("failed to set up the relays\n");
+        return -1;
+    }
 
     signal(SIGINT, sig_int);
     atomic_store(&to_exit, false);
     thrd_t up_thread, down_thread;
-    if (thrd_create(&up_thread, tunnel_thread, &up) != thrd_success)
+    if (thrd_create(&up_thread, thread, up_ctx) != thrd_success)
     {
         printf("failed to create up thread\n");
         return -1;
     }
 
-    if (thrd_create(&down_thread, tunnel_thread, &down) != thrd_success)
+    if (thrd_create(&down_thread, thread, down_ctx) != thrd_success)
     {
         printf("failed to create down thread\n");
         return -1;
@@ -80,6 +116,11 @@ int main(int argc, char ** argv)
     thrd_join(up_thread, NULL);
     thrd_join(down_thread, NULL);
 
+    if (!parse)
+    {
+        relay_linux_destroy(&relay_up);
+        relay_linux_destroy(&relay_down);
+    }
     ep_linux_uart_destroy(&ep_sitl);
     ep_linux_uart_destroy(&ep_gcs);
 
@@ -0,0 +1,122 @@
+#include <gtest/gtest.h>
+#include <codec_aggregate.h>
+#include <codec_chacha20.h>
+
+#include <thread>
+#include <vector>
+#include "test_pipe.hpp"
+
+struct mavtunnel_t A, B;
+struct stream_cipher_t encoder, decoder;
+struct codec_aggregate_t packer, splitter;
+
+static byte_pipe_t input, wire, output;
+
+class CodecAggregateTest : public ::testing::Test
+{
+public:
+    void setup(uint64_t deadline_us, size_t budget)
+    {
+        mavtunnel_init(&A, 0);
+        mavtunnel_init(&B, 1);
+
+        codec_chacha20_attach(&A, &encoder);
+        codec_aggregate_attach(&A, &packer, MT_CODEC_ENCODE, deadline_us, budget);
+        codec_chacha20_attach(&B, &decoder);
+        codec_aggregate_attach(&B, &splitter, MT_CODEC_DECODE, deadline_us, budget);
+
+        input.clear();
+        wire.clear();
+        output.clear();
+        pipe_attach_reader(&A, &input);
+        pipe_attach_writer(&A, &wire);
+        pipe_attach_reader(&B, &wire);
+        pipe_attach_writer(&B, &output);
+    }
+
+    static void append(std::vector<uint8_t>& v, mavlink_message_t* msg)
+    {
+        uint8_t buf[MAVLINK_MAX_PACKET_LEN];
+        size_t  len = mavlink_msg_to_send_buffer(buf, msg);
+        v.insert(v.end(), buf, buf + len);
+    }
+
+    static void heartbeats(size_t n)
+    {
+        mavlink_message_t msg;
+        for (size_t i = 0; i < n; i++)
+        {
+            mavlink_msg_heartbeat_pack(1, 1, &msg, MAV_TYPE_QUADROTOR,
+                MAV_AUTOPILOT_ARDUPILOTMEGA, 1, (uint32_t)i, 3);
+            append(input.bytes, &msg);
+        }
+    }
+
+    static void drain()
+    {
+        while (!wire.drained())
+        {
+            mavtunnel_spin_once(&B);
+        }
+    }
+};
+
+TEST_F(CodecAggregateTest, pack_split)
+{
+    setup(1000000, 0);
+    heartbeats(8);
+
+    mavtunnel_spin_once(&A);
+    EXPECT_EQ(wire.writes, 0);
+    EXPECT_EQ(codec_aggregate_flush(&packer), MERR_OK);
+    EXPECT_EQ(wire.writes, 1);
+    EXPECT_EQ(packer.superframes, 1);
+    EXPECT_LT(wire.bytes.size(), input.bytes.size());
+
+    drain();
+    EXPECT_EQ(splitter.frames, 8);
+    ASSERT_EQ(output.bytes.size(), input.bytes.size());
+    EXPECT_EQ(memcmp(output.bytes.data(), input.bytes.data(), input.bytes.size()), 0);
+}
+
+TEST_F(CodecAggregateTest, deadline_flushes_idle_link)
+{
+    setup(1000, 0);
+    heartbeats(3);
+
+    mavtunnel_spin_once(&A);
+    EXPECT_EQ(wire.writes, 0);
+    EXPECT_EQ(A.reader.timeout_ms, 1);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    mavtunnel_spin_once(&A);
+    EXPECT_EQ(wire.writes, 1);
+    EXPECT_EQ(A.reader.timeout_ms, -1);
+
+    drain();
+    EXPECT_EQ(output.bytes, input.bytes);
+}
+
+TEST_F(CodecAggregateTest, budget_and_oversized_frames)
+{
+    setup(1000000, 48);
+    heartbeats(5);
+
+    mavlink_message_t msg;
+    mavlink_msg_statustext_pack(1, 1, &msg, MAV_SEVERITY_INFO,
+        "PreArm: Compass not calibrated, PreArm: Need 3D Fix", 0, 0);
+    ASSERT_GT(msg.len + CODEC_AGGREGATE_SUBHEADER_LEN, 48);
+    append(input.bytes, &msg);
+    heartbeats(1);
+
+    mavtunnel_spin_once(&A);
+    codec_aggregate_flush(&packer);
+
+    /* 2 + 2 heartbeats, the fifth unwrapped, the STATUSTEXT alone, the last
+     * heartbeat unwrapped */
+    EXPECT_EQ(packer.superframes, 2);
+    EXPECT_EQ(wire.writes, 5);
+
+    drain();
+    EXPECT_EQ(output.bytes, input.bytes);
+}
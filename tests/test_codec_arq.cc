@@ -0,0 +1,189 @@
+#include <gtest/gtest.h>
+#include <codec_arq.h>
+#include <codec_chacha20.h>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+#include "test_pipe.hpp"
+
+/* the two ends of the link, each with a tunnel out and a tunnel in */
+struct mavtunnel_t x_out, x_in, y_out, y_in;
+struct stream_cipher_t x_encrypt, x_decrypt, y_encrypt, y_decrypt;
+struct codec_arq_t x_arq, y_arq;
+
+class CodecArqTest : public ::testing::Test
+{
+public:
+    frame_pipe_t x_local, y_local, x_output, y_output, x_to_y, y_to_x;
+
+    static void wire(struct mavtunnel_t* ctx, frame_pipe_t* from, frame_pipe_t* to)
+    {
+        pipe_attach_reader(ctx, from);
+        pipe_attach_writer(ctx, to);
+    }
+
+    void SetUp() override
+    {
+        mavtunnel_init(&x_out, 0);
+        mavtunnel_init(&x_in, 1);
+        mavtunnel_init(&y_out, 2);
+        mavtunnel_init(&y_in, 3);
+
+        codec_chacha20_attach(&x_out, &x_encrypt);
+        codec_chacha20_attach(&y_in, &y_decrypt);
+        codec_chacha20_attach(&y_out, &y_encrypt);
+        codec_chacha20_attach(&x_in, &x_decrypt);
+        codec_arq_attach(&x_out, &x_in, &x_arq, NULL, 0);
+        codec_arq_attach(&y_out, &y_in, &y_arq, NULL, 0);
+
+        wire(&x_out, &x_local, &x_to_y);
+        wire(&y_in, &x_to_y, &y_output);
+        wire(&y_out, &y_local, &y_to_x);
+        wire(&x_in, &y_to_x, &x_output);
+    }
+
+    static frame_t command(frame_pipe_t& local, uint16_t cmd)
+    {
+        mavlink_message_t msg;
+        uint8_t           buf[MAVLINK_MAX_PACKET_LEN];
+        mavlink_msg_command_long_pack(
+            255, 190, &msg, 1, 1, cmd, 0, 1, 2, 3, 4, 5, 6, 7);
+        size_t len = mavlink_msg_to_send_buffer(buf, &msg);
+        local.frames.emplace_back(buf, buf + len);
+        return local.frames.back();
+    }
+
+    static frame_t heartbeat(frame_pipe_t& local)
+    {
+        mavlink_message_t msg;
+        uint8_t           buf[MAVLINK_MAX_PACKET_LEN];
+        mavlink_msg_heartbeat_pack(1, 1, &msg, MAV_TYPE_QUADROTOR,
+            MAV_AUTOPILOT_ARDUPILOTMEGA, 1, 0, 3);
+        size_t len = mavlink_msg_to_send_buffer(buf, &msg);
+        local.frames.emplace_back(buf, buf + len);
+        return local.frames.back();
+    }
+
+    /* spin all four tunnels until X has sent all and has nothing in flight */
+    bool settle(uint64_t timeout_us = 2000000)
+    {
+        uint64_t start = time_us();
+        do
+        {
+            mavtunnel_spin_once(&x_out);
+            mavtunnel_spin_once(&y_in);
+            mavtunnel_spin_once(&y_out);
+            mavtunnel_spin_once(&x_in);
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        } while ((!x_local.frames.empty()
+                     || x_arq.frames != x_arq.acked + x_arq.expired)
+            && time_us() < start + timeout_us);
+        return x_arq.frames == x_arq.acked;
+    }
+};
+
+TEST_F(CodecArqTest, retransmit_lost_command)
+{
+    frame_t hb  = heartbeat(x_local);
+    frame_t cmd = command(x_local, 400);
+    x_to_y.lose = [](size_t i) { return i == 1; };
+
+    ASSERT_TRUE(settle());
+    EXPECT_EQ(x_arq.frames, 1);
+    EXPECT_EQ(x_arq.retransmits, 1);
+    EXPECT_EQ(y_arq.delivered, 1);
+    EXPECT_EQ(y_output.log, std::vector<frame_t>({hb, cmd}));
+    EXPECT_TRUE(x_output.log.empty());
+}
+
+TEST_F(CodecArqTest, duplicate_after_lost_ack)
+{
+    frame_t cmd = command(x_local, 400);
+    y_to_x.lose = [](size_t i) { return i == 0; };
+
+    ASSERT_TRUE(settle());
+    EXPECT_EQ(x_arq.retransmits, 1);
+    EXPECT_EQ(y_arq.duplicates, 1);
+    EXPECT_EQ(y_arq.acks, 2);
+    EXPECT_EQ(y_output.log, std::vector<frame_t>({cmd}));
+}
+
+TEST_F(CodecArqTest, ack_piggybacked_on_reverse_traffic)
+{
+    y_arq.ack_delay_us = 1000000;
+    frame_t cmd = command(x_local, 400);
+    mavtunnel_spin_once(&x_out);
+    mavtunnel_spin_once(&y_in);
+    ASSERT_EQ(y_output.log, std::vector<frame_t>({cmd}));
+
+    frame_t hb = heartbeat(y_local);
+    mavtunnel_spin_once(&y_out);
+    mavtunnel_spin_once(&x_in);
+    EXPECT_EQ(x_arq.acked, 1);
+    EXPECT_EQ(y_arq.acks, 1);
+    EXPECT_EQ(x_output.log, std::vector<frame_t>({hb}));
+    EXPECT_GT(x_arq.srtt_us, 0);
+}
+
+TEST_F(CodecArqTest, commands_under_loss)
+{
+    std::mt19937                rng(7);
+    std::bernoulli_distribution drop(0.2);
+    x_to_y.lose = [&](size_t) { return drop(rng); };
+    y_to_x.lose = [&](size_t) { return drop(rng); };
+
+    std::vector<frame_t> sent;
+    for (uint16_t i = 0; i < 30; i++)
+    {
+        sent.push_back(command(x_local, i));
+    }
+
+    ASSERT_TRUE(settle(10000000));
+    EXPECT_GT(x_arq.retransmits, 0);
+    EXPECT_EQ(x_arq.expired, 0);
+
+    /* each exactly once, in any order */
+    std::vector<frame_t> got = y_output.log;
+    std::sort(sent.begin(), sent.end());
+    std::sort(got.begin(), got.end());
+    EXPECT_EQ(got, sent);
+}
+
+TEST_F(CodecArqTest, sender_restart)
+{
+    for (uint16_t i = 0; i < 10; i++)
+    {
+        command(x_local, i);
+    }
+    ASSERT_TRUE(settle());
+    ASSERT_EQ(y_arq.delivered, 10);
+
+    /* X comes back at seq 0, Y still expects 10 */
+    mavtunnel_init(&x_out, 0);
+    mavtunnel_init(&x_in, 1);
+    codec_chacha20_attach(&x_out, &x_encrypt);
+    codec_chacha20_attach(&x_in, &x_decrypt);
+    codec_arq_attach(&x_out, &x_in, &x_arq, NULL, 0);
+    wire(&x_out, &x_local, &x_to_y);
+    wire(&x_in, &y_to_x, &x_output);
+
+    frame_t cmd = command(x_local, 400);
+    ASSERT_TRUE(settle());
+    EXPECT_EQ(y_arq.duplicates, 0);
+    EXPECT_EQ(y_arq.delivered, 11);
+    EXPECT_EQ(y_output.log.back(), cmd);
+}
+
+TEST_F(CodecArqTest, receiver_restart)
+{
+    /* X has been up for a while */
+    x_arq.next_seq = 200;
+
+    frame_t cmd = command(x_local, 400);
+    ASSERT_TRUE(settle());
+    EXPECT_EQ(y_arq.duplicates, 0);
+    EXPECT_EQ(y_output.log, std::vector<frame_t>({cmd}));
+}
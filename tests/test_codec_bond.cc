@@ -0,0 +1,199 @@
+#include <gtest/gtest.h>
+#include <codec_bond.h>
+#include <codec_chacha20.h>
+
+#include <algorithm>
+#include <vector>
+#include "test_pipe.hpp"
+
+/* X sends over a radio and an LTE link, Y merges what both receive */
+struct mavtunnel_t x_out, x_in, y_out, y_radio, y_lte, y_merged;
+struct stream_cipher_t x_encrypt, y_radio_decrypt, y_lte_decrypt;
+struct codec_bond_t x_bond, y_bond;
+
+class CodecBondTest : public ::testing::Test
+{
+public:
+    frame_pipe_t local, radio, lte, output;
+
+    static void wire(struct mavtunnel_t* ctx, frame_pipe_t* from, frame_pipe_t* to)
+    {
+        pipe_attach_reader(ctx, from);
+        pipe_attach_writer(ctx, to);
+    }
+
+    void setup(const uint32_t* msgids, size_t n_msgids)
+    {
+        mavtunnel_init(&x_out, 0);
+        mavtunnel_init(&y_radio, 1);
+        mavtunnel_init(&y_lte, 2);
+        mavtunnel_init(&y_merged, 3);
+        mavtunnel_init(&y_out, 3); /* not spun, Y only receives here */
+
+        codec_chacha20_attach(&x_out, &x_encrypt);
+        codec_chacha20_attach(&y_radio, &y_radio_decrypt);
+        codec_chacha20_attach(&y_lte, &y_lte_decrypt);
+
+        /* X only sends: its paths are the links' writers */
+        struct mavtunnel_t link {};
+        wire(&x_out, &local, nullptr);
+        codec_bond_attach(&x_out, &x_in, &x_bond, msgids, n_msgids);
+        wire(&link, nullptr, &radio);
+        codec_bond_add_path(&x_bond, &link);
+        wire(&link, nullptr, &lte);
+        codec_bond_add_path(&x_bond, &link);
+
+        /* Y only receives: one tunnel per link, feeding the merged one */
+        wire(&y_radio, &radio, &radio);
+        wire(&y_lte, &lte, &lte);
+        codec_bond_attach(&y_out, &y_merged, &y_bond, msgids, n_msgids);
+        codec_bond_add_path(&y_bond, &y_radio);
+        codec_bond_add_path(&y_bond, &y_lte);
+        wire(&y_merged, nullptr, &output);
+    }
+
+    std::vector<frame_t> send(size_t n, bool commands)
+    {
+        std::vector<frame_t> sent;
+        mavlink_message_t    msg;
+        uint8_t              buf[MAVLINK_MAX_PACKET_LEN];
+        for (size_t i = 0; i < n; i++)
+        {
+            if (commands)
+            {
+                mavlink_msg_command_long_pack(255, 190, &msg, 1, 1,
+                    (uint16_t)i, 0, 1, 2, 3, 4, 5, 6, 7);
+            }
+            else
+            {
+                mavlink_msg_heartbeat_pack(1, 1, &msg, MAV_TYPE_QUADROTOR,
+                    MAV_AUTOPILOT_ARDUPILOTMEGA, 1, (uint32_t)i, 3);
+            }
+            size_t len = mavlink_msg_to_send_buffer(buf, &msg);
+            local.frames.emplace_back(buf, buf + len);
+            sent.push_back(local.frames.back());
+        }
+        while (!local.frames.empty())
+        {
+            mavtunnel_spin_once(&x_out);
+        }
+        return sent;
+    }
+
+    static void drain(struct mavtunnel_t* path, frame_pipe_t& link)
+    {
+        while (!link.frames.empty())
+        {
+            mavtunnel_spin_once(path);
+        }
+    }
+};
+
+TEST_F(CodecBondTest, first_arrival_wins)
+{
+    setup(NULL, 0);
+    auto sent = send(16, false);
+    EXPECT_EQ(radio.log.size(), 16);
+    EXPECT_EQ(lte.log.size(), 16);
+
+    /* LTE is ahead for the first half, the radio for the rest */
+    for (size_t i = 0; i < 8; i++)
+    {
+        mavtunnel_spin_once(&y_lte);
+    }
+    drain(&y_radio, radio);
+    drain(&y_lte, lte);
+
+    EXPECT_EQ(output.log.size(), 16);
+    std::vector<frame_t> got = output.log;
+    std::sort(got.begin(), got.end());
+    std::sort(sent.begin(), sent.end());
+    EXPECT_EQ(got, sent);
+
+    EXPECT_EQ(y_bond.paths[1].wins, 8);
+    EXPECT_EQ(y_bond.paths[0].wins, 8);
+    EXPECT_EQ(y_bond.paths[0].duplicates, 8);
+    EXPECT_EQ(y_bond.paths[1].duplicates, 8);
+}
+
+TEST_F(CodecBondTest, survives_a_silent_link)
+{
+    setup(NULL, 0);
+    radio.lose = [](size_t) { return true; };
+    auto sent = send(16, false);
+    drain(&y_radio, radio);
+    drain(&y_lte, lte);
+
+    EXPECT_EQ(output.log, sent);
+    EXPECT_EQ(y_bond.paths[1].wins, 16);
+    EXPECT_EQ(y_bond.paths[0].rx_frames, 0);
+}
+
+TEST_F(CodecBondTest, only_critical_frames_duplicated)
+{
+    const uint32_t critical[] = {MAVLINK_MSG_ID_COMMAND_LONG};
+    setup(critical, 1);
+    auto heartbeats = send(4, false);
+    auto commands   = send(4, true);
+
+    EXPECT_EQ(radio.log.size(), 8);
+    EXPECT_EQ(lte.log.size(), 4);
+    drain(&y_radio, radio);
+    drain(&y_lte, lte);
+
+    heartbeats.insert(heartbeats.end(), commands.begin(), commands.end());
+    EXPECT_EQ(output.log, heartbeats);
+    EXPECT_EQ(y_bond.paths[1].duplicates, 4);
+}
+
+TEST_F(CodecBondTest, failover_on_write_error)
+{
+    const uint32_t critical[] = {MAVLINK_MSG_ID_COMMAND_LONG};
+    setup(critical, 1);
+    radio.down = true;
+    auto sent  = send(4, false);
+
+    EXPECT_EQ(x_bond.paths[0].tx_errors, 4);
+    EXPECT_EQ(x_bond.paths[1].tx_frames, 4);
+    drain(&y_lte, lte);
+    EXPECT_EQ(output.log, sent);
+}
+
+TEST_F(CodecBondTest, failover_on_silence)
+{
+    const uint32_t critical[] = {MAVLINK_MSG_ID_COMMAND_LONG};
+    setup(critical, 1);
+
+    /* the radio takes the writes, but the peer is only heard on LTE */
+    x_bond.paths[0].last_rx_us = time_us() - 2 * CODEC_BOND_LIVE_US;
+    x_bond.paths[1].last_rx_us = time_us();
+    send(4, false);
+    EXPECT_EQ(radio.log.size(), 0);
+    EXPECT_EQ(lte.log.size(), 4);
+
+    /* nothing heard lately on either: both get them */
+    x_bond.paths[1].last_rx_us = time_us() - 2 * CODEC_BOND_LIVE_US;
+    send(4, false);
+    EXPECT_EQ(radio.log.size(), 4);
+    EXPECT_EQ(lte.log.size(), 8);
+}
+
+TEST_F(CodecBondTest, sender_restart)
+{
+    setup(NULL, 0);
+    auto before = send(16, false);
+    drain(&y_radio, radio);
+
+    /* X comes back with its seq at 0 again, LTE still holds its last life */
+    x_bond.session++;
+    x_bond.next_seq = 0;
+    auto after      = send(16, false);
+    drain(&y_radio, radio);
+    drain(&y_lte, lte);
+
+    before.insert(before.end(), after.begin(), after.end());
+    EXPECT_EQ(output.log, before);
+    EXPECT_EQ(y_bond.restarts, 1);
+    EXPECT_EQ(y_bond.late, 16);
+    EXPECT_EQ(y_bond.paths[1].duplicates, 16);
+}
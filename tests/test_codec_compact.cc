@@ -0,0 +1,143 @@
+#include <gtest/gtest.h>
+#include <codec_aggregate.h>
+#include <codec_chacha20.h>
+#include <codec_compact.h>
+
+#include <vector>
+#include "test_pipe.hpp"
+
+struct mavtunnel_t A, B;
+struct stream_cipher_t encoder, decoder;
+struct codec_aggregate_t packer, splitter;
+struct codec_compact_t compressor, expander;
+
+static byte_pipe_t input, wire, output;
+
+class CodecCompactTest : public ::testing::Test
+{
+public:
+    void SetUp() override
+    {
+        mavtunnel_init(&A, 0);
+        mavtunnel_init(&B, 1);
+
+        codec_chacha20_attach(&A, &encoder);
+        codec_aggregate_attach(&A, &packer, MT_CODEC_ENCODE, 1000000, 0);
+        codec_compact_attach(&A, &compressor, MT_CODEC_ENCODE);
+        codec_chacha20_attach(&B, &decoder);
+        codec_aggregate_attach(&B, &splitter, MT_CODEC_DECODE, 1000000, 0);
+        codec_compact_attach(&B, &expander, MT_CODEC_DECODE);
+
+        input.clear();
+        output.clear();
+        pipe_attach_reader(&A, &input);
+        pipe_attach_writer(&A, &wire);
+        pipe_attach_reader(&B, &wire);
+        pipe_attach_writer(&B, &output);
+    }
+    void TearDown() override
+    {
+    }
+
+    /* one super-frame of n heartbeats; returns its bytes on the wire */
+    static std::vector<uint8_t> batch(size_t n, uint8_t sysid = 1)
+    {
+        mavlink_message_t msg;
+        uint8_t           buf[MAVLINK_MAX_PACKET_LEN];
+        for (size_t i = 0; i < n; i++)
+        {
+            mavlink_msg_heartbeat_pack(sysid, 1, &msg, MAV_TYPE_QUADROTOR,
+                MAV_AUTOPILOT_ARDUPILOTMEGA, 1, (uint32_t)i, 3);
+            size_t len = mavlink_msg_to_send_buffer(buf, &msg);
+            input.bytes.insert(input.bytes.end(), buf, buf + len);
+        }
+
+        wire.clear();
+        mavtunnel_spin_once(&A);
+        codec_aggregate_flush(&packer);
+        return wire.bytes;
+    }
+
+    static void deliver(const std::vector<uint8_t>& frame)
+    {
+        wire.clear();
+        wire.bytes = frame;
+        mavtunnel_spin_once(&B);
+    }
+};
+
+TEST_F(CodecCompactTest, compact_expand)
+{
+    auto frame = batch(8);
+    EXPECT_EQ(compressor.frames, 8);
+    EXPECT_EQ(compressor.defines, 1);
+    /* one definition, then a context id and a length for every frame */
+    EXPECT_EQ(compressor.bytes_in - compressor.bytes_out, 7 * 6);
+
+    deliver(frame);
+    EXPECT_EQ(expander.frames, 8);
+    EXPECT_EQ(splitter.frames, 8);
+    EXPECT_EQ(output.bytes, input.bytes);
+}
+
+TEST_F(CodecCompactTest, lost_definition_until_refresh)
+{
+    const size_t n = 8;
+    std::vector<std::vector<uint8_t>> frames;
+    for (size_t i = 0; i < 5; i++)
+    {
+        frames.push_back(batch(n));
+    }
+    size_t frame_len = input.bytes.size() / (5 * n);
+
+    /* the first super-frame is lost */
+    for (size_t i = 1; i < 5; i++)
+    {
+        deliver(frames[i]);
+    }
+
+    /* redefined CODEC_COMPACT_REFRESH frames later, in the fifth one */
+    ASSERT_EQ(CODEC_COMPACT_REFRESH, 4 * n);
+    EXPECT_EQ(expander.dropped, 3 * n);
+    size_t delivered = 5 * n - n - expander.dropped;
+    ASSERT_EQ(output.bytes.size(), delivered * frame_len);
+    EXPECT_TRUE(std::equal(output.bytes.begin(), output.bytes.end(),
+        input.bytes.end() - (ssize_t)(delivered * frame_len)));
+}
+
+TEST_F(CodecCompactTest, loss_keeps_contexts)
+{
+    const size_t n = 8;
+    deliver(batch(n));
+    size_t batch_len = input.bytes.size();
+
+    /* a lost super-frame leaves the contexts it did not bind alone */
+    batch(n);
+    deliver(batch(n));
+    EXPECT_EQ(expander.dropped, 0);
+    ASSERT_EQ(output.bytes.size(), 2 * batch_len);
+    EXPECT_TRUE(std::equal(output.bytes.begin() + (ssize_t)batch_len, output.bytes.end(),
+        input.bytes.begin() + 2 * (ssize_t)batch_len));
+}
+
+TEST_F(CodecCompactTest, taken_context_is_not_rebound)
+{
+    const size_t n = 8;
+
+    /* heartbeats of systems 1 and 32 hash to the same context id */
+    deliver(batch(n, 1));
+    size_t batch_len = input.bytes.size();
+
+    /* system 32's are defined inline, in the lost super-frame as in the next */
+    batch(n, 32);
+    deliver(batch(n, 32));
+    EXPECT_EQ(compressor.defines, 1 + 2 * n);
+    EXPECT_EQ(expander.dropped, 0);
+
+    /* and system 1's context still holds */
+    deliver(batch(n, 1));
+    EXPECT_EQ(expander.dropped, 0);
+    ASSERT_EQ(output.bytes.size(), 3 * batch_len);
+    EXPECT_TRUE(std::equal(output.bytes.begin() + (ssize_t)batch_len, output.bytes.end(),
+        input.bytes.begin() + 2 * (ssize_t)batch_len));
+}
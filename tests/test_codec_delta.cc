@@ -0,0 +1,171 @@
+#include <gtest/gtest.h>
+#include <codec_delta.h>
+
+#include <vector>
+#include "tunnel.h"
+
+struct mavtunnel_t A, B;
+struct codec_delta_t encoder, decoder;
+
+static const uint16_t keyframe_interval = 10;
+
+class CodecDeltaTest : public ::testing::Test
+{
+public:
+    void SetUp() override
+    {
+        mavtunnel_init(&A, 0);
+        mavtunnel_init(&B, 1);
+
+        codec_delta_attach(&A, &encoder, MT_CODEC_ENCODE, keyframe_interval);
+        codec_delta_attach(&B, &decoder, MT_CODEC_DECODE, keyframe_interval);
+    }
+    void TearDown() override
+    {
+    }
+
+    static void attitude(mavlink_message_t* msg, uint32_t i)
+    {
+        mavlink_msg_attitude_pack(1, 1, msg, 1000 + i * 20, 0.1f, 0.2f,
+            0.3f + (float)i * 1e-6f, 0.0f, 0.0f, 0.0f);
+        msg->seq = (uint8_t)i;
+    }
+};
+
+TEST_F(CodecDeltaTest, encdec)
+{
+    mavlink_message_t msg, plaintext_msg;
+
+    for (uint32_t i = 0; i < 3 * keyframe_interval; i++)
+    {
+        attitude(&msg, i);
+        memcpy(&plaintext_msg, &msg, sizeof(msg));
+
+        EXPECT_EQ(encoder.stage.encode(&encoder.stage, &msg), MERR_OK);
+        if (i % keyframe_interval == 0)
+        {
+            EXPECT_EQ(msg.compat_flags & MAVTUNNEL_CFLAG_DELTA, 0);
+        }
+        else
+        {
+            EXPECT_NE(msg.compat_flags & MAVTUNNEL_CFLAG_DELTA, 0);
+            EXPECT_LT(msg.len * 3, plaintext_msg.len * 2);
+        }
+
+        EXPECT_EQ(decoder.stage.encode(&decoder.stage, &msg), MERR_OK);
+        EXPECT_EQ(msg.compat_flags & MAVTUNNEL_CFLAG_DELTA, 0);
+        ASSERT_EQ(msg.len, plaintext_msg.len);
+        EXPECT_EQ(memcmp(_MAV_PAYLOAD(&msg), _MAV_PAYLOAD(&plaintext_msg), msg.len), 0);
+    }
+
+    struct codec_delta_stat_t* stat = codec_delta_stat(&encoder, MAVLINK_MSG_ID_ATTITUDE);
+    ASSERT_NE(stat, nullptr);
+    EXPECT_EQ(stat->frames, 3 * keyframe_interval);
+    EXPECT_EQ(stat->keyframes, 3);
+    EXPECT_LT(stat->bytes_out * 3, stat->bytes_in * 2);
+}
+
+TEST_F(CodecDeltaTest, loss_resync_on_keyframe)
+{
+    mavlink_message_t msg;
+
+    for (uint32_t i = 0; i < 2 * keyframe_interval; i++)
+    {
+        attitude(&msg, i);
+        encoder.stage.encode(&encoder.stage, &msg);
+        if (i == 3)
+        {
+            /* lost on the radio */
+            continue;
+        }
+
+        enum mavtunnel_error_t err = decoder.stage.encode(&decoder.stage, &msg);
+        if (i > 3 && i < keyframe_interval)
+        {
+            EXPECT_EQ(err, MERR_BAD_STATE);
+        }
+        else
+        {
+            EXPECT_EQ(err, MERR_OK);
+        }
+    }
+
+    struct codec_delta_stat_t* stat = codec_delta_stat(&decoder, MAVLINK_MSG_ID_ATTITUDE);
+    ASSERT_NE(stat, nullptr);
+    EXPECT_EQ(stat->dropped, keyframe_interval - 4);
+}
+
+TEST_F(CodecDeltaTest, streams_are_independent)
+{
+    mavlink_message_t a, b, plaintext_msg;
+
+    attitude(&a, 0);
+    encoder.stage.encode(&encoder.stage, &a);
+    decoder.stage.encode(&decoder.stage, &a);
+
+    /* same msgid from another component starts with a keyframe */
+    attitude(&b, 1);
+    b.compid = 2;
+    encoder.stage.encode(&encoder.stage, &b);
+    EXPECT_EQ(b.compat_flags & MAVTUNNEL_CFLAG_DELTA, 0);
+    decoder.stage.encode(&decoder.stage, &b);
+
+    attitude(&a, 2);
+    memcpy(&plaintext_msg, &a, sizeof(a));
+    encoder.stage.encode(&encoder.stage, &a);
+    EXPECT_NE(a.compat_flags & MAVTUNNEL_CFLAG_DELTA, 0);
+    EXPECT_EQ(decoder.stage.encode(&decoder.stage, &a), MERR_OK);
+    EXPECT_EQ(memcmp(_MAV_PAYLOAD(&a), _MAV_PAYLOAD(&plaintext_msg), a.len), 0);
+}
+
+TEST_F(CodecDeltaTest, base_alias_is_dropped)
+{
+    mavlink_message_t msg;
+
+    codec_delta_attach(&A, &encoder, MT_CODEC_ENCODE, 1000);
+    codec_delta_attach(&B, &decoder, MT_CODEC_DECODE, 1000);
+
+    attitude(&msg, 0);
+    encoder.stage.encode(&encoder.stage, &msg);
+    ASSERT_EQ(decoder.stage.encode(&decoder.stage, &msg), MERR_OK);
+
+    /* the source sends 256 other frames in between, none of these reach us */
+    for (uint32_t i = 1; i <= 256; i++)
+    {
+        attitude(&msg, i);
+        encoder.stage.encode(&encoder.stage, &msg);
+    }
+
+    /* a delta against frame 256, whose seq is frame 0's */
+    attitude(&msg, 257);
+    encoder.stage.encode(&encoder.stage, &msg);
+    ASSERT_NE(msg.compat_flags & MAVTUNNEL_CFLAG_DELTA, 0);
+    EXPECT_EQ(decoder.stage.encode(&decoder.stage, &msg), MERR_BAD_STATE);
+
+    struct codec_delta_stat_t* stat = codec_delta_stat(&decoder, MAVLINK_MSG_ID_ATTITUDE);
+    ASSERT_NE(stat, nullptr);
+    EXPECT_EQ(stat->dropped, 1);
+}
+
+TEST_F(CodecDeltaTest, empty_payload_is_a_keyframe)
+{
+    mavlink_message_t msg;
+
+    for (uint32_t i = 0; i < 3; i++)
+    {
+        attitude(&msg, i);
+        msg.len = 0;
+        ASSERT_EQ(encoder.stage.encode(&encoder.stage, &msg), MERR_OK);
+        EXPECT_EQ(msg.compat_flags & MAVTUNNEL_CFLAG_DELTA, 0);
+        EXPECT_EQ(msg.len, 0);
+        ASSERT_EQ(decoder.stage.encode(&decoder.stage, &msg), MERR_OK);
+    }
+
+    struct codec_delta_stat_t* stat = codec_delta_stat(&encoder, MAVLINK_MSG_ID_ATTITUDE);
+    ASSERT_NE(stat, nullptr);
+    EXPECT_EQ(stat->keyframes, 3);
+#ifdef MAVTUNNEL_PROFILING
+    /* the first frame of a msgid is always timed */
+    EXPECT_EQ(stat->timed, 1);
+#endif
+}
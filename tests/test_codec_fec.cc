@@ -0,0 +1,137 @@
+#include <gtest/gtest.h>
+#include <codec_chacha20.h>
+#include <codec_fec.h>
+
+#include <algorithm>
+#include <functional>
+#include <random>
+#include <vector>
+#include "test_pipe.hpp"
+
+struct mavtunnel_t A, B;
+struct stream_cipher_t encoder, decoder;
+struct codec_fec_t protector, corrector;
+
+/* every frame A writes is one datagram, that wire.lose() may drop */
+static byte_pipe_t  input;
+static frame_pipe_t wire, output;
+
+class CodecFecTest : public ::testing::Test
+{
+public:
+    std::vector<frame_t> sent;
+
+    void setup(size_t k, size_t n, uint64_t deadline_us)
+    {
+        mavtunnel_init(&A, 0);
+        mavtunnel_init(&B, 1);
+
+        codec_chacha20_attach(&A, &encoder);
+        codec_fec_attach(&A, &protector, MT_CODEC_ENCODE, k, n, deadline_us);
+        codec_chacha20_attach(&B, &decoder);
+        codec_fec_attach(&B, &corrector, MT_CODEC_DECODE, k, n, deadline_us);
+
+        input.clear();
+        wire   = frame_pipe_t();
+        output = frame_pipe_t();
+        sent.clear();
+        pipe_attach_reader(&A, &input);
+        pipe_attach_writer(&A, &wire);
+        pipe_attach_reader(&B, &wire);
+        pipe_attach_writer(&B, &output);
+    }
+
+    void send(size_t n)
+    {
+        mavlink_message_t msg;
+        uint8_t           buf[MAVLINK_MAX_PACKET_LEN];
+        for (size_t i = 0; i < n; i++)
+        {
+            mavlink_msg_heartbeat_pack(1, 1, &msg, MAV_TYPE_QUADROTOR,
+                MAV_AUTOPILOT_ARDUPILOTMEGA, 1, (uint32_t)(i * 7919), 3);
+            size_t len = mavlink_msg_to_send_buffer(buf, &msg);
+            input.bytes.insert(input.bytes.end(), buf, buf + len);
+            sent.emplace_back(buf, buf + len);
+        }
+        while (!input.drained())
+        {
+            mavtunnel_spin_once(&A);
+        }
+    }
+
+    static void deliver()
+    {
+        while (!wire.frames.empty())
+        {
+            mavtunnel_spin_once(&B);
+        }
+    }
+
+    /* frames of a group may come out of order */
+    size_t delivered()
+    {
+        std::vector<frame_t> a = sent, b = output.log;
+        std::sort(a.begin(), a.end());
+        std::sort(b.begin(), b.end());
+        std::vector<frame_t> common;
+        std::set_intersection(a.begin(), a.end(), b.begin(), b.end(),
+            std::back_inserter(common));
+        return common.size();
+    }
+};
+
+TEST_F(CodecFecTest, recover_up_to_parity)
+{
+    setup(8, 10, 1000000);
+    /* two data frames of every group of 8 + 2 */
+    wire.lose = [](size_t i) { return i % 10 == 1 || i % 10 == 5; };
+    send(64);
+    deliver();
+
+    EXPECT_EQ(wire.sent, 80);
+    EXPECT_EQ(protector.parities, 16);
+    EXPECT_EQ(corrector.recovered, 16);
+    EXPECT_EQ(output.log.size(), sent.size());
+    EXPECT_EQ(delivered(), sent.size());
+}
+
+TEST_F(CodecFecTest, xor_parity)
+{
+    setup(4, 5, 1000000);
+    wire.lose = [](size_t i) { return i % 5 == 2; };
+    send(40);
+    deliver();
+
+    EXPECT_EQ(corrector.recovered, 10);
+    EXPECT_EQ(delivered(), sent.size());
+}
+
+TEST_F(CodecFecTest, deadline_closes_partial_group)
+{
+    setup(8, 10, 0);
+    wire.lose = [](size_t i) { return i == 0; };
+    send(3);
+
+    /* closed by the tick after the read, with parity over 3 frames */
+    EXPECT_EQ(protector.parities, 2);
+    EXPECT_EQ(A.reader.timeout_ms, -1);
+    deliver();
+    EXPECT_EQ(corrector.recovered, 1);
+    EXPECT_EQ(delivered(), 3);
+}
+
+TEST_F(CodecFecTest, random_loss)
+{
+    std::mt19937                rng(1);
+    std::bernoulli_distribution drop(0.1);
+    setup(8, 10, 1000000);
+    wire.lose = [&](size_t) { return drop(rng); };
+    send(800);
+    deliver();
+
+    double raw      = (double)wire.lost / wire.sent;
+    double residual = 1.0 - (double)delivered() / sent.size();
+    EXPECT_GT(corrector.recovered, 0);
+    EXPECT_LT(residual, raw / 2);
+    EXPECT_EQ(output.log.size(), delivered());
+}
@@ -0,0 +1,108 @@
+#include <gtest/gtest.h>
+#include <codec_chacha20.h>
+#include <codec_lz.h>
+
+#include <vector>
+#include <numeric>
+#include "test_pipe.hpp"
+
+struct mavtunnel_t A, B;
+struct stream_cipher_t encoder, decoder;
+struct codec_lz_t compressor, decompressor;
+
+static byte_pipe_t input, wire, output;
+
+class CodecLzTest : public ::testing::Test
+{
+public:
+    void SetUp() override
+    {
+        mavtunnel_init(&A, 0);
+        mavtunnel_init(&B, 1);
+
+        codec_chacha20_attach(&A, &encoder);
+        codec_lz_attach(&A, &compressor, MT_CODEC_ENCODE);
+        codec_chacha20_attach(&B, &decoder);
+        codec_lz_attach(&B, &decompressor, MT_CODEC_DECODE);
+
+        input.clear();
+        wire.clear();
+        output.clear();
+        pipe_attach_reader(&A, &input);
+        pipe_attach_writer(&A, &wire);
+        pipe_attach_reader(&B, &wire);
+        pipe_attach_writer(&B, &output);
+    }
+    void TearDown() override
+    {
+    }
+
+    /* feed one serialized frame through A, then the wire bytes through B */
+    void tunnel(const uint8_t* frame, size_t len)
+    {
+        input.clear();
+        input.bytes.assign(frame, frame + len);
+        mavtunnel_spin_once(&A);
+        mavtunnel_spin_once(&B);
+    }
+};
+
+TEST_F(CodecLzTest, statustext_roundtrip)
+{
+    mavlink_message_t msg;
+    mavlink_msg_statustext_pack(1, 1, &msg, MAV_SEVERITY_INFO,
+        "PreArm: Compass not calibrated", 0, 0);
+
+    uint8_t compressed[MAVLINK_MAX_PAYLOAD_LEN];
+    size_t  n = codec_lz_compress(&compressor, (uint8_t*)_MAV_PAYLOAD(&msg),
+         msg.len, compressed, msg.len - 1);
+    EXPECT_GT(n, 0);
+    EXPECT_LT(n, msg.len / 2);
+
+    uint8_t plain[MAVLINK_MAX_PAYLOAD_LEN];
+    ssize_t m = codec_lz_decompress(
+        &decompressor, compressed, n, plain, sizeof(plain));
+    ASSERT_EQ(m, msg.len);
+    EXPECT_EQ(memcmp(plain, _MAV_PAYLOAD(&msg), msg.len), 0);
+}
+
+TEST_F(CodecLzTest, incompressible_falls_back_to_raw)
+{
+    mavlink_message_t msg;
+    mavlink_msg_heartbeat_pack(1, 200, &msg, MAV_TYPE_GCS, MAV_AUTOPILOT_ARDUPILOTMEGA, 1, 2, 3);
+    mavlink_message_t plaintext_msg;
+    memcpy(&plaintext_msg, &msg, sizeof(msg));
+
+    compressor.stage.encode(&compressor.stage, &msg);
+    EXPECT_EQ(msg.compat_flags & MAVTUNNEL_CFLAG_COMPRESSED, 0);
+    EXPECT_EQ(msg.len, plaintext_msg.len);
+    EXPECT_EQ(memcmp(_MAV_PAYLOAD(&msg), _MAV_PAYLOAD(&plaintext_msg), msg.len), 0);
+}
+
+TEST_F(CodecLzTest, corrupted_stream)
+{
+    uint8_t bad[] = { 0xF0, 0xFF };
+    uint8_t plain[MAVLINK_MAX_PAYLOAD_LEN];
+    EXPECT_LT(codec_lz_decompress(&decompressor, bad, sizeof(bad), plain, sizeof(plain)), 0);
+
+    uint8_t far[] = { 0x14, 'a', 0xFF, 0xFF, 0x00 };
+    EXPECT_LT(codec_lz_decompress(&decompressor, far, sizeof(far), plain, sizeof(plain)), 0);
+}
+
+TEST_F(CodecLzTest, compress_encrypt_transfer_decrypt_decompress)
+{
+    mavlink_message_t msg;
+    mavlink_msg_statustext_pack(1, 1, &msg, MAV_SEVERITY_INFO,
+        "EKF3 IMU0 is using GPS", 0, 0);
+    uint8_t frame[MAVLINK_MAX_PACKET_LEN];
+    size_t  len = mavlink_msg_to_send_buffer(frame, &msg);
+
+    tunnel(frame, len);
+
+    EXPECT_LT(wire.bytes.size(), len);
+    EXPECT_EQ(mavtunnel_check_out_buffer(wire.bytes.data(), wire.bytes.size()), MERR_OK);
+    EXPECT_EQ(compressor.compressed, 1);
+    EXPECT_EQ(decompressor.compressed, 1);
+    ASSERT_EQ(output.bytes.size(), len);
+    EXPECT_EQ(memcmp(output.bytes.data(), frame, len), 0);
+}
@@ -0,0 +1,181 @@
+#include <gtest/gtest.h>
+#include <endpoint_linux_shm.h>
+
+#include <thread>
+#include <sys/wait.h>
+#include <unistd.h>
+
+struct endpoint_linux_shm_t   ep;
+struct mavtunnel_shm_client_t client;
+struct mavtunnel_t            tunnel;
+
+class EndpointLinuxShmTest : public ::testing::Test
+{
+public:
+    void TearDown() override
+    {
+        mavtunnel_shm_client_close(&client);
+        ep_linux_shm_destroy(&ep);
+    }
+
+    void start(size_t n_slots = EP_SHM_SLOTS)
+    {
+        ASSERT_EQ(ep_linux_shm_init(&ep, "mavtunnel-test", n_slots), MERR_OK);
+        ASSERT_EQ(mavtunnel_shm_client_open(&client, ep.fd), MERR_OK);
+        mavtunnel_init(&tunnel, 0);
+        ep_linux_shm_attach_reader(&tunnel, &ep);
+        ep_linux_shm_attach_writer(&tunnel, &ep);
+        tunnel.reader.timeout_ms = 10;
+    }
+};
+
+TEST_F(EndpointLinuxShmTest, client_reads_in_place)
+{
+    start();
+    for (uint8_t i = 1; i <= 3; i++)
+    {
+        uint8_t frame[32] = {MAVLINK_STX, i};
+        ASSERT_EQ(tunnel.writer.write(&tunnel.writer, frame, 10 * i), MERR_OK);
+    }
+
+    for (uint8_t i = 1; i <= 3; i++)
+    {
+        size_t         len;
+        const uint8_t* frame = mavtunnel_shm_client_peek(&client, &len, 0);
+        ASSERT_NE(frame, nullptr);
+        EXPECT_EQ(len, 10u * i);
+        EXPECT_EQ(frame[1], i);
+        /* straight out of the shared mapping */
+        EXPECT_GE(frame, (const uint8_t*)client.area);
+        EXPECT_LT(frame, (const uint8_t*)client.area + client.size);
+        mavtunnel_shm_client_release(&client);
+    }
+    size_t len;
+    EXPECT_EQ(mavtunnel_shm_client_peek(&client, &len, 0), nullptr);
+    /* nobody slept, nobody was woken */
+    EXPECT_EQ(ep.wakeups, 0);
+}
+
+TEST_F(EndpointLinuxShmTest, clients_send_to_the_tunnel)
+{
+    start();
+    struct mavtunnel_shm_client_t other;
+    ASSERT_EQ(mavtunnel_shm_client_open(&other, ep.fd), MERR_OK);
+
+    uint8_t frame[16] = {MAVLINK_STX, 1}, buf[64];
+    ASSERT_EQ(mavtunnel_shm_client_send(&client, frame, sizeof(frame)), MERR_OK);
+    frame[1] = 2;
+    ASSERT_EQ(mavtunnel_shm_client_send(&other, frame, sizeof(frame)), MERR_OK);
+
+    ASSERT_EQ(tunnel.reader.read(&tunnel.reader, buf, sizeof(buf)), sizeof(frame));
+    EXPECT_EQ(buf[1], 1);
+    ASSERT_EQ(tunnel.reader.read(&tunnel.reader, buf, sizeof(buf)), sizeof(frame));
+    EXPECT_EQ(buf[1], 2);
+    EXPECT_EQ(tunnel.reader.read(&tunnel.reader, buf, sizeof(buf)), 0);
+    mavtunnel_shm_client_close(&other);
+}
+
+TEST_F(EndpointLinuxShmTest, full_ring_drops)
+{
+    start(4);
+    uint8_t frame[16] = {MAVLINK_STX};
+    for (int i = 0; i < 6; i++)
+    {
+        ASSERT_EQ(tunnel.writer.write(&tunnel.writer, frame, sizeof(frame)), MERR_OK);
+    }
+    EXPECT_EQ(ep.tx_frames, 4);
+    EXPECT_EQ(ep.tx_dropped, 2);
+    EXPECT_EQ(ep.area->down.dropped, 2);
+
+    for (int i = 0; i < 4; i++)
+    {
+        ASSERT_EQ(mavtunnel_shm_client_send(&client, frame, sizeof(frame)), MERR_OK);
+    }
+    EXPECT_EQ(mavtunnel_shm_client_send(&client, frame, sizeof(frame)), MERR_PENDING);
+}
+
+TEST_F(EndpointLinuxShmTest, sleeping_client_is_woken)
+{
+    start();
+    std::thread consumer([]() {
+        for (uint8_t i = 0; i < 100; i++)
+        {
+            size_t         len;
+            const uint8_t* frame = mavtunnel_shm_client_peek(&client, &len, 1000);
+            ASSERT_NE(frame, nullptr);
+            EXPECT_EQ(frame[1], i);
+            mavtunnel_shm_client_release(&client);
+        }
+    });
+    usleep(20000);
+
+    for (uint8_t i = 0; i < 100; i++)
+    {
+        uint8_t frame[16] = {MAVLINK_STX, i};
+        ASSERT_EQ(tunnel.writer.write(&tunnel.writer, frame, sizeof(frame)), MERR_OK);
+    }
+    consumer.join();
+    EXPECT_GE(ep.wakeups, 1);
+    EXPECT_LE(ep.wakeups, 100);
+    EXPECT_EQ(ep.tx_dropped, 0);
+}
+
+TEST_F(EndpointLinuxShmTest, another_process)
+{
+    start();
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        struct mavtunnel_shm_client_t child;
+        if (mavtunnel_shm_client_open(&child, ep.fd) != MERR_OK)
+        {
+            _exit(1);
+        }
+        for (uint8_t i = 0; i < 10; i++)
+        {
+            uint8_t frame[16] = {MAVLINK_STX, i};
+            mavtunnel_shm_client_send(&child, frame, sizeof(frame));
+        }
+        _exit(0);
+    }
+
+    uint8_t buf[64];
+    for (uint8_t i = 0; i < 10; i++)
+    {
+        ASSERT_EQ(tunnel.reader.read(&tunnel.reader, buf, sizeof(buf)), 16);
+        EXPECT_EQ(buf[1], i);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    EXPECT_EQ(WEXITSTATUS(status), 0);
+}
+
+TEST_F(EndpointLinuxShmTest, interrupt)
+{
+    start();
+    uint8_t buf[64];
+    tunnel.reader.timeout_ms = -1;
+    std::thread stopper([]() {
+        usleep(10000);
+        ep_linux_shm_interrupt(&ep);
+    });
+    EXPECT_EQ(tunnel.reader.read(&tunnel.reader, buf, sizeof(buf)), -MERR_END);
+    stopper.join();
+}
+
+TEST_F(EndpointLinuxShmTest, client_cannot_move_the_tunnel_out_of_bounds)
+{
+    start(4);
+    uint8_t frame[16] = {MAVLINK_STX, 1};
+    ASSERT_EQ(mavtunnel_shm_client_send(&client, frame, sizeof(frame)), MERR_OK);
+
+    /* a client scribbles over the ring size and the frame's length */
+    client.area->n_slots      = 1u << 30;
+    client.area->slots[4].len = 1u << 30;
+
+    uint8_t buf[2 * EP_SHM_FRAME_SIZE];
+    EXPECT_EQ(tunnel.reader.read(&tunnel.reader, buf, sizeof(buf)), EP_SHM_FRAME_SIZE);
+    EXPECT_EQ(buf[1], 1);
+    ASSERT_EQ(tunnel.writer.write(&tunnel.writer, frame, sizeof(frame)), MERR_OK);
+    EXPECT_EQ(ep.tx_frames, 1);
+}
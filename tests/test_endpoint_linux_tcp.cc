@@ -0,0 +1,210 @@
+#include <gtest/gtest.h>
+#include <endpoint_linux_tcp.h>
+
+#include <vector>
+#include <unistd.h>
+
+#define SERVER_PORT 14690
+
+struct endpoint_linux_tcp_t server, client;
+struct mavtunnel_t          server_tunnel, client_tunnel;
+
+class EndpointLinuxTcpTest : public ::testing::Test
+{
+public:
+    struct ep_tcp_options_t options = {true, 1000, 10, 40};
+    bool                    has_server = false, has_client = false;
+
+    void TearDown() override
+    {
+        if (has_client)
+        {
+            ep_linux_tcp_destroy(&client);
+        }
+        if (has_server)
+        {
+            ep_linux_tcp_destroy(&server);
+        }
+    }
+
+    void start_server()
+    {
+        ASSERT_EQ(ep_linux_tcp_init(&server, EP_TCP_LISTEN, "127.0.0.1", SERVER_PORT, &options),
+            MERR_OK);
+        has_server = true;
+        mavtunnel_init(&server_tunnel, 0);
+        ep_linux_tcp_attach_reader(&server_tunnel, &server);
+        ep_linux_tcp_attach_writer(&server_tunnel, &server);
+        server_tunnel.reader.timeout_ms = 1;
+    }
+
+    void start_client()
+    {
+        ASSERT_EQ(ep_linux_tcp_init(&client, EP_TCP_CONNECT, "127.0.0.1", SERVER_PORT, &options),
+            MERR_OK);
+        has_client = true;
+        mavtunnel_init(&client_tunnel, 1);
+        ep_linux_tcp_attach_reader(&client_tunnel, &client);
+        ep_linux_tcp_attach_writer(&client_tunnel, &client);
+        client_tunnel.reader.timeout_ms = 1;
+    }
+
+    /* run the readers of both ends, collecting what they read */
+    void pump(int ms, std::vector<uint8_t>* at_server = nullptr,
+        std::vector<uint8_t>* at_client = nullptr)
+    {
+        uint8_t  buf[4096];
+        uint64_t until = time_us() + ms * 1000ull;
+        while (time_us() < until)
+        {
+            ssize_t n;
+            if (has_server
+                && (n = server_tunnel.reader.read(&server_tunnel.reader, buf, sizeof(buf))) > 0
+                && at_server != nullptr)
+            {
+                at_server->insert(at_server->end(), buf, buf + n);
+            }
+            if (has_client
+                && (n = client_tunnel.reader.read(&client_tunnel.reader, buf, sizeof(buf))) > 0
+                && at_client != nullptr)
+            {
+                at_client->insert(at_client->end(), buf, buf + n);
+            }
+        }
+    }
+};
+
+TEST_F(EndpointLinuxTcpTest, round_trip)
+{
+    start_server();
+    start_client();
+    pump(20);
+    ASSERT_EQ(client.state, EP_TCP_UP);
+    ASSERT_EQ(server.state, EP_TCP_UP);
+
+    uint8_t frame[32] = {MAVLINK_STX, 1, 2, 3};
+    ASSERT_EQ(client_tunnel.writer.write(&client_tunnel.writer, frame, sizeof(frame)), MERR_OK);
+    frame[1] = 9;
+    ASSERT_EQ(server_tunnel.writer.write(&server_tunnel.writer, frame, sizeof(frame)), MERR_OK);
+
+    std::vector<uint8_t> at_server, at_client;
+    pump(20, &at_server, &at_client);
+    ASSERT_EQ(at_server.size(), sizeof(frame));
+    ASSERT_EQ(at_client.size(), sizeof(frame));
+    EXPECT_EQ(at_server[1], 1);
+    EXPECT_EQ(at_client[1], 9);
+}
+
+TEST_F(EndpointLinuxTcpTest, reconnects_with_backoff)
+{
+    /* nobody listens yet: retries back off up to backoff_max_ms */
+    start_client();
+    pump(100);
+    EXPECT_EQ(client.state, EP_TCP_DOWN);
+    EXPECT_EQ(client.backoff_ms, options.backoff_max_ms);
+
+    uint8_t frame[16] = {MAVLINK_STX};
+    EXPECT_EQ(client_tunnel.writer.write(&client_tunnel.writer, frame, sizeof(frame)), MERR_OK);
+    EXPECT_EQ(client.tx_dropped, sizeof(frame));
+
+    start_server();
+    pump(2 * options.backoff_max_ms);
+    ASSERT_EQ(client.state, EP_TCP_UP);
+    EXPECT_EQ(client.backoff_ms, options.backoff_min_ms);
+
+    /* the server goes away and comes back, the client follows */
+    ep_linux_tcp_destroy(&server);
+    has_server = false;
+    pump(20);
+    EXPECT_NE(client.state, EP_TCP_UP);
+    EXPECT_EQ(client.disconnects, 1);
+
+    start_server();
+    pump(2 * options.backoff_max_ms);
+    ASSERT_EQ(client.state, EP_TCP_UP);
+    EXPECT_EQ(client.connects, 2);
+
+    std::vector<uint8_t> at_server;
+    ASSERT_EQ(client_tunnel.writer.write(&client_tunnel.writer, frame, sizeof(frame)), MERR_OK);
+    pump(20, &at_server);
+    EXPECT_EQ(at_server.size(), sizeof(frame));
+}
+
+TEST_F(EndpointLinuxTcpTest, newest_client_replaces_the_old)
+{
+    start_server();
+    struct sockaddr_in addr {};
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(SERVER_PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    int old_client = socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT_EQ(connect(old_client, (struct sockaddr*)&addr, sizeof(addr)), 0);
+    pump(10);
+    int new_client = socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT_EQ(connect(new_client, (struct sockaddr*)&addr, sizeof(addr)), 0);
+    pump(10);
+    EXPECT_EQ(server.connects, 2);
+    EXPECT_EQ(server.disconnects, 1);
+
+    uint8_t frame[16] = {MAVLINK_STX}, buf[64];
+    ASSERT_EQ(server_tunnel.writer.write(&server_tunnel.writer, frame, sizeof(frame)), MERR_OK);
+    EXPECT_EQ(recv(new_client, buf, sizeof(buf), 0), sizeof(frame));
+    EXPECT_EQ(recv(old_client, buf, sizeof(buf), 0), 0);
+
+    close(old_client);
+    close(new_client);
+}
+
+TEST_F(EndpointLinuxTcpTest, queue_keeps_frames_whole)
+{
+    start_server();
+    struct sockaddr_in addr {};
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(SERVER_PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int peer             = socket(AF_INET, SOCK_STREAM, 0);
+    int small            = 4096;
+    setsockopt(peer, SOL_SOCKET, SO_RCVBUF, &small, sizeof(small));
+    ASSERT_EQ(connect(peer, (struct sockaddr*)&addr, sizeof(addr)), 0);
+    pump(10);
+    ASSERT_EQ(server.state, EP_TCP_UP);
+    setsockopt(server.fd, SOL_SOCKET, SO_SNDBUF, &small, sizeof(small));
+
+    /* the peer does not read: the socket fills up, then the queue */
+    uint8_t frame[200];
+    memset(frame, 0xab, sizeof(frame));
+    size_t written = 0;
+    for (int i = 0; i < 2000; i++)
+    {
+        frame[0] = MAVLINK_STX;
+        ASSERT_EQ(server_tunnel.writer.write(&server_tunnel.writer, frame, sizeof(frame)),
+            MERR_OK);
+        written += sizeof(frame);
+    }
+    EXPECT_GT(server.tx_queued, 0);
+    EXPECT_GT(server.tx_dropped, 0);
+    EXPECT_EQ(server.tx_dropped % sizeof(frame), 0);
+
+    /* once the peer reads, the reader flushes the queue */
+    size_t  received = 0;
+    uint8_t buf[4096];
+    while (server.queue_len > 0 || received < server.tx_bytes)
+    {
+        pump(1);
+        ssize_t n = recv(peer, buf, sizeof(buf), MSG_DONTWAIT);
+        received += n > 0 ? n : 0;
+    }
+    EXPECT_EQ(received, written - server.tx_dropped);
+    EXPECT_EQ(received % sizeof(frame), 0);
+    close(peer);
+}
+
+TEST_F(EndpointLinuxTcpTest, interrupt)
+{
+    start_client();
+    uint8_t buf[64];
+    client_tunnel.reader.timeout_ms = -1;
+    ep_linux_tcp_interrupt(&client);
+    EXPECT_EQ(client_tunnel.reader.read(&client_tunnel.reader, buf, sizeof(buf)), -MERR_END);
+}
@@ -0,0 +1,289 @@
+#include <gtest/gtest.h>
+#include <endpoint_linux_tlog.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+class EndpointLinuxTlogTest : public ::testing::Test
+{
+public:
+    struct endpoint_linux_capture_t capture {};
+    struct endpoint_linux_replay_t  replay {};
+    struct mavtunnel_t              capture_tunnel {}, replay_tunnel {};
+
+    char        dir[64] = "/tmp/mavtunnel-tlog-XXXXXX";
+    std::string prefix;
+    /* what record() wrote, as sequence numbers differ for every pack */
+    std::vector<std::vector<uint8_t>> sent;
+
+    void SetUp() override
+    {
+        ASSERT_NE(mkdtemp(dir), nullptr);
+        prefix = std::string(dir) + "/capture";
+        capture.fd = replay.fd = replay.terminate_fd = -1;
+    }
+
+    void TearDown() override
+    {
+        ep_linux_capture_destroy(&capture);
+        ep_linux_replay_destroy(&replay);
+        std::string cmd = std::string("rm -rf ") + dir;
+        ASSERT_EQ(system(cmd.c_str()), 0);
+    }
+
+    std::string segment(unsigned i)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "-%04u.tlog", i);
+        return prefix + name;
+    }
+
+    static std::vector<uint8_t> frame(uint8_t seq)
+    {
+        mavlink_message_t msg;
+        uint8_t           buf[MAVLINK_MAX_PACKET_LEN];
+        mavlink_msg_heartbeat_pack(1, 1, &msg, MAV_TYPE_QUADROTOR, MAV_AUTOPILOT_ARDUPILOTMEGA, 0,
+            seq, MAV_STATE_ACTIVE);
+        size_t len = mavlink_msg_to_send_buffer(buf, &msg);
+        return std::vector<uint8_t>(buf, buf + len);
+    }
+
+    void start_capture(size_t segment_size)
+    {
+        ASSERT_EQ(ep_linux_capture_init(&capture, prefix.c_str(), segment_size), MERR_OK);
+        mavtunnel_init(&capture_tunnel, 0);
+        ep_linux_capture_attach_writer(&capture_tunnel, &capture);
+    }
+
+    void record(size_t n, int interval_us = 0)
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            sent.push_back(frame(i));
+            auto& f = sent.back();
+            ASSERT_EQ(capture_tunnel.writer.write(&capture_tunnel.writer, f.data(), f.size()),
+                MERR_OK);
+            if (interval_us > 0)
+            {
+                usleep(interval_us);
+            }
+        }
+        ep_linux_capture_destroy(&capture);
+    }
+
+    void start_replay(const std::string& path, double speed)
+    {
+        ASSERT_EQ(ep_linux_replay_init(&replay, path.c_str(), speed), MERR_OK);
+        mavtunnel_init(&replay_tunnel, 0);
+        ep_linux_replay_attach_reader(&replay_tunnel, &replay);
+        replay_tunnel.reader.timeout_ms = 1000;
+    }
+
+    ssize_t read_frame(uint8_t* buf, size_t len)
+    {
+        return replay_tunnel.reader.read(&replay_tunnel.reader, buf, len);
+    }
+};
+
+TEST_F(EndpointLinuxTlogTest, capture_rotates_segments)
+{
+    size_t record_len = 8 + frame(0).size();
+    start_capture(4 * record_len);
+    record(10);
+
+    EXPECT_EQ(capture.frames, 10u);
+    EXPECT_EQ(capture.segments, 3u);
+    EXPECT_EQ(capture.dropped, 0u);
+
+    /* closed segments are cut to what they hold */
+    size_t sizes[] = {4 * record_len, 4 * record_len, 2 * record_len};
+    for (unsigned i = 0; i < 3; i++)
+    {
+        struct stat st;
+        ASSERT_EQ(stat(segment(i).c_str(), &st), 0);
+        EXPECT_EQ((size_t)st.st_size, sizes[i]);
+    }
+    struct stat st;
+    EXPECT_NE(stat(segment(3).c_str(), &st), 0);
+}
+
+TEST_F(EndpointLinuxTlogTest, next_segment_is_created_ahead)
+{
+    size_t record_len = 8 + frame(0).size();
+    start_capture(4 * record_len);
+    std::vector<uint8_t> f = frame(0);
+    ASSERT_EQ(capture_tunnel.writer.write(&capture_tunnel.writer, f.data(), f.size()), MERR_OK);
+
+    /* mapped at its full size before the first segment fills */
+    struct stat st = {};
+    for (int i = 0; i < 1000 && (stat(segment(1).c_str(), &st) != 0 || st.st_size == 0); i++)
+    {
+        usleep(1000);
+    }
+    EXPECT_EQ((size_t)st.st_size, 4 * record_len);
+    EXPECT_EQ(capture.segments, 1u);
+
+    /* and removed if it is never written to */
+    ep_linux_capture_destroy(&capture);
+    EXPECT_NE(stat(segment(1).c_str(), &st), 0);
+}
+
+TEST_F(EndpointLinuxTlogTest, capture_resumes_after_failed_segment)
+{
+    /* a directory in the way of the next segment */
+    ASSERT_EQ(mkdir(segment(1).c_str(), 0700), 0);
+    size_t record_len = 8 + frame(0).size();
+    start_capture(2 * record_len);
+    std::vector<uint8_t> f = frame(0);
+    auto failed = [this] {
+        pthread_mutex_lock(&capture.lock);
+        bool spare_failed = capture.spare_failed;
+        pthread_mutex_unlock(&capture.lock);
+        return spare_failed;
+    };
+    for (int i = 0; i < 1000 && !failed(); i++)
+    {
+        usleep(1000);
+    }
+
+    EXPECT_EQ(capture_tunnel.writer.write(&capture_tunnel.writer, f.data(), f.size()), MERR_OK);
+    EXPECT_EQ(capture_tunnel.writer.write(&capture_tunnel.writer, f.data(), f.size()), MERR_OK);
+    EXPECT_EQ(capture_tunnel.writer.write(&capture_tunnel.writer, f.data(), f.size()),
+        MERR_DEVICE_ERROR);
+    EXPECT_EQ(capture_tunnel.writer.write(&capture_tunnel.writer, f.data(), f.size()), MERR_OK);
+    EXPECT_EQ(capture.dropped, 1u);
+
+    /* once it is gone, a retry creates the segment and capture goes on */
+    ASSERT_EQ(rmdir(segment(1).c_str()), 0);
+    for (int i = 0; i < 1000 && capture.segments < 2; i++)
+    {
+        usleep(1000);
+        capture_tunnel.writer.write(&capture_tunnel.writer, f.data(), f.size());
+    }
+    EXPECT_EQ(capture.segments, 2u);
+    EXPECT_FALSE(failed());
+    ep_linux_capture_destroy(&capture);
+
+    struct stat st;
+    ASSERT_EQ(stat(segment(1).c_str(), &st), 0);
+    EXPECT_GT((size_t)st.st_size, 0u);
+}
+
+TEST_F(EndpointLinuxTlogTest, segment_is_a_tlog)
+{
+    start_capture(0);
+    record(2);
+
+    FILE* f = fopen(segment(0).c_str(), "rb");
+    ASSERT_NE(f, nullptr);
+    uint8_t buf[256];
+    size_t  n = fread(buf, 1, sizeof(buf), f);
+    fclose(f);
+
+    auto& expected = sent[0];
+    ASSERT_EQ(n, 2 * (8 + expected.size()));
+    uint64_t stamp = 0;
+    for (int i = 0; i < 8; i++)
+    {
+        stamp = stamp << 8 | buf[i];
+    }
+    /* microseconds since the epoch, big-endian */
+    EXPECT_NEAR((double)stamp / 1e6, (double)time(nullptr), 5);
+    EXPECT_EQ(std::vector<uint8_t>(buf + 8, buf + 8 + expected.size()), expected);
+}
+
+TEST_F(EndpointLinuxTlogTest, oversized_frame_is_dropped)
+{
+    start_capture(64);
+    uint8_t big[64] = {MAVLINK_STX};
+    EXPECT_EQ(capture_tunnel.writer.write(&capture_tunnel.writer, big, sizeof(big)), MERR_OK);
+    EXPECT_EQ(capture.dropped, 1u);
+    EXPECT_EQ(capture.frames, 0u);
+}
+
+TEST_F(EndpointLinuxTlogTest, replay_reproduces_capture)
+{
+    start_capture(4 * (8 + frame(0).size()));
+    record(10);
+    start_replay(prefix, 0);
+
+    uint8_t buf[MAVLINK_MAX_PACKET_LEN];
+    for (size_t i = 0; i < 10; i++)
+    {
+        ssize_t n = read_frame(buf, sizeof(buf));
+        ASSERT_GT(n, 0);
+        EXPECT_EQ(std::vector<uint8_t>(buf, buf + n), sent[i]);
+    }
+    EXPECT_EQ(read_frame(buf, sizeof(buf)), -MERR_END);
+    EXPECT_EQ(replay.frames, 10u);
+}
+
+TEST_F(EndpointLinuxTlogTest, replay_single_file)
+{
+    start_capture(4 * (8 + frame(0).size()));
+    record(10);
+    /* a file stops at its own end */
+    start_replay(segment(1), 0);
+
+    uint8_t buf[MAVLINK_MAX_PACKET_LEN];
+    for (size_t i = 4; i < 8; i++)
+    {
+        ssize_t n = read_frame(buf, sizeof(buf));
+        ASSERT_GT(n, 0);
+        EXPECT_EQ(std::vector<uint8_t>(buf, buf + n), sent[i]);
+    }
+    EXPECT_EQ(read_frame(buf, sizeof(buf)), -MERR_END);
+}
+
+TEST_F(EndpointLinuxTlogTest, replay_keeps_pace)
+{
+    start_capture(0);
+    record(5, 20000);
+
+    uint8_t buf[MAVLINK_MAX_PACKET_LEN];
+    for (double speed : {1.0, 4.0})
+    {
+        start_replay(prefix, speed);
+        uint64_t start = time_us();
+        for (int i = 0; i < 5; i++)
+        {
+            ASSERT_GT(read_frame(buf, sizeof(buf)), 0);
+        }
+        double elapsed = (double)(time_us() - start);
+        EXPECT_GE(elapsed, 80000 / speed * 0.9);
+        EXPECT_LT(elapsed, 80000 / speed * 2 + 10000);
+        /* recorded time, whatever the speed */
+        EXPECT_GE(replay.last_log_us - replay.first_log_us, 80000u);
+        ep_linux_replay_destroy(&replay);
+    }
+}
+
+TEST_F(EndpointLinuxTlogTest, replay_timeout_and_interrupt)
+{
+    start_capture(0);
+    record(2, 300000);
+    start_replay(prefix, 1);
+    replay_tunnel.reader.timeout_ms = 50;
+
+    uint8_t buf[MAVLINK_MAX_PACKET_LEN];
+    ASSERT_GT(read_frame(buf, sizeof(buf)), 0);
+    /* the next frame is due in 300 ms */
+    EXPECT_EQ(read_frame(buf, sizeof(buf)), 0);
+
+    replay_tunnel.reader.timeout_ms = -1;
+    std::thread t([this] {
+        usleep(20000);
+        ep_linux_replay_interrupt(&replay);
+    });
+    EXPECT_EQ(read_frame(buf, sizeof(buf)), -MERR_END);
+    t.join();
+}
+
+TEST_F(EndpointLinuxTlogTest, replay_missing)
+{
+    EXPECT_EQ(ep_linux_replay_init(&replay, prefix.c_str(), 0), MERR_DEVICE_ERROR);
+}
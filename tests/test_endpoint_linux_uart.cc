@@ -3,8 +3,10 @@
 #include <codec_passthrough.h>
 #include <pty.h>
 
+#include <thread>
 #include <vector>
 #include <numeric>
+#include <termios.h>
 
 struct mavtunnel_t tunnel;
 struct endpoint_linux_uart_t ep_a, ep_b;
@@ -78,13 +80,179 @@ TEST_F(EndpointLinuxUartTest, ep_linux_uart_attach_reader)
 
     mavlink_message_t msg;
     mavlink_msg_heartbeat_pack(1, 1, &msg, MAV_TYPE_GCS, MAV_AUTOPILOT_INVALID, 0, 0, 0);
-    n = tunnel.writer.write(&tunnel.writer, &msg);
-    ASSERT_EQ(n, MERR_OK);
-
     std::vector<uint8_t> serialized(256);
     ssize_t m = mavlink_msg_to_send_buffer(serialized.data(), &msg);
 
+    n = tunnel.writer.write(&tunnel.writer, serialized.data(), m);
+    ASSERT_EQ(n, MERR_OK);
+
     n = read(master_b, buffer.data(), buffer.size());
     ASSERT_EQ(n, m);
     ASSERT_EQ(memcmp(buffer.data(), serialized.data(), n), 0);
 }
+
+static void reopen(struct endpoint_linux_uart_t * ep, const char * device,
+    const struct ep_uart_options_t & options)
+{
+    ep_linux_uart_destroy(ep);
+    ASSERT_EQ(ep_linux_uart_init_options(ep, device, &options), MERR_OK);
+}
+
+TEST_F(EndpointLinuxUartTest, options_baud)
+{
+    EXPECT_EQ(ep_a.baud, 115200u);
+
+    for (uint32_t baud : {921600u, 1500000u, 3000000u})
+    {
+        struct ep_uart_options_t options = EP_UART_OPTIONS_DEFAULT;
+        options.baud = baud;
+        options.rtscts = true;
+        options.low_latency = true;
+        reopen(&ep_a, device_a, options);
+        EXPECT_EQ(ep_a.baud, baud);
+
+        struct termios tio;
+        ASSERT_EQ(tcgetattr(ep_a.fd, &tio), 0);
+        EXPECT_TRUE(tio.c_cflag & CRTSCTS);
+        EXPECT_FALSE(tio.c_lflag & ICANON);
+    }
+}
+
+TEST_F(EndpointLinuxUartTest, options_vmin_vtime)
+{
+    struct ep_uart_options_t options = EP_UART_OPTIONS_DEFAULT;
+    options.vmin = 64;
+    EXPECT_EQ(ep_linux_uart_init_options(&ep_b, device_b, &options), MERR_BAD_STATE);
+
+    options.vtime = 1;
+    reopen(&ep_a, device_a, options);
+    ep_linux_uart_attach_reader(&tunnel, &ep_a);
+    tunnel.reader.timeout_ms = 1000;
+
+    /* two halves of a burst come back from one read */
+    std::vector<uint8_t> data(80, 0x55), buffer(1024);
+    write(master_a, data.data(), 40);
+    std::thread writer([&]() {
+        usleep(20000);
+        write(master_a, data.data() + 40, 40);
+    });
+    EXPECT_EQ(tunnel.reader.read(&tunnel.reader, buffer.data(), buffer.size()), 80);
+    writer.join();
+
+    /* and a short one once the line goes quiet for vtime */
+    write(master_a, data.data(), 10);
+    EXPECT_EQ(tunnel.reader.read(&tunnel.reader, buffer.data(), buffer.size()), 10);
+}
+
+TEST_F(EndpointLinuxUartTest, options_read_size)
+{
+    struct ep_uart_options_t options = EP_UART_OPTIONS_DEFAULT;
+    options.read_size = 16;
+    reopen(&ep_a, device_a, options);
+    ep_linux_uart_attach_reader(&tunnel, &ep_a);
+    tunnel.reader.timeout_ms = 1000;
+
+    std::vector<uint8_t> data(100, 0xaa), buffer(1024);
+    write(master_a, data.data(), data.size());
+    EXPECT_EQ(tunnel.reader.read(&tunnel.reader, buffer.data(), buffer.size()), 16);
+}
+
+TEST_F(EndpointLinuxUartTest, failed_init_releases_device)
+{
+    /* opens, but is no terminal */
+    struct endpoint_linux_uart_t ep;
+    EXPECT_EQ(ep_linux_uart_init(&ep, "/dev/null"), MERR_DEVICE_ERROR);
+    EXPECT_EQ(ep.fd, -1);
+    EXPECT_EQ(ep.epoll, -1);
+    EXPECT_EQ(ep.device_path, nullptr);
+    ep_linux_uart_destroy(&ep);
+
+    EXPECT_EQ(ep_linux_uart_init(&ep, "./uart-none"), MERR_END);
+    EXPECT_EQ(ep.device_path, nullptr);
+}
+
+static std::vector<uint8_t> attitude_frame()
+{
+    mavlink_message_t msg;
+    std::vector<uint8_t> frame(MAVLINK_MAX_PACKET_LEN);
+    mavlink_msg_attitude_pack(1, 1, &msg, 1000, 0.1f, 0.2f, 0.3f, 0.4f, 0.5f, 0.6f);
+    frame.resize(mavlink_msg_to_send_buffer(frame.data(), &msg));
+    return frame;
+}
+
+TEST_F(EndpointLinuxUartTest, coalesce_split_frame)
+{
+    struct ep_uart_options_t options = EP_UART_OPTIONS_DEFAULT;
+    options.coalesce_us = 20000;
+    options.vmin = 1;
+    options.vtime = 1;
+    EXPECT_EQ(ep_linux_uart_init_options(&ep_b, device_b, &options), MERR_BAD_STATE);
+
+    options.vmin = options.vtime = 0;
+    reopen(&ep_a, device_a, options);
+    ep_linux_uart_attach_reader(&tunnel, &ep_a);
+    tunnel.reader.timeout_ms = 1000;
+
+    /* the rest of the frame comes while the read sleeps */
+    auto frame = attitude_frame();
+    std::vector<uint8_t> buffer(1024);
+    write(master_a, frame.data(), 10);
+    std::thread writer([&]() {
+        usleep(1000);
+        write(master_a, frame.data() + 10, frame.size() - 10);
+    });
+    EXPECT_EQ(tunnel.reader.read(&tunnel.reader, buffer.data(), buffer.size()), frame.size());
+    writer.join();
+    EXPECT_EQ(ep_a.reads, 1);
+    EXPECT_GE(ep_a.coalesced, 1);
+
+    /* a whole frame does not wait */
+    uint64_t coalesced = ep_a.coalesced;
+    write(master_a, frame.data(), frame.size());
+    EXPECT_EQ(tunnel.reader.read(&tunnel.reader, buffer.data(), buffer.size()), frame.size());
+    EXPECT_EQ(ep_a.coalesced, coalesced);
+}
+
+TEST_F(EndpointLinuxUartTest, coalesce_learns_length)
+{
+    struct ep_uart_options_t options = EP_UART_OPTIONS_DEFAULT;
+    options.coalesce_us = 20000;
+    reopen(&ep_a, device_a, options);
+    ep_linux_uart_attach_reader(&tunnel, &ep_a);
+    tunnel.reader.timeout_ms = 1000;
+
+    /* the read starts on a lone STX; the length comes with the next bytes */
+    auto frame = attitude_frame();
+    std::vector<uint8_t> buffer(1024);
+    write(master_a, frame.data(), 1);
+    std::thread writer([&]() {
+        usleep(200);
+        write(master_a, frame.data() + 1, 9);
+        usleep(1000);
+        write(master_a, frame.data() + 10, frame.size() - 10);
+    });
+    EXPECT_EQ(tunnel.reader.read(&tunnel.reader, buffer.data(), buffer.size()), frame.size());
+    writer.join();
+    EXPECT_EQ(ep_a.reads, 1);
+    EXPECT_GE(ep_a.coalesced, 2);
+}
+
+TEST_F(EndpointLinuxUartTest, coalesce_deadline)
+{
+    struct ep_uart_options_t options = EP_UART_OPTIONS_DEFAULT;
+    options.baud = 9600;
+    options.coalesce_us = 5000;
+    reopen(&ep_a, device_a, options);
+    ep_linux_uart_attach_reader(&tunnel, &ep_a);
+    tunnel.reader.timeout_ms = 1000;
+
+    /* the rest would take 30 ms at 9600 baud and never comes */
+    auto frame = attitude_frame();
+    std::vector<uint8_t> buffer(1024);
+    write(master_a, frame.data(), 10);
+    uint64_t start = time_us();
+    EXPECT_EQ(tunnel.reader.read(&tunnel.reader, buffer.data(), buffer.size()), 10);
+    uint64_t elapsed = time_us() - start;
+    EXPECT_GE(elapsed, 5000u);
+    EXPECT_LT(elapsed, 25000u);
+}
@@ -0,0 +1,289 @@
+#include <gtest/gtest.h>
+#include <endpoint_linux_uart_stripe.h>
+#include <fcntl.h>
+#include <pty.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#define N_LINKS 3
+
+typedef std::vector<uint8_t> frame_t;
+
+static const uint32_t bauds[N_LINKS] = {115200, 230400, 460800};
+static const size_t   rates[N_LINKS] = {11520, 23040, 46080};
+
+struct mavtunnel_t                  tx, rx;
+struct endpoint_linux_uart_t        tx_uart[N_LINKS], rx_uart[N_LINKS];
+struct endpoint_linux_uart_stripe_t tx_stripe, rx_stripe;
+int                                 tx_master[N_LINKS], rx_master[N_LINKS];
+
+static int
+create_mock_pts(const char* link)
+{
+    int  master, slave;
+    char pts[256];
+
+    if (openpty(&master, &slave, pts, nullptr, nullptr) < 0)
+    {
+        perror("openpty");
+        exit(1);
+    }
+
+    unlink(link);
+    if (symlink(pts, link) < 0)
+    {
+        perror("symlink");
+        exit(1);
+    }
+
+    return master;
+}
+
+/* carries what a link sends to its other end, at the link's pace */
+static void
+emulate_link(size_t i, std::atomic<bool>* running)
+{
+    uint8_t buf[32];
+    while (running->load())
+    {
+        ssize_t n = read(tx_master[i], buf, sizeof(buf));
+        if (n <= 0)
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+            continue;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(n * 1000000 / rates[i]));
+        write(rx_master[i], buf, n);
+    }
+}
+
+class EndpointLinuxUartStripeTest : public ::testing::Test
+{
+public:
+    std::atomic<bool>        running {true};
+    std::vector<std::thread> links;
+
+    void SetUp() override
+    {
+        mavtunnel_init(&tx, 0);
+        mavtunnel_init(&rx, 1);
+        for (size_t i = 0; i < N_LINKS; i++)
+        {
+            std::string tx_path = "./stripe-tx-" + std::to_string(i);
+            std::string rx_path = "./stripe-rx-" + std::to_string(i);
+            tx_master[i] = create_mock_pts(tx_path.c_str());
+            rx_master[i] = create_mock_pts(rx_path.c_str());
+            fcntl(tx_master[i], F_SETFL, O_NONBLOCK);
+
+            struct ep_uart_options_t options = EP_UART_OPTIONS_DEFAULT;
+            options.baud                     = bauds[i];
+            ep_linux_uart_init_options(&tx_uart[i], tx_path.c_str(), &options);
+            ep_linux_uart_init_options(&rx_uart[i], rx_path.c_str(), &options);
+        }
+
+        ASSERT_EQ(ep_linux_uart_stripe_init(&tx_stripe, tx_uart, N_LINKS), MERR_OK);
+        ASSERT_EQ(ep_linux_uart_stripe_init(&rx_stripe, rx_uart, N_LINKS), MERR_OK);
+        ep_linux_uart_stripe_attach_writer(&tx, &tx_stripe);
+        ep_linux_uart_stripe_attach_reader(&rx, &rx_stripe);
+        rx.reader.timeout_ms = 500;
+    }
+
+    void TearDown() override
+    {
+        running = false;
+        for (auto& link : links)
+        {
+            link.join();
+        }
+        ep_linux_uart_stripe_destroy(&tx_stripe);
+        ep_linux_uart_stripe_destroy(&rx_stripe);
+        for (size_t i = 0; i < N_LINKS; i++)
+        {
+            ep_linux_uart_destroy(&tx_uart[i]);
+            ep_linux_uart_destroy(&rx_uart[i]);
+            close(tx_master[i]);
+            close(rx_master[i]);
+            unlink(("./stripe-tx-" + std::to_string(i)).c_str());
+            unlink(("./stripe-rx-" + std::to_string(i)).c_str());
+        }
+    }
+
+    void start_links()
+    {
+        for (size_t i = 0; i < N_LINKS; i++)
+        {
+            links.emplace_back(emulate_link, i, &running);
+        }
+    }
+
+    static frame_t heartbeat(uint32_t i)
+    {
+        mavlink_message_t msg;
+        uint8_t           buf[MAVLINK_MAX_PACKET_LEN];
+        mavlink_msg_heartbeat_pack(1, 1, &msg, MAV_TYPE_QUADROTOR,
+            MAV_AUTOPILOT_ARDUPILOTMEGA, 1, i, 3);
+        size_t len = mavlink_msg_to_send_buffer(buf, &msg);
+        return frame_t(buf, buf + len);
+    }
+
+    /* a striped frame as it goes on the wire */
+    static frame_t record(uint8_t seq, const frame_t& frame)
+    {
+        frame_t rec {seq};
+        rec.insert(rec.end(), frame.begin(), frame.end());
+        uint16_t crc = crc_calculate(rec.data(), (uint16_t)rec.size());
+        rec.push_back(crc & 0xFF);
+        rec.push_back(crc >> 8);
+        return rec;
+    }
+
+    /* puts a striped frame on the receiving end of a link */
+    static void inject(size_t link, uint8_t seq, const frame_t& frame)
+    {
+        frame_t rec = record(seq, frame);
+        write(rx_master[link], rec.data(), rec.size());
+    }
+
+    static frame_t receive(size_t n)
+    {
+        frame_t got;
+        uint8_t buf[1024];
+        while (got.size() < n)
+        {
+            ssize_t len = rx.reader.read(&rx.reader, buf, sizeof(buf));
+            if (len <= 0)
+            {
+                break;
+            }
+            got.insert(got.end(), buf, buf + len);
+        }
+        return got;
+    }
+};
+
+TEST_F(EndpointLinuxUartStripeTest, in_order_over_weighted_links)
+{
+    start_links();
+
+    frame_t sent;
+    auto    start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < 300; i++)
+    {
+        frame_t frame = heartbeat(i);
+        ASSERT_EQ(tx.writer.write(&tx.writer, frame.data(), frame.size()), MERR_OK);
+        sent.insert(sent.end(), frame.begin(), frame.end());
+    }
+    frame_t got     = receive(sent.size());
+    auto    elapsed = std::chrono::steady_clock::now() - start;
+
+    EXPECT_EQ(got, sent);
+    EXPECT_EQ(rx_stripe.skipped, 0);
+    for (size_t i = 0; i < N_LINKS; i++)
+    {
+        EXPECT_EQ(tx_stripe.links[i].line_rate, rates[i]);
+    }
+
+    /* the faster a link, the more it carries */
+    EXPECT_LT(tx_stripe.links[0].tx_frames, tx_stripe.links[1].tx_frames);
+    EXPECT_LT(tx_stripe.links[1].tx_frames, tx_stripe.links[2].tx_frames);
+    EXPECT_GT(tx_stripe.links[0].tx_frames, 0);
+
+    /* faster than the fastest link could do on its own */
+    auto alone = std::chrono::microseconds(sent.size() * 1000000 / rates[N_LINKS - 1]);
+    EXPECT_LT(elapsed, alone);
+}
+
+TEST_F(EndpointLinuxUartStripeTest, reorders_across_links)
+{
+    frame_t a = heartbeat(0), b = heartbeat(1), c = heartbeat(2);
+    inject(2, 2, c);
+    inject(1, 1, b);
+    usleep(10000);
+    inject(0, 0, a);
+
+    frame_t sent = a;
+    sent.insert(sent.end(), b.begin(), b.end());
+    sent.insert(sent.end(), c.begin(), c.end());
+    EXPECT_EQ(receive(sent.size()), sent);
+    EXPECT_EQ(rx_stripe.skipped, 0);
+}
+
+TEST_F(EndpointLinuxUartStripeTest, gives_up_on_lost_frame)
+{
+    frame_t a = heartbeat(0), b = heartbeat(1), c = heartbeat(2);
+    inject(0, 0, a);
+    inject(1, 2, c);
+
+    auto    start   = std::chrono::steady_clock::now();
+    frame_t sent    = a;
+    sent.insert(sent.end(), c.begin(), c.end());
+    EXPECT_EQ(receive(sent.size()), sent);
+    EXPECT_GE(std::chrono::steady_clock::now() - start,
+        std::chrono::microseconds(EP_STRIPE_REORDER_TIMEOUT_US));
+    EXPECT_EQ(rx_stripe.skipped, 1);
+
+    /* the lost frame still shows up, out of order */
+    inject(2, 1, b);
+    EXPECT_EQ(receive(b.size()), b);
+    EXPECT_EQ(rx_stripe.late, 1);
+}
+
+TEST_F(EndpointLinuxUartStripeTest, gap_keeps_read_timeout)
+{
+    frame_t b = heartbeat(1);
+    inject(1, 1, b);
+
+    /* frame 0 is missing, but the read does not wait the gap out */
+    rx.reader.timeout_ms = 5;
+    uint8_t buf[1024];
+    auto    start = std::chrono::steady_clock::now();
+    EXPECT_EQ(rx.reader.read(&rx.reader, buf, sizeof(buf)), 0);
+    EXPECT_LT(std::chrono::steady_clock::now() - start,
+        std::chrono::microseconds(EP_STRIPE_REORDER_TIMEOUT_US));
+
+    rx.reader.timeout_ms = 500;
+    EXPECT_EQ(receive(b.size()), b);
+    EXPECT_EQ(rx_stripe.skipped, 1);
+}
+
+TEST_F(EndpointLinuxUartStripeTest, duplicate_is_dropped)
+{
+    frame_t a = heartbeat(0), b = heartbeat(1), c = heartbeat(2);
+    inject(1, 2, c);
+    inject(2, 2, c);
+    usleep(10000);
+    inject(0, 0, a);
+    inject(0, 1, b);
+
+    frame_t sent = a;
+    sent.insert(sent.end(), b.begin(), b.end());
+    sent.insert(sent.end(), c.begin(), c.end());
+    EXPECT_EQ(receive(sent.size()), sent);
+    EXPECT_EQ(rx_stripe.duplicates, 1);
+    EXPECT_EQ(rx_stripe.buffered, 0);
+
+    /* the window still moves on past a gap */
+    frame_t e = heartbeat(4);
+    inject(0, 4, e);
+    EXPECT_EQ(receive(e.size()), e);
+    EXPECT_EQ(rx_stripe.skipped, 1);
+}
+
+TEST_F(EndpointLinuxUartStripeTest, corrupt_record_is_dropped)
+{
+    frame_t a = heartbeat(0), b = heartbeat(1);
+    frame_t bad = record(0, a);
+    bad[8] ^= 0x40;
+    write(rx_master[0], bad.data(), bad.size());
+    inject(0, 0, a);
+    inject(0, 1, b);
+
+    frame_t sent = a;
+    sent.insert(sent.end(), b.begin(), b.end());
+    EXPECT_EQ(receive(sent.size()), sent);
+    EXPECT_GE(rx_stripe.links[0].rx_corrupt, 1);
+    EXPECT_EQ(rx_stripe.skipped, 0);
+}
@@ -0,0 +1,131 @@
+#include <gtest/gtest.h>
+#include <endpoint_linux_udp_server.h>
+
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+#define SERVER_PORT 14650
+
+struct mavtunnel_t                 tunnel;
+struct endpoint_linux_udp_server_t server;
+
+class EndpointLinuxUdpServerTest : public ::testing::Test
+{
+public:
+    std::vector<int> clients;
+
+    void SetUp() override
+    {
+        mavtunnel_init(&tunnel, 0);
+        ASSERT_EQ(ep_linux_udp_server_init(&server, SERVER_PORT), MERR_OK);
+        ep_linux_udp_server_attach_reader(&tunnel, &server);
+        ep_linux_udp_server_attach_writer(&tunnel, &server);
+        tunnel.reader.timeout_ms = 100;
+    }
+
+    void TearDown() override
+    {
+        for (int fd : clients)
+        {
+            close(fd);
+        }
+        ep_linux_udp_server_destroy(&server);
+    }
+
+    int connect_client()
+    {
+        int                fd = socket(AF_INET, SOCK_DGRAM, 0);
+        struct sockaddr_in addr {};
+        addr.sin_family      = AF_INET;
+        addr.sin_port        = htons(SERVER_PORT);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        connect(fd, (struct sockaddr*)&addr, sizeof(addr));
+        clients.push_back(fd);
+        return fd;
+    }
+
+    /* a client says something, and the server hears it */
+    static void hello(int fd)
+    {
+        uint8_t hello = MAVLINK_STX, buf[16];
+        send(fd, &hello, 1, 0);
+        ASSERT_EQ(tunnel.reader.read(&tunnel.reader, buf, sizeof(buf)), 1);
+    }
+
+    static struct sockaddr_in local_addr(int fd)
+    {
+        struct sockaddr_in addr {};
+        socklen_t          addr_len = sizeof(addr);
+        getsockname(fd, (struct sockaddr*)&addr, &addr_len);
+        return addr;
+    }
+
+    static ssize_t receive(int fd)
+    {
+        uint8_t buf[MAVLINK_MAX_PACKET_LEN];
+        return recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+    }
+};
+
+TEST_F(EndpointLinuxUdpServerTest, every_client_gets_the_stream)
+{
+    for (int i = 0; i < 8; i++)
+    {
+        hello(connect_client());
+    }
+    EXPECT_EQ(server.n_peers, 8);
+
+    uint8_t frame[32] = {MAVLINK_STX};
+    ASSERT_EQ(tunnel.writer.write(&tunnel.writer, frame, sizeof(frame)), MERR_OK);
+    EXPECT_EQ(server.syscalls, 1);
+    for (int fd : clients)
+    {
+        EXPECT_EQ(receive(fd), sizeof(frame));
+    }
+
+    /* the same client again is no new peer */
+    hello(clients[3]);
+    EXPECT_EQ(server.n_peers, 8);
+    EXPECT_EQ(server.peers[3].rx_datagrams, 2);
+}
+
+TEST_F(EndpointLinuxUdpServerTest, idle_peer_expires)
+{
+    server.idle_timeout_us = 20000;
+    int quiet = connect_client(), chatty = connect_client();
+    hello(quiet);
+    std::this_thread::sleep_for(std::chrono::milliseconds(150));
+    hello(chatty);
+
+    uint8_t frame[16] = {MAVLINK_STX};
+    tunnel.writer.write(&tunnel.writer, frame, sizeof(frame));
+    EXPECT_EQ(receive(chatty), sizeof(frame));
+    EXPECT_LT(receive(quiet), 0);
+    EXPECT_EQ(server.expired, 1);
+    EXPECT_EQ(server.n_peers, 1);
+
+    /* and comes back when it speaks again */
+    hello(quiet);
+    EXPECT_EQ(server.n_peers, 2);
+}
+
+TEST_F(EndpointLinuxUdpServerTest, send_to_subset)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        hello(connect_client());
+    }
+
+    struct sockaddr_in chosen[] = {local_addr(clients[1]), local_addr(clients[2])};
+    uint8_t            frame[16] = {MAVLINK_STX};
+    ep_linux_udp_server_send_to(&server, chosen, 2, frame, sizeof(frame));
+
+    EXPECT_LT(receive(clients[0]), 0);
+    EXPECT_EQ(receive(clients[1]), sizeof(frame));
+    EXPECT_EQ(receive(clients[2]), sizeof(frame));
+    EXPECT_LT(receive(clients[3]), 0);
+
+    /* the last datagram read tells who sent it */
+    EXPECT_EQ(server.last_peer.sin_port, local_addr(clients[3]).sin_port);
+}
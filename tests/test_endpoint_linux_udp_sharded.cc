@@ -0,0 +1,183 @@
+#include <gtest/gtest.h>
+#include <endpoint_linux_udp_sharded.h>
+
+#include <map>
+#include <set>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define SERVER_PORT 14660
+#define N_SHARDS    4
+#define N_CLIENTS   16
+
+struct endpoint_linux_udp_sharded_t server;
+struct mavtunnel_t                  worker[N_SHARDS];
+
+class EndpointLinuxUdpShardedTest : public ::testing::Test
+{
+public:
+    std::vector<int> clients;
+
+    void TearDown() override
+    {
+        for (int fd : clients)
+        {
+            close(fd);
+        }
+        ep_linux_udp_sharded_destroy(&server);
+    }
+
+    void start(unsigned flags)
+    {
+        ASSERT_EQ(ep_linux_udp_sharded_init(&server, SERVER_PORT, N_SHARDS, flags),
+            MERR_OK);
+        for (size_t i = 0; i < N_SHARDS; i++)
+        {
+            mavtunnel_init(&worker[i], i);
+            ep_linux_udp_sharded_attach_reader(&worker[i], &server, i);
+            ep_linux_udp_sharded_attach_writer(&worker[i], &server, i);
+            worker[i].reader.timeout_ms = 0;
+        }
+
+        struct sockaddr_in addr {};
+        addr.sin_family      = AF_INET;
+        addr.sin_port        = htons(SERVER_PORT);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        for (size_t i = 0; i < N_CLIENTS; i++)
+        {
+            int fd = socket(AF_INET, SOCK_DGRAM, 0);
+            connect(fd, (struct sockaddr*)&addr, sizeof(addr));
+            clients.push_back(fd);
+        }
+    }
+
+    static uint16_t local_port(int fd)
+    {
+        struct sockaddr_in addr {};
+        socklen_t          addr_len = sizeof(addr);
+        getsockname(fd, (struct sockaddr*)&addr, &addr_len);
+        return ntohs(addr.sin_port);
+    }
+
+    /* the shards each client's datagrams ended up on */
+    std::map<uint16_t, std::set<size_t>> ingest(size_t rounds)
+    {
+        for (size_t r = 0; r < rounds; r++)
+        {
+            for (int fd : clients)
+            {
+                uint8_t frame[16] = {MAVLINK_STX, (uint8_t)r};
+                send(fd, frame, sizeof(frame), 0);
+            }
+        }
+
+        std::map<uint16_t, std::set<size_t>> shards;
+        for (size_t i = 0; i < N_SHARDS; i++)
+        {
+            uint8_t buf[64];
+            while (worker[i].reader.read(&worker[i].reader, buf, sizeof(buf)) > 0)
+            {
+            }
+            for (size_t p = 0; p < server.shards[i].n_peers; p++)
+            {
+                shards[ntohs(server.shards[i].peers[p].addr.sin_port)].insert(i);
+            }
+        }
+        return shards;
+    }
+};
+
+TEST_F(EndpointLinuxUdpShardedTest, sender_sticks_to_a_shard)
+{
+    start(0);
+    auto shards = ingest(5);
+
+    EXPECT_EQ(shards.size(), N_CLIENTS);
+    for (auto& client : shards)
+    {
+        EXPECT_EQ(client.second.size(), 1);
+    }
+
+    uint64_t total = 0;
+    for (size_t i = 0; i < N_SHARDS; i++)
+    {
+        total += server.shards[i].rx_datagrams;
+    }
+    EXPECT_EQ(total, 5 * N_CLIENTS);
+}
+
+TEST_F(EndpointLinuxUdpShardedTest, steered_by_source_address)
+{
+    start(EP_UDP_SHARDED_STEER);
+    auto shards = ingest(3);
+
+    EXPECT_EQ(shards.size(), N_CLIENTS);
+    for (int fd : clients)
+    {
+        uint16_t port     = local_port(fd);
+        size_t   expected = (INADDR_LOOPBACK + port) % N_SHARDS;
+        EXPECT_EQ(shards[port], std::set<size_t> {expected});
+    }
+}
+
+TEST_F(EndpointLinuxUdpShardedTest, shard_replies_to_its_sender)
+{
+    start(EP_UDP_SHARDED_STEER);
+    int      fd    = clients[0];
+    size_t   shard = (INADDR_LOOPBACK + local_port(fd)) % N_SHARDS;
+    uint8_t  frame[16] = {MAVLINK_STX}, buf[64];
+    send(fd, frame, sizeof(frame), 0);
+    ASSERT_EQ(worker[shard].reader.read(&worker[shard].reader, buf, sizeof(buf)),
+        sizeof(frame));
+
+    ASSERT_EQ(worker[shard].writer.write(&worker[shard].writer, frame, 8), MERR_OK);
+    EXPECT_EQ(recv(fd, buf, sizeof(buf), MSG_DONTWAIT), 8);
+}
+
+TEST_F(EndpointLinuxUdpShardedTest, shard_replies_to_all_its_senders)
+{
+    start(EP_UDP_SHARDED_STEER);
+    auto shards = ingest(1);
+
+    /* whoever spoke last, every sender on the shard gets the downlink */
+    std::map<size_t, std::vector<int>> senders;
+    for (int fd : clients)
+    {
+        senders[*shards[local_port(fd)].begin()].push_back(fd);
+    }
+    size_t shard = 0;
+    for (auto& s : senders)
+    {
+        shard = s.second.size() > senders[shard].size() ? s.first : shard;
+    }
+    std::vector<int> mine = senders[shard];
+    ASSERT_GT(mine.size(), 1);
+
+    uint8_t frame[8] = {MAVLINK_STX}, buf[64];
+    ASSERT_EQ(worker[shard].writer.write(&worker[shard].writer, frame, sizeof(frame)), MERR_OK);
+    for (int fd : mine)
+    {
+        EXPECT_EQ(recv(fd, buf, sizeof(buf), MSG_DONTWAIT), sizeof(frame));
+    }
+}
+
+TEST_F(EndpointLinuxUdpShardedTest, destroy_after_failed_init)
+{
+    /* the port is taken by a socket outside the group */
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in addr {};
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(SERVER_PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    ASSERT_EQ(bind(fd, (struct sockaddr*)&addr, sizeof(addr)), 0);
+    clients.push_back(fd);
+
+    bool stdin_open = fcntl(0, F_GETFD) != -1;
+    EXPECT_NE(ep_linux_udp_sharded_init(&server, SERVER_PORT, N_SHARDS, 0), MERR_OK);
+    ep_linux_udp_sharded_destroy(&server);
+    server.n_shards = 0;
+
+    /* nothing it did not open was closed */
+    EXPECT_EQ(fcntl(0, F_GETFD) != -1, stdin_open);
+}
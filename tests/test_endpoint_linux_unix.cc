@@ -0,0 +1,169 @@
+#include <gtest/gtest.h>
+#include <endpoint_linux_unix.h>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SERVER_PATH "@mavtunnel-test-unix"
+#define N_CLIENTS   3
+
+struct endpoint_linux_unix_t server, clients[N_CLIENTS];
+struct mavtunnel_t           server_tunnel, client_tunnel[N_CLIENTS];
+
+class EndpointLinuxUnixTest : public ::testing::Test
+{
+public:
+    size_t n_clients = 0;
+
+    void TearDown() override
+    {
+        for (size_t i = 0; i < n_clients; i++)
+        {
+            ep_linux_unix_destroy(&clients[i]);
+        }
+        ep_linux_unix_destroy(&server);
+    }
+
+    void start(enum ep_unix_type_t type, const char* path = SERVER_PATH)
+    {
+        ASSERT_EQ(ep_linux_unix_init(&server, type, EP_UNIX_SERVER, path), MERR_OK);
+        mavtunnel_init(&server_tunnel, 0);
+        ep_linux_unix_attach_reader(&server_tunnel, &server);
+        ep_linux_unix_attach_writer(&server_tunnel, &server);
+        server_tunnel.reader.timeout_ms = 10;
+
+        for (n_clients = 0; n_clients < N_CLIENTS; n_clients++)
+        {
+            ASSERT_EQ(ep_linux_unix_init(&clients[n_clients], type, EP_UNIX_CLIENT, path),
+                MERR_OK);
+            mavtunnel_init(&client_tunnel[n_clients], 1);
+            ep_linux_unix_attach_reader(&client_tunnel[n_clients], &clients[n_clients]);
+            ep_linux_unix_attach_writer(&client_tunnel[n_clients], &clients[n_clients]);
+            client_tunnel[n_clients].reader.timeout_ms = 10;
+        }
+    }
+
+    /* every client says hello, which is how a datagram server learns them */
+    void join()
+    {
+        uint8_t hello[8] = {MAVLINK_STX}, buf[64];
+        for (size_t i = 0; i < n_clients; i++)
+        {
+            ASSERT_EQ(client_tunnel[i].writer.write(&client_tunnel[i].writer, hello, sizeof(hello)),
+                MERR_OK);
+        }
+        size_t n = 0;
+        for (int i = 0; i < 20 && n < n_clients; i++)
+        {
+            n += server_tunnel.reader.read(&server_tunnel.reader, buf, sizeof(buf)) > 0;
+        }
+        ASSERT_EQ(n, n_clients);
+        ASSERT_EQ(server.n_peers, n_clients);
+    }
+
+    void keeps_boundaries()
+    {
+        uint8_t frame[100] = {MAVLINK_STX}, buf[256];
+        for (size_t len : {10, 100, 1})
+        {
+            ASSERT_EQ(client_tunnel[0].writer.write(&client_tunnel[0].writer, frame, len), MERR_OK);
+        }
+        for (ssize_t len : {10, 100, 1})
+        {
+            ssize_t n;
+            while ((n = server_tunnel.reader.read(&server_tunnel.reader, buf, sizeof(buf))) == 0)
+            {
+            }
+            EXPECT_EQ(n, len);
+        }
+    }
+
+    void writes_reach_every_client()
+    {
+        uint8_t frame[32] = {MAVLINK_STX, 5}, buf[64];
+        ASSERT_EQ(server_tunnel.writer.write(&server_tunnel.writer, frame, sizeof(frame)), MERR_OK);
+        for (size_t i = 0; i < n_clients; i++)
+        {
+            ASSERT_EQ(client_tunnel[i].reader.read(&client_tunnel[i].reader, buf, sizeof(buf)),
+                sizeof(frame));
+            EXPECT_EQ(buf[1], 5);
+        }
+        EXPECT_EQ(server.tx_messages, n_clients);
+    }
+
+    void client_leaves()
+    {
+        ep_linux_unix_destroy(&clients[--n_clients]);
+        uint8_t frame[32] = {MAVLINK_STX}, buf[64];
+        server_tunnel.writer.write(&server_tunnel.writer, frame, sizeof(frame));
+        server_tunnel.reader.read(&server_tunnel.reader, buf, sizeof(buf));
+        EXPECT_EQ(server.n_peers, n_clients);
+        EXPECT_EQ(server.left, 1);
+    }
+};
+
+TEST_F(EndpointLinuxUnixTest, seqpacket)
+{
+    start(EP_UNIX_SEQPACKET);
+    join();
+    keeps_boundaries();
+    writes_reach_every_client();
+    client_leaves();
+}
+
+TEST_F(EndpointLinuxUnixTest, dgram)
+{
+    start(EP_UNIX_DGRAM);
+    join();
+    keeps_boundaries();
+    writes_reach_every_client();
+    client_leaves();
+}
+
+TEST_F(EndpointLinuxUnixTest, socket_file)
+{
+    const char* path = "./mavtunnel-test.sock";
+    start(EP_UNIX_SEQPACKET, path);
+    struct stat st;
+    ASSERT_EQ(stat(path, &st), 0);
+    EXPECT_TRUE(S_ISSOCK(st.st_mode));
+
+    ep_linux_unix_destroy(&server);
+    EXPECT_NE(stat(path, &st), 0);
+
+    /* a file left behind does not stop the next server */
+    ASSERT_EQ(mknod(path, S_IFSOCK | 0600, 0), 0);
+    ASSERT_EQ(ep_linux_unix_init(&server, EP_UNIX_SEQPACKET, EP_UNIX_SERVER, path), MERR_OK);
+
+    /* a live one does, and keeps its socket file */
+    struct endpoint_linux_unix_t second;
+    EXPECT_EQ(ep_linux_unix_init(&second, EP_UNIX_SEQPACKET, EP_UNIX_SERVER, path),
+        MERR_DEVICE_ERROR);
+    ep_linux_unix_destroy(&second);
+    EXPECT_EQ(ep_linux_unix_init(&second, EP_UNIX_DGRAM, EP_UNIX_SERVER, path),
+        MERR_DEVICE_ERROR);
+    ep_linux_unix_destroy(&second);
+    EXPECT_EQ(stat(path, &st), 0);
+}
+
+TEST_F(EndpointLinuxUnixTest, server_gone)
+{
+    start(EP_UNIX_SEQPACKET);
+    join();
+    ep_linux_unix_destroy(&server);
+    ASSERT_EQ(ep_linux_unix_init(&server, EP_UNIX_DGRAM, EP_UNIX_SERVER, "@mavtunnel-other"),
+        MERR_OK);
+
+    uint8_t buf[64];
+    EXPECT_EQ(client_tunnel[0].reader.read(&client_tunnel[0].reader, buf, sizeof(buf)),
+        -MERR_END);
+}
+
+TEST_F(EndpointLinuxUnixTest, interrupt)
+{
+    start(EP_UNIX_DGRAM);
+    uint8_t buf[64];
+    server_tunnel.reader.timeout_ms = -1;
+    ep_linux_unix_interrupt(&server);
+    EXPECT_EQ(server_tunnel.reader.read(&server_tunnel.reader, buf, sizeof(buf)), -MERR_END);
+}
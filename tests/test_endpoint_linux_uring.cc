@@ -0,0 +1,169 @@
+#include <gtest/gtest.h>
+#include <endpoint_linux_uart.h>
+#include <endpoint_linux_udp.h>
+#include <endpoint_linux_uring.h>
+#include <pty.h>
+
+#include <unistd.h>
+
+#define SERVER_PORT 14670
+
+struct mavtunnel_t            tunnel;
+struct endpoint_linux_udp_t   udp;
+struct endpoint_linux_uring_t ring;
+
+class EndpointLinuxUringTest : public ::testing::Test
+{
+public:
+    int client = -1;
+
+    void TearDown() override
+    {
+        ep_linux_uring_destroy(&ring);
+        ep_linux_udp_destroy(&udp);
+        if (client >= 0)
+        {
+            close(client);
+        }
+    }
+
+    void start(unsigned flags)
+    {
+        mavtunnel_init(&tunnel, 0);
+        ASSERT_EQ(ep_linux_udp_init(&udp, SERVER_PORT), MERR_OK);
+        ASSERT_EQ(ep_linux_uring_init(&ring, udp.fd, EP_URING_DATAGRAM, flags), MERR_OK);
+        ep_linux_uring_attach_reader(&tunnel, &ring);
+        ep_linux_uring_attach_writer(&tunnel, &ring);
+        tunnel.reader.timeout_ms = 100;
+
+        struct sockaddr_in addr {};
+        addr.sin_family      = AF_INET;
+        addr.sin_port        = htons(SERVER_PORT);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        client               = socket(AF_INET, SOCK_DGRAM, 0);
+        connect(client, (struct sockaddr*)&addr, sizeof(addr));
+    }
+};
+
+TEST_F(EndpointLinuxUringTest, udp_echo)
+{
+    start(0);
+    uint8_t frame[32] = {MAVLINK_STX, 1, 2, 3}, buf[64];
+    send(client, frame, sizeof(frame), 0);
+
+    ASSERT_EQ(tunnel.reader.read(&tunnel.reader, buf, sizeof(buf)), sizeof(frame));
+    EXPECT_EQ(memcmp(buf, frame, sizeof(frame)), 0);
+
+    ASSERT_EQ(tunnel.writer.write(&tunnel.writer, frame, 16), MERR_OK);
+    usleep(10000);
+    EXPECT_EQ(recv(client, buf, sizeof(buf), MSG_DONTWAIT), 16);
+    EXPECT_EQ(memcmp(buf, frame, 16), 0);
+}
+
+TEST_F(EndpointLinuxUringTest, udp_burst_is_reaped_without_syscalls)
+{
+    start(0);
+    for (uint8_t i = 0; i < 20; i++)
+    {
+        uint8_t frame[16] = {MAVLINK_STX, i};
+        send(client, frame, sizeof(frame), 0);
+    }
+    usleep(10000);
+
+    uint64_t enters = ring.rx.enters;
+    for (uint8_t i = 0; i < 20; i++)
+    {
+        uint8_t buf[64];
+        ASSERT_EQ(tunnel.reader.read(&tunnel.reader, buf, sizeof(buf)), 16);
+        EXPECT_EQ(buf[1], i);
+    }
+    /* the multishot receive posted them all ahead of the reads */
+    EXPECT_EQ(ring.rx.enters, enters);
+    EXPECT_EQ(ring.rx_completions, 20);
+}
+
+TEST_F(EndpointLinuxUringTest, sqpoll_writes)
+{
+    start(EP_URING_SQPOLL);
+    uint8_t frame[16] = {MAVLINK_STX}, buf[64];
+    send(client, frame, sizeof(frame), 0);
+    ASSERT_EQ(tunnel.reader.read(&tunnel.reader, buf, sizeof(buf)), sizeof(frame));
+
+    for (uint8_t i = 0; i < 2 * EP_URING_TX_SLOTS; i++)
+    {
+        frame[1] = i;
+        ASSERT_EQ(tunnel.writer.write(&tunnel.writer, frame, sizeof(frame)), MERR_OK);
+    }
+    usleep(50000);
+    for (uint8_t i = 0; i < 2 * EP_URING_TX_SLOTS; i++)
+    {
+        ASSERT_EQ(recv(client, buf, sizeof(buf), MSG_DONTWAIT), sizeof(frame));
+        EXPECT_EQ(buf[1], i);
+    }
+    EXPECT_EQ(ring.tx_errors, 0);
+}
+
+TEST_F(EndpointLinuxUringTest, timeout_and_interrupt)
+{
+    start(0);
+    uint8_t buf[64];
+    tunnel.reader.timeout_ms = 10;
+    EXPECT_EQ(tunnel.reader.read(&tunnel.reader, buf, sizeof(buf)), 0);
+
+    ep_linux_uring_interrupt(&ring);
+    EXPECT_EQ(tunnel.reader.read(&tunnel.reader, buf, sizeof(buf)), -MERR_END);
+    EXPECT_TRUE(atomic_load(&ring.terminated));
+}
+
+TEST(EndpointLinuxUringUartTest, stream_round_trip)
+{
+    int  master, slave;
+    char pts[256];
+    ASSERT_EQ(openpty(&master, &slave, pts, nullptr, nullptr), 0);
+    struct termios tio;
+    tcgetattr(master, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(master, TCSANOW, &tio);
+
+    struct endpoint_linux_uart_t uart;
+    ASSERT_EQ(ep_linux_uart_init(&uart, pts), 0);
+    ASSERT_EQ(ep_linux_uring_init(&ring, uart.fd, EP_URING_STREAM, 0), MERR_OK);
+    mavtunnel_init(&tunnel, 0);
+    ep_linux_uring_attach_reader(&tunnel, &ring);
+    ep_linux_uring_attach_writer(&tunnel, &ring);
+    tunnel.reader.timeout_ms = 100;
+
+    /* a read larger than the caller's buffer is handed out in pieces */
+    uint8_t data[100], buf[64];
+    for (size_t i = 0; i < sizeof(data); i++)
+    {
+        data[i] = (uint8_t)i;
+    }
+    ASSERT_EQ(write(master, data, sizeof(data)), (ssize_t)sizeof(data));
+    size_t got = 0;
+    while (got < sizeof(data))
+    {
+        ssize_t n = tunnel.reader.read(&tunnel.reader, buf, 40);
+        ASSERT_GT(n, 0);
+        EXPECT_EQ(memcmp(buf, data + got, n), 0);
+        got += n;
+    }
+
+    for (size_t i = 0; i < 4; i++)
+    {
+        ASSERT_EQ(tunnel.writer.write(&tunnel.writer, data + 25 * i, 25), MERR_OK);
+    }
+    got = 0;
+    while (got < sizeof(data))
+    {
+        ssize_t n = read(master, buf, sizeof(buf));
+        ASSERT_GT(n, 0);
+        EXPECT_EQ(memcmp(buf, data + got, n), 0);
+        got += n;
+    }
+
+    ep_linux_uring_destroy(&ring);
+    ep_linux_uart_destroy(&uart);
+    close(master);
+    close(slave);
+}
@@ -0,0 +1,143 @@
+#include <gtest/gtest.h>
+#include <endpoint_linux_xdp.h>
+
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define SERVER_PORT 14680
+#define VETH_HOST   "mtxdp0"
+#define VETH_TUNNEL "mtxdp1"
+
+struct mavtunnel_t          tunnel;
+struct endpoint_linux_xdp_t ep;
+
+/**
+ * The endpoint serves one end of a veth pair; the test injects and
+ * captures Ethernet frames on the other end.
+ */
+class EndpointLinuxXdpTest : public ::testing::Test
+{
+public:
+    int           host = -1;
+    struct ethhdr eth_template {};
+
+    void SetUp() override
+    {
+        if (system("ip link add " VETH_HOST " type veth peer name " VETH_TUNNEL
+                   " 2>/dev/null && ip link set " VETH_HOST " up && ip link set " VETH_TUNNEL
+                   " up")
+            != 0)
+        {
+            GTEST_SKIP() << "needs CAP_NET_ADMIN to create a veth pair";
+        }
+
+        host = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_IP));
+        struct sockaddr_ll addr {};
+        addr.sll_family   = AF_PACKET;
+        addr.sll_protocol = htons(ETH_P_IP);
+        addr.sll_ifindex  = if_nametoindex(VETH_HOST);
+        ASSERT_EQ(bind(host, (struct sockaddr*)&addr, sizeof(addr)), 0);
+
+        mavtunnel_init(&tunnel, 0);
+        ASSERT_EQ(ep_linux_xdp_init(&ep, VETH_TUNNEL, 0, SERVER_PORT, 0), MERR_OK);
+        ep_linux_xdp_attach_reader(&tunnel, &ep);
+        ep_linux_xdp_attach_writer(&tunnel, &ep);
+        tunnel.reader.timeout_ms = 100;
+
+        memset(eth_template.h_dest, 0xff, ETH_ALEN);
+        eth_template.h_source[0] = 0x02;
+        eth_template.h_source[5] = 0x01;
+        eth_template.h_proto     = htons(ETH_P_IP);
+    }
+
+    void TearDown() override
+    {
+        if (host < 0)
+        {
+            return;
+        }
+        ep_linux_xdp_destroy(&ep);
+        close(host);
+        system("ip link del " VETH_HOST);
+    }
+
+    void inject(uint16_t dport, const uint8_t* payload, size_t len)
+    {
+        uint8_t        frame[1514] {};
+        struct iphdr*  ip  = (struct iphdr*)(frame + ETH_HLEN);
+        struct udphdr* udp = (struct udphdr*)(ip + 1);
+        memcpy(frame, &eth_template, ETH_HLEN);
+        ip->version  = 4;
+        ip->ihl      = 5;
+        ip->tot_len  = htons(28 + len);
+        ip->ttl      = 64;
+        ip->protocol = IPPROTO_UDP;
+        ip->saddr    = inet_addr("10.77.0.1");
+        ip->daddr    = inet_addr("10.77.0.2");
+        udp->source  = htons(40000);
+        udp->dest    = htons(dport);
+        udp->len     = htons(8 + len);
+        memcpy(udp + 1, payload, len);
+        ASSERT_EQ(send(host, frame, EP_XDP_HEADERS + len, 0), (ssize_t)(EP_XDP_HEADERS + len));
+    }
+};
+
+TEST_F(EndpointLinuxXdpTest, receives_tunnel_datagrams)
+{
+    uint8_t frame[32] = {MAVLINK_STX, 1, 2, 3}, buf[64];
+    inject(SERVER_PORT, frame, sizeof(frame));
+
+    ASSERT_EQ(tunnel.reader.read(&tunnel.reader, buf, sizeof(buf)), sizeof(frame));
+    EXPECT_EQ(memcmp(buf, frame, sizeof(frame)), 0);
+    EXPECT_EQ(ntohs(ep.client.sin_port), 40000);
+    EXPECT_EQ(ep.client.sin_addr.s_addr, inet_addr("10.77.0.1"));
+}
+
+TEST_F(EndpointLinuxXdpTest, other_traffic_passes_to_the_kernel)
+{
+    uint8_t frame[32] = {MAVLINK_STX}, buf[64];
+    inject(SERVER_PORT + 1, frame, sizeof(frame));
+    EXPECT_EQ(tunnel.reader.read(&tunnel.reader, buf, sizeof(buf)), 0);
+    EXPECT_EQ(ep.rx_packets, 0);
+}
+
+TEST_F(EndpointLinuxXdpTest, replies_mirror_the_headers)
+{
+    uint8_t frame[32] = {MAVLINK_STX, 7}, buf[1514];
+    inject(SERVER_PORT, frame, sizeof(frame));
+    ASSERT_EQ(tunnel.reader.read(&tunnel.reader, buf, sizeof(buf)), sizeof(frame));
+    ASSERT_EQ(tunnel.writer.write(&tunnel.writer, frame, 16), MERR_OK);
+
+    /* skip whatever else the kernel sends on a fresh link */
+    for (int i = 0; i < 100; i++)
+    {
+        ssize_t n = recv(host, buf, sizeof(buf), 0);
+        ASSERT_GT(n, 0);
+        struct iphdr*  ip  = (struct iphdr*)(buf + ETH_HLEN);
+        struct udphdr* udp = (struct udphdr*)(ip + 1);
+        if (ip->protocol != IPPROTO_UDP || udp->source != htons(SERVER_PORT))
+        {
+            continue;
+        }
+        EXPECT_EQ(n, EP_XDP_HEADERS + 16);
+        EXPECT_EQ(memcmp(buf, eth_template.h_source, ETH_ALEN), 0);
+        EXPECT_EQ(ip->saddr, inet_addr("10.77.0.2"));
+        EXPECT_EQ(ip->daddr, inet_addr("10.77.0.1"));
+        EXPECT_EQ(udp->dest, htons(40000));
+        EXPECT_EQ(memcmp(udp + 1, frame, 16), 0);
+        return;
+    }
+    FAIL() << "no reply";
+}
+
+TEST_F(EndpointLinuxXdpTest, interrupt)
+{
+    uint8_t buf[64];
+    ep_linux_xdp_interrupt(&ep);
+    EXPECT_EQ(tunnel.reader.read(&tunnel.reader, buf, sizeof(buf)), -MERR_END);
+}
@@ -0,0 +1,199 @@
+#include <gtest/gtest.h>
+#include <codec_passthrough.h>
+#include <endpoint_loopback.h>
+
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+class EndpointLoopbackTest : public ::testing::Test
+{
+public:
+    struct endpoint_loopback_pair_t loop {};
+    struct mavtunnel_t              a {}, b {};
+
+    void TearDown() override { ep_loopback_pair_destroy(&loop); }
+
+    void start(enum ep_loopback_kind_t kind, size_t ring_size = 0)
+    {
+        ASSERT_EQ(ep_loopback_pair_init(&loop, kind, ring_size), MERR_OK);
+        mavtunnel_init(&a, 0);
+        mavtunnel_init(&b, 1);
+        ep_loopback_attach_reader(&a, &loop.end[0]);
+        ep_loopback_attach_writer(&a, &loop.end[0]);
+        ep_loopback_attach_reader(&b, &loop.end[1]);
+        ep_loopback_attach_writer(&b, &loop.end[1]);
+        a.reader.timeout_ms = b.reader.timeout_ms = 0;
+    }
+
+    static std::vector<uint8_t> frame(uint8_t custom_mode)
+    {
+        mavlink_message_t msg;
+        uint8_t           buf[MAVLINK_MAX_PACKET_LEN];
+        mavlink_msg_heartbeat_pack(1, 1, &msg, MAV_TYPE_QUADROTOR, MAV_AUTOPILOT_ARDUPILOTMEGA, 0,
+            custom_mode, MAV_STATE_ACTIVE);
+        size_t len = mavlink_msg_to_send_buffer(buf, &msg);
+        return std::vector<uint8_t>(buf, buf + len);
+    }
+
+    static ssize_t read(struct mavtunnel_t* t, uint8_t* buf, size_t len)
+    {
+        return t->reader.read(&t->reader, buf, len);
+    }
+
+    static enum mavtunnel_error_t write(struct mavtunnel_t* t, const std::vector<uint8_t>& bytes)
+    {
+        return t->writer.write(&t->writer, bytes.data(), bytes.size());
+    }
+};
+
+TEST_F(EndpointLoopbackTest, bytes_stream)
+{
+    start(EP_LOOPBACK_BYTES);
+    auto f0 = frame(0), f1 = frame(1);
+    ASSERT_EQ(write(&a, f0), MERR_OK);
+    ASSERT_EQ(write(&a, f1), MERR_OK);
+
+    /* both writes come out as one stream, in reads of any size */
+    uint8_t buf[128];
+    EXPECT_EQ(read(&b, buf, 5), 5);
+    EXPECT_EQ(read(&b, buf + 5, sizeof(buf) - 5), (ssize_t)(f0.size() + f1.size() - 5));
+    std::vector<uint8_t> expected = f0;
+    expected.insert(expected.end(), f1.begin(), f1.end());
+    EXPECT_EQ(std::vector<uint8_t>(buf, buf + expected.size()), expected);
+
+    /* nothing in the other direction */
+    EXPECT_EQ(read(&a, buf, sizeof(buf)), 0);
+    EXPECT_EQ(read(&b, buf, sizeof(buf)), 0);
+}
+
+TEST_F(EndpointLoopbackTest, datagrams_keep_boundaries)
+{
+    start(EP_LOOPBACK_DATAGRAM);
+    auto f0 = frame(0), f1 = frame(1);
+    ASSERT_EQ(write(&b, f0), MERR_OK);
+    ASSERT_EQ(write(&b, f1), MERR_OK);
+
+    uint8_t buf[128];
+    ASSERT_EQ(read(&a, buf, sizeof(buf)), (ssize_t)f0.size());
+    EXPECT_EQ(std::vector<uint8_t>(buf, buf + f0.size()), f0);
+    /* a short read cuts the datagram */
+    ASSERT_EQ(read(&a, buf, 4), 4);
+    EXPECT_EQ(std::vector<uint8_t>(buf, buf + 4), std::vector<uint8_t>(f1.begin(), f1.begin() + 4));
+    EXPECT_EQ(read(&a, buf, sizeof(buf)), 0);
+}
+
+TEST_F(EndpointLoopbackTest, full_ring_drops_and_wraps)
+{
+    start(EP_LOOPBACK_DATAGRAM, 64);
+    auto    f = frame(7);
+    uint8_t buf[128];
+    for (int round = 0; round < 10; round++)
+    {
+        /* 2 + 21 bytes each: two fit, the third does not */
+        ASSERT_EQ(write(&a, f), MERR_OK);
+        ASSERT_EQ(write(&a, f), MERR_OK);
+        ASSERT_EQ(write(&a, f), MERR_OK);
+        for (int i = 0; i < 2; i++)
+        {
+            ASSERT_EQ(read(&b, buf, sizeof(buf)), (ssize_t)f.size());
+            EXPECT_EQ(std::vector<uint8_t>(buf, buf + f.size()), f);
+        }
+        EXPECT_EQ(read(&b, buf, sizeof(buf)), 0);
+    }
+    EXPECT_EQ(loop.end[0].tx_dropped, 10u);
+}
+
+TEST_F(EndpointLoopbackTest, bad_ring_size)
+{
+    EXPECT_EQ(ep_loopback_pair_init(&loop, EP_LOOPBACK_BYTES, 1000), MERR_BAD_LENGTH);
+}
+
+TEST_F(EndpointLoopbackTest, read_timeout_and_interrupt)
+{
+    start(EP_LOOPBACK_BYTES);
+    uint8_t buf[16];
+
+    b.reader.timeout_ms = 20;
+    uint64_t start      = time_us();
+    EXPECT_EQ(read(&b, buf, sizeof(buf)), 0);
+    EXPECT_GE(time_us() - start, 20000u);
+
+    b.reader.timeout_ms = -1;
+    std::thread t([this] {
+        usleep(20000);
+        ep_loopback_interrupt(&loop.end[1]);
+    });
+    EXPECT_EQ(read(&b, buf, sizeof(buf)), -MERR_END);
+    t.join();
+}
+
+TEST_F(EndpointLoopbackTest, blocked_read_sleeps_until_write)
+{
+    start(EP_LOOPBACK_DATAGRAM);
+    auto    f = frame(1);
+    uint8_t buf[MAVLINK_MAX_PACKET_LEN];
+
+    b.reader.timeout_ms = -1;
+    ssize_t  n   = 0;
+    uint64_t cpu = 0;
+    std::thread reader([&] {
+        n = read(&b, buf, sizeof(buf));
+        struct timespec ts;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+        cpu = ts.tv_sec * 1000000ull + ts.tv_nsec / 1000;
+    });
+    usleep(50000);
+    ASSERT_EQ(write(&a, f), MERR_OK);
+    reader.join();
+
+    EXPECT_EQ(n, (ssize_t)f.size());
+    /* it slept through most of the wait rather than polling */
+    EXPECT_LT(cpu, 25000u);
+}
+
+TEST_F(EndpointLoopbackTest, tunnel_between_threads)
+{
+    /* a -> tunnel -> b, with the tunnel on its own thread */
+    struct endpoint_loopback_pair_t out;
+    struct mavtunnel_t              tunnel;
+    start(EP_LOOPBACK_BYTES);
+    ASSERT_EQ(ep_loopback_pair_init(&out, EP_LOOPBACK_BYTES, 0), MERR_OK);
+    mavtunnel_init(&tunnel, 2);
+    ep_loopback_attach_reader(&tunnel, &loop.end[1]);
+    ep_loopback_attach_writer(&tunnel, &out.end[0]);
+    codec_passthrough_attach(&tunnel);
+    std::thread spinner([&] { mavtunnel_spin(&tunnel); });
+
+    const int            n = 1000;
+    std::vector<uint8_t> sent;
+    for (int i = 0; i < n; i++)
+    {
+        auto f = frame(i);
+        /* the ring drops what does not fit, so wait for the tunnel */
+        uint64_t dropped = loop.end[0].tx_dropped;
+        while (write(&a, f) == MERR_OK && loop.end[0].tx_dropped != dropped)
+        {
+            dropped = loop.end[0].tx_dropped;
+        }
+        sent.insert(sent.end(), f.begin(), f.end());
+    }
+
+    struct mavtunnel_t sink;
+    mavtunnel_init(&sink, 3);
+    ep_loopback_attach_reader(&sink, &out.end[1]);
+    sink.reader.timeout_ms = 1000;
+    std::vector<uint8_t> received;
+    uint8_t              buf[1024];
+    ssize_t              len;
+    while (received.size() < sent.size() && (len = read(&sink, buf, sizeof(buf))) > 0)
+    {
+        received.insert(received.end(), buf, buf + len);
+    }
+    ep_loopback_interrupt(&loop.end[1]);
+    spinner.join();
+    ep_loopback_pair_destroy(&out);
+
+    /* same frames, re-finalized by the tunnel */
+    EXPECT_EQ(received.size(), sent.size());
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <vector>
+#include "tunnel.h"
+
+/**
+ * In-memory readers and writers, to run tunnels back to back in a test.
+ *
+ * A byte_pipe_t is a stream: a write appends, a read takes what is left
+ * after the last read, up to len bytes.
+ *
+ * A frame_pipe_t is a datagram link: a write is one frame, a read takes
+ * one, or returns 0 when there is none. log has every frame written,
+ * frames what is still to be read of those lose(index) let through. A
+ * pipe that is down fails its writes.
+ */
+typedef std::vector<uint8_t> frame_t;
+
+struct byte_pipe_t
+{
+    std::vector<uint8_t> bytes;
+    size_t               pos    = 0;
+    size_t               writes = 0;
+
+    void clear()
+    {
+        bytes.clear();
+        pos = writes = 0;
+    }
+    bool drained() const { return pos >= bytes.size(); }
+};
+
+static inline ssize_t
+byte_pipe_read(struct mavtunnel_reader_t* rd, uint8_t* bytes, size_t len)
+{
+    auto*  pipe = (byte_pipe_t*)rd->object;
+    size_t n    = std::min(len, pipe->bytes.size() - pipe->pos);
+    memcpy(bytes, pipe->bytes.data() + pipe->pos, n);
+    pipe->pos += n;
+    return (ssize_t)n;
+}
+
+static inline enum mavtunnel_error_t
+byte_pipe_write(struct mavtunnel_writer_t* wr, const uint8_t* bytes, size_t len)
+{
+    auto* pipe = (byte_pipe_t*)wr->object;
+    pipe->bytes.insert(pipe->bytes.end(), bytes, bytes + len);
+    pipe->writes++;
+    return MERR_OK;
+}
+
+struct frame_pipe_t
+{
+    std::deque<frame_t>         frames;
+    std::vector<frame_t>        log;
+    size_t                      sent = 0, lost = 0;
+    bool                        down = false;
+    std::function<bool(size_t)> lose = [](size_t) { return false; };
+};
+
+static inline ssize_t
+frame_pipe_read(struct mavtunnel_reader_t* rd, uint8_t* bytes, size_t len)
+{
+    auto* pipe = (frame_pipe_t*)rd->object;
+    if (pipe->frames.empty())
+    {
+        return 0;
+    }
+    frame_t frame = pipe->frames.front();
+    pipe->frames.pop_front();
+    size_t n = std::min(len, frame.size());
+    memcpy(bytes, frame.data(), n);
+    return (ssize_t)n;
+}
+
+static inline enum mavtunnel_error_t
+frame_pipe_write(struct mavtunnel_writer_t* wr, const uint8_t* bytes, size_t len)
+{
+    auto* pipe = (frame_pipe_t*)wr->object;
+    if (pipe->down)
+    {
+        return MERR_DEVICE_ERROR;
+    }
+    pipe->log.emplace_back(bytes, bytes + len);
+    if (pipe->lose(pipe->sent++))
+    {
+        pipe->lost++;
+    }
+    else
+    {
+        pipe->frames.emplace_back(bytes, bytes + len);
+    }
+    return MERR_OK;
+}
+
+static inline void
+pipe_attach_reader(struct mavtunnel_t* ctx, byte_pipe_t* pipe)
+{
+    ctx->reader.object = pipe;
+    ctx->reader.read   = byte_pipe_read;
+}
+
+static inline void
+pipe_attach_reader(struct mavtunnel_t* ctx, frame_pipe_t* pipe)
+{
+    ctx->reader.object = pipe;
+    ctx->reader.read   = frame_pipe_read;
+}
+
+static inline void
+pipe_attach_writer(struct mavtunnel_t* ctx, byte_pipe_t* pipe)
+{
+    ctx->writer.object = pipe;
+    ctx->writer.write  = byte_pipe_write;
+}
+
+static inline void
+pipe_attach_writer(struct mavtunnel_t* ctx, frame_pipe_t* pipe)
+{
+    ctx->writer.object = pipe;
+    ctx->writer.write  = frame_pipe_write;
+}
@@ -0,0 +1,206 @@
+#include <gtest/gtest.h>
+#include <relay_linux.h>
+#include <pty.h>
+
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <termios.h>
+#include <unistd.h>
+
+struct relay_linux_t relay;
+
+class RelayLinuxTest : public ::testing::Test
+{
+public:
+    /* [0]: the relay's side, [1]: the test's side */
+    int in[2] = {-1, -1}, out[2] = {-1, -1};
+
+    void TearDown() override
+    {
+        relay_linux_destroy(&relay);
+        for (int fd : {in[0], in[1], out[0], out[1]})
+        {
+            if (fd >= 0)
+            {
+                close(fd);
+            }
+        }
+    }
+
+    void sockets()
+    {
+        ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, in), 0);
+        ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, out), 0);
+    }
+
+    static void raw_pty(int fds[2])
+    {
+        struct termios options;
+        ASSERT_EQ(openpty(&fds[1], &fds[0], nullptr, nullptr, nullptr), 0);
+        tcgetattr(fds[0], &options);
+        cfmakeraw(&options);
+        tcsetattr(fds[0], TCSANOW, &options);
+        fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    }
+
+    static std::vector<uint8_t> frames(size_t n)
+    {
+        std::vector<uint8_t> bytes;
+        for (size_t i = 0; i < n; i++)
+        {
+            mavlink_message_t msg;
+            uint8_t           buf[MAVLINK_MAX_PACKET_LEN];
+            mavlink_msg_heartbeat_pack(1, 1, &msg, MAV_TYPE_QUADROTOR, MAV_AUTOPILOT_ARDUPILOTMEGA,
+                0, i, MAV_STATE_ACTIVE);
+            size_t len = mavlink_msg_to_send_buffer(buf, &msg);
+            bytes.insert(bytes.end(), buf, buf + len);
+        }
+        return bytes;
+    }
+
+    /* push bytes through the relay and collect what comes out */
+    std::vector<uint8_t> forward(const std::vector<uint8_t>& bytes, size_t chunk)
+    {
+        std::vector<uint8_t> received(bytes.size());
+        size_t               n_received = 0;
+        for (size_t sent = 0; sent < bytes.size(); sent += chunk)
+        {
+            size_t len = std::min(chunk, bytes.size() - sent);
+            EXPECT_EQ(write(in[1], bytes.data() + sent, len), (ssize_t)len);
+            EXPECT_EQ(relay_linux_spin_once(&relay, 1000), MERR_OK);
+            for (int i = 0; i < 100 && n_received < sent + len; i++)
+            {
+                ssize_t n = read(out[1], received.data() + n_received, bytes.size() - n_received);
+                if (n > 0)
+                {
+                    n_received += n;
+                }
+                else
+                {
+                    usleep(1000);
+                }
+            }
+        }
+        received.resize(n_received);
+        return received;
+    }
+};
+
+TEST_F(RelayLinuxTest, splice)
+{
+    sockets();
+    ASSERT_EQ(relay_linux_init(&relay, in[0], out[0], 0), MERR_OK);
+
+    auto bytes = frames(100);
+    EXPECT_EQ(forward(bytes, 700), bytes);
+    EXPECT_TRUE(relay.use_splice);
+    EXPECT_EQ(relay.bytes, bytes.size());
+    EXPECT_EQ(relay.frames, 0);
+}
+
+TEST_F(RelayLinuxTest, pty)
+{
+    raw_pty(in);
+    raw_pty(out);
+    ASSERT_EQ(relay_linux_init(&relay, in[0], out[0], 0), MERR_OK);
+
+    /* whether the tty splices depends on the kernel; the bytes get through
+       either way */
+    auto bytes = frames(20);
+    EXPECT_EQ(forward(bytes, 100), bytes);
+    EXPECT_EQ(relay.bytes, bytes.size());
+}
+
+TEST_F(RelayLinuxTest, check_all)
+{
+    sockets();
+    ASSERT_EQ(relay_linux_init(&relay, in[0], out[0], 1), MERR_OK);
+    EXPECT_FALSE(relay.use_splice);
+
+    auto bytes = frames(10);
+    /* a broken CRC in the sixth frame, which still goes through */
+    size_t frame_len = bytes.size() / 10;
+    bytes[6 * frame_len - 1] ^= 0xff;
+    EXPECT_EQ(forward(bytes, 64), bytes);
+    EXPECT_EQ(relay.frames, 9);
+    EXPECT_EQ(relay.bad_frames, 1);
+}
+
+TEST_F(RelayLinuxTest, check_sampled)
+{
+    sockets();
+    ASSERT_EQ(relay_linux_init(&relay, in[0], out[0], 4), MERR_OK);
+
+    /* one chunk per spin, each a whole number of frames */
+    auto   bytes     = frames(80);
+    size_t frame_len = bytes.size() / 80;
+    EXPECT_EQ(forward(bytes, 5 * frame_len), bytes);
+    EXPECT_TRUE(relay.use_splice);
+    EXPECT_EQ(relay.chunks, 16);
+    EXPECT_EQ(relay.frames, 4 * 5);
+    EXPECT_EQ(relay.bad_frames, 0);
+}
+
+TEST_F(RelayLinuxTest, slow_output)
+{
+    sockets();
+    int size = 4096;
+    setsockopt(out[0], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    ASSERT_EQ(relay_linux_init(&relay, in[0], out[0], 0), MERR_OK);
+
+    /* more than the output takes at once: the relay waits for it */
+    auto                 bytes = frames(2000);
+    std::vector<uint8_t> received;
+    std::thread          reader([&]() {
+        uint8_t buf[4096];
+        while (received.size() < bytes.size())
+        {
+            ssize_t n = read(out[1], buf, sizeof(buf));
+            if (n > 0)
+            {
+                received.insert(received.end(), buf, buf + n);
+            }
+            else
+            {
+                usleep(1000);
+            }
+        }
+    });
+    for (size_t sent = 0; sent < bytes.size();)
+    {
+        ssize_t n = write(in[1], bytes.data() + sent, bytes.size() - sent);
+        if (n > 0)
+        {
+            sent += n;
+        }
+        ASSERT_EQ(relay_linux_spin_once(&relay, 1000), MERR_OK);
+    }
+    reader.join();
+    EXPECT_EQ(received, bytes);
+}
+
+TEST_F(RelayLinuxTest, end)
+{
+    sockets();
+    ASSERT_EQ(relay_linux_init(&relay, in[0], out[0], 0), MERR_OK);
+    EXPECT_EQ(relay_linux_spin_once(&relay, 0), MERR_OK);
+
+    close(in[1]);
+    in[1] = -1;
+    EXPECT_EQ(relay_linux_spin_once(&relay, 1000), MERR_END);
+}
+
+TEST_F(RelayLinuxTest, interrupt)
+{
+    sockets();
+    ASSERT_EQ(relay_linux_init(&relay, in[0], out[0], 0), MERR_OK);
+    std::thread stopper([]() {
+        usleep(10000);
+        relay_linux_interrupt(&relay);
+    });
+    relay_linux_spin(&relay);
+    stopper.join();
+    EXPECT_EQ(relay_linux_spin_once(&relay, 0), MERR_END);
+}
@@ -0,0 +1,179 @@
+#include <gtest/gtest.h>
+#include <router.h>
+#include <codec_passthrough.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "test_pipe.hpp"
+
+enum
+{
+    GCS,
+    AUTOPILOT,
+    COMPANION,
+    LOGGER,
+    N_PORTS,
+};
+
+struct mavtunnel_t        port[N_PORTS];
+struct mavtunnel_router_t router;
+
+class RouterTest : public ::testing::Test
+{
+public:
+    /* what each endpoint sends, and what it receives */
+    frame_pipe_t in[N_PORTS], out[N_PORTS];
+
+    void SetUp() override
+    {
+        mavtunnel_router_init(&router);
+        for (size_t i = 0; i < N_PORTS; i++)
+        {
+            mavtunnel_init(&port[i], i);
+            codec_passthrough_attach(&port[i]);
+            pipe_attach_reader(&port[i], &in[i]);
+            pipe_attach_writer(&port[i], &out[i]);
+            mavtunnel_router_add_port(&router, &port[i]);
+        }
+    }
+
+    frame_t send(size_t from, mavlink_message_t* msg)
+    {
+        uint8_t buf[MAVLINK_MAX_PACKET_LEN];
+        size_t  len = mavlink_msg_to_send_buffer(buf, msg);
+        in[from].frames.emplace_back(buf, buf + len);
+        mavtunnel_spin_once(&port[from]);
+        return frame_t(buf, buf + len);
+    }
+
+    frame_t heartbeat(size_t from, uint8_t sysid, uint8_t compid)
+    {
+        mavlink_message_t msg;
+        mavlink_msg_heartbeat_pack(sysid, compid, &msg, MAV_TYPE_QUADROTOR,
+            MAV_AUTOPILOT_ARDUPILOTMEGA, 1, 0, 3);
+        return send(from, &msg);
+    }
+
+    frame_t command(size_t from, uint8_t target_system,
+        uint8_t target_component, uint8_t sysid = 255, uint8_t compid = 190)
+    {
+        mavlink_message_t msg;
+        mavlink_msg_command_long_pack(sysid, compid, &msg, target_system,
+            target_component, MAV_CMD_REQUEST_AUTOPILOT_CAPABILITIES, 0, 1, 0,
+            0, 0, 0, 0, 0);
+        return send(from, &msg);
+    }
+
+    /* ports that received something since the last call */
+    std::vector<size_t> receivers()
+    {
+        std::vector<size_t> got;
+        for (size_t i = 0; i < N_PORTS; i++)
+        {
+            if (!out[i].log.empty())
+            {
+                got.push_back(i);
+                out[i].log.clear();
+            }
+        }
+        return got;
+    }
+};
+
+TEST_F(RouterTest, broadcast_reaches_all_other_ports)
+{
+    frame_t frame = heartbeat(AUTOPILOT, 1, 1);
+
+    EXPECT_EQ(out[GCS].log, std::vector<frame_t> {frame});
+    EXPECT_EQ(receivers(), (std::vector<size_t> {GCS, COMPANION, LOGGER}));
+    EXPECT_EQ(router.broadcast, 1);
+}
+
+TEST_F(RouterTest, targeted_by_learned_routes)
+{
+    heartbeat(AUTOPILOT, 1, 1);
+    heartbeat(COMPANION, 1, 191);
+    heartbeat(GCS, 255, 190);
+    receivers();
+
+    frame_t frame = command(GCS, 1, 1);
+    EXPECT_EQ(out[AUTOPILOT].log, std::vector<frame_t> {frame});
+    EXPECT_EQ(receivers(), std::vector<size_t> {AUTOPILOT});
+
+    command(GCS, 1, 191);
+    EXPECT_EQ(receivers(), std::vector<size_t> {COMPANION});
+
+    /* the whole system, or a component not heard of yet */
+    command(GCS, 1, 0);
+    EXPECT_EQ(receivers(), (std::vector<size_t> {AUTOPILOT, COMPANION}));
+    command(GCS, 1, 100);
+    EXPECT_EQ(receivers(), (std::vector<size_t> {AUTOPILOT, COMPANION}));
+
+    /* never back where it came from */
+    command(COMPANION, 1, 191, 1, 191);
+    EXPECT_TRUE(receivers().empty());
+
+    command(AUTOPILOT, 255, 190, 1, 1);
+    EXPECT_EQ(receivers(), std::vector<size_t> {GCS});
+}
+
+TEST_F(RouterTest, unknown_target_dropped)
+{
+    command(GCS, 7, 1);
+    EXPECT_TRUE(receivers().empty());
+    EXPECT_EQ(router.unroutable, 1);
+
+    command(GCS, 0, 0);
+    EXPECT_EQ(receivers(), (std::vector<size_t> {AUTOPILOT, COMPANION, LOGGER}));
+}
+
+TEST_F(RouterTest, route_follows_component)
+{
+    heartbeat(AUTOPILOT, 1, 1);
+    receivers();
+    command(GCS, 1, 1);
+    EXPECT_EQ(receivers(), std::vector<size_t> {AUTOPILOT});
+
+    /* the autopilot moved to the companion's link */
+    heartbeat(COMPANION, 1, 1);
+    receivers();
+    command(GCS, 1, 1);
+    EXPECT_EQ(receivers(), std::vector<size_t> {COMPANION});
+}
+
+static std::atomic<bool> gcs_stuck;
+
+static enum mavtunnel_error_t
+stuck_write(struct mavtunnel_writer_t* wr, const uint8_t* bytes, size_t len)
+{
+    while (gcs_stuck.load())
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return frame_pipe_write(wr, bytes, len);
+}
+
+TEST_F(RouterTest, slow_port_does_not_hold_up_others)
+{
+    heartbeat(AUTOPILOT, 1, 1);
+    receivers();
+
+    /* the GCS link blocks a broadcast on its way to the other ports */
+    gcs_stuck                      = true;
+    router.ports[GCS].writer.write = stuck_write;
+    mavlink_message_t msg;
+    mavlink_msg_heartbeat_pack(1, 191, &msg, MAV_TYPE_QUADROTOR,
+        MAV_AUTOPILOT_ARDUPILOTMEGA, 1, 0, 3);
+    std::thread broadcast([this, &msg] { send(COMPANION, &msg); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+    frame_t frame = command(LOGGER, 1, 1);
+    EXPECT_EQ(out[AUTOPILOT].log, std::vector<frame_t> {frame});
+
+    gcs_stuck = false;
+    broadcast.join();
+    EXPECT_EQ(out[GCS].log.size(), 1);
+    EXPECT_EQ(out[AUTOPILOT].log.size(), 2);
+}
@@ -0,0 +1,175 @@
+#include <gtest/gtest.h>
+#include <writer_set.h>
+#include <endpoint_linux_udp_fanout.h>
+#include <codec_chacha20.h>
+
+#include <vector>
+#include <unistd.h>
+#include "test_pipe.hpp"
+
+/* counts the frames the tunnel codec encrypts */
+static size_t   encrypted;
+static encode_t chacha_encode;
+
+static enum mavtunnel_error_t
+counting_encode(struct mavtunnel_codec_t* codec, mavlink_message_t* msg)
+{
+    encrypted++;
+    return chacha_encode(codec, msg);
+}
+
+struct mavtunnel_t             tunnel;
+struct stream_cipher_t         cipher;
+struct mavtunnel_writer_set_t  subscribers;
+
+class WriterSetTest : public ::testing::Test
+{
+public:
+    frame_pipe_t local;
+
+    void SetUp() override
+    {
+        mavtunnel_init(&tunnel, 0);
+        codec_chacha20_attach(&tunnel, &cipher);
+        chacha_encode        = tunnel.codec.encode;
+        tunnel.codec.encode  = counting_encode;
+        encrypted            = 0;
+        pipe_attach_reader(&tunnel, &local);
+
+        mavtunnel_writer_set_init(&subscribers);
+        mavtunnel_writer_set_attach(&tunnel, &subscribers);
+    }
+
+    static void add(frame_pipe_t* pipe)
+    {
+        struct mavtunnel_writer_t writer = {pipe, frame_pipe_write};
+        mavtunnel_writer_set_add(&subscribers, &writer);
+    }
+
+    void send(size_t n)
+    {
+        mavlink_message_t msg;
+        uint8_t           buf[MAVLINK_MAX_PACKET_LEN];
+        for (size_t i = 0; i < n; i++)
+        {
+            mavlink_msg_heartbeat_pack(1, 1, &msg, MAV_TYPE_QUADROTOR,
+                MAV_AUTOPILOT_ARDUPILOTMEGA, 1, (uint32_t)i, 3);
+            size_t len = mavlink_msg_to_send_buffer(buf, &msg);
+            local.frames.emplace_back(buf, buf + len);
+            mavtunnel_spin_once(&tunnel);
+        }
+    }
+};
+
+TEST_F(WriterSetTest, encrypts_once_for_all_subscribers)
+{
+    frame_pipe_t gcs[4];
+    for (auto& pipe : gcs)
+    {
+        add(&pipe);
+    }
+    send(8);
+
+    EXPECT_EQ(encrypted, 8);
+    EXPECT_EQ(subscribers.frames, 8);
+    for (auto& pipe : gcs)
+    {
+        EXPECT_EQ(pipe.log, gcs[0].log);
+        EXPECT_EQ(pipe.log.size(), 8);
+    }
+}
+
+TEST_F(WriterSetTest, failing_subscriber_isolated)
+{
+    frame_pipe_t gcs[3];
+    for (auto& pipe : gcs)
+    {
+        add(&pipe);
+    }
+    gcs[1].down = true;
+    send(4);
+
+    EXPECT_EQ(gcs[0].log.size(), 4);
+    EXPECT_EQ(gcs[2].log.size(), 4);
+    EXPECT_EQ(subscribers.members[1].errors, 4);
+    EXPECT_EQ(subscribers.members[2].frames, 4);
+
+    uint8_t frame[] = {MAVLINK_STX};
+    gcs[0].down = gcs[2].down = true;
+    EXPECT_EQ(tunnel.writer.write(&tunnel.writer, frame, sizeof(frame)),
+        MERR_DEVICE_ERROR);
+}
+
+TEST_F(WriterSetTest, udp_peers_in_one_syscall)
+{
+    const size_t n_peers = 4;
+    int          peers[n_peers];
+
+    struct endpoint_linux_udp_fanout_t udp;
+    ASSERT_EQ(ep_linux_udp_fanout_init(&udp, 0), MERR_OK);
+    for (size_t i = 0; i < n_peers; i++)
+    {
+        peers[i] = socket(AF_INET, SOCK_DGRAM, 0);
+        struct sockaddr_in addr {};
+        addr.sin_family      = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        ASSERT_EQ(bind(peers[i], (struct sockaddr*)&addr, sizeof(addr)), 0);
+        socklen_t addr_len = sizeof(addr);
+        getsockname(peers[i], (struct sockaddr*)&addr, &addr_len);
+        ASSERT_EQ(ep_linux_udp_fanout_add_peer(&udp, "127.0.0.1", ntohs(addr.sin_port)),
+            MERR_OK);
+    }
+
+    struct mavtunnel_t udp_tunnel;
+    ep_linux_udp_fanout_attach_writer(&udp_tunnel, &udp);
+    frame_pipe_t local_copy;
+    add(&local_copy);
+    mavtunnel_writer_set_add(&subscribers, &udp_tunnel.writer);
+    send(3);
+
+    EXPECT_EQ(udp.syscalls, 3);
+    EXPECT_EQ(udp.datagrams, 3 * n_peers);
+    for (size_t i = 0; i < n_peers; i++)
+    {
+        for (auto& expected : local_copy.log)
+        {
+            uint8_t buf[MAVLINK_MAX_PACKET_LEN];
+            ssize_t n = recv(peers[i], buf, sizeof(buf), MSG_DONTWAIT);
+            EXPECT_EQ(frame_t(buf, buf + (n > 0 ? n : 0)), expected);
+        }
+        close(peers[i]);
+    }
+    ep_linux_udp_fanout_destroy(&udp);
+}
+
+TEST_F(WriterSetTest, udp_fails_when_no_peer_takes_it)
+{
+    struct endpoint_linux_udp_fanout_t udp;
+    ASSERT_EQ(ep_linux_udp_fanout_init(&udp, 0), MERR_OK);
+
+    /* broadcast without SO_BROADCAST is refused */
+    ASSERT_EQ(ep_linux_udp_fanout_add_peer(&udp, "255.255.255.255", 14550), MERR_OK);
+    struct mavtunnel_t udp_tunnel;
+    ep_linux_udp_fanout_attach_writer(&udp_tunnel, &udp);
+    uint8_t frame[] = {MAVLINK_STX};
+    EXPECT_EQ(udp_tunnel.writer.write(&udp_tunnel.writer, frame, sizeof(frame)),
+        MERR_DEVICE_ERROR);
+    EXPECT_EQ(udp.errors, 1);
+
+    /* one peer that takes it is enough */
+    int peer = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in addr {};
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ASSERT_EQ(bind(peer, (struct sockaddr*)&addr, sizeof(addr)), 0);
+    socklen_t addr_len = sizeof(addr);
+    getsockname(peer, (struct sockaddr*)&addr, &addr_len);
+    ASSERT_EQ(ep_linux_udp_fanout_add_peer(&udp, "127.0.0.1", ntohs(addr.sin_port)),
+        MERR_OK);
+    EXPECT_EQ(udp_tunnel.writer.write(&udp_tunnel.writer, frame, sizeof(frame)),
+        MERR_OK);
+    EXPECT_EQ(udp.errors, 2);
+
+    close(peer);
+    ep_linux_udp_fanout_destroy(&udp);
+}
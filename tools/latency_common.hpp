@@ -421,4 +421,10 @@ public:
         }
         printf("client %s:%d connected\n", inet_ntoa(addr.sin_addr), ntohs(addr.sin_port));
     }
+
+    ~UDPSendRecvMonitor() override
+    {
+        interrupt_send();
+        interrupt_recv();
+    }
 };
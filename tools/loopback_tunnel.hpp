@@ -0,0 +1,171 @@
+#pragma once
+
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "codec_aggregate.h"
+#include "codec_chacha20.h"
+#include "endpoint_linux_udp.h"
+#include "endpoint_linux_udp_client.h"
+#include "tunnel.h"
+
+/**
+ * An encrypting tunnel pair run inside the profiling tool, so that a sweep
+ * can reconfigure it between runs:
+ *
+ *   monitor tx port <-> up (encode) -> relay port -> down (decode) -> monitor
+ *                                                                   rx port
+ *
+ * A negative deadline leaves frame aggregation off.
+ */
+class LoopbackTunnel
+{
+protected:
+    static constexpr uint16_t RELAY_PORT = 16550;
+
+    struct mavtunnel_t                 up {}, down {};
+    struct endpoint_linux_udp_client_t ep_tx {}, ep_relay_tx {}, ep_rx {};
+    struct endpoint_linux_udp_t        ep_relay_rx {};
+    struct stream_cipher_t             encrypt {}, decrypt {};
+    struct codec_aggregate_t           packer {}, splitter {};
+    std::unique_ptr<std::thread>       up_thread {}, down_thread {};
+    uint16_t                           port_send, port_recv;
+    int64_t                            deadline_us;
+
+    static void spin(struct mavtunnel_t* ctx)
+    {
+        enum mavtunnel_error_t err = MERR_OK;
+        while (err != MERR_END && !atomic_load(&ctx->terminate))
+        {
+            err = mavtunnel_spin_once(ctx);
+        }
+    }
+
+public:
+    LoopbackTunnel(uint16_t port_send, uint16_t port_recv, int64_t deadline_us)
+        : port_send(port_send), port_recv(port_recv), deadline_us(deadline_us)
+    {
+    }
+
+    ~LoopbackTunnel() { stop(); }
+
+    /* the monitor has to listen on both of its ports before this connects */
+    void start()
+    {
+        mavtunnel_init(&up, 2);
+        mavtunnel_init(&down, 3);
+
+        if (ep_linux_udp_init(&ep_relay_rx, RELAY_PORT) != MERR_OK
+            || ep_linux_udp_client_init(&ep_tx, "127.0.0.1", port_send) != MERR_OK
+            || ep_linux_udp_client_init(&ep_relay_tx, "127.0.0.1", RELAY_PORT) != MERR_OK
+            || ep_linux_udp_client_init(&ep_rx, "127.0.0.1", port_recv) != MERR_OK)
+        {
+            throw std::runtime_error("could not set up the loopback tunnel");
+        }
+
+        ep_linux_udp_client_attach_reader(&up, &ep_tx);
+        ep_linux_udp_client_attach_writer(&up, &ep_relay_tx);
+        codec_chacha20_attach(&up, &encrypt);
+
+        ep_linux_udp_attach_reader(&down, &ep_relay_rx);
+        ep_linux_udp_client_attach_writer(&down, &ep_rx);
+        codec_chacha20_attach(&down, &decrypt);
+
+        if (deadline_us >= 0)
+        {
+            codec_aggregate_attach(&up, &packer, MT_CODEC_ENCODE,
+                (uint64_t)deadline_us, 0);
+            codec_aggregate_attach(&down, &splitter, MT_CODEC_DECODE,
+                (uint64_t)deadline_us, 0);
+        }
+
+        up_thread   = std::make_unique<std::thread>(spin, &up);
+        down_thread = std::make_unique<std::thread>(spin, &down);
+    }
+
+    void stop()
+    {
+        if (!up_thread)
+        {
+            return;
+        }
+        mavtunnel_exit(&up);
+        mavtunnel_exit(&down);
+        ep_linux_udp_client_interrupt(&ep_tx);
+        ep_linux_udp_interrupt(&ep_relay_rx);
+        up_thread->join();
+        down_thread->join();
+        up_thread.reset();
+        down_thread.reset();
+
+        ep_linux_udp_client_destroy(&ep_tx);
+        ep_linux_udp_client_destroy(&ep_relay_tx);
+        ep_linux_udp_client_destroy(&ep_rx);
+        ep_linux_udp_destroy(&ep_relay_rx);
+    }
+
+    uint64_t superframes() const { return packer.superframes; }
+    uint64_t wire_frames() const { return up.count[MT_PERF_SENT_COUNT]; }
+    uint64_t wire_bytes() const { return up.count[MT_PERF_SENT_BYTE]; }
+
+    /**
+     * Starts the tunnel once the monitor, constructed by make(), is
+     * listening, i.e. while it waits for the tunnel to connect.
+     */
+    template <typename Monitor, typename Make>
+    static std::unique_ptr<Monitor> connect(LoopbackTunnel& tunnel, Make make)
+    {
+        std::thread starter(
+            [&tunnel]()
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(200));
+                tunnel.start();
+            });
+        std::unique_ptr<Monitor> monitor(make());
+        starter.join();
+        return monitor;
+    }
+};
+
+/**
+ * Takes "--sweep-deadline-us=<us>[,<us>...]" out of argv, "off" for no
+ * aggregation. Returns the deadlines, empty if the option is not given.
+ */
+static inline std::vector<int64_t>
+parse_deadline_sweep(int& argc, char** argv)
+{
+    static const std::string option = "--sweep-deadline-us=";
+    std::vector<int64_t>     deadlines;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg.compare(0, option.size(), option) != 0)
+        {
+            continue;
+        }
+
+        std::string list = arg.substr(option.size());
+        size_t      pos  = 0;
+        while (pos <= list.size())
+        {
+            size_t      end  = std::min(list.find(',', pos), list.size());
+            std::string item = list.substr(pos, end - pos);
+            deadlines.push_back(item == "off" ? -1 : std::stoll(item));
+            pos = end + 1;
+        }
+
+        for (int k = i; k < argc - 1; k++)
+        {
+            argv[k] = argv[k + 1];
+        }
+        argc--;
+        i--;
+    }
+    return deadlines;
+}
@@ -0,0 +1,437 @@
+#include "codec_aggregate.h"
+#include "codec_chacha20.h"
+#include "codec_compact.h"
+#include "codec_delta.h"
+#include "codec_lz.h"
+#include "codec_passthrough.h"
+#include "endpoint_linux_tlog.h"
+#include "tunnel.h"
+
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+#include <getopt.h>
+#include <nlohmann/json.hpp>
+
+/* 115200 baud, 8N1: ten bits on the wire for every byte */
+static constexpr double LINK_BAUD          = 115200;
+static constexpr double LINK_BYTES_PER_SEC = LINK_BAUD / 10;
+
+static const char* statustexts[] = {
+    "PreArm: Compass not calibrated",
+    "PreArm: Need 3D Fix",
+    "EKF3 IMU0 is using GPS",
+    "EKF3 IMU1 is using GPS",
+    "Arming motors",
+    "Mission: 3 WP",
+    "Reached command #3",
+    "GPS 1: detected as u-blox at 230400 baud",
+};
+
+static const char* param_ids[] = {
+    "ARMING_CHECK",
+    "BATT_MONITOR",
+    "BATT_CAPACITY",
+    "COMPASS_OFS_X",
+    "COMPASS_OFS_Y",
+    "INS_ACC_OFFS_X",
+    "SERVO1_FUNCTION",
+    "RC1_MIN",
+    "RC1_MAX",
+    "WPNAV_SPEED",
+    "RTL_ALT",
+    "ATC_RAT_RLL_P",
+};
+
+using Traffic = std::vector<uint8_t>;
+
+static void
+append(Traffic& traffic, mavlink_message_t* msg)
+{
+    uint8_t buf[MAVLINK_MAX_PACKET_LEN];
+    size_t  len = mavlink_msg_to_send_buffer(buf, msg);
+    traffic.insert(traffic.end(), buf, buf + len);
+}
+
+static Traffic
+statustext_traffic(size_t n)
+{
+    Traffic           traffic;
+    mavlink_message_t msg;
+    for (size_t i = 0; i < n; i++)
+    {
+        mavlink_msg_statustext_pack(1, 1, &msg, MAV_SEVERITY_INFO,
+            statustexts[i % (sizeof(statustexts) / sizeof(statustexts[0]))],
+            0, 0);
+        append(traffic, &msg);
+    }
+    return traffic;
+}
+
+static Traffic
+param_value_traffic(size_t n)
+{
+    Traffic           traffic;
+    mavlink_message_t msg;
+    size_t            count = sizeof(param_ids) / sizeof(param_ids[0]);
+    for (size_t i = 0; i < n; i++)
+    {
+        mavlink_msg_param_value_pack(1, 1, &msg, param_ids[i % count],
+            (float)(i % 100), 9, (uint16_t)count, (uint16_t)(i % count));
+        append(traffic, &msg);
+    }
+    return traffic;
+}
+
+/* dataflash blocks: 0xA3 0x95 headers, slowly changing IMU samples */
+static Traffic
+logging_data_traffic(size_t n)
+{
+    Traffic                traffic;
+    mavlink_message_t      msg;
+    mavlink_logging_data_t data {};
+    for (size_t i = 0; i < n; i++)
+    {
+        data.sequence = (uint16_t)i;
+        data.length   = sizeof(data.data);
+        memset(data.data, 0, sizeof(data.data));
+        for (size_t off = 0; off + 24 <= sizeof(data.data); off += 24)
+        {
+            data.data[off]     = 0xA3;
+            data.data[off + 1] = 0x95;
+            data.data[off + 2] = 0x40;
+            data.data[off + 3] = (uint8_t)(i + off);
+            data.data[off + 8] = (uint8_t)(i >> 3);
+        }
+        mavlink_msg_logging_data_encode(1, 1, &msg, &data);
+        append(traffic, &msg);
+    }
+    return traffic;
+}
+
+/* 10 Hz ATTITUDE, 5 Hz GPS_RAW_INT and SERVO_OUTPUT_RAW of a hovering copter */
+static Traffic
+telemetry_traffic(size_t n)
+{
+    Traffic           traffic;
+    mavlink_message_t msg;
+    for (size_t i = 0; i < n; i++)
+    {
+        uint32_t t = (uint32_t)(i * 100);
+        mavlink_msg_attitude_pack(1, 1, &msg, t, 0.01f * (float)(i % 7),
+            -0.02f, 1.57f + 0.001f * (float)(i % 13), 0.001f, -0.002f, 0.0f);
+        append(traffic, &msg);
+
+        if (i % 2 == 0)
+        {
+            mavlink_msg_gps_raw_int_pack(1, 1, &msg, (uint64_t)t * 1000, 3,
+                -353632620 + (int32_t)(i % 5), 1491652370 - (int32_t)(i % 3),
+                584000 + (int32_t)(i % 11), 121, 160, 12, 9000, 14, 600000, 800,
+                1200, 300, 0, 0);
+            append(traffic, &msg);
+
+            mavlink_msg_servo_output_raw_pack(1, 1, &msg, t * 1000, 0,
+                1500 + (uint16_t)(i % 4), 1500 - (uint16_t)(i % 3),
+                1502 + (uint16_t)(i % 2), 1498, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                0, 0);
+            append(traffic, &msg);
+        }
+    }
+    return traffic;
+}
+
+struct MemoryLink
+{
+    const Traffic* input {};
+    size_t         pos {};
+    size_t         frames {}, bytes {};
+    Traffic        output {};
+};
+
+static ssize_t
+memory_read(struct mavtunnel_reader_t* rd, uint8_t* bytes, size_t len)
+{
+    auto*  link = (MemoryLink*)rd->object;
+    size_t n    = std::min(len, link->input->size() - link->pos);
+    if (n == 0)
+    {
+        return -MERR_END;
+    }
+    memcpy(bytes, link->input->data() + link->pos, n);
+    link->pos += n;
+    return (ssize_t)n;
+}
+
+static enum mavtunnel_error_t
+memory_write(struct mavtunnel_writer_t* wr, const uint8_t* bytes, size_t len)
+{
+    auto* link = (MemoryLink*)wr->object;
+    link->frames++;
+    link->bytes += len;
+    link->output.insert(link->output.end(), bytes, bytes + len);
+    return MERR_OK;
+}
+
+/* attach the same codec configuration to the sending and receiving tunnel */
+using Setup = std::function<void(struct mavtunnel_t*, enum mavtunnel_codec_dir_t)>;
+
+struct Codec
+{
+    const char*                     name;
+    Setup                           setup;
+    std::function<nlohmann::json()> stats {};
+    bool                            aggregate {};
+};
+
+static struct stream_cipher_t ciphers[2];
+static struct codec_lz_t      compressors[2];
+static struct codec_delta_t   deltas[2];
+static struct codec_aggregate_t aggregators[2];
+static struct codec_compact_t   compactors[2];
+
+static const uint16_t keyframe_interval = 50;
+
+/* frames arrive back to back here: super-frames are closed by the budget */
+static const uint64_t deadline_us = 1000000;
+
+static nlohmann::json
+delta_stats()
+{
+    nlohmann::json j = nlohmann::json::array();
+    for (auto& stat : deltas[MT_CODEC_ENCODE].stats)
+    {
+        if (!stat.used || stat.frames == 0)
+        {
+            continue;
+        }
+        nlohmann::json s = {
+            {"msgid",      stat.msgid                                    },
+            { "frames",    stat.frames                                   },
+            { "keyframes", stat.keyframes                                },
+            { "ratio",     (double)stat.bytes_out / (double)stat.bytes_in},
+        };
+#ifdef MAVTUNNEL_PROFILING
+        s["ns/frame"] = stat.timed ? stat.exec_time_ns / stat.timed : 0;
+#endif
+        j.push_back(s);
+    }
+    return j;
+}
+
+/* frames recorded by a capture, or any tlog, played as fast as they read */
+static Traffic
+tlog_traffic(const char* path)
+{
+    Traffic                        traffic;
+    struct endpoint_linux_replay_t replay;
+    struct mavtunnel_t             tunnel;
+    if (ep_linux_replay_init(&replay, path, 0) != MERR_OK)
+    {
+        ep_linux_replay_destroy(&replay);
+        return traffic;
+    }
+    mavtunnel_init(&tunnel, 0);
+    ep_linux_replay_attach_reader(&tunnel, &replay);
+
+    uint8_t buf[MAVLINK_MAX_PACKET_LEN];
+    ssize_t n;
+    while ((n = tunnel.reader.read(&tunnel.reader, buf, sizeof(buf))) > 0)
+    {
+        traffic.insert(traffic.end(), buf, buf + n);
+    }
+    ep_linux_replay_destroy(&replay);
+    return traffic;
+}
+
+static nlohmann::json
+run(const char* traffic_name, const Traffic& traffic, const Codec& codec)
+{
+    struct mavtunnel_t up, down;
+    MemoryLink         radio, gcs;
+
+    mavtunnel_init(&up, 0);
+    mavtunnel_init(&down, 1);
+    codec.setup(&up, MT_CODEC_ENCODE);
+    codec.setup(&down, MT_CODEC_DECODE);
+
+    radio.input      = &traffic;
+    up.reader.object = &radio;
+    up.reader.read   = memory_read;
+    up.writer.object = &radio;
+    up.writer.write  = memory_write;
+    while (mavtunnel_spin_once(&up) == MERR_OK) { }
+    if (codec.aggregate)
+    {
+        codec_aggregate_flush(&aggregators[MT_CODEC_ENCODE]);
+    }
+
+    gcs.input          = &radio.output;
+    down.reader.object = &gcs;
+    down.reader.read   = memory_read;
+    down.writer.object = &gcs;
+    down.writer.write  = memory_write;
+    while (mavtunnel_spin_once(&down) == MERR_OK) { }
+
+    bool   intact  = gcs.output == traffic;
+    double ratio   = (double)radio.bytes / (double)traffic.size();
+    double goodput = LINK_BYTES_PER_SEC / ratio;
+
+    printf("%-14s %-26s frames %6zu in %8zu B wire %8zu B ratio %.3f "
+           "goodput %8.1f B/s%s\n",
+        traffic_name, codec.name, radio.frames, traffic.size(), radio.bytes,
+        ratio, goodput, intact ? "" : " (MISMATCH)");
+
+    nlohmann::json j = {
+        {"traffic",          traffic_name  },
+        { "codec",           codec.name    },
+        { "frames",          radio.frames  },
+        { "input bytes",     traffic.size()},
+        { "wire bytes",      radio.bytes   },
+        { "ratio",           ratio         },
+        { "goodput (B/s)",   goodput       },
+        { "intact",          intact        },
+    };
+    if (codec.stats)
+    {
+        j["per msgid"] = codec.stats();
+    }
+    return j;
+}
+
+int
+main(int argc, char** argv)
+{
+    const size_t n    = 1000;
+    const char*  tlog = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "r:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 'r': tlog = optarg; break;
+        default:
+            printf("usage: %s [-r tlog or capture prefix] [label]\n", argv[0]);
+            return opt == 'h' ? 0 : -1;
+        }
+    }
+    const char* label = optind < argc ? argv[optind] : NULL;
+
+    std::vector<std::pair<const char*, Traffic>> traffics = {
+        {"STATUSTEXT",    statustext_traffic(n)  },
+        { "PARAM_VALUE",  param_value_traffic(n) },
+        { "LOGGING_DATA", logging_data_traffic(n)},
+        { "telemetry",    telemetry_traffic(n)   },
+    };
+
+    Traffic mix;
+    for (auto& t : traffics)
+    {
+        mix.insert(mix.end(), t.second.begin(), t.second.end());
+    }
+    traffics.emplace_back("mix", mix);
+    if (tlog != NULL)
+    {
+        Traffic recorded = tlog_traffic(tlog);
+        if (recorded.empty())
+        {
+            fprintf(stderr, "no frames in %s\n", tlog);
+            return -1;
+        }
+        traffics.emplace_back("recorded", recorded);
+    }
+
+    std::vector<Codec> codecs = {
+        {"passthrough",
+         [](struct mavtunnel_t* t, enum mavtunnel_codec_dir_t dir)
+         { codec_passthrough_attach(t); }},
+        { "chacha20",
+         [](struct mavtunnel_t* t, enum mavtunnel_codec_dir_t dir)
+         { codec_chacha20_attach(t, &ciphers[dir]); }},
+        { "lz+chacha20",
+         [](struct mavtunnel_t* t, enum mavtunnel_codec_dir_t dir)
+         {
+         codec_chacha20_attach(t, &ciphers[dir]);
+         codec_lz_attach(t, &compressors[dir], dir);
+         }},
+        { "delta+chacha20",
+         [](struct mavtunnel_t* t, enum mavtunnel_codec_dir_t dir)
+         {
+         codec_chacha20_attach(t, &ciphers[dir]);
+         codec_delta_attach(t, &deltas[dir], dir, keyframe_interval);
+         }, delta_stats},
+        { "delta+lz+chacha20",
+         [](struct mavtunnel_t* t, enum mavtunnel_codec_dir_t dir)
+         {
+         codec_chacha20_attach(t, &ciphers[dir]);
+         codec_delta_attach(t, &deltas[dir], dir, keyframe_interval);
+         codec_lz_attach(t, &compressors[dir], dir);
+         }, delta_stats},
+        { "agg+chacha20",
+         [](struct mavtunnel_t* t, enum mavtunnel_codec_dir_t dir)
+         {
+         codec_chacha20_attach(t, &ciphers[dir]);
+         codec_aggregate_attach(t, &aggregators[dir], dir, deadline_us, 0);
+         }, {}, true},
+        { "agg+compact+chacha20",
+         [](struct mavtunnel_t* t, enum mavtunnel_codec_dir_t dir)
+         {
+         codec_chacha20_attach(t, &ciphers[dir]);
+         codec_aggregate_attach(t, &aggregators[dir], dir, deadline_us, 0);
+         codec_compact_attach(t, &compactors[dir], dir);
+         }, {}, true},
+        { "delta+agg+compact+chacha20",
+         [](struct mavtunnel_t* t, enum mavtunnel_codec_dir_t dir)
+         {
+         codec_chacha20_attach(t, &ciphers[dir]);
+         codec_delta_attach(t, &deltas[dir], dir, keyframe_interval);
+         codec_aggregate_attach(t, &aggregators[dir], dir, deadline_us, 0);
+         codec_compact_attach(t, &compactors[dir], dir);
+         }, delta_stats, true},
+    };
+
+    nlohmann::json j;
+    j["description"] = "MAVTunnel codec goodput (emulated UART, 115200 8N1)";
+    if (label != NULL)
+    {
+        j["argument"] = label;
+    }
+    if (tlog != NULL)
+    {
+        j["recording"] = tlog;
+    }
+    j["unit"]                  = "Bytes / s";
+    j["link capacity (B/s)"]   = LINK_BYTES_PER_SEC;
+    j["messages for each group"] = n;
+    j["goodput"]               = nlohmann::json::array();
+    for (auto& t : traffics)
+    {
+        for (auto& c : codecs)
+        {
+            j["goodput"].push_back(run(t.first, t.second, c));
+        }
+    }
+
+    char        filename[128];
+    std::time_t now = std::time(nullptr);
+    std::tm*    tm  = std::localtime(&now);
+    if (label != NULL)
+    {
+        std::sprintf(filename, "%s-%s-%04d-%02d0-%02d-%02d%02d%02d.json",
+            argv[0], label, tm->tm_year + 1900, tm->tm_mon + 1, tm->tm_mday,
+            tm->tm_hour, tm->tm_min, tm->tm_sec);
+    }
+    else
+    {
+        std::sprintf(filename, "%s-%04d-%02d0-%02d-%02d%02d%02d.json", argv[0],
+            tm->tm_year + 1900, tm->tm_mon + 1, tm->tm_mday, tm->tm_hour,
+            tm->tm_min, tm->tm_sec);
+    }
+    std::ofstream out(filename);
+    out << j.dump(4) << std::endl;
+    out.flush();
+    out.close();
+
+    return 0;
+}
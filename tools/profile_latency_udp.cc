@@ -1,20 +1,12 @@
 #include "latency_common.hpp"
+#include "loopback_tunnel.hpp"
 #include <fstream>
 #include <nlohmann/json.hpp>
 
-int
-main(int argc, char** argv)
+static nlohmann::json
+latency_json(const SendRecvStatistics& statistics)
 {
-    UDPSendRecvMonitor monitor(100, 14550, 15550);
-    monitor.run(5000);
-
-    auto           statistics = monitor.statistics();
     nlohmann::json j;
-    j["description"] = "MAVTunnel end to end latency (UDP, Pi4)";
-    if (argc > 1)
-    {
-        j["argument"] = argv[1];
-    }
     j["total_tx"] = statistics.total_tx;
     j["total_rx"] = statistics.total_rx;
     j["drops"]    = statistics.drops;
@@ -24,6 +16,46 @@ main(int argc, char** argv)
         { "max",  statistics.latency.max },
         { "mean", statistics.latency.mean}
     };
+    return j;
+}
+
+int
+main(int argc, char** argv)
+{
+    auto deadlines = parse_deadline_sweep(argc, argv);
+
+    nlohmann::json j;
+    j["description"] = "MAVTunnel end to end latency (UDP, Pi4)";
+    if (argc > 1)
+    {
+        j["argument"] = argv[1];
+    }
+
+    if (deadlines.empty())
+    {
+        UDPSendRecvMonitor monitor(100, 14550, 15550);
+        monitor.run(5000);
+        j.update(latency_json(monitor.statistics()));
+    }
+    else
+    {
+        /* run the tunnel in-process, once for every aggregation deadline */
+        j["sweep"] = nlohmann::json::array();
+        for (auto deadline : deadlines)
+        {
+            LoopbackTunnel tunnel(14550, 15550, deadline);
+            auto monitor = LoopbackTunnel::connect<UDPSendRecvMonitor>(tunnel,
+                []() { return new UDPSendRecvMonitor(100, 14550, 15550); });
+            monitor->run(5000);
+            tunnel.stop();
+
+            auto entry = latency_json(monitor->statistics());
+            entry["deadline (us)"] = deadline;
+            entry["wire frames"]   = tunnel.wire_frames();
+            entry["super-frames"]  = tunnel.superframes();
+            j["sweep"].push_back(entry);
+        }
+    }
 
     char        filename[128];
     std::time_t now = std::time(nullptr);
@@ -1,43 +1,144 @@
 #include "throughput_common.hpp"
+#include "throughput_json.hpp"
 #include <fstream>
+#include <string>
+#include <vector>
+#include <getopt.h>
 #include <nlohmann/json.hpp>
 
+static void
+usage(const char* prog)
+{
+    printf("usage: %s [-s send device] [-r recv device] [-b baud[,baud...]]\n"
+           "          [-f] [-l] [-m vmin] [-t vtime] [-z read size] [label]\n"
+           "          [--offered-msgps=rate,... | --offered-bps=rate,...]\n"
+           "          [--payload=bytes] [--step-seconds=s]\n"
+           "          [--mix=arducopter|profile|tlog] [--mix-scale=x,...]\n"
+           "  -f  RTS/CTS flow control\n"
+           "  -l  low latency mode\n"
+           "  --offered-*  open-loop load steps instead of the stop-and-wait sweep\n"
+           "  --mix        open-loop traffic mix, see traffic_mix.hpp\n",
+        prog);
+}
+
 int
 main(int argc, char** argv)
 {
-    SerialThroughputMonitor monitor("/dev/ttyUART_IO1", "/dev/ttyUART_IO2");
-    monitor.run(500, 0, 240, 32);
+    const char*              f_send = "/dev/ttyUART_IO1";
+    const char*              f_recv = "/dev/ttyUART_IO2";
+    std::vector<uint32_t>    bauds;
+    ep_uart_options_t        options = EP_UART_OPTIONS_DEFAULT;
+    LoadSweep                sweep   = parse_load_sweep(argc, argv);
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:r:b:flm:t:z:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 's': f_send = optarg; break;
+        case 'r': f_recv = optarg; break;
+        case 'b':
+            for (char* baud = strtok(optarg, ","); baud != NULL; baud = strtok(NULL, ","))
+            {
+                bauds.push_back(strtoul(baud, NULL, 10));
+            }
+            break;
+        case 'f': options.rtscts = true; break;
+        case 'l': options.low_latency = true; break;
+        case 'm': options.vmin = atoi(optarg); break;
+        case 't': options.vtime = atoi(optarg); break;
+        case 'z': options.read_size = strtoul(optarg, NULL, 10); break;
+        default: usage(argv[0]); return opt == 'h' ? 0 : -1;
+        }
+    }
+    if (bauds.empty())
+    {
+        bauds.push_back(options.baud);
+    }
+    const char* label = optind < argc ? argv[optind] : NULL;
+
+    TrafficMix mix;
+    if (!sweep.mix.empty() && !load_traffic_mix(sweep.mix, mix))
+    {
+        return -1;
+    }
 
     nlohmann::json j;
-    j["description"] = "MAVTunnel Throughput (UART, 115200, Pi4)";
-    if (argc > 1)
+    j["description"] = "MAVTunnel Throughput (UART)";
+    if (label != NULL)
     {
-        j["argument"] = argv[1];
+        j["argument"] = label;
     }
     j["unit"] = "Bytes / s";
-    j["messages for each group"] = 100;
-    j["payload size range start"] = 0;
-    j["payload size range end"] = 240;
-    j["payload size range step"] = 32;
-    j["throughput"] = nlohmann::json::array();
-    for (auto& t : monitor.get_metrics().entries)
-    {
-        j["throughput"].push_back({
-            {"payload size", t->payload_size},
-            {"throughput (B/s)", t->throughput_bps()},
-            {"throughput msg/s", t->throughput_msgps()},
-            {"drop rate (B/s)", t->drop_rate_bps()},
-            {"drop rate %", t->drop_rate_percent()},
-        });
+    if (!sweep.mix.empty())
+    {
+        j["mix"] = mix.name;
+        j["mix profile"] = mix.profile();
+        j["seconds for each step"] = sweep.seconds;
+    }
+    else if (sweep.loads.empty())
+    {
+        j["messages for each group"] = 500;
+        j["payload size range start"] = 0;
+        j["payload size range end"] = 240;
+        j["payload size range step"] = 32;
+    }
+    else
+    {
+        j["payload size"] = sweep.payload_size;
+        j["seconds for each step"] = sweep.seconds;
+    }
+    j["rtscts"] = options.rtscts;
+    j["low latency"] = options.low_latency;
+    j["vmin"] = options.vmin;
+    j["vtime"] = options.vtime;
+    j["read size"] = options.read_size;
+    j["runs"] = nlohmann::json::array();
+
+    for (uint32_t baud : bauds)
+    {
+        options.baud = baud;
+        SerialThroughputMonitor monitor(f_send, f_recv, &options);
+        printf("baud %u (driver reports %u)\n", baud, monitor.baud());
+
+        nlohmann::json run;
+        run["baud"] = baud;
+        run["achieved baud"] = monitor.baud();
+        if (!sweep.mix.empty())
+        {
+            run["mix steps"] = mix_steps_json(monitor.run_mix(mix, sweep));
+            j["runs"].push_back(run);
+            continue;
+        }
+        if (!sweep.loads.empty())
+        {
+            run["load steps"] = load_steps_json(monitor.run_open_loop(sweep));
+            j["runs"].push_back(run);
+            continue;
+        }
+
+        monitor.run(500, 0, 240, 32);
+        run["throughput"] = nlohmann::json::array();
+        for (auto& t : monitor.get_metrics().entries)
+        {
+            run["throughput"].push_back({
+                {"payload size", t->payload_size},
+                {"throughput (B/s)", t->throughput_bps()},
+                {"throughput msg/s", t->throughput_msgps()},
+                {"drop rate (B/s)", t->drop_rate_bps()},
+                {"drop rate %", t->drop_rate_percent()},
+            });
+        }
+        j["runs"].push_back(run);
     }
 
     char        filename[128];
     std::time_t now = std::time(nullptr);
     std::tm*    tm  = std::localtime(&now);
-    if (argc > 1)
+    if (label != NULL)
     {
         std::sprintf(filename, "%s-%s-%04d-%02d0-%02d-%02d%02d%02d.json",
-            argv[0], argv[1], tm->tm_year + 1900, tm->tm_mon + 1, tm->tm_mday,
+            argv[0], label, tm->tm_year + 1900, tm->tm_mon + 1, tm->tm_mday,
             tm->tm_hour, tm->tm_min, tm->tm_sec);
     }
     else
@@ -1,12 +1,37 @@
+#include "loopback_tunnel.hpp"
 #include "throughput_common.hpp"
+#include "throughput_json.hpp"
 #include <fstream>
 #include <nlohmann/json.hpp>
 
+static nlohmann::json
+throughput_json(ThroughputMonitor& monitor)
+{
+    nlohmann::json j = nlohmann::json::array();
+    for (auto& t : monitor.get_metrics().entries)
+    {
+        j.push_back({
+            {"payload size", t->payload_size},
+            {"throughput (B/s)", t->throughput_bps()},
+            {"throughput msg/s", t->throughput_msgps()},
+            {"drop rate (B/s)", t->drop_rate_bps()},
+            {"drop rate %", t->drop_rate_percent()},
+        });
+    }
+    return j;
+}
+
 int
 main(int argc, char** argv)
 {
-    UDPThroughputMonitor monitor(14550, 15550);
-    monitor.run(100, 0, 240, 32);
+    auto deadlines = parse_deadline_sweep(argc, argv);
+    auto sweep     = parse_load_sweep(argc, argv);
+
+    TrafficMix mix;
+    if (!sweep.mix.empty() && !load_traffic_mix(sweep.mix, mix))
+    {
+        return -1;
+    }
 
     nlohmann::json j;
     j["description"] = "MAVTunnel Throughput (UART, 115200, Pi4)";
@@ -15,20 +40,71 @@ main(int argc, char** argv)
         j["argument"] = argv[1];
     }
     j["unit"] = "Bytes / s";
-    j["messages for each group"] = 100;
-    j["payload size range start"] = 0;
-    j["payload size range end"] = 240;
-    j["payload size range step"] = 32;
-    j["throughput"] = nlohmann::json::array();
-    for (auto& t : monitor.get_metrics().entries)
+    if (!sweep.mix.empty())
     {
-        j["throughput"].push_back({
-            {"payload size", t->payload_size},
-            {"throughput (B/s)", t->throughput_bps()},
-            {"throughput msg/s", t->throughput_msgps()},
-            {"drop rate (B/s)", t->drop_rate_bps()},
-            {"drop rate %", t->drop_rate_percent()},
-        });
+        j["mix"] = mix.name;
+        j["mix profile"] = mix.profile();
+        j["seconds for each step"] = sweep.seconds;
+    }
+    else if (sweep.loads.empty())
+    {
+        j["messages for each group"] = 100;
+        j["payload size range start"] = 0;
+        j["payload size range end"] = 240;
+        j["payload size range step"] = 32;
+    }
+    else
+    {
+        j["payload size"] = sweep.payload_size;
+        j["seconds for each step"] = sweep.seconds;
+    }
+
+    if (deadlines.empty() && !sweep.mix.empty())
+    {
+        UDPThroughputMonitor monitor(14550, 15550);
+        j["mix steps"] = mix_steps_json(monitor.run_mix(mix, sweep));
+    }
+    else if (deadlines.empty() && !sweep.loads.empty())
+    {
+        UDPThroughputMonitor monitor(14550, 15550);
+        j["load steps"] = load_steps_json(monitor.run_open_loop(sweep));
+    }
+    else if (deadlines.empty())
+    {
+        UDPThroughputMonitor monitor(14550, 15550);
+        monitor.run(100, 0, 240, 32);
+        j["throughput"] = throughput_json(monitor);
+    }
+    else
+    {
+        /* run the tunnel in-process, once for every aggregation deadline */
+        j["sweep"] = nlohmann::json::array();
+        for (auto deadline : deadlines)
+        {
+            LoopbackTunnel tunnel(14550, 15550, deadline);
+            auto monitor = LoopbackTunnel::connect<UDPThroughputMonitor>(tunnel,
+                []() { return new UDPThroughputMonitor(14550, 15550); });
+            nlohmann::json run;
+            if (!sweep.mix.empty())
+            {
+                run["mix steps"] = mix_steps_json(monitor->run_mix(mix, sweep));
+            }
+            else if (sweep.loads.empty())
+            {
+                monitor->run(100, 0, 240, 32);
+                run["throughput"] = throughput_json(*monitor);
+            }
+            else
+            {
+                run["load steps"] = load_steps_json(monitor->run_open_loop(sweep));
+            }
+            tunnel.stop();
+
+            run["deadline (us)"] = deadline;
+            run["wire frames"]   = tunnel.wire_frames();
+            run["super-frames"]  = tunnel.superframes();
+            j["sweep"].push_back(run);
+        }
     }
 
     char        filename[128];
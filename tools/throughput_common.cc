@@ -2,6 +2,13 @@
 
 #include "throughput_common.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <random>
+#include <thread>
+#include <unordered_map>
+
 ThroughputEntry::ThroughputEntry(size_t payload_size)
     : payload_size(payload_size)
 {
@@ -181,50 +188,448 @@ ThroughputMonitor::run(size_t n, size_t payload_sz_start, size_t payload_sz_end,
     }
 }
 
-#include <fcntl.h>
-#include <stdexcept>
-#include <sys/epoll.h>
-#include <termios.h>
-#include <unistd.h>
+static uint64_t
+steady_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
 
-void
-SerialThroughputMonitor::configure(int fd)
+static uint64_t
+percentile(const std::vector<uint64_t>& sorted, double p)
+{
+    if (sorted.empty())
+    {
+        return 0;
+    }
+    return sorted[std::min(sorted.size() - 1, (size_t)(p / 100 * sorted.size()))];
+}
+
+LoadStep
+ThroughputMonitor::open_loop_step(const OfferedLoad& load, size_t payload_sz, double seconds)
+{
+    LoadStep step;
+    step.offered      = load;
+    step.payload_size = std::min(std::max(payload_sz, LOAD_HEADER_LEN), sizeof(mavlink_logging_data_t::data));
+
+    mavlink_logging_data_t data {};
+    data.length = step.payload_size;
+    std::iota(data.data, data.data + step.payload_size, 0);
+    mavlink_reset_channel_status(MAVLINK_COMM_0);
+    mavlink_msg_logging_data_encode(1, 1, &tx_msg, &data);
+    step.frame_len = mavlink_msg_to_send_buffer(tx_buf, &tx_msg);
+
+    step.offered_msgps = load.bytes ? load.rate / step.frame_len : load.rate;
+    size_t n           = (size_t)(step.offered_msgps * seconds);
+    if (n == 0)
+    {
+        return step;
+    }
+
+    std::vector<uint8_t>  seen(n);
+    std::vector<uint64_t> latencies;
+    latencies.reserve(n);
+    std::atomic<bool>   receiving {true};
+    std::atomic<size_t> arrived {0};
+    uint64_t          last_rx_ns = 0;
+
+    memset(&rx_status, 0, sizeof(rx_status));
+    mavlink_reset_channel_status(MAVLINK_COMM_1);
+    std::thread receiver(
+        [&]()
+        {
+            mavlink_logging_data_t rx_data;
+            while (receiving.load())
+            {
+                ssize_t rv = recv(rx_buf, sizeof(rx_buf));
+                for (ssize_t i = 0; i < rv; i++)
+                {
+                    if (!mavlink_parse_char(MAVLINK_COMM_1, rx_buf[i], &rx_msg, &rx_status)
+                        || rx_msg.msgid != MAVLINK_MSG_ID_LOGGING_DATA)
+                    {
+                        continue;
+                    }
+                    uint64_t now = steady_ns();
+                    mavlink_msg_logging_data_decode(&rx_msg, &rx_data);
+                    uint32_t index;
+                    uint64_t sent_ns;
+                    memcpy(&index, rx_data.data, sizeof(index));
+                    memcpy(&sent_ns, rx_data.data + sizeof(index), sizeof(sent_ns));
+                    if (index >= n)
+                    {
+                        continue;
+                    }
+                    if (seen[index])
+                    {
+                        step.duplicates++;
+                        continue;
+                    }
+                    seen[index] = 1;
+                    step.received++;
+                    arrived++;
+                    latencies.push_back((now - sent_ns) / 1000);
+                    last_rx_ns = now;
+                }
+            }
+        });
+
+    /* on schedule, not on replies: a late frame does not delay the next */
+    uint64_t interval_ns = (uint64_t)(1e9 / step.offered_msgps);
+    uint64_t start_ns    = steady_ns();
+    for (uint32_t i = 0; i < n; i++)
+    {
+        uint64_t due = start_ns + i * interval_ns;
+        uint64_t now = steady_ns();
+        if (now < due)
+        {
+            std::this_thread::sleep_for(std::chrono::nanoseconds(due - now));
+        }
+
+        uint64_t sent_ns = steady_ns();
+        data.sequence    = i;
+        memcpy(data.data, &i, sizeof(i));
+        memcpy(data.data + sizeof(i), &sent_ns, sizeof(sent_ns));
+        mavlink_msg_logging_data_encode(1, 1, &tx_msg, &data);
+        size_t len = mavlink_msg_to_send_buffer(tx_buf, &tx_msg);
+        send(tx_buf, len);
+        step.sent++;
+    }
+    uint64_t sent_end_ns = steady_ns();
+
+    /* what is still in flight gets a second, or until it all arrived */
+    while (steady_ns() - sent_end_ns < 1000000000ull)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        if (arrived.load() >= n)
+        {
+            break;
+        }
+    }
+    receiving.store(false);
+    receiver.join();
+
+    double send_s    = (double)(sent_end_ns - start_ns) / 1e9;
+    step.sent_msgps  = send_s > 0 ? step.sent / send_s : 0;
+    step.seconds     = (double)(std::max(last_rx_ns, sent_end_ns) - start_ns) / 1e9;
+    step.goodput_msgps = step.received / step.seconds;
+    step.goodput_bps   = step.goodput_msgps * step.payload_size;
+    step.loss_percent  = (double)(step.sent - step.received) / step.sent * 100.0;
+
+    std::sort(latencies.begin(), latencies.end());
+    step.latency_us_p50 = percentile(latencies, 50);
+    step.latency_us_p90 = percentile(latencies, 90);
+    step.latency_us_p99 = percentile(latencies, 99);
+    step.latency_us_max = latencies.empty() ? 0 : latencies.back();
+
+    printf("Offered %.0f msg/s (sent %.0f msg/s, %zu B frames): goodput %.0f B/s %.0f msg/s "
+           "loss %.2f %% latency p50 %lu p90 %lu p99 %lu max %lu us\n",
+        step.offered_msgps, step.sent_msgps, step.frame_len, step.goodput_bps,
+        step.goodput_msgps, step.loss_percent, step.latency_us_p50, step.latency_us_p90,
+        step.latency_us_p99, step.latency_us_max);
+    return step;
+}
+
+std::vector<LoadStep>
+ThroughputMonitor::run_open_loop(const LoadSweep& sweep)
+{
+    printf("warmup ...\n");
+    one_pass(100, 100);
+
+    std::vector<LoadStep> steps;
+    for (auto& load : sweep.loads)
+    {
+        steps.push_back(open_loop_step(load, sweep.payload_size, sweep.seconds));
+    }
+    return steps;
+}
+
+namespace
+{
+/* when a frame was sent, by its count */
+struct MixFrame
+{
+    std::atomic<uint64_t> sent_ns {0};
+    std::atomic<uint32_t> msgid {0};
+};
+
+/* one sysid/compid: its sequence numbers, and the frames it sends in a step */
+struct MixSource
+{
+    mavlink_status_t            status {};
+    size_t                      expected {};
+    std::unique_ptr<MixFrame[]> frames {};
+    uint32_t                    sent {};
+    /* the highest count received */
+    uint32_t                    last_rx {};
+};
+
+/* the count that ends in the bits of low, nearest to last */
+uint32_t
+mix_unwrap(uint32_t last, uint32_t low, unsigned bits)
+{
+    if (bits >= 32)
+    {
+        return low;
+    }
+    uint32_t span  = 1u << bits;
+    uint32_t count = (last & ~(span - 1)) | low;
+    if (count > last && count - last > span / 2 && count >= span)
+    {
+        count -= span;
+    }
+    else if (count < last && last - count > span / 2)
+    {
+        count += span;
+    }
+    return count;
+}
+
+struct MixSchedule
 {
-    termios tty;
-    memset(&tty, 0, sizeof(tty));
-    if (tcgetattr(fd, &tty) != 0)
+    const TrafficStream* stream;
+    MixSource*           source;
+    size_t               message;
+    uint64_t             interval_ns, due_ns;
+    uint8_t              payload[MAVLINK_MAX_PAYLOAD_LEN];
+};
+}
+
+MixStep
+ThroughputMonitor::mix_step(const TrafficMix& mix, double scale, double seconds)
+{
+    MixStep step;
+    step.scale         = scale;
+    step.offered_msgps = mix.msgps() * scale;
+    step.offered_bps   = mix.bps() * scale;
+
+    /* messages by msgid, sources by sysid << 8 | compid */
+    std::unordered_map<uint32_t, int>       message_of;
+    std::vector<int>                        source_of(1 << 16, -1);
+    std::vector<std::unique_ptr<MixSource>> sources;
+    std::vector<MixSchedule>                schedule;
+    std::mt19937                            rng(1);
+    for (auto& stream : mix.streams)
+    {
+        auto m = message_of.emplace(stream.msgid, (int)step.messages.size()).first->second;
+        if (m == (int)step.messages.size())
+        {
+            step.messages.push_back({stream.msgid});
+        }
+        int& s = source_of[stream.sysid << 8 | stream.compid];
+        if (s < 0)
+        {
+            s = sources.size();
+            sources.emplace_back(new MixSource());
+        }
+
+        /* the schedule rounds intervals down, a frame more at most */
+        sources[s]->expected += (size_t)(stream.hz * scale * seconds) + 2;
+
+        /* random fields, and never a trailing zero for v2 to trim */
+        MixSchedule entry {&stream, sources[s].get(), (size_t)m};
+        entry.interval_ns = (uint64_t)(1e9 / (stream.hz * scale));
+        entry.due_ns      = rng() % entry.interval_ns;
+        for (auto& b : entry.payload)
+        {
+            b = rng() % 255 + 1;
+        }
+        schedule.push_back(entry);
+    }
+    for (auto& source : sources)
     {
-        throw std::runtime_error("Failed to get serial port attributes");
+        source->frames.reset(new MixFrame[source->expected]);
     }
+    std::vector<std::vector<uint64_t>> latencies(step.messages.size());
 
-    cfmakeraw(&tty);
-    tty.c_cflag |= CS8 | CLOCAL | CREAD;
-    tty.c_cflag &= ~(PARENB | CSTOPB | CRTSCTS);
-    cfsetospeed(&tty, B115200);
-    cfsetispeed(&tty, B115200);
+    std::atomic<bool> receiving {true};
+    uint64_t          last_rx_ns     = 0;
+    size_t            received_bytes = 0;
+    memset(&rx_status, 0, sizeof(rx_status));
+    mavlink_reset_channel_status(MAVLINK_COMM_1);
+    std::thread receiver(
+        [&]()
+        {
+            while (receiving.load())
+            {
+                ssize_t rv = recv(rx_buf, sizeof(rx_buf));
+                for (ssize_t i = 0; i < rv; i++)
+                {
+                    if (!mavlink_parse_char(MAVLINK_COMM_1, rx_buf[i], &rx_msg, &rx_status))
+                    {
+                        continue;
+                    }
+                    uint64_t now = steady_ns();
+                    int      s   = source_of[rx_msg.sysid << 8 | rx_msg.compid];
+                    auto     m   = message_of.find(rx_msg.msgid);
+                    if (s < 0 || m == message_of.end())
+                    {
+                        continue;
+                    }
+                    /* what of the count fits in the payload, or the sequence number */
+                    MixSource& source = *sources[s];
+                    uint32_t   low    = rx_msg.seq;
+                    unsigned   bits   = 8;
+                    if (rx_msg.len > 1)
+                    {
+                        size_t width = std::min<size_t>(sizeof(low), rx_msg.len - 1);
+                        low          = 0;
+                        memcpy(&low, rx_msg.payload64, width);
+                        bits = width * 8;
+                    }
+                    uint32_t count = mix_unwrap(source.last_rx, low, bits);
+                    if (count >= source.expected)
+                    {
+                        step.unmatched++;
+                        continue;
+                    }
+                    auto&    frame   = source.frames[count];
+                    uint32_t msgid   = frame.msgid.load(std::memory_order_acquire);
+                    uint64_t sent_ns = frame.sent_ns.load(std::memory_order_acquire);
+                    if (sent_ns == 0 || msgid != rx_msg.msgid
+                        || !frame.sent_ns.compare_exchange_strong(sent_ns, 0))
+                    {
+                        step.unmatched++;
+                        continue;
+                    }
+                    source.last_rx = std::max(source.last_rx, count);
+                    step.messages[m->second].received++;
+                    received_bytes += MAVLINK_NUM_NON_PAYLOAD_BYTES + rx_msg.len;
+                    latencies[m->second].push_back((now - sent_ns) / 1000);
+                    last_rx_ns = now;
+                }
+            }
+        });
 
-    if (tcsetattr(fd, TCSANOW, &tty) != 0)
+    /* every stream on its own schedule, the earliest due first */
+    uint64_t start_ns = steady_ns();
+    uint64_t end_ns   = start_ns + (uint64_t)(seconds * 1e9);
+    for (;;)
     {
-        throw std::runtime_error("Failed to set serial port attributes");
+        MixSchedule* next = &schedule.front();
+        for (auto& entry : schedule)
+        {
+            if (entry.due_ns < next->due_ns)
+            {
+                next = &entry;
+            }
+        }
+        uint64_t due = start_ns + next->due_ns;
+        if (due >= end_ns)
+        {
+            break;
+        }
+        uint64_t now = steady_ns();
+        if (now < due)
+        {
+            std::this_thread::sleep_for(std::chrono::nanoseconds(due - now));
+        }
+        next->due_ns += next->interval_ns;
+
+        /* the count where most ArduPilot messages have time_boot_ms */
+        const TrafficStream&       stream = *next->stream;
+        const mavlink_msg_entry_t* entry  = mavlink_get_msg_entry(stream.msgid);
+        MixSource&                 source = *next->source;
+        uint32_t                   count  = source.sent++;
+        memcpy(next->payload, &count, std::min<size_t>(sizeof(count), stream.payload_len - 1));
+        tx_msg.msgid = stream.msgid;
+        memcpy(tx_msg.payload64, next->payload, stream.payload_len);
+
+        uint64_t sent_ns = steady_ns();
+        if (count < source.expected)
+        {
+            source.frames[count].msgid.store(stream.msgid, std::memory_order_relaxed);
+            source.frames[count].sent_ns.store(sent_ns, std::memory_order_release);
+        }
+        mavlink_finalize_message_buffer(&tx_msg, stream.sysid, stream.compid,
+            &source.status, entry->min_msg_len, stream.payload_len, entry->crc_extra);
+        size_t len = mavlink_msg_to_send_buffer(tx_buf, &tx_msg);
+        send(tx_buf, len);
+        step.messages[next->message].sent++;
+        step.sent++;
     }
+    uint64_t sent_end_ns = steady_ns();
+
+    /* what is still in flight gets a second */
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    receiving.store(false);
+    receiver.join();
+
+    std::vector<uint64_t> all;
+    for (size_t m = 0; m < step.messages.size(); m++)
+    {
+        MixMessage& msg = step.messages[m];
+        std::sort(latencies[m].begin(), latencies[m].end());
+        all.insert(all.end(), latencies[m].begin(), latencies[m].end());
+        msg.loss_percent   = msg.sent ? (double)(msg.sent - std::min(msg.sent, msg.received)) / msg.sent * 100.0 : 0;
+        msg.latency_us_p50 = percentile(latencies[m], 50);
+        msg.latency_us_p99 = percentile(latencies[m], 99);
+        step.received += msg.received;
+    }
+
+    double send_s      = (double)(sent_end_ns - start_ns) / 1e9;
+    step.sent_msgps    = send_s > 0 ? step.sent / send_s : 0;
+    step.seconds       = (double)(std::max(last_rx_ns, sent_end_ns) - start_ns) / 1e9;
+    step.goodput_msgps = step.received / step.seconds;
+    step.goodput_bps   = received_bytes / step.seconds;
+    step.loss_percent  = step.sent ? (double)(step.sent - std::min(step.sent, step.received)) / step.sent * 100.0 : 0;
+
+    std::sort(all.begin(), all.end());
+    step.latency_us_p50 = percentile(all, 50);
+    step.latency_us_p90 = percentile(all, 90);
+    step.latency_us_p99 = percentile(all, 99);
+    step.latency_us_max = all.empty() ? 0 : all.back();
+
+    printf("Mix x%g (offered %.0f msg/s %.0f B/s, sent %.0f msg/s): goodput %.0f B/s %.0f msg/s "
+           "loss %.2f %% unmatched %zu latency p50 %lu p90 %lu p99 %lu max %lu us\n",
+        scale, step.offered_msgps, step.offered_bps, step.sent_msgps, step.goodput_bps,
+        step.goodput_msgps, step.loss_percent, step.unmatched, step.latency_us_p50,
+        step.latency_us_p90, step.latency_us_p99, step.latency_us_max);
+    for (auto& msg : step.messages)
+    {
+        printf("  msgid %6u: sent %8zu received %8zu loss %6.2f %% latency p50 %lu p99 %lu us\n",
+            msg.msgid, msg.sent, msg.received, msg.loss_percent, msg.latency_us_p50,
+            msg.latency_us_p99);
+    }
+    return step;
 }
 
+std::vector<MixStep>
+ThroughputMonitor::run_mix(const TrafficMix& mix, const LoadSweep& sweep)
+{
+    printf("warmup ...\n");
+    one_pass(100, 100);
+
+    printf("%s", mix.profile().c_str());
+    std::vector<MixStep> steps;
+    for (double scale : sweep.mix_scales)
+    {
+        steps.push_back(mix_step(mix, scale, sweep.seconds));
+    }
+    return steps;
+}
+
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/epoll.h>
+#include <unistd.h>
+
 SerialThroughputMonitor::SerialThroughputMonitor(
-    const char* f_send, const char* f_recv)
+    const char* f_send, const char* f_recv, const ep_uart_options_t* options)
 {
-    fd_send = ::open(f_send, O_RDWR | O_NOCTTY | O_SYNC);
-    if (fd_send < 0)
+    if (ep_linux_uart_init_options(&ep_send, f_send, options) != MERR_OK)
     {
         throw std::runtime_error("Failed to open serial port");
     }
-    configure(fd_send);
+    fd_send = ep_send.fd;
+    /* the sender paces itself on a blocking write() */
+    fcntl(fd_send, F_SETFL, fcntl(fd_send, F_GETFL) & ~O_NONBLOCK);
 
-    fd_recv = ::open(f_recv, O_RDWR | O_NOCTTY | O_NDELAY);
-    if (fd_recv < 0)
+    if (ep_linux_uart_init_options(&ep_recv, f_recv, options) != MERR_OK)
     {
         throw std::runtime_error("Failed to open serial port");
     }
-    configure(fd_recv);
+    fd_recv = ep_recv.fd;
 
     epoll_recv = epoll_create1(0);
     if (epoll_recv < 0)
@@ -245,11 +650,11 @@ SerialThroughputMonitor::~SerialThroughputMonitor()
 {
     if (fd_send >= 0)
     {
-        ::close(fd_send);
+        ep_linux_uart_destroy(&ep_send);
     }
     if (fd_recv >= 0)
     {
-        ::close(fd_recv);
+        ep_linux_uart_destroy(&ep_recv);
     }
     if (epoll_recv >= 0)
     {
@@ -2,9 +2,10 @@
 
 #include <chrono>
 #include <numeric>
+#include <string>
 #include <vector>
 
-#include <v2.0/ardupilotmega/mavlink.h>
+#include "traffic_mix.hpp"
 
 using time_point = std::chrono::system_clock::time_point;
 using std::chrono::high_resolution_clock;
@@ -54,6 +55,71 @@ public:
     void check_in(mavlink_message_t* msg);
 };
 
+/**
+ * Open-loop load: the sender keeps to a schedule of offered_msgps messages
+ * per second, whatever comes back, while a receiver thread takes what
+ * arrives. An offered load is a message rate, or a byte rate turned into
+ * one for the frame size. Every frame carries its index and the time it
+ * was sent, for loss and one-way latency (both ends share the clock).
+ */
+struct OfferedLoad
+{
+    double rate {};
+    bool   bytes {};
+};
+
+struct LoadSweep
+{
+    std::vector<OfferedLoad> loads {};
+    size_t                   payload_size {128};
+    double                   seconds {5};
+    /* a traffic mix instead of LOGGING_DATA, with its rates scaled */
+    std::string              mix {};
+    std::vector<double>      mix_scales {};
+};
+
+struct LoadStep
+{
+    OfferedLoad offered {};
+    size_t      payload_size {}, frame_len {};
+    double      offered_msgps {}, sent_msgps {};
+    size_t      sent {}, received {}, duplicates {};
+    double      seconds {};
+    double      goodput_bps {}, goodput_msgps {}, loss_percent {};
+    uint64_t    latency_us_p50 {}, latency_us_p90 {}, latency_us_p99 {}, latency_us_max {};
+};
+
+/**
+ * A traffic mix step plays every stream at scale times its rate, open-loop
+ * as above. The payloads are the mix's own, except that the bytes where
+ * ArduPilot puts time_boot_ms carry a count of the frames sent by the
+ * frame's source, by which the source keeps its send time. A payload too
+ * short for all four bytes carries what fits, or only the sequence number,
+ * and the receiver takes the count nearest to the last it saw. A frame that
+ * arrives again is unmatched rather than received.
+ */
+struct MixMessage
+{
+    uint32_t msgid {};
+    size_t   sent {}, received {};
+    double   loss_percent {};
+    uint64_t latency_us_p50 {}, latency_us_p99 {};
+};
+
+struct MixStep
+{
+    double                  scale {};
+    double                  offered_msgps {}, offered_bps {}, sent_msgps {};
+    size_t                  sent {}, received {}, unmatched {};
+    double                  seconds {};
+    double                  goodput_bps {}, goodput_msgps {}, loss_percent {};
+    uint64_t                latency_us_p50 {}, latency_us_p90 {}, latency_us_p99 {}, latency_us_max {};
+    std::vector<MixMessage> messages {};
+};
+
+/* the index and send time at the front of every open-loop payload */
+static constexpr size_t LOAD_HEADER_LEN = 12;
+
 class ThroughputMonitor
 {
 protected:
@@ -68,29 +134,114 @@ protected:
 
     void one_pass(size_t payload_size, size_t messages);
 
+    LoadStep open_loop_step(const OfferedLoad& load, size_t payload_size, double seconds);
+    MixStep  mix_step(const TrafficMix& mix, double scale, double seconds);
+
 public:
     ThroughputMonitor()          = default;
     virtual ~ThroughputMonitor() = default;
     void run(size_t n, size_t payload_sz_start, size_t payload_sz_end,
         size_t payload_sz_step);
+    std::vector<LoadStep> run_open_loop(const LoadSweep& sweep);
+    std::vector<MixStep>  run_mix(const TrafficMix& mix, const LoadSweep& sweep);
     OverallThroughput& get_metrics() { return overall; }
 };
 
+/**
+ * Takes the open-loop options out of argv:
+ *   --offered-msgps=<rate>[,<rate>...]  offered loads in messages/s
+ *   --offered-bps=<rate>[,<rate>...]    offered loads in bytes/s
+ *   --payload=<bytes>                   LOGGING_DATA data bytes
+ *   --step-seconds=<s>                  length of every load step
+ *   --mix=<profile>                     a traffic mix, see traffic_mix.hpp
+ *   --mix-scale=<x>[,<x>...]            its rates times x, 1 by default
+ * No offered loads and no mix means the stop-and-wait sweep.
+ */
+static inline LoadSweep
+parse_load_sweep(int& argc, char** argv)
+{
+    LoadSweep sweep;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        size_t      eq  = arg.find('=');
+        if (arg.compare(0, 2, "--") != 0 || eq == std::string::npos)
+        {
+            continue;
+        }
+
+        std::string name = arg.substr(2, eq - 2), value = arg.substr(eq + 1);
+        if (name == "offered-msgps" || name == "offered-bps")
+        {
+            size_t pos = 0;
+            while (pos <= value.size())
+            {
+                size_t end = std::min(value.find(',', pos), value.size());
+                sweep.loads.push_back({std::stod(value.substr(pos, end - pos)), name == "offered-bps"});
+                pos = end + 1;
+            }
+        }
+        else if (name == "mix")
+        {
+            sweep.mix = value;
+        }
+        else if (name == "mix-scale")
+        {
+            size_t pos = 0;
+            while (pos <= value.size())
+            {
+                size_t end = std::min(value.find(',', pos), value.size());
+                sweep.mix_scales.push_back(std::stod(value.substr(pos, end - pos)));
+                pos = end + 1;
+            }
+        }
+        else if (name == "payload")
+        {
+            sweep.payload_size = std::stoul(value);
+        }
+        else if (name == "step-seconds")
+        {
+            sweep.seconds = std::stod(value);
+        }
+        else
+        {
+            continue;
+        }
+
+        for (int k = i; k < argc - 1; k++)
+        {
+            argv[k] = argv[k + 1];
+        }
+        argc--;
+        i--;
+    }
+    if (!sweep.mix.empty() && sweep.mix_scales.empty())
+    {
+        sweep.mix_scales.push_back(1);
+    }
+    return sweep;
+}
+
 #include <sys/socket.h>
+#include "endpoint_linux_uart.h"
 
 class SerialThroughputMonitor : public ThroughputMonitor
 {
 protected:
+    endpoint_linux_uart_t ep_send {}, ep_recv {};
     int fd_send {-1}, fd_recv {-1}, epoll_recv{-1};
     sockaddr sa_send {};
     void send(uint8_t* buf, size_t len) override;
     ssize_t recv(uint8_t* buf, size_t len) override;
 
-    static void configure(int fd) ;
-
 public:
-    SerialThroughputMonitor(const char* f_send, const char * f_recv);
+    /* options: NULL for EP_UART_OPTIONS_DEFAULT, on both devices */
+    SerialThroughputMonitor(const char* f_send, const char * f_recv,
+        const ep_uart_options_t* options = nullptr);
     ~SerialThroughputMonitor() override;
+
+    /* the rate the driver reports for the receiving device */
+    uint32_t baud() const { return ep_recv.baud; }
 };
 
 
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "throughput_common.hpp"
+#include <nlohmann/json.hpp>
+
+static inline nlohmann::json
+load_steps_json(const std::vector<LoadStep>& steps)
+{
+    nlohmann::json j = nlohmann::json::array();
+    for (auto& s : steps)
+    {
+        j.push_back({
+            {"offered msg/s", s.offered_msgps},
+            {"sent msg/s", s.sent_msgps},
+            {"frame size", s.frame_len},
+            {"sent", s.sent},
+            {"received", s.received},
+            {"duplicates", s.duplicates},
+            {"goodput (B/s)", s.goodput_bps},
+            {"goodput msg/s", s.goodput_msgps},
+            {"loss %", s.loss_percent},
+            {"latency p50 (us)", s.latency_us_p50},
+            {"latency p90 (us)", s.latency_us_p90},
+            {"latency p99 (us)", s.latency_us_p99},
+            {"latency max (us)", s.latency_us_max},
+        });
+    }
+    return j;
+}
+
+static inline nlohmann::json
+mix_steps_json(const std::vector<MixStep>& steps)
+{
+    nlohmann::json j = nlohmann::json::array();
+    for (auto& s : steps)
+    {
+        nlohmann::json messages = nlohmann::json::array();
+        for (auto& m : s.messages)
+        {
+            messages.push_back({
+                {"msgid", m.msgid},
+                {"sent", m.sent},
+                {"received", m.received},
+                {"loss %", m.loss_percent},
+                {"latency p50 (us)", m.latency_us_p50},
+                {"latency p99 (us)", m.latency_us_p99},
+            });
+        }
+        j.push_back({
+            {"scale", s.scale},
+            {"offered msg/s", s.offered_msgps},
+            {"offered (B/s)", s.offered_bps},
+            {"sent msg/s", s.sent_msgps},
+            {"sent", s.sent},
+            {"received", s.received},
+            {"unmatched", s.unmatched},
+            {"goodput (B/s)", s.goodput_bps},
+            {"goodput msg/s", s.goodput_msgps},
+            {"loss %", s.loss_percent},
+            {"latency p50 (us)", s.latency_us_p50},
+            {"latency p90 (us)", s.latency_us_p90},
+            {"latency p99 (us)", s.latency_us_p99},
+            {"latency max (us)", s.latency_us_max},
+            {"messages", messages},
+        });
+    }
+    return j;
+}
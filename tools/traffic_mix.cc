@@ -0,0 +1,228 @@
+#include "traffic_mix.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <tuple>
+
+#include "endpoint_linux_tlog.h"
+
+/*
+ * ArduCopter on a telemetry radio, with the SRx_* stream rates at 2 Hz and
+ * EXTRA1/EXTRA2 (attitude, VFR_HUD) at 4 Hz; an onboard computer, a GCS
+ * and a SiK radio share the link.
+ */
+static const char* ARDUCOPTER_PROFILE = R"(
+# autopilot
+1 1 0 1        # HEARTBEAT
+1 1 27 2       # RAW_SENS: RAW_IMU
+1 1 116 2      #           SCALED_IMU2
+1 1 29 2       #           SCALED_PRESSURE
+1 1 1 2        # EXT_STAT: SYS_STATUS
+1 1 125 2      #           POWER_STATUS
+1 1 152 2      #           MEMINFO
+1 1 42 2       #           MISSION_CURRENT
+1 1 24 2       #           GPS_RAW_INT
+1 1 62 2       #           NAV_CONTROLLER_OUTPUT
+1 1 33 2       # POSITION: GLOBAL_POSITION_INT
+1 1 32 2       #           LOCAL_POSITION_NED
+1 1 36 2       # RC_CHAN:  SERVO_OUTPUT_RAW
+1 1 65 2       #           RC_CHANNELS
+1 1 30 4       # EXTRA1:   ATTITUDE
+1 1 178 4      #           AHRS2
+1 1 74 4       # EXTRA2:   VFR_HUD
+1 1 163 2      # EXTRA3:   AHRS
+1 1 2 2        #           SYSTEM_TIME
+1 1 168 2      #           WIND
+1 1 147 2      #           BATTERY_STATUS
+1 1 193 2      #           EKF_STATUS_REPORT
+1 1 241 2      #           VIBRATION
+# onboard computer
+1 191 0 1      # HEARTBEAT
+# GCS
+255 190 0 1    # HEARTBEAT
+# SiK radio
+51 68 109 1    # RADIO_STATUS
+)";
+
+double
+TrafficMix::msgps() const
+{
+    double sum = 0;
+    for (auto& s : streams)
+    {
+        sum += s.hz;
+    }
+    return sum;
+}
+
+double
+TrafficMix::bps() const
+{
+    double sum = 0;
+    for (auto& s : streams)
+    {
+        sum += s.hz * (MAVLINK_NUM_NON_PAYLOAD_BYTES + s.payload_len);
+    }
+    return sum;
+}
+
+std::string
+TrafficMix::profile() const
+{
+    std::ostringstream out;
+    out << "# " << name << ": " << msgps() << " msg/s, " << bps() << " B/s\n";
+    for (auto& s : streams)
+    {
+        out << (unsigned)s.sysid << " " << (unsigned)s.compid << " " << s.msgid << " "
+            << s.hz << " " << (unsigned)s.payload_len << "\n";
+    }
+    return out.str();
+}
+
+/* a stream of a message this dialect does not know cannot be framed */
+static bool
+add_stream(TrafficMix& mix, TrafficStream s)
+{
+    const mavlink_msg_entry_t* entry = mavlink_get_msg_entry(s.msgid);
+    if (entry == NULL)
+    {
+        fprintf(stderr, "%s: unknown msgid %u, skipped\n", mix.name.c_str(), s.msgid);
+        return false;
+    }
+    if (s.payload_len == 0 || s.payload_len > entry->max_msg_len)
+    {
+        s.payload_len = entry->max_msg_len;
+    }
+    mix.streams.push_back(s);
+    return true;
+}
+
+static bool
+parse_profile(std::istream& in, TrafficMix& mix)
+{
+    std::string line;
+    size_t      line_no = 0;
+    while (std::getline(in, line))
+    {
+        line_no++;
+        line = line.substr(0, line.find('#'));
+
+        std::istringstream fields(line);
+        unsigned           sysid, compid, msgid, payload_len = 0;
+        double             hz;
+        if (!(fields >> sysid))
+        {
+            continue;
+        }
+        if (!(fields >> compid >> msgid >> hz) || sysid > 255 || compid > 255 || hz <= 0)
+        {
+            fprintf(stderr, "%s:%zu: expected <sysid> <compid> <msgid> <rate Hz> [payload bytes]\n",
+                mix.name.c_str(), line_no);
+            return false;
+        }
+        fields >> payload_len;
+        add_stream(mix, {(uint8_t)sysid, (uint8_t)compid, msgid, hz,
+                            (uint8_t)std::min(payload_len, 255u)});
+    }
+    return true;
+}
+
+/* the rate and mean payload of every stream in a recording */
+static bool
+extract_profile(const std::string& path, TrafficMix& mix)
+{
+    struct endpoint_linux_replay_t replay;
+    struct mavtunnel_t             tunnel;
+    if (ep_linux_replay_init(&replay, path.c_str(), 0) != MERR_OK)
+    {
+        ep_linux_replay_destroy(&replay);
+        return false;
+    }
+    mavtunnel_init(&tunnel, 0);
+    ep_linux_replay_attach_reader(&tunnel, &replay);
+
+    /* (sysid, compid, msgid) -> (frames, payload bytes) */
+    std::map<std::tuple<uint8_t, uint8_t, uint32_t>, std::pair<size_t, size_t>> seen;
+    uint8_t buf[MAVLINK_MAX_PACKET_LEN];
+    ssize_t n;
+    while ((n = tunnel.reader.read(&tunnel.reader, buf, sizeof(buf))) > 0)
+    {
+        uint8_t  sysid, compid;
+        uint32_t msgid;
+        if (buf[0] == MAVLINK_STX && n >= MAVLINK_CORE_HEADER_LEN + 1)
+        {
+            sysid  = buf[5];
+            compid = buf[6];
+            msgid  = buf[7] | (buf[8] << 8) | ((uint32_t)buf[9] << 16);
+        }
+        else if (n >= MAVLINK_CORE_HEADER_MAVLINK1_LEN + 1)
+        {
+            sysid  = buf[3];
+            compid = buf[4];
+            msgid  = buf[5];
+        }
+        else
+        {
+            continue;
+        }
+        auto& s = seen[std::make_tuple(sysid, compid, msgid)];
+        s.first++;
+        s.second += buf[1];
+    }
+    double seconds = (double)(replay.last_log_us - replay.first_log_us) / 1e6;
+    ep_linux_replay_destroy(&replay);
+    if (seconds <= 0)
+    {
+        fprintf(stderr, "%s: too short to take rates from\n", path.c_str());
+        return false;
+    }
+
+    for (auto& kv : seen)
+    {
+        add_stream(mix, {std::get<0>(kv.first), std::get<1>(kv.first), std::get<2>(kv.first),
+                            kv.second.first / seconds,
+                            (uint8_t)std::ceil((double)kv.second.second / kv.second.first)});
+    }
+    return true;
+}
+
+bool
+load_traffic_mix(const std::string& spec, TrafficMix& mix)
+{
+    mix.name = spec;
+    mix.streams.clear();
+
+    bool ok;
+    if (spec == "arducopter")
+    {
+        std::istringstream in(ARDUCOPTER_PROFILE);
+        ok = parse_profile(in, mix);
+    }
+    else if (spec.size() > 5 && spec.compare(spec.size() - 5, 5, ".tlog") == 0)
+    {
+        ok = extract_profile(spec, mix);
+    }
+    else
+    {
+        std::ifstream in(spec);
+        if (!in)
+        {
+            /* not a profile, maybe the prefix of a capture */
+            ok = extract_profile(spec, mix);
+        }
+        else
+        {
+            ok = parse_profile(in, mix);
+        }
+    }
+
+    if (ok && mix.streams.empty())
+    {
+        fprintf(stderr, "%s: no streams\n", spec.c_str());
+        ok = false;
+    }
+    return ok;
+}
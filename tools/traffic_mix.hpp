@@ -0,0 +1,38 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <v2.0/ardupilotmega/mavlink.h>
+
+/**
+ * A traffic mix: the messages a vehicle, its peripherals and a GCS put on
+ * a link, each at its own rate. A profile has one stream per line,
+ *
+ *   <sysid> <compid> <msgid> <rate Hz> [payload bytes]   # comment
+ *
+ * where the payload defaults to the message's full length (extensions
+ * included), as ArduPilot sends it. "arducopter" is the built-in profile,
+ * and a .tlog (or a capture prefix) gives the mix that was recorded.
+ */
+struct TrafficStream
+{
+    uint8_t  sysid {}, compid {};
+    uint32_t msgid {};
+    double   hz {};
+    uint8_t  payload_len {};
+};
+
+struct TrafficMix
+{
+    std::string                name {};
+    std::vector<TrafficStream> streams {};
+
+    double      msgps() const;
+    /* on the wire, MAVLink v2 framing included */
+    double      bps() const;
+    std::string profile() const;
+};
+
+/* false, with a warning, if spec names no usable profile */
+bool load_traffic_mix(const std::string& spec, TrafficMix& mix);